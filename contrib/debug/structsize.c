@@ -0,0 +1,79 @@
+/*
+ * Reports the size of the main per-connection structures and the layout of
+ * struct stream, using the same build options as the haproxy binary. Build
+ * and run it with "make structsize" from the top directory.
+ */
+#include <stddef.h>
+#include <stdio.h>
+
+#include <types/applet.h>
+#include <types/channel.h>
+#include <types/connection.h>
+#include <types/hdr_idx.h>
+#include <types/proto_http.h>
+#include <types/session.h>
+#include <types/stream.h>
+#include <types/stream_interface.h>
+#include <types/task.h>
+
+#define CACHE_LINE 64
+
+#define SHOW_SIZE(type)							\
+	printf("%-24s %6lu bytes %4lu cache lines\n", #type,		\
+	       (unsigned long)sizeof(type),				\
+	       (unsigned long)(sizeof(type) + CACHE_LINE - 1) / CACHE_LINE)
+
+#define SHOW_FIELD(type, field)						\
+	printf("  %-22s %6lu %6lu  line %lu\n", #field,		\
+	       (unsigned long)offsetof(type, field),			\
+	       (unsigned long)sizeof(((type *)0)->field),		\
+	       (unsigned long)offsetof(type, field) / CACHE_LINE)
+
+int main(int argc, char **argv)
+{
+	SHOW_SIZE(struct stream);
+	SHOW_SIZE(struct session);
+	SHOW_SIZE(struct connection);
+	SHOW_SIZE(struct appctx);
+	SHOW_SIZE(struct task);
+	SHOW_SIZE(struct channel);
+	SHOW_SIZE(struct stream_interface);
+	SHOW_SIZE(struct http_txn);
+	SHOW_SIZE(struct hdr_idx);
+	SHOW_SIZE(struct stream_store);
+
+	printf("\nstruct stream layout:  offset   size\n");
+	SHOW_FIELD(struct stream, flags);
+	SHOW_FIELD(struct stream, uniq_id);
+	SHOW_FIELD(struct stream, task);
+	SHOW_FIELD(struct stream, sess);
+	SHOW_FIELD(struct stream, be);
+	SHOW_FIELD(struct stream, target);
+	SHOW_FIELD(struct stream, txn);
+	SHOW_FIELD(struct stream, srv_conn);
+	SHOW_FIELD(struct stream, pend_pos);
+	SHOW_FIELD(struct stream, req);
+	SHOW_FIELD(struct stream, res);
+	SHOW_FIELD(struct stream, si);
+	SHOW_FIELD(struct stream, strm_flt);
+	SHOW_FIELD(struct stream, do_log);
+	SHOW_FIELD(struct stream, srv_error);
+	SHOW_FIELD(struct stream, current_rule_list);
+	SHOW_FIELD(struct stream, current_rule);
+	SHOW_FIELD(struct stream, store_count);
+	SHOW_FIELD(struct stream, store);
+	SHOW_FIELD(struct stream, buffer_wait);
+	SHOW_FIELD(struct stream, mem);
+	SHOW_FIELD(struct stream, logs);
+	SHOW_FIELD(struct stream, list);
+	SHOW_FIELD(struct stream, by_srv);
+	SHOW_FIELD(struct stream, back_refs);
+	SHOW_FIELD(struct stream, stkctr);
+	SHOW_FIELD(struct stream, req_cap);
+	SHOW_FIELD(struct stream, res_cap);
+	SHOW_FIELD(struct stream, vars_txn);
+	SHOW_FIELD(struct stream, vars_reqres);
+	SHOW_FIELD(struct stream, unique_id);
+	SHOW_FIELD(struct stream, hlua);
+	return 0;
+}
@@ -40,6 +40,7 @@ struct buffer {
 };
 
 extern struct pool_head *pool2_buffer;
+extern struct pool_head *pool2_buffer_small;
 extern struct buffer buf_empty;
 extern struct buffer buf_wanted;
 
@@ -49,6 +50,8 @@ int buffer_insert_line2(struct buffer *b, char *pos, const char *str, int len);
 void buffer_dump(FILE *o, struct buffer *b, int from, int to);
 void buffer_slow_realign(struct buffer *buf);
 void buffer_bounce_realign(struct buffer *buf);
+struct buffer *b_grow(struct buffer **buf, int margin);
+struct buffer *b_shrink(struct buffer **buf);
 
 /*****************************************************************/
 /* These functions are used to compute various buffer area sizes */
@@ -473,10 +476,19 @@ static inline struct buffer *b_alloc_fast(struct buffer **buf)
 	return b;
 }
 
+/* Returns non-zero if <buf> was allocated from the small buffers pool */
+static inline int b_is_small(const struct buffer *buf)
+{
+	return pool2_buffer_small && buf->size == pool2_buffer_small->size - sizeof(struct buffer);
+}
+
 /* Releases buffer *buf (no check of emptiness) */
 static inline void __b_drop(struct buffer **buf)
 {
-	pool_free2(pool2_buffer, *buf);
+	if (b_is_small(*buf))
+		pool_free2(pool2_buffer_small, *buf);
+	else
+		pool_free2(pool2_buffer, *buf);
 }
 
 /* Releases buffer *buf if allocated. */
@@ -522,6 +534,27 @@ static inline struct buffer *b_alloc_margin(struct buffer **buf, int margin)
 	return next;
 }
 
+/* Same as b_alloc_margin() except that a small buffer is preferred when they
+ * are enabled. The small buffers pool is not subject to the reserve, so the
+ * standard one is only used when no memory is left for a small buffer.
+ */
+static inline struct buffer *b_alloc_small_margin(struct buffer **buf, int margin)
+{
+	struct buffer *b;
+
+	if ((*buf)->size || !pool2_buffer_small)
+		return b_alloc_margin(buf, margin);
+
+	b = pool_alloc_dirty(pool2_buffer_small);
+	if (unlikely(!b))
+		return b_alloc_margin(buf, margin);
+
+	b->size = pool2_buffer_small->size - sizeof(struct buffer);
+	b_reset(b);
+	*buf = b;
+	return b;
+}
+
 #endif /* _COMMON_BUFFER_H */
 
 /*
@@ -77,6 +77,9 @@ int cfg_register_section(char *section_name,
 void cfg_unregister_sections(void);
 void cfg_backup_sections(struct list *backup_sections);
 void cfg_restore_sections(struct list *backup_sections);
+unsigned long long cfg_timing_now(void);
+void cfg_timing_add(const char *phase, const char *name, unsigned long long start);
+void cfg_timing_dump(void);
 int warnif_misplaced_tcp_conn(struct proxy *proxy, const char *file, int line, const char *arg);
 int warnif_misplaced_tcp_sess(struct proxy *proxy, const char *file, int line, const char *arg);
 int warnif_misplaced_tcp_cont(struct proxy *proxy, const char *file, int line, const char *arg);
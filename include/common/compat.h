@@ -82,6 +82,20 @@
 #define F_SETPIPE_SZ (1024 + 7)
 #endif
 
+#ifndef F_GETPIPE_SZ
+#define F_GETPIPE_SZ (1024 + 8)
+#endif
+
+/* On Linux, allows to steer incoming connections inside a SO_REUSEPORT group */
+#if defined(__linux__)
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU 49
+#endif
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+#endif
+
 #if defined(TPROXY) && defined(NETFILTER)
 #include <linux/types.h>
 #include <linux/netfilter_ipv6.h>
@@ -81,6 +81,16 @@
 // This should cover at least 5 + twice the # of data_types
 #define MAX_STATS_ARGS  64
 
+// max size of the commands queued in a CLI batch between "begin" and "commit"
+#ifndef MAX_CLI_BATCH_SIZE
+#define MAX_CLI_BATCH_SIZE  (16*1024*1024)
+#endif
+
+// max # of entries a CLI dump may visit in a single call before yielding
+#ifndef CLI_DUMP_BUDGET
+#define CLI_DUMP_BUDGET  1000
+#endif
+
 // max # of matches per regexp
 #define	MAX_MATCH       10
 
@@ -290,6 +300,18 @@
 #define TIME_STATS_SAMPLES 512
 #endif
 
+/* Number of samples used to compute the average number of connections accepted
+ * per wake up, reported in stats.
+ */
+#ifndef ACCEPT_BATCH_SAMPLES
+#define ACCEPT_BATCH_SAMPLES 64
+#endif
+
+/* max number of threads used to load the SSL certificates at startup */
+#ifndef MAX_SSL_LOAD_THREADS
+#define MAX_SSL_LOAD_THREADS 64
+#endif
+
 /* max ocsp cert id asn1 encoded length */
 #ifndef OCSP_MAX_CERTID_ASN1_LENGTH
 #define OCSP_MAX_CERTID_ASN1_LENGTH 128
@@ -314,4 +336,11 @@
 #define DEFAULT_PAT_LRU_SIZE 10000
 #endif
 
+/* max number of file descriptors passed at once when transferring listening
+ * sockets to a new process (kernel's SCM_MAX_FD is 253).
+ */
+#ifndef MAX_SEND_FD
+#define MAX_SEND_FD 253
+#endif
+
 #endif /* _COMMON_DEFAULTS_H */
@@ -26,5 +26,7 @@ unsigned int hash_djb2(const char *key, int len);
 unsigned int hash_wt6(const char *key, int len);
 unsigned int hash_sdbm(const char *key, int len);
 unsigned int hash_crc32(const char *key, int len);
+unsigned int hash_crc32_update(unsigned int crc, const void *data, int len);
+int hash_crc32_accelerated(void);
 
 #endif /* _COMMON_HASH_H_ */
@@ -27,6 +27,7 @@
 
 #include <common/config.h>
 #include <common/mini-clist.h>
+#include <ebpttree.h>
 
 #ifndef DEBUG_DONT_SHARE_POOLS
 #define MEM_F_SHARED	0x1
@@ -44,9 +45,39 @@
 #define POOL_LINK(pool, item) ((void **)(item))
 #endif
 
+/* pools may be refilled from large slabs instead of per-object malloc() calls,
+ * so that objects are packed into few (ideally huge) pages. Slabs are never
+ * returned to the system before the pool is destroyed.
+ */
+#define POOL_SLAB_SIZE		(2 * 1024 * 1024)	/* one x86 huge page */
+#define POOL_SLAB_MIN_OBJS	8			/* larger objects are malloc()ed */
+
+/* values for global.tune.pool_hugepages */
+#define POOL_HP_OFF		0	/* no slab, one malloc() per object */
+#define POOL_HP_TRANSPARENT	1	/* slabs advised for transparent huge pages */
+#define POOL_HP_EXPLICIT	2	/* slabs from the hugetlbfs reserve if possible */
+
+/* backing page types of a slab */
+#define POOL_PAGE_NORMAL	0	/* regular pages */
+#define POOL_PAGE_THP		1	/* transparent huge pages were requested */
+#define POOL_PAGE_HUGETLB	2	/* explicit huge pages */
+
+struct pool_slab {
+	struct ebpt_node node;	/* in the pool's slabs, key is the mapped area */
+	size_t size;		/* size of the mapped area */
+	unsigned int type;	/* POOL_PAGE_* */
+};
+
 struct pool_head {
 	void **free_list;
 	struct list list;	/* list of all known pools */
+	struct eb_root slabs;	/* slabs this pool was refilled from, by address */
+	char *slab_ptr;		/* next object to carve from the current slab */
+	char *slab_end;		/* end of the current slab */
+	unsigned int nb_slabs;	/* number of slabs mapped */
+	unsigned int slab_objs;	/* number of objects carved from slabs */
+	unsigned int slab_cap;	/* number of objects the slabs may hold */
+	unsigned int no_hugetlb; /* explicit huge pages could not be mapped */
 	unsigned int used;	/* how many chunks are currently in use */
 	unsigned int allocated;	/* how many chunks have been allocated */
 	unsigned int limit;	/* hard limit on the number of chunks */
@@ -100,6 +131,12 @@ int pool_total_failures();
 unsigned long pool_total_allocated();
 unsigned long pool_total_used();
 
+/* Makes all pools start a new slab on their next refill, so that the calling
+ * process maps and first touches its own memory, on its own NUMA node when
+ * its CPUs are bound.
+ */
+void pool_slab_detach();
+
 /*
  * This function frees whatever can be freed in pool <pool>.
  */
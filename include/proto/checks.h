@@ -28,6 +28,8 @@
 const char *get_check_status_description(short check_status);
 const char *get_check_status_info(short check_status);
 int start_checks();
+int start_server_checks(struct server *s);
+void stop_server_checks(struct server *s);
 void __health_adjust(struct server *s, short status);
 int trigger_resolution(struct server *s);
 
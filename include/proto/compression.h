@@ -30,9 +30,9 @@ extern unsigned int compress_min_idle;
 int comp_append_type(struct comp *comp, const char *type);
 int comp_append_algo(struct comp *comp, const char *algo);
 
-#ifdef USE_ZLIB
+#if defined(USE_ZLIB) || defined(USE_BROTLI) || defined(USE_ZSTD)
 extern long zlib_used_memory;
-#endif /* USE_ZLIB */
+#endif
 
 #endif /* _PROTO_COMP_H */
 
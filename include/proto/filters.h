@@ -222,5 +222,41 @@ flt_change_forward_size(struct filter *filter, struct channel *chn, int len)
 	}
 }
 
+/* Fills <segs> with read-only references to <len> bytes of the input data of
+ * the channel <chn>, starting <ofs> bytes after buf->p. Nothing is copied and
+ * the buffer is left untouched, so filters can inspect or consume data at any
+ * offset (typically FLT_NXT or FLT_FWD) without having to b_adv()/b_rew() the
+ * buffer. <len> is truncated to the available input data. It returns the
+ * number of segments filled: 0 if there is nothing to reference, 1, or 2 when
+ * the data wrap at the end of the buffer.
+ */
+static inline int
+flt_data_segs(const struct channel *chn, unsigned int ofs, unsigned int len,
+	      struct flt_seg segs[2])
+{
+	const struct buffer *buf = chn->buf;
+	const char          *beg;
+	unsigned int         block;
+
+	if (ofs >= buf->i)
+		return 0;
+	if (len > buf->i - ofs)
+		len = buf->i - ofs;
+	if (!len)
+		return 0;
+
+	beg   = b_ptr(buf, ofs);
+	block = buf->data + buf->size - beg;
+	segs[0].ptr = beg;
+	if (len <= block) {
+		segs[0].len = len;
+		return 1;
+	}
+	segs[0].len = block;
+	segs[1].ptr = buf->data;
+	segs[1].len = len - block;
+	return 2;
+}
+
 
 #endif /* _PROTO_FILTERS_H */
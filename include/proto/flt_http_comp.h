@@ -22,8 +22,10 @@
 #define _PROTO_FLT_HTTP_COMP_H
 
 #include <types/proxy.h>
+#include <types/stream.h>
 
 int check_legacy_http_comp_flt(struct proxy *proxy);
+unsigned int http_comp_stream_mem(struct stream *s);
 
 
 #endif // _PROTO_FLT_HTTP_COMP_H
@@ -27,6 +27,7 @@
 
 extern int pipes_used;	/* # of pipes in use (2 fds each) */
 extern int pipes_free;	/* # of pipes unused (2 fds each) */
+extern int pipes_size;	/* size of the last created pipe, 0 if unknown */
 
 /* return a pre-allocated empty pipe. Try to allocate one if there isn't any
  * left. NULL is returned if a pipe could not be allocated.
@@ -44,6 +45,11 @@ void kill_pipe(struct pipe *p);
  */
 void put_pipe(struct pipe *p);
 
+/* create up to <count> pipes at once and place them into the live pool. Returns
+ * the number of pipes created.
+ */
+int prealloc_pipes(int count);
+
 #endif /* _PROTO_PIPE_H */
 
 /*
@@ -54,6 +54,7 @@ struct proxy *proxy_find_by_name(const char *name, int cap, int table);
 struct proxy *proxy_find_best_match(int cap, const char *name, int id, int *diff);
 struct server *findserver(const struct proxy *px, const char *name);
 int proxy_cfg_ensure_no_http(struct proxy *curproxy);
+void proxy_mem_add(struct proxy *px, long buf, long http, long comp);
 void init_new_proxy(struct proxy *p);
 int get_backend_server(const char *bk_name, const char *sv_name,
 		       struct proxy **bk, struct server **sv);
@@ -105,6 +106,26 @@ static inline void proxy_reset_timeouts(struct proxy *proxy)
 	proxy->timeout.tunnel = TICK_ETERNITY;
 }
 
+/* Returns the number of bytes currently accounted to proxy <px>'s streams */
+static inline unsigned long proxy_mem_used(const struct proxy *px)
+{
+	return px->mem.buf + px->mem.http + px->mem.comp;
+}
+
+/* Returns non-zero if proxy <px> has a "maxmem" and reached it */
+static inline int proxy_mem_full(const struct proxy *px)
+{
+	return px->mem.max && proxy_mem_used(px) >= px->mem.max;
+}
+
+/* Returns the number of bytes used by the stick-table of proxy <px> */
+static inline unsigned long proxy_mem_table(const struct proxy *px)
+{
+	if (!px->table.size || !px->table.pool)
+		return 0;
+	return (unsigned long)px->table.current * px->table.pool->size;
+}
+
 /* increase the number of cumulated connections received on the designated frontend */
 static void inline proxy_inc_fe_conn_ctr(struct listener *l, struct proxy *fe)
 {
@@ -45,7 +45,7 @@ const char *update_server_addr_port(struct server *s, const char *addr, const ch
 struct server *server_find_by_id(struct proxy *bk, int id);
 struct server *server_find_by_name(struct proxy *bk, const char *name);
 struct server *server_find_best_match(struct proxy *bk, char *name, int id, int *diff);
-void apply_server_state(void);
+void apply_server_state(const char *unixsocket);
 void srv_compute_all_admin_states(struct proxy *px);
 int srv_set_addr_via_libc(struct server *srv, int *err_code);
 int srv_init_addr(void);
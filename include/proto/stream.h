@@ -31,6 +31,7 @@
 #include <proto/task.h>
 
 extern struct pool_head *pool2_stream;
+extern struct pool_head *pool2_stream_store;
 extern struct list streams;
 extern struct list buffer_wq;
 
@@ -59,6 +60,7 @@ void __stream_offer_buffers(int rqlimit);
 static inline void stream_offer_buffers();
 int stream_alloc_work_buffer(struct stream *s);
 void stream_release_buffers(struct stream *s);
+void stream_account_mem(struct stream *s);
 int stream_alloc_recv_buffer(struct channel *chn);
 
 /* returns the session this stream belongs to */
@@ -93,6 +93,10 @@ struct appctx {
 			long long value;	/* value to compare against */
 			signed char data_type;	/* type of data to compare, or -1 if none */
 			signed char data_op;	/* operator (STD_OP_*) when data_type set */
+			unsigned char prefix_mask; /* bits of the byte following the prefix to match */
+			unsigned char compact;	/* non-zero for the compact output format */
+			unsigned char *prefix;	/* allocated key prefix to restrict the walk to, or NULL */
+			int prefix_len;		/* number of full bytes in the prefix */
 		} table;
 		struct {
 			const char *msg;	/* pointer to a persistent message to be returned in PRINT state */
@@ -120,11 +124,17 @@ struct appctx {
 			struct hlua_socket *socket;
 			struct list wake_on_read;
 			struct list wake_on_write;
+			struct hlua_tcp_pool *pool; /* owning pool, if any */
+			struct list by_pool;        /* member of the pool idle list */
+			unsigned int idle_exp;      /* idle expiration date */
 		} hlua;
 		struct {
 			struct hlua hlua;
 			struct task *task;
 		} hlua_cli;
+		struct {
+			struct list *cur;	/* next registered Lua function to dump */
+		} hlua_stats;
 		struct {
 			struct hlua hlua;
 			int flags;
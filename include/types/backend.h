@@ -151,6 +151,8 @@ struct lbprm {
 	void (*set_server_status_down)(struct server *); /* to be called after status changes to DOWN */
 	void (*server_take_conn)(struct server *);       /* to be called when connection is assigned */
 	void (*server_drop_conn)(struct server *);       /* to be called when connection is dropped */
+	int  (*server_init)(struct server *);            /* to be called when a server is added at runtime, <0 on error */
+	void (*server_deinit)(struct server *);          /* to be called when a server is removed at runtime */
 };
 
 #endif /* _TYPES_BACKEND_H */
@@ -20,6 +20,7 @@
 #ifndef _TYPES_CLI_H
 #define _TYPES_CLI_H
 
+#include <common/chunk.h>
 #include <common/mini-clist.h>
 #include <types/applet.h>
 
@@ -50,5 +51,22 @@ enum {
 	CLI_ST_CALLBACK,   /* custom callback pointer */
 };
 
+/* CLI flags, stored in appctx->st1 */
+#define APPCTX_CLI_ST1_PROMPT  0x00000001  /* interactive mode with a prompt */
+#define APPCTX_CLI_ST1_BINARY  0x00000002  /* length-prefixed binary framing */
+#define APPCTX_CLI_ST1_BATCH   0x00000004  /* appctx->private holds a struct cli_batch */
+
+/* Commands collected between "begin" and "commit", then the responses. Each
+ * command is stored as its number of arguments on one byte followed by the
+ * nul-terminated arguments.
+ */
+struct cli_batch {
+	struct chunk cmds;       /* queued commands */
+	struct chunk out;        /* responses of the committed commands */
+	int count;               /* number of queued commands */
+	int sent;                /* number of bytes of <out> already sent */
+	const char *error;       /* if set, the batch will be rejected on commit */
+};
+
 
 #endif /* _TYPES_CLI_H */
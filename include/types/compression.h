@@ -32,12 +32,21 @@
 #include <zlib.h>
 #endif
 
+#ifdef USE_BROTLI
+#include <brotli/encode.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
 #include <common/buffer.h>
 
 struct comp {
 	struct comp_algo *algos;
 	struct comp_type *types;
 	unsigned int offload;
+	unsigned int precompressed;      /* serve precompressed variants from the server */
+	struct comp_type *precomp_exts;  /* extensions eligible to precompressed variants, NULL=all */
 };
 
 struct comp_ctx {
@@ -53,8 +62,20 @@ struct comp_ctx {
 	void *zlib_prev;
 	void *zlib_pending_buf;
 	void *zlib_head;
+	unsigned int gz_crc;    /* gzip: CRC32 of the data consumed so far */
+	unsigned int gz_size;   /* gzip: size of the data consumed so far, modulo 2^32 */
+	int gz_hdr;             /* gzip: non-zero once the header was emitted */
+#endif
+#ifdef USE_BROTLI
+	BrotliEncoderState *br; /* brotli encoder state */
+#endif
+#ifdef USE_ZSTD
+	ZSTD_CStream *zstd;     /* zstd compression stream */
+	size_t zstd_mem;        /* memory accounted for <zstd> */
 #endif
+	long mem;               /* memory used by this context, in bytes */
 	int cur_lvl;
+	int max_lvl;            /* level never exceeded when raising cur_lvl */
 };
 
 /* Thanks to MSIE/IIS, the "deflate" name is ambigous, as according to the RFC
@@ -31,6 +31,8 @@ struct fe_counters {
 
 	unsigned int cps_max;                   /* maximum of new connections received per second */
 	unsigned int sps_max;                   /* maximum of new connections accepted per second (sessions) */
+	unsigned int acc_batch;                 /* sliding sum of the connections accepted per wake up */
+	long long acc_qfull;                    /* number of times the accept queue was found full */
 
 	long long bytes_in;                     /* number of bytes transferred from the client to the server */
 	long long bytes_out;                    /* number of bytes transferred from the server to the client */
@@ -234,6 +234,16 @@ struct filter {
 	struct list     list;              /* Next filter for the same proxy/stream */
 };
 
+/*
+ * Read-only reference to a contiguous area of a channel's buffer. Data
+ * wrapping at the end of the buffer are described using two segments. See
+ * flt_data_segs().
+ */
+struct flt_seg {
+	const char   *ptr;                 /* start of the area, inside the buffer */
+	unsigned int  len;                 /* length of the area */
+};
+
 /*
  * Structure reprensenting the "global" state of filters attached to a stream.
  */
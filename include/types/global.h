@@ -66,12 +66,17 @@
 #define GTUNE_USE_GAI            (1<<5)
 #define GTUNE_USE_REUSEPORT      (1<<6)
 #define GTUNE_RESOLVE_DONTFAIL   (1<<7)
+#define GTUNE_TIMING_REPORT      (1<<8)
 
 /* Access level for a stats socket */
 #define ACCESS_LVL_NONE     0
 #define ACCESS_LVL_USER     1
 #define ACCESS_LVL_OPER     2
 #define ACCESS_LVL_ADMIN    3
+#define ACCESS_LVL_MASK     0x3
+
+/* Extra capabilities of a stats socket, ORed with the level */
+#define ACCESS_FD_LISTENERS 0x4  /* expose the listening sockets (expose-fd listeners) */
 
 /* SSL server verify mode */
 enum {
@@ -114,7 +119,13 @@ struct global {
 	int ssl_lim, ssl_max;
 	int ssl_fe_keys_max, ssl_be_keys_max;
 	unsigned int shctx_lookups, shctx_misses;
+	unsigned int ssl_lazy_loads, ssl_lazy_evictions; /* lazily built certificates */
 	int comp_rate_lim;           /* HTTP compression rate limit */
+	long long comp_saved;        /* bytes saved by HTTP compression (may be negative) */
+	unsigned long long comp_cpu_us; /* time spent in the compressors, in microseconds */
+	unsigned int comp_skipped;   /* responses not compressed because of their poor history */
+	unsigned long long spliced_bytes; /* bytes received into pipes */
+	unsigned long long copied_bytes;  /* bytes received into buffers */
 	int maxpipes;		/* max # of pipes */
 	int maxsock;		/* max # of sockets */
 	int rlimit_nofile;	/* default ulimit-n value : 0=unset */
@@ -141,6 +152,7 @@ struct global {
 		int options;       /* various tuning options */
 		int recv_enough;   /* how many input bytes at once are "enough" */
 		int bufsize;       /* buffer size in bytes, defaults to BUFSIZE */
+		int bufsize_small; /* size of the small request buffers in bytes, 0=disabled */
 		int maxrewrite;    /* buffer max rewrite size in bytes, defaults to MAXREWRITE */
 		int reserved_bufs; /* how many buffers can only be allocated for response */
 		int buf_limit;     /* if not null, how many total buffers may only be allocated */
@@ -150,9 +162,13 @@ struct global {
 		int server_rcvbuf; /* set server rcvbuf to this value if not null */
 		int chksize;       /* check buffer size in bytes, defaults to BUFSIZE */
 		int pipesize;      /* pipe size in bytes, system defaults if zero */
+		int pipes_prealloc; /* number of pipes to create at boot */
+		unsigned int splice_auto_min; /* splice-auto: min expected transfer size in bytes, 0=streamer only */
 		int max_http_hdr;  /* max number of HTTP headers, use MAX_HTTP_HDR if zero */
 		int cookie_len;    /* max length of cookie captures */
 		int pattern_cache; /* max number of entries in the pattern cache. */
+		int cli_dump_budget; /* max number of entries a CLI dump visits per call */
+		int pool_hugepages; /* POOL_HP_* : how pools are refilled */
 		int sslcachesize;  /* SSL cache size in session, defaults to 20000 */
 #ifdef USE_OPENSSL
 		int sslprivatecache; /* Force to use a private session cache even if nbproc > 1 */
@@ -160,12 +176,16 @@ struct global {
 		unsigned int ssl_max_record; /* SSL max record size */
 		unsigned int ssl_default_dh_param; /* SSL maximum DH parameter size */
 		int ssl_ctx_cache; /* max number of entries in the ssl_ctx cache. */
+		int ssl_load_threads; /* max number of threads loading certificates, 0=auto */
+		int ssl_lazy_cache;   /* max number of lazily built certificates, 0=disabled */
 #endif
 #ifdef USE_ZLIB
 		int zlibmemlevel;    /* zlib memlevel */
 		int zlibwindowsize;  /* zlib window size */
 #endif
 		int comp_maxlevel;    /* max HTTP compression level */
+		int comp_governor;    /* adapt the compression level of each stream */
+		int comp_min_savings; /* governor: min historic savings to compress (%) */
 		unsigned short idle_timer; /* how long before an empty buffer is considered idle (ms) */
 	} tune;
 	struct {
@@ -246,6 +266,7 @@ extern struct list global_listener_queue; /* list of the temporarily limited lis
 extern struct task *global_listener_queue_task;
 extern unsigned int warned;     /* bitfield of a few warnings to emit just once */
 extern struct list dns_resolvers;
+extern struct xfer_sock_list *xfer_sock_list; /* sockets inherited from an old process */
 
 /* bit values to go with "warned" above */
 #define WARN_BLOCK_DEPRECATED       0x00000001
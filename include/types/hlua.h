@@ -14,6 +14,7 @@
 #define CLASS_FETCHES      "Fetches"
 #define CLASS_CONVERTERS   "Converters"
 #define CLASS_SOCKET       "Socket"
+#define CLASS_TCP_POOL     "TcpPool"
 #define CLASS_CHANNEL      "Channel"
 #define CLASS_HTTP         "HTTP"
 #define CLASS_MAP          "Map"
@@ -22,6 +23,7 @@
 #define CLASS_PROXY        "Proxy"
 #define CLASS_SERVER       "Server"
 #define CLASS_LISTENER     "Listener"
+#define CLASS_DICT         "Dict"
 
 struct stream;
 
@@ -65,6 +67,7 @@ struct hlua {
 	                      We must wake this task to continue the task execution */
 	struct list com; /* The list head of the signals attached to this task. */
 	struct ebpt_node node;
+	struct hlua_function *fcn; /* The registered function being executed, or NULL. */
 };
 
 struct hlua_com {
@@ -88,8 +91,15 @@ struct hlua_init_function {
  * or actions.
  */
 struct hlua_function {
+	struct list list; /* Chaining of all the registered functions. */
+	const char *type; /* "action", "fetch", "converter", "service" or "cli". */
 	char *name;
 	int function_ref;
+	/* Profiling counters, reported by "show lua stats". */
+	unsigned long long calls; /* Number of executions started. */
+	unsigned long long yields; /* Number of times the execution yielded. */
+	unsigned long long run_time; /* Cumulated execution time, in microseconds. */
+	unsigned long long alloc; /* Cumulated bytes allocated while running. */
 };
 
 /* This struct is used with the structs:
@@ -99,7 +109,7 @@ struct hlua_function {
  * It contains the lua execution configuration.
  */
 struct hlua_rule {
-	struct hlua_function fcn;
+	struct hlua_function *fcn;
 	char **args;
 };
 
@@ -145,6 +155,29 @@ struct hlua_socket {
 	luaL_Buffer b; /* buffer used to prepare strings. */
 };
 
+/* This struct describes a pool of established TCP connections created
+ * with core.tcp_pool(). The connections are the fake streams used by
+ * the sockets. They are leased to the coroutines and returned in the
+ * idle list when the socket is closed.
+ */
+struct hlua_tcp_pool {
+	struct list list;            /* chaining of all the pools */
+	char *name;                  /* pool name */
+	struct sockaddr_storage addr; /* destination address */
+	int max;                     /* max number of connections (idle + used) */
+	int idle;                    /* number of idle connections */
+	int used;                    /* number of leased connections */
+	unsigned int idle_timeout;   /* max idle time of a connection, in ms */
+	struct list idle_conns;      /* idle appctx, most recently used first */
+	struct list wake_on_release; /* coroutines waiting for a free slot */
+	struct task *task;           /* task expiring the idle connections */
+	/* statistics */
+	unsigned long long created;  /* number of connections established */
+	unsigned long long reused;   /* number of leases of idle connections */
+	unsigned long long waits;    /* number of leases which had to wait */
+	unsigned long long wait_time; /* cumulated wait time, in ms */
+};
+
 struct hlua_concat {
 	int size;
 	int len;
@@ -169,6 +202,7 @@ struct hlua_addr {
 /* Empty struct for compilation compatibility */
 struct hlua { };
 struct hlua_socket { };
+struct hlua_tcp_pool { };
 struct hlua_rule { };
 
 #endif /* USE_LUA */
@@ -31,6 +31,7 @@
 
 #include <common/config.h>
 #include <common/mini-clist.h>
+#include <types/freq_ctr.h>
 #include <types/obj_type.h>
 #include <eb32tree.h>
 
@@ -94,6 +95,12 @@ enum li_state {
 #define LI_O_V6ONLY             0x0400  /* bind to IPv6 only on Linux >= 2.4.21 */
 #define LI_O_V4V6               0x0800  /* bind to IPv4/IPv6 on Linux >= 2.4.21 */
 #define LI_O_ACC_CIP            0x1000  /* find the proxied address in the NetScaler Client IP header */
+#define LI_O_STEER_CPU          0x2000  /* deliver connections to the process running on the receiving CPU */
+#define LI_O_INHERITED          0x4000  /* the socket was not created by this process */
+#define LI_O_GRP_ORDER          0x8000  /* position in the SO_REUSEPORT group is known to follow the bind order */
+
+/* options which must match for a listener to reuse a socket from an old process */
+#define LI_O_XFER_MASK          (LI_O_FOREIGN | LI_O_V6ONLY | LI_O_V4V6)
 
 /* Note: if a listener uses LI_O_UNLIMITED, it is highly recommended that it adds its own
  * maxconn setting to the global.maxsock value so that its resources are reserved.
@@ -178,6 +185,10 @@ struct listener {
 	int maxconn;			/* maximum connections allowed on this listener */
 	unsigned int backlog;		/* if set, listen backlog */
 	unsigned int maxaccept;         /* if set, max number of connections accepted at once */
+	unsigned int acc_batch;         /* adaptive number of connections to accept at next wake up, 0=maxaccept */
+	unsigned int acc_weight;        /* percentage of maxaccept this listener may accept at once, 0=100 */
+	unsigned int acc_lim;           /* if set, max number of connections accepted per second */
+	struct freq_ctr acc_per_sec;    /* connections accepted per second on this listener */
 	struct list proto_list;         /* list in the protocol header */
 	int (*accept)(struct listener *l, int fd, struct sockaddr_storage *addr); /* upper layer's accept() */
 	struct task * (*handler)(struct task *t); /* protocol handler. It is a task */
@@ -226,6 +237,20 @@ struct bind_kw_list {
 	struct bind_kw kw[VAR_ARRAY];
 };
 
+/* A listening socket inherited from an old process through the stats socket
+ * ("-x" command line option). Sockets are matched against the listeners using
+ * their address and the options which cannot be changed once bound. The list
+ * keeps the order in which the old process sent them.
+ */
+struct xfer_sock_list {
+	int fd;
+	int options;               /* listener options among LI_O_XFER_MASK and LI_O_GRP_ORDER */
+	char *iface;               /* interface name or NULL */
+	char *namespace;           /* network namespace name or NULL */
+	struct sockaddr_storage addr;
+	struct xfer_sock_list *next;
+};
+
 
 #endif /* _TYPES_LISTENER_H */
 
@@ -326,6 +326,7 @@ struct proxy {
 	struct freq_ctr be_sess_per_sec;	/* sessions per second on the backend */
 	unsigned int fe_sps_lim;		/* limit on new sessions per second on the frontend */
 	unsigned int fullconn;			/* #conns on backend above which servers are used at full load */
+	unsigned int tot_fe_maxconn;		/* sum of the maxconn of the frontends which may use this backend */
 	struct in_addr except_net, except_mask; /* don't x-forward-for for this address. FIXME: should support IPv6 */
 	struct in_addr except_to;		/* don't x-original-to for this address. */
 	struct in_addr except_mask_to;		/* the netmask for except_to. */
@@ -364,8 +365,16 @@ struct proxy {
 	struct list req_add, rsp_add;           /* headers to be added */
 	struct be_counters be_counters;		/* backend statistics counters */
 	struct fe_counters fe_counters;		/* frontend statistics counters */
+	unsigned int req_kb_sum, res_kb_sum;	/* sliding sums of request/response sizes (kB) for splice-auto */
 
 	struct list listener_queue;		/* list of the temporarily limited listeners because of lack of a proxy resource */
+	struct {
+		unsigned long buf;		/* bytes of buffers held by the streams */
+		unsigned long http;		/* bytes of HTTP transactions and captures */
+		unsigned long comp;		/* bytes of compression contexts */
+		unsigned long max;		/* "maxmem": limit on the sum of the above, 0=none */
+		struct list wait;		/* streams waiting for the usage to fall below <max> */
+	} mem;
 	struct stktable table;			/* table for storing sticking streams */
 
 	struct task *task;			/* the associated task, mandatory to manage rate limiting, stopping and resource shortage, NULL if disabled */
@@ -396,6 +405,8 @@ struct proxy {
 		struct eb32_node id;		/* place in the tree of used IDs */
 		struct eb_root used_listener_id;/* list of listener IDs in use */
 		struct eb_root used_server_id;	/* list of server IDs in use */
+		struct eb_root used_server_name;/* list of server names in use */
+		struct proxy *fullconn_fe;	/* last frontend accounted in tot_fe_maxconn */
 		struct list bind;		/* list of bind settings */
 		struct list listeners;		/* list of listeners belonging to this frontend */
 		struct arg_list args;           /* sample arg list that need to be resolved */
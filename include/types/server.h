@@ -32,6 +32,7 @@
 #include <common/config.h>
 #include <common/mini-clist.h>
 #include <eb32tree.h>
+#include <ebistree.h>
 
 #include <types/connection.h>
 #include <types/counters.h>
@@ -268,6 +269,7 @@ struct server {
 		const char *file;		/* file where the section appears */
 		int line;			/* line where the section appears */
 		struct eb32_node id;		/* place in the tree of used IDs */
+		struct ebpt_node name;		/* place in the tree of used names */
 	} conf;					/* config information */
 };
 
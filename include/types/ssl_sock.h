@@ -25,8 +25,21 @@
 #include <openssl/ssl.h>
 #include <ebmbtree.h>
 
+/* Certificate whose SSL context is only built when a client asks for one of
+ * its names (see tune.ssl.lazy-cache-size). The private key, the certificate,
+ * its chain and the optional DH parameters are kept DER-encoded in <der>.
+ */
+struct ssl_lazy_cert {
+	unsigned char *der;       /* key, cert, chain then DH params */
+	int key_len;              /* length of the private key */
+	int cert_len;             /* length of the certificate */
+	int chain_len;            /* length of all the chain certificates */
+	int dh_len;               /* length of the DH params, 0 if none */
+};
+
 struct sni_ctx {
 	SSL_CTX *ctx;             /* context associated to the certificate */
+	struct ssl_lazy_cert *lazy; /* certificate built on first use if ctx is NULL */
 	int order;                /* load order for the certificate */
 	int neg;                  /* reject if match */
 	struct ebmb_node name;    /* node holding the servername value */
@@ -281,6 +281,16 @@ enum info_field {
 	INF_IDLE_PCT,
 	INF_NODE,
 	INF_DESCRIPTION,
+	INF_COMPRESS_SAVED,
+	INF_COMPRESS_CPU_MS,
+	INF_COMPRESS_SAVED_PER_CPU_MS,
+	INF_COMPRESS_SKIPPED,
+	INF_SPLICED_BYTES,
+	INF_COPIED_BYTES,
+	INF_PIPE_SIZE,
+	INF_SSL_LAZY_LOADS,
+	INF_SSL_LAZY_EVICTIONS,
+	INF_SSL_LAZY_CACHED,
 
 	/* must always be the last one */
 	INF_TOTAL_FIELDS
@@ -376,6 +386,14 @@ enum stat_field {
 	ST_F_INTERCEPTED,
 	ST_F_DCON,
 	ST_F_DSES,
+	ST_F_ACC_BATCH,
+	ST_F_ACC_QFULL,
+	ST_F_MEM_USED,
+	ST_F_MEM_MAX,
+	ST_F_MEM_BUF,
+	ST_F_MEM_HTTP,
+	ST_F_MEM_COMP,
+	ST_F_MEM_TBL,
 
 	/* must always be the last one */
 	ST_F_TOTAL_FIELDS
@@ -111,58 +111,73 @@ struct strm_logs {
 	long long bytes_out;            /* number of bytes transferred from the server to the client */
 };
 
+/* maximum number of stickiness values a stream may store */
+#define STREAM_MAX_STORE	8
+
+/* A stickiness value to store at the end of the stream. These are only needed
+ * by "stick store" rules, so the array is allocated from pool2_stream_store the
+ * first time a stream needs one.
+ */
+struct stream_store {
+	struct stksess *ts;
+	struct stktable *table;
+};
+
+/* The fields are ordered so that the ones process_stream() uses on every call
+ * come first and share as few cache lines as possible, while the fields only
+ * used at creation, logging or release time are at the end. Run "make
+ * structsize" to check the resulting layout after any change.
+ */
 struct stream {
 	int flags;                      /* some flags describing the stream */
 	unsigned int uniq_id;           /* unique ID used for the traces */
+	struct task *task;              /* the task associated with this stream */
+	struct session *sess;           /* the session this stream is attached to */
+	struct proxy *be;               /* the proxy this stream depends on for the server side */
 	enum obj_type *target;          /* target to use for this stream */
+	struct http_txn *txn;           /* current HTTP transaction being processed. Should become a list. */
+	struct server *srv_conn;        /* stream already has a slot on a server and is not in queue */
+	struct pendconn *pend_pos;      /* if not NULL, points to the position in the pending queue */
 
 	struct channel req;             /* request channel */
 	struct channel res;             /* response channel */
+	struct stream_interface si[2];  /* client and server stream interfaces */
 
-	struct proxy *be;               /* the proxy this stream depends on for the server side */
+	struct strm_flt strm_flt;       /* current state of filters active on this stream */
+	void (*do_log)(struct stream *s);       /* the function to call in order to log (or NULL) */
+	void (*srv_error)(struct stream *s,     /* the function to call upon unrecoverable server errors (or NULL) */
+			  struct stream_interface *si);
 
-	struct session *sess;           /* the session this stream is attached to */
+	/* These two pointers are used to resume the execution of the rule lists. */
+	struct list *current_rule_list; /* this is used to store the current executed rule list. */
+	void *current_rule;             /* this is used to store the current rule to be resumed. */
 
-	struct server *srv_conn;        /* stream already has a slot on a server and is not in queue */
-	struct pendconn *pend_pos;      /* if not NULL, points to the position in the pending queue */
+	int store_count;                /* number of entries used in <store> */
+	/* 4 unused bytes here */
+	struct stream_store *store;     /* tracked stickiness values to store, or NULL */
+	struct list buffer_wait;        /* position in the list of streams waiting for a buffer or for memory */
+	struct {
+		struct proxy *be;       /* backend also charged with the memory below, or NULL */
+		unsigned int buf;       /* bytes of buffers charged to the proxies */
+		unsigned int http;      /* bytes of HTTP transaction and captures charged to the proxies */
+		unsigned int comp;      /* bytes of compression context charged to the proxies */
+	} mem;
 
-	struct http_txn *txn;           /* current HTTP transaction being processed. Should become a list. */
+	struct strm_logs logs;          /* logs for this stream */
 
-	struct task *task;              /* the task associated with this stream */
 	struct list list;               /* position in global streams list */
 	struct list by_srv;             /* position in server stream list */
 	struct list back_refs;          /* list of users tracking this stream */
-	struct list buffer_wait;        /* position in the list of streams waiting for a buffer */
-
-	struct {
-		struct stksess *ts;
-		struct stktable *table;
-	} store[8];                     /* tracked stickiness values to store */
-	int store_count;
-	/* 4 unused bytes here */
 
 	struct stkctr stkctr[MAX_SESS_STKCTR];  /* content-aware stick counters */
 
-	struct strm_flt strm_flt;               /* current state of filters active on this stream */
+	char **req_cap;                 /* array of captures from the request (may be NULL) */
+	char **res_cap;                 /* array of captures from the response (may be NULL) */
+	struct vars vars_txn;           /* list of variables for the txn scope. */
+	struct vars vars_reqres;        /* list of variables for the request and resp scope. */
 
-	char **req_cap;                         /* array of captures from the request (may be NULL) */
-	char **res_cap;                         /* array of captures from the response (may be NULL) */
-	struct vars vars_txn;                   /* list of variables for the txn scope. */
-	struct vars vars_reqres;                /* list of variables for the request and resp scope. */
-
-	struct stream_interface si[2];          /* client and server stream interfaces */
-	struct strm_logs logs;                  /* logs for this stream */
-
-	void (*do_log)(struct stream *s);       /* the function to call in order to log (or NULL) */
-	void (*srv_error)(struct stream *s,     /* the function to call upon unrecoverable server errors (or NULL) */
-			  struct stream_interface *si);
-
-	char *unique_id;                        /* custom unique ID */
-
-	/* These two pointers are used to resume the execution of the rule lists. */
-	struct list *current_rule_list;         /* this is used to store the current executed rule list. */
-	void *current_rule;                     /* this is used to store the current rule to be resumed. */
-	struct hlua hlua;                       /* lua runtime context */
+	char *unique_id;                /* custom unique ID */
+	struct hlua hlua;               /* lua runtime context */
 };
 
 #endif /* _TYPES_STREAM_H */
@@ -21,6 +21,7 @@
 #include <types/global.h>
 
 struct pool_head *pool2_buffer;
+struct pool_head *pool2_buffer_small;
 
 /* These buffers are used to always have a valid pointer to an empty buffer in
  * channels. The first buffer is set once a buffer is empty. The second one is
@@ -56,9 +57,93 @@ int init_buffer()
 		return 0;
 
 	pool_free2(pool2_buffer, buffer);
+
+	/* small buffers are only used to receive requests, they are promoted
+	 * to standard buffers once full (see b_grow()).
+	 */
+	if (global.tune.bufsize_small) {
+		pool2_buffer_small = create_pool("small_buf", sizeof (struct buffer) + global.tune.bufsize_small, MEM_F_SHARED|MEM_F_EXACT);
+		if (!pool2_buffer_small)
+			return 0;
+	}
 	return 1;
 }
 
+/* Moves the contents of buffer *buf to buffer <new> allocated from <pool>, then
+ * releases the old one and replaces *buf with <new>. Input and output data are
+ * stored contiguously around the new buffer's <p> so that all positions
+ * relative to <p> remain valid, just like after a realign. The new buffer must
+ * be large enough.
+ */
+static void b_move(struct buffer **buf, struct buffer *new, struct pool_head *pool)
+{
+	struct buffer *old = *buf;
+	int block1, block2;
+
+	new->size = pool->size - sizeof(struct buffer);
+	new->o = old->o;
+	new->i = old->i;
+	new->p = new->data + old->o;
+
+	/* output data, possibly wrapping */
+	block1 = old->o;
+	block2 = 0;
+	if (block1 > old->p - old->data) {
+		block2 = old->p - old->data;
+		block1 -= block2;
+	}
+	memcpy(new->data, bo_ptr(old), block1);
+	memcpy(new->data + block1, old->data, block2);
+
+	/* input data, possibly wrapping */
+	block1 = old->i;
+	block2 = 0;
+	if (block1 > old->data + old->size - old->p) {
+		block1 = old->data + old->size - old->p;
+		block2 = old->i - block1;
+	}
+	memcpy(new->p, old->p, block1);
+	memcpy(new->p + block1, old->data, block2);
+
+	__b_drop(buf);
+	*buf = new;
+}
+
+/* Replaces the small buffer *buf with a standard one holding the same data.
+ * As with b_alloc_margin(), at least <margin> standard buffers must remain
+ * available in the pool after the allocation. Returns the new buffer, or NULL
+ * if none could be allocated, in which case *buf is left untouched.
+ */
+struct buffer *b_grow(struct buffer **buf, int margin)
+{
+	struct buffer *new;
+
+	if ((pool2_buffer->allocated - pool2_buffer->used) > margin)
+		new = pool_alloc_dirty(pool2_buffer);
+	else
+		new = pool_refill_alloc(pool2_buffer, margin);
+	if (new)
+		b_move(buf, new, pool2_buffer);
+	return new;
+}
+
+/* Replaces the standard buffer *buf with a small one holding the same data,
+ * which must fit. Returns the new buffer, or NULL if small buffers are not
+ * enabled or none could be allocated, in which case *buf is left untouched.
+ */
+struct buffer *b_shrink(struct buffer **buf)
+{
+	struct buffer *new;
+
+	if (!pool2_buffer_small)
+		return NULL;
+
+	new = pool_alloc_dirty(pool2_buffer_small);
+	if (new)
+		b_move(buf, new, pool2_buffer_small);
+	return new;
+}
+
 /* This function writes the string <str> at position <pos> which must be in
  * buffer <b>, and moves <end> just after the end of <str>. <b>'s parameters
  * <l> and <r> are updated to be valid after the shift. The shift value
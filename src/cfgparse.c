@@ -135,6 +135,19 @@ struct cfg_section {
 	int (*section_parser)(const char *, int, char **, int);
 };
 
+/* Startup timing report (-dT). Time is accumulated per phase, and the slowest
+ * individual items (sections, proxies) are kept to be reported at the end.
+ */
+#define CFG_TIMING_PHASES 32
+#define CFG_TIMING_TOP    10
+
+static struct cfg_timing {
+	const char *phase;
+	char *name;
+	unsigned long long usec;
+	unsigned int count;
+} cfg_timing_phases[CFG_TIMING_PHASES], cfg_timing_top[CFG_TIMING_TOP];
+
 /* Used to chain configuration sections definitions. This list
  * stores struct cfg_section
  */
@@ -716,6 +729,31 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 		}
 		global.tune.chksize = atol(args[1]);
 	}
+	else if (!strcmp(args[0], "tune.cli.dump-budget")) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (*(args[1]) == 0 || atol(args[1]) <= 0) {
+			Alert("parsing [%s:%d] : '%s' expects a positive integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.tune.cli_dump_budget = atol(args[1]);
+	}
+	else if (!strcmp(args[0], "tune.pool.hugepages")) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (strcmp(args[1], "off") == 0)
+			global.tune.pool_hugepages = POOL_HP_OFF;
+		else if (strcmp(args[1], "transparent") == 0)
+			global.tune.pool_hugepages = POOL_HP_TRANSPARENT;
+		else if (strcmp(args[1], "explicit") == 0)
+			global.tune.pool_hugepages = POOL_HP_EXPLICIT;
+		else {
+			Alert("parsing [%s:%d] : '%s' expects 'off', 'transparent' or 'explicit'.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
 	else if (!strcmp(args[0], "tune.recv_enough")) {
 		if (alertif_too_many_args(1, file, linenum, args, &err_code))
 			goto out;
@@ -807,6 +845,38 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 			goto out;
 		}
 	}
+	else if (!strcmp(args[0], "tune.ssl.lazy-cache-size")) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (*(args[1]) == 0) {
+			Alert("parsing [%s:%d] : '%s' expects an integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.tune.ssl_lazy_cache = atoi(args[1]);
+		if (global.tune.ssl_lazy_cache < 0) {
+			Alert("parsing [%s:%d] : '%s' expects a positive numeric value\n",
+			      file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
+	else if (!strcmp(args[0], "tune.ssl.load-threads")) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (*(args[1]) == 0) {
+			Alert("parsing [%s:%d] : '%s' expects an integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.tune.ssl_load_threads = atoi(args[1]);
+		if (global.tune.ssl_load_threads < 0 || global.tune.ssl_load_threads > MAX_SSL_LOAD_THREADS) {
+			Alert("parsing [%s:%d] : '%s' expects a value between 0 and %d.\n",
+			      file, linenum, args[0], MAX_SSL_LOAD_THREADS);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
 #endif
 	else if (!strcmp(args[0], "tune.buffers.limit")) {
 		if (alertif_too_many_args(1, file, linenum, args, &err_code))
@@ -855,6 +925,21 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 		chunk_init(&trash, realloc(trash.str, global.tune.bufsize), global.tune.bufsize);
 		alloc_trash_buffers(global.tune.bufsize);
 	}
+	else if (!strcmp(args[0], "tune.bufsize.small")) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (*(args[1]) == 0) {
+			Alert("parsing [%s:%d] : '%s' expects an integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.tune.bufsize_small = atol(args[1]);
+		if (global.tune.bufsize_small < 0) {
+			Alert("parsing [%s:%d] : '%s' expects a positive integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
 	else if (!strcmp(args[0], "tune.maxrewrite")) {
 		if (alertif_too_many_args(1, file, linenum, args, &err_code))
 			goto out;
@@ -967,6 +1052,26 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 		}
 		global.tune.pipesize = atol(args[1]);
 	}
+	else if (!strcmp(args[0], "tune.pipes.prealloc")) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (*(args[1]) == 0) {
+			Alert("parsing [%s:%d] : '%s' expects an integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.tune.pipes_prealloc = atol(args[1]);
+	}
+	else if (!strcmp(args[0], "tune.splice.auto-min")) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (*(args[1]) == 0) {
+			Alert("parsing [%s:%d] : '%s' expects an integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.tune.splice_auto_min = atol(args[1]);
+	}
 	else if (!strcmp(args[0], "tune.http.cookielen")) {
 		if (alertif_too_many_args(1, file, linenum, args, &err_code))
 			goto out;
@@ -1053,6 +1158,31 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 			goto out;
 		}
 	}
+	else if (!strcmp(args[0], "tune.comp.governor")) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (strcmp(args[1], "on") == 0)
+			global.tune.comp_governor = 1;
+		else if (strcmp(args[1], "off") == 0)
+			global.tune.comp_governor = 0;
+		else {
+			Alert("parsing [%s:%d] : '%s' expects 'on' or 'off'\n",
+			      file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
+	else if (!strcmp(args[0], "tune.comp.min-savings")) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		global.tune.comp_min_savings = atoi(args[1]);
+		if (!*args[1] || global.tune.comp_min_savings < 0 || global.tune.comp_min_savings > 100) {
+			Alert("parsing [%s:%d] : '%s' expects a percentage between 0 and 100\n",
+			      file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
 	else if (!strcmp(args[0], "tune.pattern.cache-size")) {
 		if (*args[1]) {
 			global.tune.pattern_cache = atoi(args[1]);
@@ -2803,6 +2933,7 @@ int cfg_parse_listen(const char *file, int linenum, char **args, int kwm)
 
 		if (curproxy->cap & PR_CAP_FE) {
 			curproxy->maxconn = defproxy.maxconn;
+			curproxy->mem.max = defproxy.mem.max;
 			curproxy->backlog = defproxy.backlog;
 			curproxy->fe_sps_lim = defproxy.fe_sps_lim;
 
@@ -2817,6 +2948,7 @@ int cfg_parse_listen(const char *file, int linenum, char **args, int kwm)
 			curproxy->lbprm.algo = defproxy.lbprm.algo;
 			curproxy->lbprm.chash.balance_factor = defproxy.lbprm.chash.balance_factor;
 			curproxy->fullconn = defproxy.fullconn;
+			curproxy->mem.max = defproxy.mem.max;
 			curproxy->conn_retries = defproxy.conn_retries;
 			curproxy->redispatch_after = defproxy.redispatch_after;
 			curproxy->max_ka_queue = defproxy.max_ka_queue;
@@ -2962,11 +3094,14 @@ int cfg_parse_listen(const char *file, int linenum, char **args, int kwm)
 			curproxy->comp = calloc(1, sizeof(struct comp));
 			curproxy->comp->algos = defproxy.comp->algos;
 			curproxy->comp->types = defproxy.comp->types;
+			curproxy->comp->precompressed = defproxy.comp->precompressed;
+			curproxy->comp->precomp_exts = defproxy.comp->precomp_exts;
 		}
 
 		curproxy->grace  = defproxy.grace;
 		curproxy->conf.used_listener_id = EB_ROOT;
 		curproxy->conf.used_server_id = EB_ROOT;
+		curproxy->conf.used_server_name = EB_ROOT;
 
 		if (defproxy.check_path)
 			curproxy->check_path = strdup(defproxy.check_path);
@@ -5844,6 +5979,25 @@ stats_error_parsing:
 		if (alertif_too_many_args(1, file, linenum, args, &err_code))
 			goto out;
 	}
+	else if (!strcmp(args[0], "maxmem")) {  /* maxmem */
+		unsigned int maxmem;
+		const char *err;
+
+		if (*(args[1]) == 0) {
+			Alert("parsing [%s:%d] : '%s' expects a size argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		if ((err = parse_size_err(args[1], &maxmem))) {
+			Alert("parsing [%s:%d] : unexpected character '%c' in argument of '%s'.\n",
+			      file, linenum, *err, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		curproxy->mem.max = maxmem;
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+	}
 	else if (!strcmp(args[0], "grace")) {  /* grace time (ms) */
 		if (*(args[1]) == 0) {
 			Alert("parsing [%s:%d] : '%s' expects a time in milliseconds.\n", file, linenum, args[0]);
@@ -7069,6 +7223,83 @@ cfg_parse_scope(const char *file, int linenum, char *line)
 	return err_code;
 }
 
+/* Returns the current date in microseconds, for the startup timing report */
+unsigned long long cfg_timing_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+/* Accounts the time elapsed since <start> to phase <phase> and to item <name>
+ * if not NULL, in the startup timing report. <phase> must be a constant
+ * string. Does nothing unless -dT was passed.
+ */
+void cfg_timing_add(const char *phase, const char *name, unsigned long long start)
+{
+	unsigned long long usec;
+	int i;
+
+	if (!(global.tune.options & GTUNE_TIMING_REPORT))
+		return;
+
+	usec = cfg_timing_now() - start;
+	for (i = 0; i < CFG_TIMING_PHASES; i++) {
+		if (!cfg_timing_phases[i].phase)
+			cfg_timing_phases[i].phase = phase;
+		if (cfg_timing_phases[i].phase == phase) {
+			cfg_timing_phases[i].usec += usec;
+			cfg_timing_phases[i].count++;
+			break;
+		}
+	}
+
+	if (!name)
+		return;
+
+	/* keep the slowest items sorted by decreasing times */
+	for (i = CFG_TIMING_TOP; i > 0 && usec > cfg_timing_top[i - 1].usec; i--)
+		;
+	if (i == CFG_TIMING_TOP)
+		return;
+
+	free(cfg_timing_top[CFG_TIMING_TOP - 1].name);
+	memmove(&cfg_timing_top[i + 1], &cfg_timing_top[i],
+		(CFG_TIMING_TOP - 1 - i) * sizeof(*cfg_timing_top));
+	cfg_timing_top[i].phase = phase;
+	cfg_timing_top[i].name = strdup(name);
+	cfg_timing_top[i].usec = usec;
+	cfg_timing_top[i].count = 1;
+}
+
+/* Dumps the startup timing report to stderr and releases it */
+void cfg_timing_dump(void)
+{
+	int i;
+
+	if (!(global.tune.options & GTUNE_TIMING_REPORT))
+		return;
+
+	fprintf(stderr, "Startup timing report :\n");
+	for (i = 0; i < CFG_TIMING_PHASES && cfg_timing_phases[i].phase; i++)
+		fprintf(stderr, "  %-32s %10llu.%03llu ms  (%u)\n",
+			cfg_timing_phases[i].phase,
+			cfg_timing_phases[i].usec / 1000, cfg_timing_phases[i].usec % 1000,
+			cfg_timing_phases[i].count);
+
+	fprintf(stderr, "Slowest items :\n");
+	for (i = 0; i < CFG_TIMING_TOP && cfg_timing_top[i].phase; i++) {
+		fprintf(stderr, "  %-32s %10llu.%03llu ms  %s\n",
+			cfg_timing_top[i].phase,
+			cfg_timing_top[i].usec / 1000, cfg_timing_top[i].usec % 1000,
+			cfg_timing_top[i].name);
+		free(cfg_timing_top[i].name);
+	}
+	memset(cfg_timing_top, 0, sizeof(cfg_timing_top));
+	memset(cfg_timing_phases, 0, sizeof(cfg_timing_phases));
+}
+
 /*
  * This function reads and parses the configuration file given in the argument.
  * Returns the error code, 0 if OK, or any combination of :
@@ -7089,6 +7320,8 @@ int readcfgfile(const char *file)
 	struct cfg_section *cs = NULL;
 	struct cfg_section *ics;
 	int readbytes = 0;
+	unsigned long long sect_start = 0;
+	char *sect_desc = NULL;
 
 	if ((thisline = malloc(sizeof(*thisline) * linesize)) == NULL) {
 		Alert("parsing [%s] : out of memory.\n", file);
@@ -7380,6 +7613,12 @@ next_line:
 		/* detect section start */
 		list_for_each_entry(ics, &sections, list) {
 			if (strcmp(args[0], ics->section_name) == 0) {
+				if (global.tune.options & GTUNE_TIMING_REPORT) {
+					if (cs)
+						cfg_timing_add(cs->section_name, sect_desc, sect_start);
+					memprintf(&sect_desc, "%s '%s' at [%s:%d]", args[0], args[1], file, linenum);
+					sect_start = cfg_timing_now();
+				}
 				cursection = ics->section_name;
 				cs = ics;
 				break;
@@ -7397,6 +7636,9 @@ next_line:
 		if (err_code & ERR_ABORT)
 			break;
 	}
+	if (cs)
+		cfg_timing_add(cs->section_name, sect_desc, sect_start);
+	free(sect_desc);
 	free(cfg_scope);
 	cfg_scope = NULL;
 	cursection = NULL;
@@ -7459,6 +7701,18 @@ void propagate_processes(struct proxy *from, struct proxy *to)
 	}
 }
 
+/* Adds the maxconn of frontend <fe> to the ones which may reach backend <be>,
+ * unless it was already accounted. Frontends must be processed one at a time.
+ */
+static void proxy_add_fe_maxconn(struct proxy *be, struct proxy *fe)
+{
+	if (!be || be->conf.fullconn_fe == fe)
+		return;
+
+	be->conf.fullconn_fe = fe;
+	be->tot_fe_maxconn += fe->maxconn;
+}
+
 /*
  * Returns the error code, 0 if OK, or any combination of :
  *  - ERR_ABORT: must abort ASAP
@@ -7476,6 +7730,7 @@ int check_config_validity()
 	int err_code = 0;
 	unsigned int next_pxid = 1;
 	struct bind_conf *bind_conf;
+	unsigned long long start;
 	char *err;
 
 	bind_conf = NULL;
@@ -7522,6 +7777,8 @@ int check_config_validity()
 		unsigned int next_id;
 		int nbproc;
 
+		start = cfg_timing_now();
+
 		if (curproxy->uuid < 0) {
 			/* proxy ID not set, use automatic numbering with first
 			 * spare entry starting with next_pxid.
@@ -8436,13 +8693,18 @@ out_uri_auth_compat:
 		 * want to annoy people who correctly manage them.
 		 */
 		for (newsrv = curproxy->srv; newsrv; newsrv = newsrv->next) {
+			struct ebpt_node *node;
 			struct server *other_srv;
 
 			if (newsrv->puid)
 				continue;
 
-			for (other_srv = curproxy->srv; other_srv && other_srv != newsrv; other_srv = other_srv->next) {
-				if (!other_srv->puid && strcmp(other_srv->id, newsrv->id) == 0) {
+			/* same names are stored in declaration order */
+			for (node = ebis_lookup(&curproxy->conf.used_server_name, newsrv->id);
+			     node && node != &newsrv->conf.name;
+			     node = ebpt_next(node)) {
+				other_srv = container_of(node, struct server, conf.name);
+				if (!other_srv->puid) {
 					Warning("parsing [%s:%d] : %s '%s', another server named '%s' was defined without an explicit ID at line %d, this is not recommended.\n",
 						newsrv->conf.file, newsrv->conf.line,
 						proxy_type_str(curproxy), curproxy->id,
@@ -8837,6 +9099,7 @@ out_uri_auth_compat:
 				}
 			}
 		}
+		cfg_timing_add("check proxies", curproxy->id, start);
 	}
 
 	/***********************************************************/
@@ -8919,6 +9182,8 @@ out_uri_auth_compat:
 		struct listener *listener;
 		unsigned int next_id;
 
+		start = cfg_timing_now();
+
 #ifdef USE_OPENSSL
 		/* Configure SSL for each bind line.
 		 * Note: if configuration fails at some point, the ->ctx member
@@ -9008,6 +9273,13 @@ out_uri_auth_compat:
 				if (nbproc > 1)
 					listener->maxaccept = (listener->maxaccept + 1) / 2;
 				listener->maxaccept = (listener->maxaccept + nbproc - 1) / nbproc;
+
+				/* listeners with a lower weight yield earlier to the others */
+				if (listener->acc_weight && (int)listener->maxaccept > 0) {
+					listener->maxaccept = ((unsigned long long)listener->maxaccept * listener->acc_weight + 99) / 100;
+					if (!listener->maxaccept)
+						listener->maxaccept = 1;
+				}
 			}
 
 			listener->accept = session_accept_fd;
@@ -9093,62 +9365,48 @@ out_uri_auth_compat:
 			      curproxy->id);
 			cfgerr++;
 		}
+		cfg_timing_add("check listeners", curproxy->id, start);
 	}
 
 	/* automatically compute fullconn if not set. We must not do it in the
 	 * loop above because cross-references are not yet fully resolved.
 	 */
-	for (curproxy = proxy; curproxy; curproxy = curproxy->next) {
-		/* If <fullconn> is not set, let's set it to 10% of the sum of
-		 * the possible incoming frontend's maxconns.
-		 */
-		if (!curproxy->fullconn && (curproxy->cap & PR_CAP_BE)) {
-			struct proxy *fe;
-			int total = 0;
+	start = cfg_timing_now();
 
-			/* sum up the number of maxconns of frontends which
-			 * reference this backend at least once or which are
-			 * the same one ('listen').
-			 */
-			for (fe = proxy; fe; fe = fe->next) {
-				struct switching_rule *rule;
-				int found = 0;
+	/* sum up the number of maxconns of frontends which reference each
+	 * backend at least once or which are the same one ('listen'). Each
+	 * frontend is only accounted once per backend.
+	 */
+	for (curproxy = proxy; curproxy; curproxy = curproxy->next) {
+		struct switching_rule *rule;
 
-				if (!(fe->cap & PR_CAP_FE))
-					continue;
+		if (!(curproxy->cap & PR_CAP_FE))
+			continue;
 
-				if (fe == curproxy)  /* we're on a "listen" instance */
-					found = 1;
+		if (curproxy->cap & PR_CAP_BE)  /* we're on a "listen" instance */
+			proxy_add_fe_maxconn(curproxy, curproxy);
 
-				if (fe->defbe.be == curproxy) /* "default_backend" */
-					found = 1;
+		if (curproxy->defbe.be) /* "default_backend" */
+			proxy_add_fe_maxconn(curproxy->defbe.be, curproxy);
 
-				/* check if a "use_backend" rule matches */
-				if (!found) {
-					list_for_each_entry(rule, &fe->switching_rules, list) {
-						if (!rule->dynamic && rule->be.backend == curproxy) {
-							found = 1;
-							break;
-						}
-					}
-				}
+		list_for_each_entry(rule, &curproxy->switching_rules, list) {
+			if (!rule->dynamic)
+				proxy_add_fe_maxconn(rule->be.backend, curproxy);
+		}
+	}
 
-				/* now we've checked all possible ways to reference a backend
-				 * from a frontend.
-				 */
-				if (!found)
-					continue;
-				total += fe->maxconn;
-			}
-			/* we have the sum of the maxconns in <total>. We only
-			 * keep 10% of that sum to set the default fullconn, with
-			 * a hard minimum of 1 (to avoid a divide by zero).
-			 */
-			curproxy->fullconn = (total + 9) / 10;
+	for (curproxy = proxy; curproxy; curproxy = curproxy->next) {
+		/* If <fullconn> is not set, let's set it to 10% of the sum of
+		 * the possible incoming frontend's maxconns, with a hard
+		 * minimum of 1 (to avoid a divide by zero).
+		 */
+		if (!curproxy->fullconn && (curproxy->cap & PR_CAP_BE)) {
+			curproxy->fullconn = (curproxy->tot_fe_maxconn + 9) / 10;
 			if (!curproxy->fullconn)
 				curproxy->fullconn = 1;
 		}
 	}
+	cfg_timing_add("compute fullconn", NULL, start);
 
 	/*
 	 * Recount currently required checks.
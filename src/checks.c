@@ -2424,6 +2424,63 @@ int start_checks() {
 	return 0;
 }
 
+/*
+ * Start the warmup task and the health and agent checks of server <s> which
+ * was added at runtime, the same way start_checks() does for all servers at
+ * boot time. External checks are not supported here. Returns 0 if OK, -1 if
+ * error.
+ */
+int start_server_checks(struct server *s)
+{
+	struct task *t;
+
+	if (s->slowstart) {
+		if ((t = task_new()) == NULL)
+			return -1;
+		s->warmup = t;
+		t->process = server_warmup;
+		t->context = s;
+		t->expire = TICK_ETERNITY;
+	}
+
+	if ((s->check.state & CHK_ST_CONFIGURED) &&
+	    (s->check.type == PR_O2_EXT_CHK || !start_check_task(&s->check, 0, 1, 0)))
+		goto fail;
+
+	if ((s->agent.state & CHK_ST_CONFIGURED) &&
+	    !start_check_task(&s->agent, 0, 1, 0))
+		goto fail;
+
+	return 0;
+ fail:
+	stop_server_checks(s);
+	return -1;
+}
+
+/*
+ * Stop and release the warmup, health check and agent check tasks of server
+ * <s>. This is used when a server is removed at runtime, the caller must have
+ * ensured that no check is in progress.
+ */
+void stop_server_checks(struct server *s)
+{
+	if (s->check.task) {
+		task_delete(s->check.task);
+		task_free(s->check.task);
+		s->check.task = NULL;
+	}
+	if (s->agent.task) {
+		task_delete(s->agent.task);
+		task_free(s->agent.task);
+		s->agent.task = NULL;
+	}
+	if (s->warmup) {
+		task_delete(s->warmup);
+		task_free(s->warmup);
+		s->warmup = NULL;
+	}
+}
+
 /*
  * Perform content verification check on data in s->check.buffer buffer.
  * The buffer MUST be terminated by a null byte before calling this function.
@@ -3060,16 +3117,21 @@ const char *init_check(struct check *check, int type)
 {
 	check->type = type;
 
-	/* Allocate buffer for requests... */
-	if ((check->bi = calloc(sizeof(struct buffer) + global.tune.chksize, sizeof(char))) == NULL) {
+	/* Allocate buffer for requests... Only the header is initialized so
+	 * that the pages are not touched before the check runs, which matters
+	 * with many servers.
+	 */
+	if ((check->bi = malloc(sizeof(struct buffer) + global.tune.chksize)) == NULL) {
 		return "out of memory while allocating check buffer";
 	}
+	memset(check->bi, 0, sizeof(struct buffer) + 1);
 	check->bi->size = global.tune.chksize;
 
 	/* Allocate buffer for responses... */
-	if ((check->bo = calloc(sizeof(struct buffer) + global.tune.chksize, sizeof(char))) == NULL) {
+	if ((check->bo = malloc(sizeof(struct buffer) + global.tune.chksize)) == NULL) {
 		return "out of memory while allocating check buffer";
 	}
+	memset(check->bo, 0, sizeof(struct buffer) + 1);
 	check->bo->size = global.tune.chksize;
 
 	/* Allocate buffer for partial results... */
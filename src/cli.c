@@ -72,6 +72,10 @@ static const char stats_sock_usage_msg[] =
 	"Unknown command. Please enter one of the following commands only :\n"
 	"  help           : this message\n"
 	"  prompt         : toggle interactive mode with prompt\n"
+	"  binary         : switch to binary framing for the rest of the session\n"
+	"  begin          : start a batch of commands\n"
+	"  commit         : apply the current batch at once\n"
+	"  abort          : discard the current batch\n"
 	"  quit           : disconnect\n"
 	"";
 
@@ -382,7 +386,7 @@ int cli_has_level(struct appctx *appctx, int level)
 	struct stream_interface *si = appctx->owner;
 	struct stream *s = si_strm(si);
 
-	if (strm_li(s)->bind_conf->level < level) {
+	if ((strm_li(s)->bind_conf->level & ACCESS_LVL_MASK) < level) {
 		appctx->ctx.cli.msg = stats_permission_denied_msg;
 		appctx->st0 = CLI_ST_PRINT;
 		return 0;
@@ -391,18 +395,13 @@ int cli_has_level(struct appctx *appctx, int level)
 }
 
 
-/* Processes the CLI interpreter on the stats socket. This function is called
- * from the CLI's IO handler running in an appctx context. The function returns 1
- * if the request was understood, otherwise zero. It is called with appctx->st0
- * set to CLI_ST_GETREQ and presets ->st2 to 0 so that parsers don't have to do
- * it. It will possilbly leave st0 to CLI_ST_CALLBACK if the keyword needs to
- * have its own I/O handler called again. Most of the time, parsers will only
- * set st0 to CLI_ST_PRINT and put their message to be displayed into cli.msg.
+/* Splits the request line <line> into arguments stored into <args>, which must
+ * have room for MAX_STATS_ARGS + 1 entries. Arguments are delimited by spaces
+ * unless they are escaped with a backslash, and backslashes are unescaped.
+ * Unused entries point to an empty string.
  */
-static int cli_parse_request(struct appctx *appctx, char *line)
+static void cli_split_line(char *line, char **args)
 {
-	char *args[MAX_STATS_ARGS + 1];
-	struct cli_kw *kw;
 	int arg;
 	int i, j;
 
@@ -451,6 +450,162 @@ static int cli_parse_request(struct appctx *appctx, char *line)
 		args[arg][j] = '\0';
 		arg++;
 	}
+}
+
+/* Extracts the next request line from channel <req> into the trash and splits
+ * it into <args>. An unescaped semi-colon also ends a request so that several
+ * ones may be sent on the same line. Returns the number of bytes to skip from
+ * the channel, 0 if the line is not complete yet, or <0 if the channel is
+ * closed or the line is too long.
+ */
+static int cli_get_line(struct channel *req, char **args)
+{
+	int reql, len;
+
+	reql = bo_getline(req, trash.str, trash.size);
+	if (reql <= 0) /* closed or EOL not found */
+		return reql;
+
+	/* seek for a possible unescaped semi-colon. If we find one, we
+	 * replace it with an LF and skip only this part.
+	 */
+	for (len = 0; len < reql; len++) {
+		if (trash.str[len] == '\\') {
+			len++;
+			continue;
+		}
+		if (trash.str[len] == ';') {
+			trash.str[len] = '\n';
+			reql = len + 1;
+			break;
+		}
+	}
+
+	/* now it is time to check that we have a full line, remove the
+	 * trailing \n and possibly \r, then cut the line.
+	 */
+	len = reql - 1;
+	if (trash.str[len] != '\n')
+		return -1;
+
+	if (len && trash.str[len-1] == '\r')
+		len--;
+
+	trash.str[len] = '\0';
+	cli_split_line(trash.str, args);
+	return reql;
+}
+
+/* Extracts the next binary request from channel <req> into the trash and
+ * splits it into <args>. A request is made of a 32-bit big-endian length
+ * followed by the arguments, each of them being made of a 16-bit big-endian
+ * length followed by the raw bytes, without any escaping. Returns the number
+ * of bytes to skip from the channel, 0 if the request is not complete yet, or
+ * <0 if the channel is closed or the request is invalid or too large.
+ */
+static int cli_get_frame(struct channel *req, char **args)
+{
+	unsigned char hdr[4];
+	char *p, *end;
+	int ret, len, arg;
+
+	ret = bo_getblk(req, (char *)hdr, 4, 0);
+	if (ret <= 0)
+		return ret;
+
+	len = (hdr[0] << 24) + (hdr[1] << 16) + (hdr[2] << 8) + hdr[3];
+	if (len < 0 || len >= trash.size ||
+	    len + 4 > global.tune.bufsize - global.tune.maxrewrite)
+		return -1;
+
+	if (len) {
+		ret = bo_getblk(req, trash.str, len, 4);
+		if (ret <= 0)
+			return ret;
+	}
+
+	/* each argument is moved over its length which leaves room for its
+	 * trailing zero.
+	 */
+	p = trash.str;
+	end = p + len;
+	*end = '\0';
+	for (arg = 0; p < end; arg++) {
+		if (arg >= MAX_STATS_ARGS || end - p < 2)
+			return -1;
+		ret = ((unsigned char)p[0] << 8) + (unsigned char)p[1];
+		if (ret > end - p - 2)
+			return -1;
+		memmove(p, p + 2, ret);
+		p[ret] = '\0';
+		args[arg] = p;
+		p += ret + 2;
+	}
+
+	while (arg <= MAX_STATS_ARGS)
+		args[arg++] = end;
+
+	return len + 4;
+}
+
+/* In binary mode, reserves room for a frame header at the end of channel
+ * <chn> before an output function writes its data, and sets <start> to the
+ * position to pass to cli_close_frame(). Returns 0 if there is no room left.
+ */
+static int cli_open_frame(struct channel *chn, unsigned long long *start)
+{
+	if (channel_recv_max(chn) <= 4)
+		return 0;
+
+	*start = chn->total;
+	return bi_putblk(chn, "\0\0\0\0", 4) == 4;
+}
+
+/* Completes the frame header reserved at position <start> on channel <chn>
+ * with the length of the data written since then, which are possibly already
+ * scheduled for forwarding. The header is removed if nothing was written.
+ */
+static void cli_close_frame(struct channel *chn, unsigned long long start)
+{
+	struct buffer *buf = chn->buf;
+	unsigned int len = chn->total - start - 4;
+	int ofs, i;
+
+	if (!len) {
+		if (buf->i < 4)
+			b_rew(buf, 4 - buf->i);
+		buf->i -= 4;
+		chn->total -= 4;
+		return;
+	}
+
+	ofs = buf->i - (int)(len + 4);
+	for (i = 0; i < 4; i++)
+		*b_ptr(buf, ofs + i) = len >> (24 - 8 * i);
+}
+
+/* Prepares the usage message to be displayed */
+static void cli_usage(struct appctx *appctx)
+{
+	cli_gen_usage_msg();
+	if (dynamic_usage_msg)
+		appctx->ctx.cli.msg = dynamic_usage_msg;
+	else
+		appctx->ctx.cli.msg = stats_sock_usage_msg;
+	appctx->st0 = CLI_ST_PRINT;
+}
+
+/* Processes the CLI interpreter on the stats socket. This function is called
+ * from the CLI's IO handler running in an appctx context. The function returns 1
+ * if the request was understood, otherwise zero. It is called with appctx->st0
+ * set to CLI_ST_GETREQ and presets ->st2 to 0 so that parsers don't have to do
+ * it. It will possilbly leave st0 to CLI_ST_CALLBACK if the keyword needs to
+ * have its own I/O handler called again. Most of the time, parsers will only
+ * set st0 to CLI_ST_PRINT and put their message to be displayed into cli.msg.
+ */
+static int cli_parse_request(struct appctx *appctx, char **args)
+{
+	struct cli_kw *kw;
 
 	appctx->ctx.stats.scope_str = 0;
 	appctx->ctx.stats.scope_len = 0;
@@ -469,26 +624,320 @@ static int cli_parse_request(struct appctx *appctx, char *line)
 	return 1;
 }
 
+/* Appends <len> bytes from <data> to the growable chunk <chk>, without letting
+ * it grow beyond <max> bytes. Returns 0 on success or -1 on failure.
+ */
+static int cli_batch_append(struct chunk *chk, const char *data, int len, int max)
+{
+	char *area;
+	int size;
+
+	if (chk->len + len > max)
+		return -1;
+
+	for (size = chk->size ? chk->size : 1024; chk->len + len > size; size *= 2);
+	if (size > chk->size) {
+		area = realloc(chk->str, size);
+		if (!area)
+			return -1;
+		chk->str = area;
+		chk->size = size;
+	}
+
+	memcpy(chk->str + chk->len, data, len);
+	chk->len += len;
+	return 0;
+}
+
+/* Releases the batch attached to the CLI appctx <appctx> */
+static void cli_batch_release(struct appctx *appctx)
+{
+	struct cli_batch *batch = appctx->private;
+
+	free(batch->cmds.str);
+	free(batch->out.str);
+	free(batch);
+	appctx->private = NULL;
+	appctx->st1 &= ~APPCTX_CLI_ST1_BATCH;
+}
+
+/* Queues the request made of arguments <args> into the batch of <appctx>. Any
+ * error is reported immediately and causes the whole batch to be rejected on
+ * commit, so that it is never partially applied.
+ */
+static void cli_batch_queue(struct appctx *appctx, char **args)
+{
+	struct cli_batch *batch = appctx->private;
+	struct cli_kw *kw;
+	char argc;
+	int arg;
+
+	if (batch->error)
+		return;
+
+	kw = cli_find_kw(args);
+	if (!kw || !kw->parse) {
+		batch->error = "Unknown command in batch, it will be rejected.\n";
+		goto fail;
+	}
+
+	for (argc = 0; argc < MAX_STATS_ARGS && *args[(int)argc]; argc++);
+	if (cli_batch_append(&batch->cmds, &argc, 1, MAX_CLI_BATCH_SIZE) < 0)
+		goto too_large;
+
+	for (arg = 0; arg < argc; arg++) {
+		if (cli_batch_append(&batch->cmds, args[arg], strlen(args[arg]) + 1, MAX_CLI_BATCH_SIZE) < 0)
+			goto too_large;
+	}
+
+	batch->count++;
+	return;
+
+ too_large:
+	batch->error = "Batch too large or out of memory, it will be rejected.\n";
+ fail:
+	free(batch->cmds.str);
+	batch->cmds.str = NULL;
+	batch->cmds.size = batch->cmds.len = 0;
+	appctx->ctx.cli.msg = batch->error;
+	appctx->st0 = CLI_ST_PRINT;
+}
+
+/* Sends the responses of the committed batch. It returns 0 if the output
+ * buffer is full and it needs to be called again, otherwise non-zero.
+ */
+static int cli_io_handler_batch(struct appctx *appctx)
+{
+	struct stream_interface *si = appctx->owner;
+	struct cli_batch *batch = appctx->private;
+	int len;
+
+	len = batch->out.len - batch->sent;
+	if (len > channel_recv_max(si_ic(si)))
+		len = channel_recv_max(si_ic(si));
+
+	if (len > 0 && bi_putblk(si_ic(si), batch->out.str + batch->sent, len) > 0)
+		batch->sent += len;
+
+	if (batch->sent < batch->out.len) {
+		si_applet_cant_put(si);
+		return 0;
+	}
+	return 1;
+}
+
+/* Moves to the batch's output the data that the last command of the batch of
+ * <appctx> wrote directly into the response channel <chn> after its first
+ * <ofs> input bytes, prefixed with header <hdr>. Returns 1 if some data were
+ * moved, 0 if there were none, or -1 if they were lost for lack of memory.
+ */
+static int cli_batch_capture(struct appctx *appctx, struct channel *chn, int ofs, const char *hdr)
+{
+	struct cli_batch *batch = appctx->private;
+	struct buffer *buf = chn->buf;
+	char *start;
+	int len, contig, ret = 1;
+
+	len = buf->i - ofs;
+	if (len <= 0)
+		return 0;
+
+	start = b_ptr(buf, ofs);
+	contig = MIN(len, buf->data + buf->size - start);
+	if (cli_batch_append(&batch->out, hdr, strlen(hdr), INT_MAX) < 0 ||
+	    cli_batch_append(&batch->out, start, contig, INT_MAX) < 0 ||
+	    cli_batch_append(&batch->out, buf->data, len - contig, INT_MAX) < 0)
+		ret = -1;
+	buf->i = ofs;
+	chn->total -= len;
+	return ret;
+}
+
+/* Executes all the commands queued in the batch of <appctx> at once, so that
+ * no other processing can take place in the middle, and prepares their
+ * responses, each of them being prefixed with the command's number. The
+ * output of commands writing directly to the response channel is moved there
+ * as well. Commands which need to dump data cannot be used there.
+ */
+static void cli_batch_commit(struct appctx *appctx)
+{
+	struct stream_interface *si = appctx->owner;
+	struct channel *res = si_ic(si);
+	struct cli_batch *batch = appctx->private;
+	char *args[MAX_STATS_ARGS + 1];
+	unsigned long long to_forward;
+	const char *msg;
+	char *p, *end;
+	char hdr[32];
+	int num, arg, argc, ofs, written;
+	int lost = 0;
+
+	if (batch->error) {
+		appctx->ctx.cli.msg = "Batch rejected, nothing was applied.\n";
+		appctx->st0 = CLI_ST_PRINT;
+		cli_batch_release(appctx);
+		return;
+	}
+
+	/* keep direct writes in the channel's input to be able to take them */
+	to_forward = res->to_forward;
+	res->to_forward = 0;
+
+	p = batch->cmds.str;
+	end = p + batch->cmds.len;
+	for (num = 1; p < end; num++) {
+		argc = *p++;
+		for (arg = 0; arg < argc; arg++) {
+			args[arg] = p;
+			p += strlen(p) + 1;
+		}
+		while (arg <= MAX_STATS_ARGS)
+			args[arg++] = end - 1; /* last arg's trailing zero */
+
+		/* some parsers use appctx->private for their I/O handler */
+		appctx->private = NULL;
+		appctx->st0 = CLI_ST_PROMPT;
+		msg = NULL;
+		ofs = res->buf->i;
+		if (!cli_parse_request(appctx, args))
+			msg = "Unknown command.\n";
+		else if (appctx->st0 == CLI_ST_PRINT)
+			msg = appctx->ctx.cli.msg;
+		else if (appctx->st0 == CLI_ST_PRINT_FREE)
+			msg = appctx->ctx.cli.err;
+		else if (appctx->st0 == CLI_ST_CALLBACK) {
+			if (appctx->io_release)
+				appctx->io_release(appctx);
+			msg = "This command cannot be used in a batch.\n";
+		}
+		appctx->io_handler = NULL;
+		appctx->io_release = NULL;
+		appctx->private = batch;
+
+		snprintf(hdr, sizeof(hdr), "%d: ", num);
+		written = cli_batch_capture(appctx, res, ofs, hdr);
+		if (written < 0)
+			lost = 1;
+		if (msg && *msg) {
+			if (!written && cli_batch_append(&batch->out, hdr, strlen(hdr), INT_MAX) < 0)
+				lost = 1;
+			if (cli_batch_append(&batch->out, msg, strlen(msg), INT_MAX) < 0)
+				lost = 1;
+			if (msg[strlen(msg) - 1] != '\n' &&
+			    cli_batch_append(&batch->out, "\n", 1, INT_MAX) < 0)
+				lost = 1;
+		}
+
+		if (appctx->st0 == CLI_ST_PRINT_FREE)
+			free(appctx->ctx.cli.err);
+	}
+
+	res->to_forward = to_forward;
+
+	snprintf(hdr, sizeof(hdr), "Batch of %d commands applied.\n", batch->count);
+	if (cli_batch_append(&batch->out, hdr, strlen(hdr), INT_MAX) < 0)
+		lost = 1;
+
+	if (lost) {
+		/* the commands were applied, only their output is missing */
+		appctx->ctx.cli.msg = "Batch applied, but out of memory while saving its output.\n";
+		appctx->st0 = CLI_ST_PRINT;
+		cli_batch_release(appctx);
+		return;
+	}
+
+	free(batch->cmds.str);
+	batch->cmds.str = NULL;
+	batch->cmds.size = batch->cmds.len = 0;
+
+	appctx->io_handler = cli_io_handler_batch;
+	appctx->io_release = cli_batch_release;
+	appctx->st0 = CLI_ST_CALLBACK;
+}
+
+/* Processes the request made of arguments <args>. The CLI's own commands are
+ * handled here, other ones are either queued in the current batch or passed
+ * to their keyword's parser.
+ */
+static void cli_process_request(struct appctx *appctx, char **args)
+{
+	struct cli_batch *batch = NULL;
+
+	if (appctx->st1 & APPCTX_CLI_ST1_BATCH)
+		batch = appctx->private;
+
+	if (!*args[0]) {
+		/* if prompt is disabled, print help on empty lines, so that
+		 * the user at least knows how to enable prompt and find help.
+		 */
+		if (!(appctx->st1 & (APPCTX_CLI_ST1_PROMPT | APPCTX_CLI_ST1_BINARY)))
+			cli_usage(appctx);
+	}
+	else if (strcmp(args[0], "quit") == 0)
+		appctx->st0 = CLI_ST_END;
+	else if (strcmp(args[0], "prompt") == 0)
+		appctx->st1 ^= APPCTX_CLI_ST1_PROMPT;
+	else if (strcmp(args[0], "binary") == 0)
+		appctx->st1 |= APPCTX_CLI_ST1_BINARY;
+	else if (strcmp(args[0], "help") == 0)
+		cli_usage(appctx);
+	else if (strcmp(args[0], "begin") == 0) {
+		if (batch) {
+			appctx->ctx.cli.msg = "A batch is already in progress.\n";
+			appctx->st0 = CLI_ST_PRINT;
+			return;
+		}
+		batch = calloc(1, sizeof(*batch));
+		if (!batch) {
+			appctx->ctx.cli.msg = "Out of memory.\n";
+			appctx->st0 = CLI_ST_PRINT;
+			return;
+		}
+		appctx->private = batch;
+		appctx->st1 |= APPCTX_CLI_ST1_BATCH;
+	}
+	else if (strcmp(args[0], "commit") == 0 || strcmp(args[0], "abort") == 0) {
+		if (!batch) {
+			appctx->ctx.cli.msg = "No batch in progress.\n";
+			appctx->st0 = CLI_ST_PRINT;
+		}
+		else if (*args[0] == 'c')
+			cli_batch_commit(appctx);
+		else
+			cli_batch_release(appctx);
+	}
+	else if (batch)
+		cli_batch_queue(appctx, args);
+	else if (!cli_parse_request(appctx, args))
+		cli_usage(appctx);
+}
+
 /* This I/O handler runs as an applet embedded in a stream interface. It is
  * used to processes I/O from/to the stats unix socket. The system relies on a
  * state machine handling requests and various responses. We read a request,
  * then we process it and send the response, and we possibly display a prompt.
  * Then we can read again. The state is stored in appctx->st0 and is one of the
- * CLI_ST_* constants. appctx->st1 is used to indicate whether prompt is enabled
- * or not.
+ * CLI_ST_* constants. appctx->st1 holds the APPCTX_CLI_ST1_* flags indicating
+ * whether prompt or binary mode are enabled or a batch is in progress. In
+ * binary mode, each response is sent as frames made of a 32-bit big-endian
+ * length followed by the data, and ends with an empty frame.
  */
 static void cli_io_handler(struct appctx *appctx)
 {
 	struct stream_interface *si = appctx->owner;
 	struct channel *req = si_oc(si);
 	struct channel *res = si_ic(si);
+	char *args[MAX_STATS_ARGS + 1];
+	unsigned long long frame;
+	int binary, framed;
 	int reql;
-	int len;
 
 	if (unlikely(si->state == SI_ST_DIS || si->state == SI_ST_CLO))
 		goto out;
 
 	while (1) {
+		binary = appctx->st1 & APPCTX_CLI_ST1_BINARY;
+
 		if (appctx->st0 == CLI_ST_INIT) {
 			/* Stats output not initialized yet */
 			memset(&appctx->ctx.stats, 0, sizeof(appctx->ctx.stats));
@@ -510,83 +959,46 @@ static void cli_io_handler(struct appctx *appctx)
 				break;
 			}
 
-			reql = bo_getline(si_oc(si), trash.str, trash.size);
-			if (reql <= 0) { /* closed or EOL not found */
+			if (binary)
+				reql = cli_get_frame(si_oc(si), args);
+			else
+				reql = cli_get_line(si_oc(si), args);
+
+			if (reql <= 0) { /* closed, incomplete or invalid */
 				if (reql == 0)
 					break;
 				appctx->st0 = CLI_ST_END;
 				continue;
 			}
 
-			/* seek for a possible unescaped semi-colon. If we find
-			 * one, we replace it with an LF and skip only this part.
+			/* some parsers directly write their response, which
+			 * must not be sent unframed. The request is left in
+			 * the channel to be parsed again once there is room.
 			 */
-			for (len = 0; len < reql; len++) {
-				if (trash.str[len] == '\\') {
-					len++;
-					continue;
-				}
-				if (trash.str[len] == ';') {
-					trash.str[len] = '\n';
-					reql = len + 1;
-					break;
-				}
-			}
-
-			/* now it is time to check that we have a full line,
-			 * remove the trailing \n and possibly \r, then cut the
-			 * line.
-			 */
-			len = reql - 1;
-			if (trash.str[len] != '\n') {
-				appctx->st0 = CLI_ST_END;
-				continue;
+			if (binary && !cli_open_frame(res, &frame)) {
+				si_applet_cant_put(si);
+				break;
 			}
 
-			if (len && trash.str[len-1] == '\r')
-				len--;
-
-			trash.str[len] = '\0';
-
 			appctx->st0 = CLI_ST_PROMPT;
-			if (len) {
-				if (strcmp(trash.str, "quit") == 0) {
-					appctx->st0 = CLI_ST_END;
-					continue;
-				}
-				else if (strcmp(trash.str, "prompt") == 0)
-					appctx->st1 = !appctx->st1;
-				else if (strcmp(trash.str, "help") == 0 ||
-					 !cli_parse_request(appctx, trash.str)) {
-					cli_gen_usage_msg();
-					if (dynamic_usage_msg)
-						appctx->ctx.cli.msg = dynamic_usage_msg;
-					else
-						appctx->ctx.cli.msg = stats_sock_usage_msg;
-					appctx->st0 = CLI_ST_PRINT;
-				}
-				/* NB: stats_sock_parse_request() may have put
-				 * another CLI_ST_O_* into appctx->st0.
-				 */
-			}
-			else if (!appctx->st1) {
-				/* if prompt is disabled, print help on empty lines,
-				 * so that the user at least knows how to enable
-				 * prompt and find help.
-				 */
-				cli_gen_usage_msg();
-				if (dynamic_usage_msg)
-					appctx->ctx.cli.msg = dynamic_usage_msg;
-				else
-					appctx->ctx.cli.msg = stats_sock_usage_msg;
-				appctx->st0 = CLI_ST_PRINT;
-			}
+			cli_process_request(appctx, args);
+			if (binary)
+				cli_close_frame(res, frame);
+			/* NB: cli_process_request() may have put another
+			 * CLI_ST_O_* into appctx->st0.
+			 */
 
 			/* re-adjust req buffer */
 			bo_skip(si_oc(si), reql);
 			req->flags |= CF_READ_DONTWAIT; /* we plan to read small requests */
 		}
 		else {	/* output functions */
+			framed = binary && appctx->st0 != CLI_ST_PROMPT;
+			if (framed && !cli_open_frame(res, &frame)) {
+				si_applet_cant_put(si);
+				break;
+			}
+
 			switch (appctx->st0) {
 			case CLI_ST_PROMPT:
 				break;
@@ -619,9 +1031,19 @@ static void cli_io_handler(struct appctx *appctx)
 				break;
 			}
 
-			/* The post-command prompt is either LF alone or LF + '> ' in interactive mode */
+			if (framed)
+				cli_close_frame(res, frame);
+
+			/* The post-command prompt is either LF alone or LF + '> ' in
+			 * interactive mode, or an empty frame in binary mode.
+			 */
 			if (appctx->st0 == CLI_ST_PROMPT) {
-				if (bi_putstr(si_ic(si), appctx->st1 ? "\n> " : "\n") != -1)
+				if (binary)
+					reql = bi_putblk(si_ic(si), "\0\0\0\0", 4);
+				else
+					reql = bi_putstr(si_ic(si), (appctx->st1 & APPCTX_CLI_ST1_PROMPT) ? "\n> " : "\n");
+
+				if (reql != -1)
 					appctx->st0 = CLI_ST_GETREQ;
 				else
 					si_applet_cant_put(si);
@@ -634,9 +1056,12 @@ static void cli_io_handler(struct appctx *appctx)
 			/* Now we close the output if one of the writers did so,
 			 * or if we're not in interactive mode and the request
 			 * buffer is empty. This still allows pipelined requests
-			 * to be sent in non-interactive mode.
+			 * to be sent in non-interactive mode. Binary mode and
+			 * batches under construction are always interactive.
 			 */
-			if ((res->flags & (CF_SHUTW|CF_SHUTW_NOW)) || (!appctx->st1 && !req->buf->o)) {
+			if ((res->flags & (CF_SHUTW|CF_SHUTW_NOW)) ||
+			    (!(appctx->st1 & (APPCTX_CLI_ST1_PROMPT | APPCTX_CLI_ST1_BINARY | APPCTX_CLI_ST1_BATCH)) &&
+			     !req->buf->o)) {
 				appctx->st0 = CLI_ST_END;
 				continue;
 			}
@@ -688,6 +1113,9 @@ static void cli_release_handler(struct appctx *appctx)
 		free(appctx->ctx.cli.err);
 		appctx->ctx.cli.err = NULL;
 	}
+
+	if (appctx->st1 & APPCTX_CLI_ST1_BATCH)
+		cli_batch_release(appctx);
 }
 
 /* This function dumps all environmnent variables to the buffer. It returns 0
@@ -886,11 +1314,11 @@ static int bind_parse_level(char **args, int cur_arg, struct proxy *px, struct b
 	}
 
 	if (!strcmp(args[cur_arg+1], "user"))
-		conf->level = ACCESS_LVL_USER;
+		conf->level = (conf->level & ~ACCESS_LVL_MASK) | ACCESS_LVL_USER;
 	else if (!strcmp(args[cur_arg+1], "operator"))
-		conf->level = ACCESS_LVL_OPER;
+		conf->level = (conf->level & ~ACCESS_LVL_MASK) | ACCESS_LVL_OPER;
 	else if (!strcmp(args[cur_arg+1], "admin"))
-		conf->level = ACCESS_LVL_ADMIN;
+		conf->level = (conf->level & ~ACCESS_LVL_MASK) | ACCESS_LVL_ADMIN;
 	else {
 		memprintf(err, "'%s' only supports 'user', 'operator', and 'admin' (got '%s')",
 			  args[cur_arg], args[cur_arg+1]);
@@ -900,6 +1328,174 @@ static int bind_parse_level(char **args, int cur_arg, struct proxy *px, struct b
 	return 0;
 }
 
+/* parse the "expose-fd" argument on the bind lines */
+static int bind_parse_expose_fd(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
+{
+	if (!*args[cur_arg + 1]) {
+		memprintf(err, "'%s' : missing fd type", args[cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+	if (!strcmp(args[cur_arg+1], "listeners")) {
+		conf->level |= ACCESS_FD_LISTENERS;
+	} else {
+		memprintf(err, "'%s' only supports 'listeners' (got '%s')",
+			  args[cur_arg], args[cur_arg+1]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	return 0;
+}
+
+/* Appends the description of listener <l> to <buf> at offset <ofs> for
+ * _getsocks and returns the new offset : the length and name of the interface,
+ * the length and name of the network namespace, and the listener's options.
+ * LI_O_GRP_ORDER tells the new process whether it may rely on the order of the
+ * sockets to know their position in their SO_REUSEPORT group.
+ */
+static int cli_getsocks_describe(const struct listener *l, unsigned char *buf, int ofs)
+{
+	const char *ns = NULL;
+	int len, opts;
+
+	len = l->interface ? MIN(strlen(l->interface), 255) : 0;
+	buf[ofs++] = len;
+	memcpy(buf + ofs, l->interface, len);
+	ofs += len;
+#ifdef CONFIG_HAP_NS
+	if (l->netns)
+		ns = l->netns->node.key;
+#endif
+	len = ns ? MIN(strlen(ns), 255) : 0;
+	buf[ofs++] = len;
+	memcpy(buf + ofs, ns, len);
+	ofs += len;
+	opts = l->options & (LI_O_XFER_MASK | LI_O_GRP_ORDER);
+	memcpy(buf + ofs, &opts, sizeof(opts));
+	return ofs + sizeof(opts);
+}
+
+/* Sends all the TCP listening sockets of this process over the UNIX socket
+ * used by the CLI session with SCM_RIGHTS, so that a new process started with
+ * "-x" may reuse them instead of binding new ones. This is only allowed on
+ * sockets declared with "expose-fd listeners". The number of sockets is sent
+ * first, then batches of up to MAX_SEND_FD sockets, each carrying the length
+ * of its data followed by the description of each socket. The socket is
+ * temporarily switched to blocking mode, the peer being expected to read
+ * everything at once.
+ */
+static int _getsocks(char **args, struct appctx *appctx, void *private)
+{
+	struct stream_interface *si = appctx->owner;
+	struct stream *s = si_strm(si);
+	struct connection *remote = objt_conn(strm_orig(s));
+	struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+	unsigned char *tmpbuf = NULL;
+	char *cmsgbuf = NULL;
+	struct cmsghdr *cmsg;
+	struct msghdr msghdr;
+	struct iovec iov;
+	struct listener *l;
+	struct proxy *px;
+	int *tmpfd;
+	int tot_fd_nb = 0;
+	int nb = 0, done = 0;
+	int curoff;
+	int old_fcntl = -1;
+	int fd;
+
+	if (!(strm_li(s)->bind_conf->level & ACCESS_FD_LISTENERS)) {
+		appctx->ctx.cli.msg = stats_permission_denied_msg;
+		appctx->st0 = CLI_ST_PRINT;
+		return 1;
+	}
+
+	if (!remote || strm_li(s)->proto->sock_family != AF_UNIX) {
+		appctx->ctx.cli.msg = "Sockets may only be passed over a UNIX socket.\n";
+		appctx->st0 = CLI_ST_PRINT;
+		return 1;
+	}
+	fd = remote->t.sock.fd;
+
+	cmsgbuf = malloc(CMSG_SPACE(sizeof(int) * MAX_SEND_FD));
+	tmpbuf = malloc(sizeof(int) + MAX_SEND_FD * (1 + 255 + 1 + 255 + sizeof(int)));
+	if (!cmsgbuf || !tmpbuf) {
+		Warning("Failed to allocate memory to send sockets\n");
+		goto out;
+	}
+
+	/* the peer reads everything at once, it's much simpler to block here */
+	old_fcntl = fcntl(fd, F_GETFL);
+	if (old_fcntl < 0 || fcntl(fd, F_SETFL, old_fcntl & ~O_NONBLOCK) == -1) {
+		Warning("Cannot make the unix socket blocking\n");
+		old_fcntl = -1;
+		goto out;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	for (px = proxy; px; px = px->next) {
+		list_for_each_entry(l, &px->conf.listeners, by_fe) {
+			if (l->state >= LI_LISTEN && l->fd >= 0 &&
+			    l->proto->sock_type == SOCK_STREAM &&
+			    (l->proto->sock_family == AF_INET || l->proto->sock_family == AF_INET6))
+				tot_fd_nb++;
+		}
+	}
+
+	memset(&msghdr, 0, sizeof(msghdr));
+	msghdr.msg_iov = &iov;
+	msghdr.msg_iovlen = 1;
+	iov.iov_base = &tot_fd_nb;
+	iov.iov_len = sizeof(tot_fd_nb);
+	if (sendmsg(fd, &msghdr, 0) != sizeof(tot_fd_nb)) {
+		Warning("Failed to send the number of sockets to send\n");
+		goto out;
+	}
+
+	curoff = sizeof(int);
+	tmpfd = (int *)CMSG_DATA((struct cmsghdr *)cmsgbuf);
+	for (px = proxy; px && done < tot_fd_nb; px = px->next) {
+		list_for_each_entry(l, &px->conf.listeners, by_fe) {
+			if (!(l->state >= LI_LISTEN && l->fd >= 0 &&
+			      l->proto->sock_type == SOCK_STREAM &&
+			      (l->proto->sock_family == AF_INET || l->proto->sock_family == AF_INET6)))
+				continue;
+
+			tmpfd[nb++] = l->fd;
+			curoff = cli_getsocks_describe(l, tmpbuf, curoff);
+			done++;
+
+			if (nb < MAX_SEND_FD && done < tot_fd_nb)
+				continue;
+
+			/* send this batch */
+			memcpy(tmpbuf, &curoff, sizeof(int));
+			iov.iov_base = tmpbuf;
+			iov.iov_len = curoff;
+			msghdr.msg_control = cmsgbuf;
+			msghdr.msg_controllen = CMSG_SPACE(sizeof(int) * nb);
+			cmsg = CMSG_FIRSTHDR(&msghdr);
+			cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nb);
+			cmsg->cmsg_level = SOL_SOCKET;
+			cmsg->cmsg_type = SCM_RIGHTS;
+			if (sendmsg(fd, &msghdr, 0) != curoff) {
+				Warning("Failed to transfer sockets\n");
+				goto out;
+			}
+			nb = 0;
+			curoff = sizeof(int);
+			if (done >= tot_fd_nb)
+				break;
+		}
+	}
+
+ out:
+	if (old_fcntl >= 0)
+		fcntl(fd, F_SETFL, old_fcntl);
+	free(cmsgbuf);
+	free(tmpbuf);
+	return 1;
+}
+
 static struct applet cli_applet = {
 	.obj_type = OBJ_TYPE_APPLET,
 	.name = "<CLI>", /* used for logging */
@@ -913,6 +1509,7 @@ static struct cli_kw_list cli_kws = {{ },{
 	{ { "set", "rate-limit", NULL }, "set rate-limit : change a rate limiting value", cli_parse_set_ratelimit, NULL },
 	{ { "set", "timeout",  NULL }, "set timeout    : change a timeout setting", cli_parse_set_timeout, NULL, NULL },
 	{ { "show", "env",  NULL }, "show env [var] : dump environment variables known to the process", cli_parse_show_env, cli_io_handler_show_env, NULL },
+	{ { "_getsocks", NULL }, NULL,  _getsocks, NULL },
 	{{},}
 }};
 
@@ -922,7 +1519,8 @@ static struct cfg_kw_list cfg_kws = {ILH, {
 }};
 
 static struct bind_kw_list bind_kws = { "STAT", { }, {
-	{ "level",    bind_parse_level,    1 }, /* set the unix socket admin level */
+	{ "level",     bind_parse_level,    1 }, /* set the unix socket admin level */
+	{ "expose-fd", bind_parse_expose_fd, 1 }, /* set the unix socket expose fd rights */
 	{ NULL, NULL, 0 },
 }};
 
@@ -27,6 +27,7 @@
 #endif /* USE_ZLIB */
 
 #include <common/compat.h>
+#include <common/hash.h>
 #include <common/memory.h>
 
 #include <types/global.h>
@@ -51,8 +52,20 @@ static struct pool_head *zlib_pool_prev = NULL;
 static struct pool_head *zlib_pool_head = NULL;
 static struct pool_head *zlib_pool_pending_buf = NULL;
 
+#endif
+
+#if defined(USE_ZLIB) || defined(USE_BROTLI) || defined(USE_ZSTD)
+/* memory used by all the compression libraries, limited by "maxzlibmem" */
 long zlib_used_memory = 0;
+#endif
 
+/* zstd uses the same window size as zlib so that its memory usage remains
+ * comparable. It refuses windows smaller than 1kB.
+ */
+#ifdef USE_ZLIB
+#define COMP_WINDOW_BITS  MAX(10, global.tune.zlibwindowsize)
+#else
+#define COMP_WINDOW_BITS  15
 #endif
 
 unsigned int compress_min_idle = 0;
@@ -76,6 +89,9 @@ static int rfc195x_end(struct comp_ctx **comp_ctx);
 #elif defined(USE_ZLIB)
 
 static int gzip_init(struct comp_ctx **comp_ctx, int level);
+static int gzip_add_data(struct comp_ctx *comp_ctx, const char *in_data, int in_len, struct buffer *out);
+static int gzip_flush(struct comp_ctx *comp_ctx, struct buffer *out);
+static int gzip_finish(struct comp_ctx *comp_ctx, struct buffer *out);
 static int raw_def_init(struct comp_ctx **comp_ctx, int level);
 static int deflate_init(struct comp_ctx **comp_ctx, int level);
 static int deflate_add_data(struct comp_ctx *comp_ctx, const char *in_data, int in_len, struct buffer *out);
@@ -85,6 +101,26 @@ static int deflate_end(struct comp_ctx **comp_ctx);
 
 #endif /* USE_ZLIB */
 
+#if defined(USE_BROTLI)
+
+static int brotli_init(struct comp_ctx **comp_ctx, int level);
+static int brotli_add_data(struct comp_ctx *comp_ctx, const char *in_data, int in_len, struct buffer *out);
+static int brotli_flush(struct comp_ctx *comp_ctx, struct buffer *out);
+static int brotli_finish(struct comp_ctx *comp_ctx, struct buffer *out);
+static int brotli_end(struct comp_ctx **comp_ctx);
+
+#endif /* USE_BROTLI */
+
+#if defined(USE_ZSTD)
+
+static int zstd_init(struct comp_ctx **comp_ctx, int level);
+static int zstd_add_data(struct comp_ctx *comp_ctx, const char *in_data, int in_len, struct buffer *out);
+static int zstd_flush(struct comp_ctx *comp_ctx, struct buffer *out);
+static int zstd_finish(struct comp_ctx *comp_ctx, struct buffer *out);
+static int zstd_end(struct comp_ctx **comp_ctx);
+
+#endif /* USE_ZSTD */
+
 
 const struct comp_algo comp_algos[] =
 {
@@ -96,8 +132,14 @@ const struct comp_algo comp_algos[] =
 #elif defined(USE_ZLIB)
 	{ "deflate",      7, "deflate",  7, deflate_init,  deflate_add_data,  deflate_flush,  deflate_finish,  deflate_end },
 	{ "raw-deflate", 11, "deflate",  7, raw_def_init,  deflate_add_data,  deflate_flush,  deflate_finish,  deflate_end },
-	{ "gzip",         4, "gzip",     4, gzip_init,     deflate_add_data,  deflate_flush,  deflate_finish,  deflate_end },
+	{ "gzip",         4, "gzip",     4, gzip_init,     gzip_add_data,     gzip_flush,     gzip_finish,     deflate_end },
 #endif /* USE_ZLIB */
+#if defined(USE_BROTLI)
+	{ "br",           2, "br",       2, brotli_init,   brotli_add_data,   brotli_flush,   brotli_finish,   brotli_end },
+#endif /* USE_BROTLI */
+#if defined(USE_ZSTD)
+	{ "zstd",         4, "zstd",     4, zstd_init,     zstd_add_data,     zstd_flush,     zstd_finish,     zstd_end },
+#endif /* USE_ZSTD */
 	{ NULL,       0, NULL,          0, NULL ,         NULL,              NULL,           NULL,           NULL }
 };
 
@@ -136,7 +178,7 @@ int comp_append_algo(struct comp *comp, const char *algo)
 	return -1;
 }
 
-#if defined(USE_ZLIB) || defined(USE_SLZ)
+#if defined(USE_ZLIB) || defined(USE_SLZ) || defined(USE_BROTLI) || defined(USE_ZSTD)
 static struct pool_head *pool_comp_ctx = NULL;
 /*
  * Alloc the comp_ctx
@@ -156,6 +198,14 @@ static inline int init_comp_ctx(struct comp_ctx **comp_ctx)
 	*comp_ctx = pool_alloc2(pool_comp_ctx);
 	if (*comp_ctx == NULL)
 		return -1;
+	(*comp_ctx)->mem = sizeof(struct comp_ctx);
+#ifdef USE_BROTLI
+	(*comp_ctx)->br = NULL;
+#endif
+#ifdef USE_ZSTD
+	(*comp_ctx)->zstd = NULL;
+	(*comp_ctx)->zstd_mem = 0;
+#endif
 #if defined(USE_SLZ)
 	(*comp_ctx)->direct_ptr = NULL;
 	(*comp_ctx)->direct_len = 0;
@@ -249,6 +299,7 @@ static int rfc1952_init(struct comp_ctx **comp_ctx, int level)
 		return -1;
 
 	(*comp_ctx)->cur_lvl = !!level;
+	(*comp_ctx)->max_lvl = level;
 	return slz_rfc1952_init(&(*comp_ctx)->strm, !!level);
 }
 
@@ -259,6 +310,7 @@ static int rfc1951_init(struct comp_ctx **comp_ctx, int level)
 		return -1;
 
 	(*comp_ctx)->cur_lvl = !!level;
+	(*comp_ctx)->max_lvl = level;
 	return slz_rfc1951_init(&(*comp_ctx)->strm, !!level);
 }
 
@@ -269,6 +321,7 @@ static int rfc1950_init(struct comp_ctx **comp_ctx, int level)
 		return -1;
 
 	(*comp_ctx)->cur_lvl = !!level;
+	(*comp_ctx)->max_lvl = level;
 	return slz_rfc1950_init(&(*comp_ctx)->strm, !!level);
 }
 
@@ -355,7 +408,7 @@ static int rfc195x_flush_or_finish(struct comp_ctx *comp_ctx, struct buffer *out
 		if (comp_ctx->cur_lvl > 0)
 			strm->level = --comp_ctx->cur_lvl;
 	}
-	else if (comp_ctx->cur_lvl < global.tune.comp_maxlevel && comp_ctx->cur_lvl < 1) {
+	else if (comp_ctx->cur_lvl < comp_ctx->max_lvl && comp_ctx->cur_lvl < 1) {
 		strm->level = ++comp_ctx->cur_lvl;
 	}
 
@@ -432,8 +485,10 @@ static void *alloc_zlib(void *opaque, unsigned int items, unsigned int size)
 			ctx->zlib_pending_buf = buf = pool_alloc2(pool);
 		break;
 	}
-	if (buf != NULL)
+	if (buf != NULL) {
 		zlib_used_memory += pool->size;
+		ctx->mem += pool->size;
+	}
 
 end:
 
@@ -465,30 +520,122 @@ static void free_zlib(void *opaque, void *ptr)
 
 	pool_free2(pool, ptr);
 	zlib_used_memory -= pool->size;
+	ctx->mem -= pool->size;
 }
 
 /**************************
 ****  gzip algorithm   ****
 ***************************/
+
+/* When the CPU supports carry-less multiplications, the gzip CRC is faster
+ * computed by hash_crc32_update() than by zlib. zlib then produces a raw
+ * deflate stream and the gzip header and trailer (RFC1952) are emitted here.
+ */
 static int gzip_init(struct comp_ctx **comp_ctx, int level)
 {
 	z_stream *strm;
+	int wbits;
 
 	if (init_comp_ctx(comp_ctx) < 0)
 		return -1;
 
 	strm = &(*comp_ctx)->strm;
 
-	if (deflateInit2(strm, level, Z_DEFLATED, global.tune.zlibwindowsize + 16, global.tune.zlibmemlevel, Z_DEFAULT_STRATEGY) != Z_OK) {
+	wbits = global.tune.zlibwindowsize + 16;
+	if (hash_crc32_accelerated())
+		wbits = -global.tune.zlibwindowsize;
+
+	if (deflateInit2(strm, level, Z_DEFLATED, wbits, global.tune.zlibmemlevel, Z_DEFAULT_STRATEGY) != Z_OK) {
 		deinit_comp_ctx(comp_ctx);
 		return -1;
 	}
 
+	(*comp_ctx)->gz_crc  = 0;
+	(*comp_ctx)->gz_size = 0;
+	(*comp_ctx)->gz_hdr  = !hash_crc32_accelerated(); /* zlib does it */
 	(*comp_ctx)->cur_lvl = level;
+	(*comp_ctx)->max_lvl = level;
 
 	return 0;
 }
 
+/* Emits the gzip header if not done yet. Returns -1 if there's no room */
+static int gzip_put_header(struct comp_ctx *comp_ctx, struct buffer *out)
+{
+	static const char hdr[10] = { 0x1f, 0x8b, Z_DEFLATED, 0, 0, 0, 0, 0, 0, 3 /* unix */ };
+
+	if (comp_ctx->gz_hdr)
+		return 0;
+
+	if (out->size - buffer_len(out) < (int)sizeof(hdr))
+		return -1;
+
+	memcpy(bi_end(out), hdr, sizeof(hdr));
+	out->i += sizeof(hdr);
+	comp_ctx->gz_hdr = 1;
+	return 0;
+}
+
+/* Return the size of consumed data or -1 */
+static int gzip_add_data(struct comp_ctx *comp_ctx, const char *in_data, int in_len, struct buffer *out)
+{
+	int ret;
+
+	if (!hash_crc32_accelerated())
+		return deflate_add_data(comp_ctx, in_data, in_len, out);
+
+	if (in_len <= 0)
+		return 0;
+
+	if (gzip_put_header(comp_ctx, out) < 0)
+		return -1;
+
+	ret = deflate_add_data(comp_ctx, in_data, in_len, out);
+	if (ret > 0) {
+		comp_ctx->gz_crc = hash_crc32_update(comp_ctx->gz_crc, in_data, ret);
+		comp_ctx->gz_size += ret;
+	}
+	return ret;
+}
+
+static int gzip_flush(struct comp_ctx *comp_ctx, struct buffer *out)
+{
+	if (gzip_put_header(comp_ctx, out) < 0)
+		return -1;
+
+	return deflate_flush(comp_ctx, out);
+}
+
+static int gzip_finish(struct comp_ctx *comp_ctx, struct buffer *out)
+{
+	unsigned char *p;
+	int ret;
+
+	if (!hash_crc32_accelerated())
+		return deflate_finish(comp_ctx, out);
+
+	if (gzip_put_header(comp_ctx, out) < 0)
+		return -1;
+
+	/* zlib needs to be called again when it fills the output */
+	ret = deflate_finish(comp_ctx, out);
+	if (ret < 0 || !comp_ctx->strm.avail_out || out->size - buffer_len(out) < 8)
+		return -1;
+
+	/* trailer : CRC32 and input size, little endian */
+	p = (unsigned char *)bi_end(out);
+	p[0] = comp_ctx->gz_crc;
+	p[1] = comp_ctx->gz_crc >> 8;
+	p[2] = comp_ctx->gz_crc >> 16;
+	p[3] = comp_ctx->gz_crc >> 24;
+	p[4] = comp_ctx->gz_size;
+	p[5] = comp_ctx->gz_size >> 8;
+	p[6] = comp_ctx->gz_size >> 16;
+	p[7] = comp_ctx->gz_size >> 24;
+	out->i += 8;
+	return ret + 8;
+}
+
 /* Raw deflate algorithm */
 static int raw_def_init(struct comp_ctx **comp_ctx, int level)
 {
@@ -505,6 +652,7 @@ static int raw_def_init(struct comp_ctx **comp_ctx, int level)
 	}
 
 	(*comp_ctx)->cur_lvl = level;
+	(*comp_ctx)->max_lvl = level;
 	return 0;
 }
 
@@ -527,6 +675,7 @@ static int deflate_init(struct comp_ctx **comp_ctx, int level)
 	}
 
 	(*comp_ctx)->cur_lvl = level;
+	(*comp_ctx)->max_lvl = level;
 
 	return 0;
 }
@@ -588,7 +737,7 @@ static int deflate_flush_or_finish(struct comp_ctx *comp_ctx, struct buffer *out
 			deflateParams(&comp_ctx->strm, comp_ctx->cur_lvl, Z_DEFAULT_STRATEGY);
 		}
 
-	} else if (comp_ctx->cur_lvl < global.tune.comp_maxlevel) {
+	} else if (comp_ctx->cur_lvl < comp_ctx->max_lvl) {
 		/* increase level */
 		comp_ctx->cur_lvl++ ;
 		deflateParams(&comp_ctx->strm, comp_ctx->cur_lvl, Z_DEFAULT_STRATEGY);
@@ -621,6 +770,311 @@ static int deflate_end(struct comp_ctx **comp_ctx)
 
 #endif /* USE_ZLIB */
 
+#ifdef USE_BROTLI
+
+/*************************
+**** Brotli algorithm ****
+**************************/
+
+/* Brotli allocations are accounted in zlib_used_memory and in the comp_ctx
+ * passed as <opaque>. The encoder aborts the whole process when an allocation
+ * fails, so "maxzlibmem" is only enforced by brotli_init() before creating the
+ * encoder, and the allocator never refuses memory once it exists. The library
+ * does not pass the size on free, so it is stored in front of each area (16
+ * bytes to preserve malloc()'s alignment).
+ */
+#define BROTLI_ALLOC_HDR 16
+
+static void *alloc_brotli(void *opaque, size_t size)
+{
+	struct comp_ctx *ctx = opaque;
+	char *ptr;
+
+	ptr = malloc(size + BROTLI_ALLOC_HDR);
+	if (!ptr)
+		return NULL;
+	*(size_t *)ptr = size + BROTLI_ALLOC_HDR;
+	zlib_used_memory += size + BROTLI_ALLOC_HDR;
+	ctx->mem += size + BROTLI_ALLOC_HDR;
+	return ptr + BROTLI_ALLOC_HDR;
+}
+
+static void free_brotli(void *opaque, void *address)
+{
+	struct comp_ctx *ctx = opaque;
+	char *ptr = address;
+
+	if (!ptr)
+		return;
+	ptr -= BROTLI_ALLOC_HDR;
+	zlib_used_memory -= *(size_t *)ptr;
+	ctx->mem -= *(size_t *)ptr;
+	free(ptr);
+}
+
+/* Brotli's qualities are not comparable to zlib's levels: below quality 4 it
+ * compresses worse than deflate, and qualities 9 and above are very slow. So
+ * the compression level is mapped to a quality between 4 and 11 using this
+ * table. Brotli also needs a larger window than zlib to make a difference, so
+ * it always uses a 256kB window.
+ */
+#define BROTLI_WINDOW_BITS 18
+
+static const int brotli_quality[10] = { 4, 4, 4, 5, 5, 5, 6, 6, 7, 11 };
+
+/* Peak memory used by an encoder for each quality with BROTLI_WINDOW_BITS, in
+ * kB, as measured when compressing large text files without flushing.
+ */
+static const int brotli_mem_kb[BROTLI_MAX_QUALITY + 1] = {
+	160, 160, 1400, 1400, 4000, 4500, 5500, 12000, 20500, 39500, 13000, 22500
+};
+
+/* The level is mapped to a brotli quality using brotli_quality[]. Returns < 0
+ * on error, in which case the response is not compressed. The whole budget the
+ * encoder may need is checked here since its allocations cannot fail later.
+ */
+static int brotli_init(struct comp_ctx **comp_ctx, int level)
+{
+	BrotliEncoderState *br;
+	int quality;
+
+	if (level < 0)
+		level = 0;
+	if (level > 9)
+		level = 9;
+	quality = brotli_quality[level];
+
+	if (global.maxzlibmem > 0 &&
+	    (global.maxzlibmem - zlib_used_memory) < brotli_mem_kb[quality] * 1024L)
+		return -1;
+
+	if (init_comp_ctx(comp_ctx) < 0)
+		return -1;
+
+	br = BrotliEncoderCreateInstance(alloc_brotli, free_brotli, *comp_ctx);
+	if (!br) {
+		deinit_comp_ctx(comp_ctx);
+		return -1;
+	}
+
+	BrotliEncoderSetParameter(br, BROTLI_PARAM_QUALITY, quality);
+	BrotliEncoderSetParameter(br, BROTLI_PARAM_LGWIN, BROTLI_WINDOW_BITS);
+	BrotliEncoderSetParameter(br, BROTLI_PARAM_MODE, BROTLI_MODE_TEXT);
+
+	(*comp_ctx)->br = br;
+	(*comp_ctx)->cur_lvl = quality;
+	(*comp_ctx)->max_lvl = quality;
+	return 0;
+}
+
+/* Runs the encoder with operation <op> on <in_len> bytes from <in_data>. It
+ * stops when everything was consumed and no more output is pending, or when
+ * the output buffer is full. Returns the number of bytes consumed or -1.
+ */
+static int brotli_run(struct comp_ctx *comp_ctx, BrotliEncoderOperation op,
+                      const char *in_data, int in_len, struct buffer *out)
+{
+	const uint8_t *next_in = (const uint8_t *)in_data;
+	size_t avail_in = in_len;
+	int out_len = out->size - buffer_len(out);
+	uint8_t *next_out = (uint8_t *)bi_end(out);
+	size_t avail_out = out_len;
+
+	if (out_len <= 0)
+		return -1;
+
+	do {
+		if (!BrotliEncoderCompressStream(comp_ctx->br, op, &avail_in, &next_in,
+		                                 &avail_out, &next_out, NULL))
+			return -1;
+	} while (avail_out && (avail_in || BrotliEncoderHasMoreOutput(comp_ctx->br)));
+
+	out->i += out_len - avail_out;
+	return in_len - avail_in;
+}
+
+static int brotli_add_data(struct comp_ctx *comp_ctx, const char *in_data, int in_len, struct buffer *out)
+{
+	if (in_len <= 0)
+		return 0;
+
+	return brotli_run(comp_ctx, BROTLI_OPERATION_PROCESS, in_data, in_len, out);
+}
+
+/* Brotli does not support changing the quality once the stream has started,
+ * so unlike deflate, the level is not adjusted here.
+ */
+static int brotli_flush_or_finish(struct comp_ctx *comp_ctx, struct buffer *out, BrotliEncoderOperation op)
+{
+	int out_len = out->i;
+
+	if (brotli_run(comp_ctx, op, NULL, 0, out) < 0)
+		return -1;
+
+	return out->i - out_len;
+}
+
+static int brotli_flush(struct comp_ctx *comp_ctx, struct buffer *out)
+{
+	return brotli_flush_or_finish(comp_ctx, out, BROTLI_OPERATION_FLUSH);
+}
+
+static int brotli_finish(struct comp_ctx *comp_ctx, struct buffer *out)
+{
+	return brotli_flush_or_finish(comp_ctx, out, BROTLI_OPERATION_FINISH);
+}
+
+static int brotli_end(struct comp_ctx **comp_ctx)
+{
+	BrotliEncoderDestroyInstance((*comp_ctx)->br);
+	deinit_comp_ctx(comp_ctx);
+	return 0;
+}
+
+#endif /* USE_BROTLI */
+
+#ifdef USE_ZSTD
+
+/***********************
+**** Zstd algorithm ****
+************************/
+
+/* zstd allocates its tables on first use and only offers a custom allocator
+ * through its experimental API. So the memory is accounted after each call
+ * using ZSTD_sizeof_CStream(), and the initialization refuses to start a new
+ * stream if "maxzlibmem" does not leave room for about three windows.
+ */
+static void zstd_account(struct comp_ctx *comp_ctx)
+{
+	size_t mem = ZSTD_sizeof_CStream(comp_ctx->zstd);
+
+	zlib_used_memory += (long)mem - (long)comp_ctx->zstd_mem;
+	comp_ctx->mem += (long)mem - (long)comp_ctx->zstd_mem;
+	comp_ctx->zstd_mem = mem;
+}
+
+/* The level is used as zstd's compression level. Level 0 means "default" to
+ * zstd, so the lowest level used is 1. Returns < 0 on error.
+ */
+static int zstd_init(struct comp_ctx **comp_ctx, int level)
+{
+	ZSTD_CStream *zstd;
+
+	if (global.maxzlibmem > 0 &&
+	    (global.maxzlibmem - zlib_used_memory) < (3L << COMP_WINDOW_BITS))
+		return -1;
+
+	if (init_comp_ctx(comp_ctx) < 0)
+		return -1;
+
+	zstd = ZSTD_createCStream();
+	if (!zstd) {
+		deinit_comp_ctx(comp_ctx);
+		return -1;
+	}
+
+	if (level < 1)
+		level = 1;
+	if (ZSTD_isError(ZSTD_CCtx_setParameter(zstd, ZSTD_c_compressionLevel, level)) ||
+	    ZSTD_isError(ZSTD_CCtx_setParameter(zstd, ZSTD_c_windowLog, COMP_WINDOW_BITS))) {
+		ZSTD_freeCStream(zstd);
+		deinit_comp_ctx(comp_ctx);
+		return -1;
+	}
+
+	(*comp_ctx)->zstd = zstd;
+	(*comp_ctx)->cur_lvl = level;
+	(*comp_ctx)->max_lvl = level;
+	zstd_account(*comp_ctx);
+	return 0;
+}
+
+/* Return the size of consumed data or -1 */
+static int zstd_add_data(struct comp_ctx *comp_ctx, const char *in_data, int in_len, struct buffer *out)
+{
+	ZSTD_inBuffer  ib = { in_data, in_len, 0 };
+	ZSTD_outBuffer ob = { bi_end(out), out->size - buffer_len(out), 0 };
+	size_t ret;
+
+	if (in_len <= 0)
+		return 0;
+
+	if ((int)ob.size <= 0)
+		return -1;
+
+	ret = ZSTD_compressStream2(comp_ctx->zstd, &ob, &ib, ZSTD_e_continue);
+	zstd_account(comp_ctx);
+	if (ZSTD_isError(ret))
+		return -1;
+
+	out->i += ob.pos;
+	return ib.pos;
+}
+
+/* Unlike deflate, zstd only applies a new compression level to the next
+ * frame. So when the compression limits require another level, the flush
+ * ends the current frame, and the next data start a new one at the new level.
+ * Decoders process concatenated frames as a single stream.
+ */
+static int zstd_flush_or_finish(struct comp_ctx *comp_ctx, struct buffer *out, ZSTD_EndDirective mode)
+{
+	ZSTD_inBuffer  ib = { NULL, 0, 0 };
+	ZSTD_outBuffer ob = { bi_end(out), out->size - buffer_len(out), 0 };
+	int level = comp_ctx->cur_lvl;
+	size_t ret;
+
+	/* compression limit */
+	if ((global.comp_rate_lim > 0 && (read_freq_ctr(&global.comp_bps_out) > global.comp_rate_lim)) ||    /* rate */
+	   (idle_pct < compress_min_idle)) {                                                                     /* idle */
+		/* decrease level */
+		if (level > 1)
+			level--;
+	} else if (level < comp_ctx->max_lvl) {
+		/* increase level */
+		level++;
+	}
+
+	if (level != comp_ctx->cur_lvl)
+		mode = ZSTD_e_end;
+
+	do {
+		ret = ZSTD_compressStream2(comp_ctx->zstd, &ob, &ib, mode);
+		if (ZSTD_isError(ret))
+			return -1;
+	} while (ret && ob.pos < ob.size);
+
+	zstd_account(comp_ctx);
+	out->i += ob.pos;
+
+	/* the frame is complete, the next one will use the new level */
+	if (!ret && level != comp_ctx->cur_lvl) {
+		comp_ctx->cur_lvl = level;
+		ZSTD_CCtx_setParameter(comp_ctx->zstd, ZSTD_c_compressionLevel, level);
+	}
+
+	return ob.pos;
+}
+
+static int zstd_flush(struct comp_ctx *comp_ctx, struct buffer *out)
+{
+	return zstd_flush_or_finish(comp_ctx, out, ZSTD_e_flush);
+}
+
+static int zstd_finish(struct comp_ctx *comp_ctx, struct buffer *out)
+{
+	return zstd_flush_or_finish(comp_ctx, out, ZSTD_e_end);
+}
+
+static int zstd_end(struct comp_ctx **comp_ctx)
+{
+	zlib_used_memory -= (*comp_ctx)->zstd_mem;
+	ZSTD_freeCStream((*comp_ctx)->zstd);
+	deinit_comp_ctx(comp_ctx);
+	return 0;
+}
+
+#endif /* USE_ZSTD */
+
 __attribute__((constructor))
 static void __comp_fetch_init(void)
 {
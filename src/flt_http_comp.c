@@ -12,6 +12,7 @@
 
 #include <common/buffer.h>
 #include <common/cfgparse.h>
+#include <common/hash.h>
 #include <common/mini-clist.h>
 #include <common/standard.h>
 
@@ -21,9 +22,14 @@
 #include <types/proxy.h>
 #include <types/sample.h>
 
+#include <ebsttree.h>
+
+#include <proto/channel.h>
 #include <proto/compression.h>
 #include <proto/filters.h>
+#include <proto/flt_http_comp.h>
 #include <proto/hdr_idx.h>
+#include <proto/log.h>
 #include <proto/proto_http.h>
 #include <proto/sample.h>
 #include <proto/stream.h>
@@ -32,7 +38,6 @@ static const char *http_comp_flt_id = "compression filter";
 
 struct flt_ops comp_ops;
 
-static struct buffer *tmpbuf = &buf_empty;
 static struct buffer *zbuf   = &buf_empty;
 
 struct comp_state {
@@ -43,30 +48,224 @@ struct comp_state {
 	int consumed;
 	int initialized;
 	int finished;
+	unsigned int hist_key;        /* governor: hash of the URL prefix and content-type */
+	unsigned long long bytes_in;  /* bytes compressed for this stream */
+	unsigned long long bytes_out; /* bytes emitted for this stream */
+	char *orig_uri;               /* original URI when a precompressed variant was requested (pool2_requri) */
+	int orig_uri_len;
+	int orig_path_ofs;            /* position of the path in orig_uri, see comp_novar */
+	int orig_path_len;
+};
+
+/* The compression governor keeps, per URL prefix and content-type, the amount
+ * of data before and after compression, in a small direct-mapped table. New
+ * keys simply evict older ones sharing the same slot. Counters are halved once
+ * they reach COMP_HIST_MAX_IN so that the ratio follows recent changes.
+ */
+#define COMP_HIST_SIZE    1024                /* number of entries, power of 2 */
+#define COMP_HIST_MIN_IN  (64 * 1024)         /* trust an entry after this many bytes */
+#define COMP_HIST_MAX_IN  (16 * 1024 * 1024)  /* halve an entry's counters past this */
+
+struct comp_hist {
+	unsigned int key;             /* hash of the URL prefix and content-type */
+	unsigned int skips;           /* responses skipped, used to retry once in a while */
+	unsigned long long in;        /* decayed bytes before compression */
+	unsigned long long out;       /* decayed bytes after compression */
 };
 
+static struct comp_hist comp_hist[COMP_HIST_SIZE];
+
+/* Paths for which the server has no precompressed variant, learnt from 404
+ * responses. Entries are indexed by their full path in a tree, and are also
+ * linked by expiration date. They expire after COMP_NOVAR_TIMEOUT so that
+ * variants added later are eventually used. Once COMP_NOVAR_MAX entries are
+ * known, learning a new path evicts the oldest one. This is only an
+ * optimization: the redirect emitted on a 404 carries COMP_NOVAR_ARG in its
+ * query string, which prevents the retried request from being rewritten
+ * again even if its path could not be learnt or was learnt by another process.
+ */
+#define COMP_NOVAR_MAX      4096              /* max number of entries */
+#define COMP_NOVAR_TIMEOUT  60000             /* ms */
+#define COMP_NOVAR_ARG      "haproxy-novariant"
+#define COMP_NOVAR_ARG_LEN  (sizeof(COMP_NOVAR_ARG) - 1)
+
+struct comp_novar {
+	struct list list;             /* entries by expiration date */
+	unsigned int expire;          /* expiration date (ticks) */
+	struct ebmb_node node;        /* node in comp_novar_tree, the key is the path (must be last) */
+};
+
+static struct eb_root comp_novar_tree = EB_ROOT_UNIQUE;
+static struct list comp_novar_list = LIST_HEAD_INIT(comp_novar_list);
+static unsigned int comp_novar_count;
+
 static int select_compression_request_header(struct comp_state *st,
 					     struct stream *s,
 					     struct http_msg *msg);
 static int select_compression_response_header(struct comp_state *st,
 					      struct stream *s,
 					      struct http_msg *msg);
+static void precompressed_request(struct comp_state *st, struct stream *s,
+				  struct http_msg *msg);
+static void precompressed_response(struct comp_state *st, struct stream *s,
+				   struct http_msg *msg);
 
 static int http_compression_buffer_init(struct buffer *in, struct buffer *out);
 static int http_compression_buffer_add_data(struct comp_state *st,
-					    struct buffer *in,
+					    struct channel *chn, unsigned int ofs,
 					    struct buffer *out, int sz);
 static int http_compression_buffer_end(struct comp_state *st, struct stream *s,
 				       struct buffer **in, struct buffer **out,
 				       int end);
 
 /***********************************************************************/
+/* Returns the number of microseconds elapsed since <tv> */
+static inline unsigned long long
+comp_elapsed_us(const struct timeval *tv)
+{
+	struct timeval now_tv;
+
+	tv_now(&now_tv);
+	return (now_tv.tv_sec - tv->tv_sec) * 1000000LL + now_tv.tv_usec - tv->tv_usec;
+}
+
+/* Returns a hash of the request's path, up to and including its last '/' */
+static unsigned int
+comp_url_prefix_hash(struct http_txn *txn)
+{
+	const char *beg, *end, *ptr;
+
+	beg = http_get_path(txn);
+	if (!beg)
+		return 0;
+	end = txn->req.chn->buf->p + txn->req.sl.rq.u + txn->req.sl.rq.u_l;
+
+	for (ptr = beg; ptr < end && *ptr != '?'; ptr++)
+		;
+	while (ptr > beg && ptr[-1] != '/')
+		ptr--;
+	return hash_crc32(beg, ptr - beg);
+}
+
+/* Accounts the data compressed by the stream in the governor's history */
+static void
+comp_hist_update(const struct comp_state *st)
+{
+	struct comp_hist *h = &comp_hist[st->hist_key & (COMP_HIST_SIZE - 1)];
+
+	if (h->key != st->hist_key) {
+		h->key   = st->hist_key;
+		h->skips = 0;
+		h->in    = 0;
+		h->out   = 0;
+	}
+	h->in  += st->bytes_in;
+	h->out += st->bytes_out;
+	while (h->in > COMP_HIST_MAX_IN) {
+		h->in  /= 2;
+		h->out /= 2;
+	}
+}
+
+/* Returns the compression level the governor picks for the stream, or -1 if
+ * the response should not be compressed at all. It starts from
+ * tune.comp.maxlevel, then:
+ *  - responses whose history shows less than tune.comp.min-savings percent of
+ *    savings are skipped, except one in 16 to notice when this changes ;
+ *  - the level is halved for data saving less than 50%, since higher levels
+ *    bring little on them ;
+ *  - the level is reduced when the CPU idle gets within 20% of the limit set
+ *    by maxcompcpuusage ;
+ *  - the level is halved when the output rate exceeds half of maxcomprate.
+ */
+static int
+comp_governor_level(const struct comp_state *st)
+{
+	struct comp_hist *h = &comp_hist[st->hist_key & (COMP_HIST_SIZE - 1)];
+	int level = global.tune.comp_maxlevel;
+	int savings, headroom;
+
+	if (h->key == st->hist_key && h->in >= COMP_HIST_MIN_IN) {
+		savings = 100 - (int)(h->out * 100 / h->in);
+		if (savings < global.tune.comp_min_savings && (++h->skips & 15))
+			return -1;
+		if (savings < 50)
+			level = (level + 1) / 2;
+	}
+
+	headroom = (int)idle_pct - (int)compress_min_idle;
+	if (headroom < 20)
+		level = level * MAX(headroom, 0) / 20;
+
+	if (global.comp_rate_lim > 0 &&
+	    read_freq_ctr(&global.comp_bps_out) > global.comp_rate_lim / 2)
+		level = (level + 1) / 2;
+
+	return MAX(level, 1);
+}
+
+/* Releases the entries of comp_novar_tree which have expired */
+static void
+comp_novar_purge(void)
+{
+	struct comp_novar *nv, *back;
+
+	list_for_each_entry_safe(nv, back, &comp_novar_list, list) {
+		if (!tick_is_expired(nv->expire, now_ms))
+			break;
+		ebmb_delete(&nv->node);
+		LIST_DEL(&nv->list);
+		free(nv);
+		comp_novar_count--;
+	}
+}
+
+/* Returns non-zero if the server is known to have no precompressed variant
+ * for the <len> bytes path <path>.
+ */
+static int
+comp_novar_lookup(const char *path, int len)
+{
+	comp_novar_purge();
+	return ebst_lookup_len(&comp_novar_tree, path, len) != NULL;
+}
+
+/* Remembers that the server has no precompressed variant for the <len> bytes
+ * path <path>. Nothing is done if it is already known. When the table is full,
+ * the oldest entry is evicted.
+ */
+static void
+comp_novar_learn(const char *path, int len)
+{
+	struct comp_novar *nv;
+
+	comp_novar_purge();
+	if (ebst_lookup_len(&comp_novar_tree, path, len))
+		return;
+
+	if (comp_novar_count >= COMP_NOVAR_MAX) {
+		nv = LIST_ELEM(comp_novar_list.n, struct comp_novar *, list);
+		ebmb_delete(&nv->node);
+		LIST_DEL(&nv->list);
+		free(nv);
+		comp_novar_count--;
+	}
+
+	nv = malloc(sizeof(*nv) + len + 1);
+	if (!nv)
+		return;
+	memcpy(nv->node.key, path, len);
+	nv->node.key[len] = 0;
+	nv->expire = tick_add(now_ms, COMP_NOVAR_TIMEOUT);
+	ebst_insert(&comp_novar_tree, &nv->node);
+	LIST_ADDQ(&comp_novar_list, &nv->list);
+	comp_novar_count++;
+}
+
 static int
 comp_flt_init(struct proxy *px, struct flt_conf *fconf)
 {
 
-	if (!tmpbuf->size && b_alloc(&tmpbuf) == NULL)
-		return -1;
 	if (!zbuf->size && b_alloc(&zbuf) == NULL)
 		return -1;
 	return 0;
@@ -75,8 +274,6 @@ comp_flt_init(struct proxy *px, struct flt_conf *fconf)
 static void
 comp_flt_deinit(struct proxy *px, struct flt_conf *fconf)
 {
-	if (tmpbuf->size)
-		b_free(&tmpbuf);
 	if (zbuf->size)
 		b_free(&zbuf);
 }
@@ -97,6 +294,13 @@ comp_start_analyze(struct stream *s, struct filter *filter, struct channel *chn)
 		st->consumed    = 0;
 		st->initialized = 0;
 		st->finished    = 0;
+		st->hist_key    = 0;
+		st->bytes_in    = 0;
+		st->bytes_out   = 0;
+		st->orig_uri    = NULL;
+		st->orig_uri_len = 0;
+		st->orig_path_ofs = 0;
+		st->orig_path_len = 0;
 		filter->ctx     = st;
 	}
 	return 1;
@@ -118,10 +322,14 @@ comp_end_analyze(struct stream *s, struct filter *filter, struct channel *chn)
 	if ((s->flags & SF_BE_ASSIGNED) && (s->be->mode == PR_MODE_HTTP))
 		s->be->be_counters.p.http.comp_rsp++;
 
+	if (global.tune.comp_governor && st->comp_ctx && st->bytes_in)
+		comp_hist_update(st);
+
 	/* release any possible compression context */
 	st->comp_algo->end(&st->comp_ctx);
 
  release_ctx:
+	pool_free2(pool2_requri, st->orig_uri);
 	free(st);
 	filter->ctx = NULL;
  end:
@@ -139,6 +347,8 @@ comp_http_headers(struct stream *s, struct filter *filter, struct http_msg *msg)
 	if (!(msg->chn->flags & CF_ISRESP))
 		select_compression_request_header(st, s, msg);
 	else {
+		if (st->orig_uri)
+			precompressed_response(st, s, msg);
 		select_compression_response_header(st, s, msg);
 		if (st->comp_algo) {
 			register_data_filter(s, msg->chn, filter);
@@ -163,10 +373,18 @@ comp_http_data(struct stream *s, struct filter *filter, struct http_msg *msg)
 	if (!len)
 		return len;
 
+	/* Each flush costs some compression ratio, especially with brotli. So
+	 * when the body's length is known, data are only compressed once the
+	 * buffer is full or the end of the body was received, in order to
+	 * flush large blocks.
+	 */
+	if (!(msg->flags & HTTP_MSGF_TE_CHNK) && msg->chunk_len + msg->next > buf->i &&
+	    channel_recv_max(msg->chn) > 0 && !(msg->chn->flags & CF_SHUTR))
+		return 0;
+
 	if (!st->initialized) {
 		unsigned int fwd = flt_rsp_fwd(filter) + st->hdrs_len;
 
-		b_reset(tmpbuf);
 		b_adv(buf, fwd);
 		ret = http_compression_buffer_init(buf, zbuf);
 		b_rew(buf, fwd);
@@ -176,28 +394,13 @@ comp_http_data(struct stream *s, struct filter *filter, struct http_msg *msg)
 		}
 	}
 
-	if (msg->flags & HTTP_MSGF_TE_CHNK) {
-		int block;
-
-		len = MIN(tmpbuf->size - buffer_len(tmpbuf), len);
-
-		b_adv(buf, *nxt);
-		block = bi_contig_data(buf);
-		memcpy(bi_end(tmpbuf), bi_ptr(buf), block);
-		if (len > block)
-			memcpy(bi_end(tmpbuf)+block, buf->data, len-block);
-		b_rew(buf, *nxt);
-
-		tmpbuf->i += len;
-		ret        = len;
-	}
-	else {
-		b_adv(buf, *nxt);
-		ret = http_compression_buffer_add_data(st, buf, zbuf, len);
-		b_rew(buf, *nxt);
-		if (ret < 0)
-			return ret;
-	}
+	/* Data are compressed directly from the channel's buffer, for both
+	 * chunked and non-chunked messages. For chunked messages, we are only
+	 * called on the chunks payload, the envelope is skipped.
+	 */
+	ret = http_compression_buffer_add_data(st, msg->chn, *nxt, zbuf, len);
+	if (ret < 0)
+		return ret;
 
 	st->initialized = 1;
 	msg->next      += ret;
@@ -217,7 +420,6 @@ comp_http_chunk_trailers(struct stream *s, struct filter *filter,
 			struct buffer *buf = msg->chn->buf;
 			unsigned int   fwd = flt_rsp_fwd(filter) + st->hdrs_len;
 
-			b_reset(tmpbuf);
 			b_adv(buf, fwd);
 			http_compression_buffer_init(buf, zbuf);
 			b_rew(buf, fwd);
@@ -272,15 +474,6 @@ comp_http_forward_data(struct stream *s, struct filter *filter,
 		return ret;
 	}
 
-	if (msg->flags & HTTP_MSGF_TE_CHNK) {
-		ret = http_compression_buffer_add_data(st, tmpbuf, zbuf, tmpbuf->i);
-		if (ret != tmpbuf->i) {
-			Warning("HTTP compression failed: Must consume %d bytes but only %d bytes consumed\n",
-				tmpbuf->i, ret);
-			return -1;
-		}
-	}
-
 	st->consumed = len - st->hdrs_len - st->tlrs_len;
 	b_adv(msg->chn->buf, flt_rsp_fwd(filter) + st->hdrs_len);
 	ret = http_compression_buffer_end(st, s, &msg->chn->buf, &zbuf, msg->msg_state >= HTTP_MSG_TRAILERS);
@@ -300,6 +493,68 @@ comp_http_forward_data(struct stream *s, struct filter *filter,
 }
 
 /***********************************************************************/
+/*
+ * Returns the q-value (0 to 1000) the client's Accept-Encoding header gives to
+ * algorithm <algo>. An explicit token takes precedence over "*". 0 is
+ * returned if the algorithm is not acceptable or not mentioned.
+ */
+static int
+accept_encoding_qvalue(struct http_txn *txn, struct buffer *req,
+		       const struct comp_algo *algo)
+{
+	struct hdr_ctx ctx;
+	int any_q = 0;
+
+	ctx.idx = 0;
+	while (http_find_header2("Accept-Encoding", 15, req->p, &txn->hdr_idx, &ctx)) {
+		const char *qval;
+		int q;
+		int toklen;
+
+		/* try to isolate the token from the optional q-value */
+		toklen = 0;
+		while (toklen < ctx.vlen && HTTP_IS_TOKEN(*(ctx.line + ctx.val + toklen)))
+			toklen++;
+
+		if (*(ctx.line + ctx.val) != '*' &&
+		    !word_match(ctx.line + ctx.val, toklen, algo->ua_name, algo->ua_name_len))
+			continue;
+
+		qval = ctx.line + ctx.val + toklen;
+		while (1) {
+			while (qval < ctx.line + ctx.val + ctx.vlen && HTTP_IS_LWS(*qval))
+				qval++;
+
+			if (qval >= ctx.line + ctx.val + ctx.vlen || *qval != ';') {
+				qval = NULL;
+				break;
+			}
+			qval++;
+
+			while (qval < ctx.line + ctx.val + ctx.vlen && HTTP_IS_LWS(*qval))
+				qval++;
+
+			if (qval >= ctx.line + ctx.val + ctx.vlen) {
+				qval = NULL;
+				break;
+			}
+			if (strncmp(qval, "q=", MIN(ctx.line + ctx.val + ctx.vlen - qval, 2)) == 0)
+				break;
+
+			while (qval < ctx.line + ctx.val + ctx.vlen && *qval != ';')
+				qval++;
+		}
+
+		/* here we have qval pointing to the first "q=" attribute or NULL if not found */
+		q = qval ? parse_qvalue(qval + 2, NULL) : 1000;
+
+		if (*(ctx.line + ctx.val) != '*')
+			return q;
+		any_q = q;
+	}
+	return any_q;
+}
+
 /*
  * Selects a compression algorithm depending on the client request.
  */
@@ -330,60 +585,24 @@ select_compression_request_header(struct comp_state *st, struct stream *s,
 		return 0;
 	}
 
-	/* search for the algo in the backend in priority or the frontend */
+	if (global.tune.comp_governor)
+		st->hist_key = comp_url_prefix_hash(txn);
+
+	/* search for the algo in the backend in priority or the frontend. The
+	 * client's q-values decide. For equal q-values, the first declared
+	 * algorithm wins. Algorithms are stored in reverse order of declaration,
+	 * hence the ">=" below.
+	 */
 	if ((s->be->comp && (comp_algo_back = s->be->comp->algos)) ||
 	    (strm_fe(s)->comp && (comp_algo_back = strm_fe(s)->comp->algos))) {
 		int best_q = 0;
+		int q;
 
-		ctx.idx = 0;
-		while (http_find_header2("Accept-Encoding", 15, req->p, &txn->hdr_idx, &ctx)) {
-			const char *qval;
-			int q;
-			int toklen;
-
-			/* try to isolate the token from the optional q-value */
-			toklen = 0;
-			while (toklen < ctx.vlen && HTTP_IS_TOKEN(*(ctx.line + ctx.val + toklen)))
-				toklen++;
-
-			qval = ctx.line + ctx.val + toklen;
-			while (1) {
-				while (qval < ctx.line + ctx.val + ctx.vlen && HTTP_IS_LWS(*qval))
-					qval++;
-
-				if (qval >= ctx.line + ctx.val + ctx.vlen || *qval != ';') {
-					qval = NULL;
-					break;
-				}
-				qval++;
-
-				while (qval < ctx.line + ctx.val + ctx.vlen && HTTP_IS_LWS(*qval))
-					qval++;
-
-				if (qval >= ctx.line + ctx.val + ctx.vlen) {
-					qval = NULL;
-					break;
-				}
-				if (strncmp(qval, "q=", MIN(ctx.line + ctx.val + ctx.vlen - qval, 2)) == 0)
-					break;
-
-				while (qval < ctx.line + ctx.val + ctx.vlen && *qval != ';')
-					qval++;
-			}
-
-			/* here we have qval pointing to the first "q=" attribute or NULL if not found */
-			q = qval ? parse_qvalue(qval + 2, NULL) : 1000;
-
-			if (q <= best_q)
-				continue;
-
-			for (comp_algo = comp_algo_back; comp_algo; comp_algo = comp_algo->next) {
-				if (*(ctx.line + ctx.val) == '*' ||
-				    word_match(ctx.line + ctx.val, toklen, comp_algo->ua_name, comp_algo->ua_name_len)) {
-					st->comp_algo = comp_algo;
-					best_q = q;
-					break;
-				}
+		for (comp_algo = comp_algo_back; comp_algo; comp_algo = comp_algo->next) {
+			q = accept_encoding_qvalue(txn, req, comp_algo);
+			if (q > 0 && q >= best_q) {
+				st->comp_algo = comp_algo;
+				best_q = q;
 			}
 		}
 	}
@@ -392,12 +611,14 @@ select_compression_request_header(struct comp_state *st, struct stream *s,
 	if (st->comp_algo) {
 		if ((s->be->comp && s->be->comp->offload) ||
 		    (strm_fe(s)->comp && strm_fe(s)->comp->offload)) {
-			http_remove_header2(msg, &txn->hdr_idx, &ctx);
 			ctx.idx = 0;
 			while (http_find_header2("Accept-Encoding", 15, req->p, &txn->hdr_idx, &ctx)) {
 				http_remove_header2(msg, &txn->hdr_idx, &ctx);
 			}
 		}
+		if ((s->be->comp && s->be->comp->precompressed) ||
+		    (strm_fe(s)->comp && strm_fe(s)->comp->precompressed))
+			precompressed_request(st, s, msg);
 		return 1;
 	}
 
@@ -427,11 +648,16 @@ select_compression_response_header(struct comp_state *st, struct stream *s, stru
 	struct buffer *res = msg->chn->buf;
 	struct hdr_ctx ctx;
 	struct comp_type *comp_type;
+	int level;
 
 	/* no common compression algorithm was found in request header */
 	if (st->comp_algo == NULL)
 		goto fail;
 
+	/* a precompressed variant is being served, see precompressed_response() */
+	if (st->orig_uri)
+		goto fail;
+
 	/* HTTP < 1.1 should not be compressed */
 	if (!(msg->flags & HTTP_MSGF_VER_11) || !(txn->req.flags & HTTP_MSGF_VER_11))
 		goto fail;
@@ -475,6 +701,14 @@ select_compression_response_header(struct comp_state *st, struct stream *s, stru
 		if (ctx.vlen >= 9 && strncasecmp("multipart", ctx.line+ctx.val, 9) == 0)
 			goto fail;
 
+		if (global.tune.comp_governor) {
+			int len = 0;
+
+			while (len < ctx.vlen && ctx.line[ctx.val + len] != ';')
+				len++;
+			st->hist_key ^= hash_crc32(ctx.line + ctx.val, len) * 0x9e3779b1U;
+		}
+
 		if ((s->be->comp && (comp_type = s->be->comp->types)) ||
 		    (strm_fe(s)->comp && (comp_type = strm_fe(s)->comp->types))) {
 			for (; comp_type; comp_type = comp_type->next) {
@@ -503,8 +737,18 @@ select_compression_response_header(struct comp_state *st, struct stream *s, stru
 	if (idle_pct < compress_min_idle)
 		goto fail;
 
+	/* let the governor adapt the level to this response */
+	level = global.tune.comp_maxlevel;
+	if (global.tune.comp_governor) {
+		level = comp_governor_level(st);
+		if (level < 0) {
+			global.comp_skipped++;
+			goto fail;
+		}
+	}
+
 	/* initialize compression */
-	if (st->comp_algo->init(&st->comp_ctx, global.tune.comp_maxlevel) < 0)
+	if (st->comp_algo->init(&st->comp_ctx, level) < 0)
 		goto fail;
 
 	/* remove Content-Length header */
@@ -538,6 +782,178 @@ fail:
 	return 0;
 }
 
+/***********************************************************************/
+/* Returns the file suffix of the precompressed variants for algorithm <algo>,
+ * or NULL if there is none.
+ */
+static const char *
+precompressed_suffix(const struct comp_algo *algo)
+{
+	if (algo->ua_name_len == 4 && memcmp(algo->ua_name, "gzip", 4) == 0)
+		return ".gz";
+	if (algo->ua_name_len == 2 && memcmp(algo->ua_name, "br", 2) == 0)
+		return ".br";
+	if (algo->ua_name_len == 4 && memcmp(algo->ua_name, "zstd", 4) == 0)
+		return ".zst";
+	return NULL;
+}
+
+/*
+ * With "compression precompressed", rewrites the path of a GET request so
+ * that the server delivers the variant precompressed with the selected
+ * algorithm ("/foo.js" becomes "/foo.js.br"). This is only done for paths
+ * ending with one of the configured extensions, if any, and which are not
+ * known to miss their variant. Range requests are never rewritten since the
+ * ranges designate the original representation. A request redirected after
+ * a 404 on the variant has COMP_NOVAR_ARG at the end of its query string: it
+ * is removed and the request is not rewritten. The original URI is kept to
+ * handle a 404.
+ */
+static void
+precompressed_request(struct comp_state *st, struct stream *s, struct http_msg *msg)
+{
+	struct http_txn *txn = s->txn;
+	struct comp *comp = (s->be->comp && s->be->comp->precompressed) ? s->be->comp : strm_fe(s)->comp;
+	struct comp_type *ext;
+	struct hdr_ctx ctx;
+	const char *suffix;
+	char *uri, *path, *end, *uri_end;
+	int len;
+
+	if (txn->meth != HTTP_METH_GET)
+		return;
+
+	path = http_get_path(txn);
+	if (!path)
+		return;
+	uri = msg->chn->buf->p + msg->sl.rq.u;
+	uri_end = uri + msg->sl.rq.u_l;
+	for (end = path; end < uri_end && *end != '?'; end++)
+		;
+
+	if (uri_end - end > COMP_NOVAR_ARG_LEN &&
+	    (uri_end[-COMP_NOVAR_ARG_LEN - 1] == '?' || uri_end[-COMP_NOVAR_ARG_LEN - 1] == '&') &&
+	    memcmp(uri_end - COMP_NOVAR_ARG_LEN, COMP_NOVAR_ARG, COMP_NOVAR_ARG_LEN) == 0) {
+		len = uri_end - COMP_NOVAR_ARG_LEN - 1 - uri;
+		memcpy(trash.str, uri, len);
+		http_replace_req_line(3, trash.str, len, s->be, s);
+		return;
+	}
+
+	suffix = precompressed_suffix(st->comp_algo);
+	if (!suffix)
+		return;
+
+	if (end == path || end[-1] == '/')
+		return;
+
+	ctx.idx = 0;
+	if (http_find_header2("Range", 5, msg->chn->buf->p, &txn->hdr_idx, &ctx))
+		return;
+	ctx.idx = 0;
+	if (http_find_header2("If-Range", 8, msg->chn->buf->p, &txn->hdr_idx, &ctx))
+		return;
+
+	if (comp->precomp_exts) {
+		for (ext = comp->precomp_exts; ext; ext = ext->next) {
+			if (end - path >= ext->name_len &&
+			    strncasecmp(end - ext->name_len, ext->name, ext->name_len) == 0)
+				break;
+		}
+		if (!ext)
+			return;
+	}
+
+	len = end - path;
+	if (comp_novar_lookup(path, len))
+		return;
+
+	/* the original URI must be kept for the redirect on 404 */
+	if (msg->sl.rq.u_l >= REQURI_LEN || len + strlen(suffix) >= trash.size)
+		return;
+	st->orig_uri = pool_alloc2(pool2_requri);
+	if (!st->orig_uri)
+		return;
+	memcpy(st->orig_uri, uri, msg->sl.rq.u_l);
+	st->orig_uri_len = msg->sl.rq.u_l;
+	st->orig_path_ofs = path - uri;
+	st->orig_path_len = len;
+
+	memcpy(trash.str, path, len);
+	memcpy(trash.str + len, suffix, strlen(suffix));
+	trash.len = len + strlen(suffix);
+	if (http_replace_req_line(1, trash.str, trash.len, s->be, s) < 0) {
+		pool_free2(pool2_requri, st->orig_uri);
+		st->orig_uri = NULL;
+	}
+}
+
+/*
+ * Handles the response to a request rewritten by precompressed_request().
+ * A 2xx or 304 comes from the precompressed variant: it gets the right
+ * Content-Encoding and Vary headers and will not be compressed again. A 404
+ * means that the variant does not exist: the path is remembered so that it
+ * will not be rewritten anymore, and the server's response is replaced with
+ * a bodyless 307 redirect to the original URI, so that the client immediately
+ * requests it again and gets the original resource. COMP_NOVAR_ARG is added
+ * to the redirect's query string so that the retried request is never
+ * rewritten again. The connection is closed after the redirect since the rest
+ * of the 404 is not read.
+ */
+static void
+precompressed_response(struct comp_state *st, struct stream *s, struct http_msg *msg)
+{
+	struct http_txn *txn = s->txn;
+	struct buffer *res = msg->chn->buf;
+	struct hdr_ctx ctx;
+
+	if (txn->status == 404) {
+		static const char hdr[] =
+			"HTTP/1.1 307 Temporary Redirect\r\n"
+			"Cache-Control: no-store\r\n"
+			"Content-length: 0\r\n"
+			"Connection: close\r\n"
+			"Location: ";
+
+		comp_novar_learn(st->orig_uri + st->orig_path_ofs, st->orig_path_len);
+
+		if (sizeof(hdr) - 1 + st->orig_uri_len + 1 + COMP_NOVAR_ARG_LEN + 4 > trash.size)
+			return;
+		trash.len = sizeof(hdr) - 1;
+		memcpy(trash.str, hdr, trash.len);
+		memcpy(trash.str + trash.len, st->orig_uri, st->orig_uri_len);
+		trash.len += st->orig_uri_len;
+		trash.str[trash.len++] = memchr(st->orig_uri, '?', st->orig_uri_len) ? '&' : '?';
+		memcpy(trash.str + trash.len, COMP_NOVAR_ARG "\r\n\r\n", COMP_NOVAR_ARG_LEN + 4);
+		trash.len += COMP_NOVAR_ARG_LEN + 4;
+
+		msg->chn->analysers &= AN_FLT_END;
+		txn->status = 307;
+		s->si[1].flags |= SI_FL_NOLINGER;
+		channel_truncate(msg->chn);
+		http_reply_and_close(s, txn->status, &trash);
+		if (!(s->flags & SF_ERR_MASK))
+			s->flags |= SF_ERR_LOCAL;
+		if (!(s->flags & SF_FINST_MASK))
+			s->flags |= SF_FINST_H;
+		return;
+	}
+
+	if ((txn->status < 200 || txn->status >= 300) && txn->status != 304)
+		return;
+
+	ctx.idx = 0;
+	if (!http_find_header2("Content-Encoding", 16, res->p, &txn->hdr_idx, &ctx)) {
+		trash.len = 18;
+		memcpy(trash.str, "Content-Encoding: ", trash.len);
+		memcpy(trash.str + trash.len, st->comp_algo->ua_name, st->comp_algo->ua_name_len);
+		trash.len += st->comp_algo->ua_name_len;
+		trash.str[trash.len] = '\0';
+		http_header_add_tail2(msg, &txn->hdr_idx, trash.str, trash.len);
+	}
+	http_header_add_tail2(msg, &txn->hdr_idx, "Vary: Accept-Encoding", 21);
+}
+
 /***********************************************************************/
 /* emit the chunksize followed by a CRLF on the output and return the number of
  * bytes written. It goes backwards and starts with the byte before <end>. It
@@ -584,38 +1000,40 @@ http_compression_buffer_init(struct buffer *in, struct buffer *out)
 }
 
 /*
- * Add data to compress
+ * Add data to compress. <sz> bytes are read from the input data of channel
+ * <chn>, starting at offset <ofs> from buf->p. They are passed to the
+ * compressor straight from the channel's buffer, without intermediate copy.
  */
 static int
-http_compression_buffer_add_data(struct comp_state *st, struct buffer *in,
-				 struct buffer *out, int sz)
+http_compression_buffer_add_data(struct comp_state *st, struct channel *chn,
+				 unsigned int ofs, struct buffer *out, int sz)
 {
+	struct flt_seg segs[2];
+	struct timeval start;
 	int consumed_data = 0;
-	int data_process_len;
-	int block1, block2;
+	int nbsegs, i, ret;
 
 	if (!sz)
 		goto end;
 
+	tv_now(&start);
+
 	/* select the smallest size between the announced chunk size, the input
 	 * data, and the available output buffer size. The compressors are
 	 * assumed to be able to process all the bytes we pass to them at
 	 * once. */
-	data_process_len = MIN(out->size - buffer_len(out), sz);
+	nbsegs = flt_data_segs(chn, ofs, MIN(out->size - buffer_len(out), sz), segs);
 
-	block1 = data_process_len;
-	if (block1 > bi_contig_data(in))
-		block1 = bi_contig_data(in);
-	block2 = data_process_len - block1;
-
-	/* compressors return < 0 upon error or the amount of bytes read */
-	consumed_data = st->comp_algo->add_data(st->comp_ctx, bi_ptr(in), block1, out);
-	if (consumed_data != block1 || !block2)
-		goto end;
-	consumed_data = st->comp_algo->add_data(st->comp_ctx, in->data, block2, out);
-	if (consumed_data < 0)
-		goto end;
-	consumed_data += block1;
+	for (i = 0; i < nbsegs; i++) {
+		/* compressors return < 0 upon error or the amount of bytes read */
+		ret = st->comp_algo->add_data(st->comp_ctx, segs[i].ptr, segs[i].len, out);
+		if (ret < 0)
+			return ret;
+		consumed_data += ret;
+		if (ret != segs[i].len)
+			break;
+	}
+	global.comp_cpu_us += comp_elapsed_us(&start);
 
  end:
 	return consumed_data;
@@ -634,14 +1052,17 @@ http_compression_buffer_end(struct comp_state *st, struct stream *s,
 	char *tail;
 	int   to_forward, left;
 
-#if defined(USE_SLZ) || defined(USE_ZLIB)
+#if defined(USE_SLZ) || defined(USE_ZLIB) || defined(USE_BROTLI) || defined(USE_ZSTD)
+	struct timeval start;
 	int ret;
 
 	/* flush data here */
+	tv_now(&start);
 	if (end)
 		ret = st->comp_algo->finish(st->comp_ctx, ob); /* end of data */
 	else
 		ret = st->comp_algo->flush(st->comp_ctx, ob); /* end of buffer */
+	global.comp_cpu_us += comp_elapsed_us(&start);
 
 	if (ret < 0)
 		return -1; /* flush failed */
@@ -743,6 +1164,9 @@ http_compression_buffer_end(struct comp_state *st, struct stream *s,
 		update_freq_ctr(&global.comp_bps_out, to_forward);
 		strm_fe(s)->fe_counters.comp_out += to_forward;
 		s->be->be_counters.comp_out += to_forward;
+		global.comp_saved += (long long)st->consumed - to_forward;
+		st->bytes_in  += st->consumed;
+		st->bytes_out += to_forward;
 	}
 
 	return to_forward;
@@ -805,6 +1229,24 @@ parse_compression_options(char **args, int section, struct proxy *proxy,
 	}
 	else if (!strcmp(args[1], "offload"))
 		comp->offload = 1;
+	else if (!strcmp(args[1], "precompressed")) {
+		int cur_arg = 2;
+
+		comp->precompressed = 1;
+		while (*(args[cur_arg])) {
+			struct comp_type *ext = calloc(1, sizeof(*ext));
+
+			if (!ext || !(ext->name = strdup(args[cur_arg]))) {
+				free(ext);
+				memprintf(err, "'%s' : out of memory\n", args[0]);
+				return -1;
+			}
+			ext->name_len = strlen(ext->name);
+			ext->next = comp->precomp_exts;
+			comp->precomp_exts = ext;
+			cur_arg++;
+		}
+	}
 	else if (!strcmp(args[1], "type")) {
 		int cur_arg = 2;
 
@@ -819,7 +1261,7 @@ parse_compression_options(char **args, int section, struct proxy *proxy,
 		}
 	}
 	else {
-		memprintf(err, "'%s' expects 'algo', 'type' or 'offload'\n",
+		memprintf(err, "'%s' expects 'algo', 'type', 'offload' or 'precompressed'\n",
 			  args[0]);
 		return -1;
 	}
@@ -929,6 +1371,26 @@ smp_fetch_res_comp_algo(const struct arg *args, struct sample *smp,
 	return 0;
 }
 
+/* Returns the memory used by the compression context of stream <s>, in bytes.
+ * It is used to account this memory to the stream's proxies.
+ */
+unsigned int http_comp_stream_mem(struct stream *s)
+{
+	struct filter     *filter;
+	struct comp_state *st;
+
+	list_for_each_entry(filter, &strm_flt(s)->filters, list) {
+		if (FLT_ID(filter) != http_comp_flt_id)
+			continue;
+
+		st = filter->ctx;
+		if (st && st->comp_ctx)
+			return st->comp_ctx->mem;
+		break;
+	}
+	return 0;
+}
+
 /* Declare the config parser for "compression" keyword */
 static struct cfg_kw_list cfg_kws = {ILH, {
 		{ CFG_LISTEN, "compression", parse_compression_options },
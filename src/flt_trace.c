@@ -76,19 +76,19 @@ filter_type(const struct filter *f)
 	return (f->flags & FLT_FL_IS_BACKEND_FILTER) ? "backend" : "frontend";
 }
 
+/* Returns the byte at position <i> of the data referenced by <segs> */
+#define TRACE_SEG_BYTE(segs, i)						\
+	((unsigned char)((i) < (segs)[0].len ? (segs)[0].ptr[(i)] : (segs)[1].ptr[(i) - (segs)[0].len]))
+
 static void
-trace_hexdump(struct buffer *buf, int len)
+trace_hexdump(struct channel *chn, unsigned int ofs, int len)
 {
-	unsigned char p[len];
-	int block1, block2, i, j, padding;
-
-	block1 = len;
-        if (block1 > bi_contig_data(buf))
-                block1 = bi_contig_data(buf);
-        block2 = len - block1;
+	struct flt_seg segs[2] = { { NULL, 0 }, { NULL, 0 } };
+	int i, j, padding;
 
-	memcpy(p, buf->p, block1);
-	memcpy(p+block1, buf->data, block2);
+	if (!flt_data_segs(chn, ofs, len, segs))
+		return;
+	len = segs[0].len + segs[1].len;
 
 	padding = ((len % 16) ? (16 - len % 16) : 0);
 	for (i = 0; i < len + padding; i++) {
@@ -98,7 +98,7 @@ trace_hexdump(struct buffer *buf, int len)
                         fprintf(stderr, "  ");
 
                 if (i < len)
-                        fprintf(stderr, "%02x ", p[i]);
+                        fprintf(stderr, "%02x ", TRACE_SEG_BYTE(segs, i));
                 else
                         fprintf(stderr, "   ");
 
@@ -106,7 +106,7 @@ trace_hexdump(struct buffer *buf, int len)
                 if (i % 16 == 15) {
                         fprintf(stderr, "  |");
                         for(j = i - 15; j <= i && j < len; j++)
-				fprintf(stderr, "%c", (isprint(p[j]) ? p[j] : '.'));
+				fprintf(stderr, "%c", (isprint(TRACE_SEG_BYTE(segs, j)) ? TRACE_SEG_BYTE(segs, j) : '.'));
                         fprintf(stderr, "|\n");
                 }
         }
@@ -444,9 +444,7 @@ trace_http_forward_data(struct stream *s, struct filter *filter,
 		   FLT_NXT(filter, msg->chn), FLT_FWD(filter, msg->chn), ret);
 
 	if (conf->hexdump) {
-		b_adv(msg->chn->buf, FLT_FWD(filter, msg->chn));
-		trace_hexdump(msg->chn->buf, ret);
-		b_rew(msg->chn->buf, FLT_FWD(filter, msg->chn));
+		trace_hexdump(msg->chn, FLT_FWD(filter, msg->chn), ret);
 	}
 
 	if ((ret != len) ||
@@ -494,9 +492,7 @@ trace_tcp_forward_data(struct stream *s, struct filter *filter, struct channel *
 		   FLT_FWD(filter, chn), ret);
 
 	if (conf->hexdump) {
-		b_adv(chn->buf, FLT_FWD(filter, chn));
-		trace_hexdump(chn->buf, ret);
-		b_rew(chn->buf, FLT_FWD(filter, chn));
+		trace_hexdump(chn, FLT_FWD(filter, chn), ret);
 	}
 
 	if (ret != len)
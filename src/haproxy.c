@@ -36,6 +36,7 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/tcp.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -99,8 +100,10 @@
 #include <proto/listener.h>
 #include <proto/log.h>
 #include <proto/pattern.h>
+#include <proto/pipe.h>
 #include <proto/protocol.h>
 #include <proto/proto_http.h>
+#include <proto/proto_tcp.h>
 #include <proto/proxy.h>
 #include <proto/queue.h>
 #include <proto/server.h>
@@ -176,6 +179,7 @@ struct global global = {
 		.zlibwindowsize = MAX_WBITS,
 #endif
 		.comp_maxlevel = 1,
+		.comp_min_savings = 10,
 #ifdef DEFAULT_IDLE_TIMER
 		.idle_timer = DEFAULT_IDLE_TIMER,
 #else
@@ -238,6 +242,12 @@ int jobs = 0;   /* number of active jobs (conns, listeners, active tasks, ...) *
 static int *oldpids = NULL;
 static int oldpids_sig; /* use USR1 or TERM */
 
+/* path to the stats socket of the old process to retrieve listening sockets
+ * from ("-x"), and the sockets retrieved this way.
+ */
+static char *old_unixsocket = NULL;
+struct xfer_sock_list *xfer_sock_list = NULL;
+
 /* this is used to drain data, and as a temporary buffer for sprintf()... */
 struct chunk trash = { };
 
@@ -315,6 +325,15 @@ void display_build_opts()
 	printf("Built with libslz for stateless compression.\n");
 #else /* USE_ZLIB */
 	printf("Built without compression support (neither USE_ZLIB nor USE_SLZ are set)\n");
+#endif
+#ifdef USE_BROTLI
+	printf("Running on brotli version : %u.%u.%u\n",
+	       BrotliEncoderVersion() >> 24, (BrotliEncoderVersion() >> 12) & 0xfff,
+	       BrotliEncoderVersion() & 0xfff);
+#endif
+#ifdef USE_ZSTD
+	printf("Built with zstd version : " ZSTD_VERSION_STRING "\n");
+	printf("Running on zstd version : %s\n", ZSTD_versionString());
 #endif
 	printf("Compression algorithms supported :");
 	{
@@ -484,8 +503,10 @@ void usage(char *name)
 		"        -dR disables SO_REUSEPORT usage\n"
 #endif
 		"        -dr ignores server address resolution failures\n"
+		"        -dT reports the time spent loading the configuration\n"
 		"        -dV disables SSL verify on servers side\n"
 		"        -sf/-st [pid ]* finishes/terminates old pids.\n"
+		"        -x <unix_socket> get listening sockets from a unix socket\n"
 		"\n",
 		name, DEFAULT_MAXCONN, cfg_maxpconn);
 	exit(1);
@@ -690,6 +711,7 @@ void init(int argc, char **argv)
 	char *progname;
 	char *change_dir = NULL;
 	struct proxy *px;
+	unsigned long long start;
 
 	chunk_init(&trash, malloc(global.tune.bufsize), global.tune.bufsize);
 	alloc_trash_buffers(global.tune.bufsize);
@@ -814,6 +836,8 @@ void init(int argc, char **argv)
 				mem_poison_byte = flag[2] ? strtol(flag + 2, NULL, 0) : 'P';
 			else if (*flag == 'd' && flag[1] == 'r')
 				global.tune.options |= GTUNE_RESOLVE_DONTFAIL;
+			else if (*flag == 'd' && flag[1] == 'T')
+				global.tune.options |= GTUNE_TIMING_REPORT;
 			else if (*flag == 'd')
 				arg_mode |= MODE_DEBUG;
 			else if (*flag == 'c')
@@ -880,6 +904,7 @@ void init(int argc, char **argv)
 					}
 					break;
 				case 'p' : cfg_pidfile = *argv; break;
+				case 'x' : old_unixsocket = *argv; break;
 				default: usage(progname);
 				}
 			}
@@ -909,9 +934,11 @@ void init(int argc, char **argv)
 	init_default_instance();
 
 	list_for_each_entry(wl, &cfg_cfgfiles, list) {
+		unsigned long long start = cfg_timing_now();
 		int ret;
 
 		ret = readcfgfile(wl->s);
+		cfg_timing_add("read files", wl->s, start);
 		if (ret == -1) {
 			Alert("Could not open configuration file %s : %s\n",
 			      wl->s, strerror(errno));
@@ -924,12 +951,16 @@ void init(int argc, char **argv)
 			exit(1);
 	}
 
+	start = cfg_timing_now();
 	pattern_finalize_config();
 #if (defined SSL_CTRL_SET_TLSEXT_TICKET_KEY_CB && TLS_TICKETS_NO > 0)
 	tlskeys_finalize_config();
 #endif
+	cfg_timing_add("finalize patterns", NULL, start);
 
+	start = cfg_timing_now();
 	err_code |= check_config_validity();
+	cfg_timing_add("check config", NULL, start);
 	if (err_code & (ERR_ABORT|ERR_FATAL)) {
 		Alert("Fatal errors found in configuration.\n");
 		exit(1);
@@ -960,13 +991,18 @@ void init(int argc, char **argv)
 #endif
 
 	/* Apply server states */
-	apply_server_state();
+	start = cfg_timing_now();
+	apply_server_state(old_unixsocket);
 
 	for (px = proxy; px; px = px->next)
 		srv_compute_all_admin_states(px);
+	cfg_timing_add("apply server states", NULL, start);
 
 	/* Apply servers' configured address */
+	start = cfg_timing_now();
 	err_code |= srv_init_addr();
+	cfg_timing_add("resolve server addresses", NULL, start);
+	cfg_timing_dump();
 	if (err_code & (ERR_ABORT|ERR_FATAL)) {
 		Alert("Failed to initialize server(s) addr.\n");
 		exit(1);
@@ -1217,6 +1253,9 @@ void init(int argc, char **argv)
 	if (global.tune.maxpollevents <= 0)
 		global.tune.maxpollevents = MAX_POLL_EVENTS;
 
+	if (global.tune.cli_dump_budget <= 0)
+		global.tune.cli_dump_budget = CLI_DUMP_BUDGET;
+
 	if (global.tune.recv_enough == 0)
 		global.tune.recv_enough = MIN_RECV_AT_ONCE_ENOUGH;
 
@@ -1226,6 +1265,14 @@ void init(int argc, char **argv)
 	if (global.tune.maxrewrite >= global.tune.bufsize / 2)
 		global.tune.maxrewrite = global.tune.bufsize / 2;
 
+	if (global.tune.bufsize_small &&
+	    (global.tune.bufsize_small >= global.tune.bufsize ||
+	     global.tune.bufsize_small < 2 * global.tune.maxrewrite)) {
+		Alert("tune.bufsize.small must be smaller than tune.bufsize and at least twice as large as tune.maxrewrite (%d).\n",
+		      global.tune.maxrewrite);
+		exit(1);
+	}
+
 	if (arg_mode & (MODE_DEBUG | MODE_FOREGROUND)) {
 		/* command line debug mode inhibits configuration mode */
 		global.mode &= ~(MODE_DAEMON | MODE_SYSTEMD | MODE_QUIET);
@@ -1683,6 +1730,7 @@ void deinit(void)
 	vars_prune(&global.vars, NULL, NULL);
 
 	pool_destroy2(pool2_stream);
+	pool_destroy2(pool2_stream_store);
 	pool_destroy2(pool2_session);
 	pool_destroy2(pool2_connection);
 	pool_destroy2(pool2_buffer);
@@ -1709,6 +1757,153 @@ static int tell_old_pids(int sig)
 	return ret;
 }
 
+/* Connects to the stats socket <unixsocket> of an old process exposing its
+ * listeners ("expose-fd listeners") and retrieves all of its listening TCP
+ * sockets, which are placed into xfer_sock_list to be reused when binding the
+ * listeners. See _getsocks() for the format. Returns 0 on success, -1 if no
+ * socket could be retrieved, in which case the listeners will simply be bound
+ * again.
+ */
+static int get_old_sockets(const char *unixsocket)
+{
+	struct xfer_sock_list *xfer_sock, **xfer_tail = &xfer_sock_list;
+	struct sockaddr_un addr;
+	struct cmsghdr *cmsg;
+	struct msghdr msghdr;
+	struct iovec iov;
+	char *cmsgbuf = NULL;
+	unsigned char *tmpbuf = NULL;
+	int *tmpfd = NULL;
+	int sock = -1;
+	int fd_nb = 0, got = 0;
+	int ret = -1;
+	int len, ofs, i;
+
+	if (strlen(unixsocket) >= sizeof(addr.sun_path)) {
+		Warning("Unix socket path '%s' is too long\n", unixsocket);
+		goto out;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, unixsocket);
+
+	sock = socket(PF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0) {
+		Warning("Failed to connect to the old process socket '%s'\n", unixsocket);
+		goto out;
+	}
+	if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		Warning("Failed to connect to the old process socket '%s'\n", unixsocket);
+		goto out;
+	}
+
+	if (send(sock, "_getsocks\n", 10, 0) != 10) {
+		Warning("Failed to get the sockets from the old process!\n");
+		goto out;
+	}
+
+	if (recv(sock, &fd_nb, sizeof(fd_nb), MSG_WAITALL) != sizeof(fd_nb)) {
+		Warning("Failed to get the number of sockets to be transferred !\n");
+		goto out;
+	}
+	if (fd_nb <= 0) {
+		ret = 0;
+		goto out;
+	}
+
+	cmsgbuf = malloc(CMSG_SPACE(sizeof(int) * MAX_SEND_FD));
+	tmpbuf = malloc(sizeof(int) + MAX_SEND_FD * (1 + 255 + 1 + 255 + sizeof(int)));
+	tmpfd = malloc(sizeof(int) * fd_nb);
+	if (!cmsgbuf || !tmpbuf || !tmpfd) {
+		Warning("Failed to allocate memory while receiving sockets\n");
+		goto out;
+	}
+
+	while (got < fd_nb) {
+		int nb;
+
+		memset(&msghdr, 0, sizeof(msghdr));
+		iov.iov_base = tmpbuf;
+		iov.iov_len = sizeof(int) + MAX_SEND_FD * (1 + 255 + 1 + 255 + sizeof(int));
+		msghdr.msg_iov = &iov;
+		msghdr.msg_iovlen = 1;
+		msghdr.msg_control = cmsgbuf;
+		msghdr.msg_controllen = CMSG_SPACE(sizeof(int) * MAX_SEND_FD);
+
+		len = recvmsg(sock, &msghdr, 0);
+		cmsg = CMSG_FIRSTHDR(&msghdr);
+		if (len < (int)sizeof(int) || !cmsg ||
+		    cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+			Warning("Failed to receive sockets from the old process\n");
+			goto out;
+		}
+
+		nb = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		if (nb <= 0 || got + nb > fd_nb) {
+			Warning("Unexpected number of sockets received from the old process\n");
+			goto out;
+		}
+		memcpy(tmpfd + got, CMSG_DATA(cmsg), nb * sizeof(int));
+
+		/* the descriptions may come in several parts */
+		memcpy(&ofs, tmpbuf, sizeof(int));
+		if (ofs < len || ofs > iov.iov_len ||
+		    (ofs > len && recv(sock, tmpbuf + len, ofs - len, MSG_WAITALL) != ofs - len)) {
+			Warning("Failed to receive sockets descriptions from the old process\n");
+			got += nb;
+			goto out;
+		}
+
+		for (i = 0, ofs = sizeof(int); i < nb; i++) {
+			socklen_t socklen;
+
+			xfer_sock = calloc(1, sizeof(*xfer_sock));
+			if (!xfer_sock) {
+				Warning("Failed to allocate memory while receiving sockets\n");
+				got += nb;
+				goto out;
+			}
+			/* keep the order, it is the one of the reuseport groups */
+			xfer_sock->fd = tmpfd[got + i];
+			*xfer_tail = xfer_sock;
+			xfer_tail = &xfer_sock->next;
+
+			len = tmpbuf[ofs++];
+			if (len)
+				xfer_sock->iface = my_strndup((char *)tmpbuf + ofs, len);
+			ofs += len;
+			len = tmpbuf[ofs++];
+			if (len)
+				xfer_sock->namespace = my_strndup((char *)tmpbuf + ofs, len);
+			ofs += len;
+			memcpy(&xfer_sock->options, tmpbuf + ofs, sizeof(int));
+			ofs += sizeof(int);
+
+			socklen = sizeof(xfer_sock->addr);
+			if (getsockname(xfer_sock->fd, (struct sockaddr *)&xfer_sock->addr, &socklen) != 0)
+				xfer_sock->addr.ss_family = AF_UNSPEC; /* will never match */
+		}
+		got += nb;
+	}
+	ret = 0;
+
+ out:
+	/* sockets received but not attached to the list must not leak */
+	for (i = 0; tmpfd && i < got; i++) {
+		for (xfer_sock = xfer_sock_list; xfer_sock; xfer_sock = xfer_sock->next)
+			if (xfer_sock->fd == tmpfd[i])
+				break;
+		if (!xfer_sock)
+			close(tmpfd[i]);
+	}
+	if (sock >= 0)
+		close(sock);
+	free(cmsgbuf);
+	free(tmpbuf);
+	free(tmpfd);
+	return ret;
+}
+
 /* Runs the polling loop */
 void run_poll_loop()
 {
@@ -1824,6 +2019,12 @@ int main(int argc, char **argv)
 #endif
 	}
 
+	/* the old process may pass us its listening sockets so that we don't
+	 * have to bind new ones, and no connection is lost during the reload.
+	 */
+	if (old_unixsocket)
+		get_old_sockets(old_unixsocket);
+
 	/* We will loop at most 100 times with 10 ms delay each time.
 	 * That's at most 1 second. We only send a signal to old pids
 	 * if we cannot grab at least one port.
@@ -1872,6 +2073,23 @@ int main(int argc, char **argv)
 	}
 
 	err = protocol_bind_all(errmsg, sizeof(errmsg));
+
+	/* all SO_REUSEPORT groups are complete now, they may be steered. This
+	 * must be done before closing the unused inherited sockets.
+	 */
+	tcp_steer_listeners();
+
+	/* close the inherited sockets which do not match any listener anymore */
+	while (xfer_sock_list) {
+		struct xfer_sock_list *xfer_sock = xfer_sock_list;
+
+		xfer_sock_list = xfer_sock->next;
+		close(xfer_sock->fd);
+		free(xfer_sock->iface);
+		free(xfer_sock->namespace);
+		free(xfer_sock);
+	}
+
 	if ((err & ~ERR_WARN) != ERR_NONE) {
 		if ((err & ERR_ALERT) || (err & ERR_WARN))
 			Alert("[%s.main()] %s.\n", argv[0], errmsg);
@@ -2000,12 +2218,15 @@ int main(int argc, char **argv)
 #ifdef USE_CPU_AFFINITY
 		if (proc < global.nbproc &&  /* child */
 		    proc < LONGBITS &&       /* only the first 32/64 processes may be pinned */
-		    global.cpu_map[proc])    /* only do this if the process has a CPU map */
+		    global.cpu_map[proc]) {  /* only do this if the process has a CPU map */
 #ifdef __FreeBSD__
 			cpuset_setaffinity(CPU_LEVEL_WHICH, CPU_WHICH_PID, -1, sizeof(unsigned long), (void *)&global.cpu_map[proc]);
 #else
 			sched_setaffinity(0, sizeof(unsigned long), (void *)&global.cpu_map[proc]);
 #endif
+			/* let the pools refill from memory local to our CPUs */
+			pool_slab_detach();
+		}
 #endif
 		/* close the pidfile both in children and father */
 		if (pidfd >= 0) {
@@ -2090,6 +2311,10 @@ int main(int argc, char **argv)
 		fork_poller();
 	}
 
+	/* pipes are created once in each process as they must not be shared */
+	if (global.tune.pipes_prealloc && (global.tune.options & GTUNE_USE_SPLICE))
+		prealloc_pipes(MIN(global.tune.pipes_prealloc, global.maxpipes));
+
 	protocol_enable_all();
 	/*
 	 * That's it : the central polling loop. Run until we stop.
@@ -90,14 +90,151 @@ unsigned int hash_sdbm(const char *key, int len)
  * The magic value represents the polynom with one bit per exponent. Much
  * faster table-based versions exist but are pointless for our usage here,
  * this hash already sustains gigabit speed which is far faster than what
- * we'd ever need. Better preserve the CPU's cache instead.
+ * we'd ever need. Better preserve the CPU's cache instead. It works on the
+ * non-inverted state <hash> so that it can complete a vectorized calculation.
  */
+static unsigned int hash_crc32_bits(unsigned int hash, const char *key, int len)
+{
+	int bit;
+
+	while (len--) {
+		hash ^= *key++;
+		for (bit = 0; bit < 8; bit++)
+			hash = (hash >> 1) ^ ((hash & 1) ? 0xedb88320 : 0);
+	}
+	return hash;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#include <cpuid.h>
+#include <immintrin.h>
+
+/* set at boot if the CPU supports PCLMULQDQ and SSE4.1 */
+static int hash_crc32_clmul_ok;
+
+/* Folds <len> bytes from <key> into the non-inverted CRC32 state <hash> using
+ * carry-less multiplications, as described in Intel's "Fast CRC Computation
+ * for Generic Polynomials Using PCLMULQDQ Instruction". <len> must be at least
+ * 64 and a multiple of 16. The result is only valid if <*high> is zero upon
+ * return, otherwise one of the bytes had its highest bit set, which the bitwise
+ * version above sign-extends, and the caller must fall back to it.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static unsigned int hash_crc32_clmul(unsigned int hash, const char *key, int len, int *high)
+{
+	const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596ULL, 0x0154442bd4ULL);
+	const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eULL, 0x01751997d0ULL);
+	const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124ULL);
+	const __m128i poly = _mm_set_epi64x(0x01f7011641ULL, 0x01db710641ULL);
+	const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+	__m128i x1, x2, x3, x4, y1, y2, y3, y4, bits;
+
+	x1 = _mm_loadu_si128((const __m128i *)(key + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *)(key + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *)(key + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *)(key + 0x30));
+	bits = _mm_or_si128(_mm_or_si128(x1, x2), _mm_or_si128(x3, x4));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(hash));
+	key += 64;
+	len -= 64;
+
+	/* fold 4 lanes of 128 bits in parallel */
+	while (len >= 64) {
+		y1 = _mm_loadu_si128((const __m128i *)(key + 0x00));
+		y2 = _mm_loadu_si128((const __m128i *)(key + 0x10));
+		y3 = _mm_loadu_si128((const __m128i *)(key + 0x20));
+		y4 = _mm_loadu_si128((const __m128i *)(key + 0x30));
+		bits = _mm_or_si128(bits, _mm_or_si128(_mm_or_si128(y1, y2), _mm_or_si128(y3, y4)));
+
+		x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k1k2, 0x00), _mm_clmulepi64_si128(x1, k1k2, 0x11)), y1);
+		x2 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x2, k1k2, 0x00), _mm_clmulepi64_si128(x2, k1k2, 0x11)), y2);
+		x3 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x3, k1k2, 0x00), _mm_clmulepi64_si128(x3, k1k2, 0x11)), y3);
+		x4 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x4, k1k2, 0x00), _mm_clmulepi64_si128(x4, k1k2, 0x11)), y4);
+		key += 64;
+		len -= 64;
+	}
+
+	/* reduce the 4 lanes to a single one */
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00), _mm_clmulepi64_si128(x1, k3k4, 0x11)), x2);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00), _mm_clmulepi64_si128(x1, k3k4, 0x11)), x3);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00), _mm_clmulepi64_si128(x1, k3k4, 0x11)), x4);
+
+	/* remaining blocks of 16 bytes */
+	while (len >= 16) {
+		y1 = _mm_loadu_si128((const __m128i *)key);
+		bits = _mm_or_si128(bits, y1);
+		x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00), _mm_clmulepi64_si128(x1, k3k4, 0x11)), y1);
+		key += 16;
+		len -= 16;
+	}
+	*high = _mm_movemask_epi8(bits);
+
+	/* fold 128 bits to 64 bits */
+	x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k5k0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	/* Barrett reduction to 32 bits */
+	x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), poly, 0x10);
+	x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask), poly, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	return _mm_extract_epi32(x1, 1);
+}
+
+__attribute__((constructor))
+static void __hash_init(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		hash_crc32_clmul_ok = (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1);
+}
+#endif
+
 unsigned int hash_crc32(const char *key, int len)
 {
-	unsigned int hash;
+	unsigned int hash = ~0;
+
+#ifdef bit_PCLMUL
+	if (hash_crc32_clmul_ok && len >= 64) {
+		unsigned int fast;
+		int high;
+
+		fast = hash_crc32_clmul(hash, key, len & -16, &high);
+		if (!high) {
+			hash = fast;
+			key += len & -16;
+			len &= 15;
+		}
+	}
+#endif
+	return ~hash_crc32_bits(hash, key, len);
+}
+
+/* Returns the standard CRC32 (the one of gzip and zlib's crc32()) of <len>
+ * bytes from <data> continuing CRC <crc>, which starts at zero. Unlike with
+ * hash_crc32(), bytes are unsigned. Without carry-less multiplications, this
+ * is much slower than a table-based version, see hash_crc32_accelerated().
+ */
+unsigned int hash_crc32_update(unsigned int crc, const void *data, int len)
+{
+	const unsigned char *key = data;
+	unsigned int hash = ~crc;
 	int bit;
 
-	hash = ~0;
+#ifdef bit_PCLMUL
+	if (hash_crc32_clmul_ok && len >= 64) {
+		int high;
+
+		/* high bytes are fine here since they are not sign-extended */
+		hash = hash_crc32_clmul(hash, (const char *)key, len & -16, &high);
+		key += len & -16;
+		len &= 15;
+	}
+#endif
 	while (len--) {
 		hash ^= *key++;
 		for (bit = 0; bit < 8; bit++)
@@ -105,3 +242,13 @@ unsigned int hash_crc32(const char *key, int len)
 	}
 	return ~hash;
 }
+
+/* Returns non-zero if hash_crc32_update() uses carry-less multiplications */
+int hash_crc32_accelerated(void)
+{
+#ifdef bit_PCLMUL
+	return hash_crc32_clmul_ok;
+#else
+	return 0;
+#endif
+}
@@ -48,6 +48,7 @@
 #include <proto/sample.h>
 #include <proto/server.h>
 #include <proto/session.h>
+#include <proto/signal.h>
 #include <proto/stream.h>
 #include <proto/ssl_sock.h>
 #include <proto/stream_interface.h>
@@ -137,6 +138,14 @@ static int hlua_panic_ljmp(lua_State *L) { longjmp(safe_ljmp_env, 1); }
 /* The main Lua execution context. */
 struct hlua gL;
 
+/* List of the registered Lua functions (actions, fetches, converters, services
+ * and CLI keywords), used to report their profiling counters.
+ */
+static struct list hlua_functions = LIST_HEAD_INIT(hlua_functions);
+
+/* List of the TCP connection pools created with core.tcp_pool(). */
+static struct list hlua_tcp_pools = LIST_HEAD_INIT(hlua_tcp_pools);
+
 /* This is the memory pool containing all the signal structs. These
  * struct are used to store each requiered signal between two tasks.
  */
@@ -158,6 +167,7 @@ struct list hlua_init_functions = LIST_HEAD_INIT(hlua_init_functions);
  */
 static int class_txn_ref;
 static int class_socket_ref;
+static int class_tcp_pool_ref;
 static int class_channel_ref;
 static int class_fetches_ref;
 static int class_converters_ref;
@@ -208,6 +218,7 @@ static unsigned int hlua_nb_instruction = 10000;
 struct hlua_mem_allocator {
 	size_t allocated;
 	size_t limit;
+	unsigned long long total; /* cumulated allocated bytes, never decreases */
 };
 
 static struct hlua_mem_allocator hlua_global_allocator;
@@ -389,6 +400,15 @@ static int hlua_lua2arg(lua_State *L, int ud, struct arg *arg)
 	switch (lua_type(L, ud)) {
 
 	case LUA_TNUMBER:
+		/* A number without integer representation is kept as its
+		 * string form, so it is refused where an integer is expected.
+		 */
+		if (!lua_isinteger(L, ud)) {
+			arg->type = ARGT_STR;
+			arg->data.str.str = (char *)lua_tolstring(L, ud, (size_t *)&arg->data.str.len);
+			break;
+		}
+		/* fall through */
 	case LUA_TBOOLEAN:
 		arg->type = ARGT_SINT;
 		arg->data.sint = lua_tointeger(L, ud);
@@ -514,6 +534,63 @@ static int hlua_smp2lua_str(lua_State *L, struct sample *smp)
 	return 1;
 }
 
+/* This function compares the sample <smp> with the Lua value at the
+ * stack index <ud> without pushing anything on the Lua stack. Strings
+ * are compared in place, so no Lua string is created for the sample.
+ * This is used by the read-only inspection functions. It returns 1 if
+ * the values are equal, otherwise 0. Note that the sample may be
+ * casted to a string.
+ */
+static int hlua_smp_match(lua_State *L, int ud, struct sample *smp)
+{
+	const char *str;
+	size_t len;
+	enum http_meth_t meth;
+
+	switch (lua_type(L, ud)) {
+	case LUA_TNUMBER:
+		/* an integer sample never equals 2.5 */
+		if (!lua_isinteger(L, ud))
+			return 0;
+		if (smp->data.type != SMP_T_SINT && smp->data.type != SMP_T_BOOL)
+			return 0;
+		return smp->data.u.sint == lua_tointeger(L, ud);
+
+	case LUA_TBOOLEAN:
+		if (smp->data.type != SMP_T_SINT && smp->data.type != SMP_T_BOOL)
+			return 0;
+		return !!smp->data.u.sint == lua_toboolean(L, ud);
+
+	case LUA_TSTRING:
+		str = lua_tolstring(L, ud, &len);
+		switch (smp->data.type) {
+		case SMP_T_METH:
+			meth = find_http_meth(str, len);
+			if (meth != smp->data.u.meth.meth)
+				return 0;
+			if (meth != HTTP_METH_OTHER)
+				return 1;
+			return smp->data.u.meth.str.len == len &&
+			       memcmp(smp->data.u.meth.str.str, str, len) == 0;
+
+		case SMP_T_BIN:
+		case SMP_T_STR:
+			break;
+
+		default:
+			if (!sample_casts[smp->data.type][SMP_T_STR] ||
+			    !sample_casts[smp->data.type][SMP_T_STR](smp))
+				return 0;
+			break;
+		}
+		return smp->data.u.str.len == len &&
+		       memcmp(smp->data.u.str.str, str, len) == 0;
+
+	default:
+		return 0;
+	}
+}
+
 /* the following functions are used to convert an Lua type in a
  * struct sample. This is useful to provide data from a converter
  * to the LUA code.
@@ -523,11 +600,19 @@ static int hlua_lua2smp(lua_State *L, int ud, struct sample *smp)
 	switch (lua_type(L, ud)) {
 
 	case LUA_TNUMBER:
+		/* Samples have no floating point type, so a number without
+		 * integer representation is provided as its string form.
+		 */
+		if (!lua_isinteger(L, ud)) {
+			smp->data.type = SMP_T_STR;
+			smp->flags |= SMP_F_CONST;
+			smp->data.u.str.str = (char *)lua_tolstring(L, ud, (size_t *)&smp->data.u.str.len);
+			break;
+		}
 		smp->data.type = SMP_T_SINT;
 		smp->data.u.sint = lua_tointeger(L, ud);
 		break;
 
-
 	case LUA_TBOOLEAN:
 		smp->data.type = SMP_T_BOOL;
 		smp->data.u.sint = lua_toboolean(L, ud);
@@ -850,6 +935,7 @@ int hlua_ctx_init(struct hlua *lua, struct task *task)
 	}
 	lua->Mref = LUA_REFNIL;
 	lua->flags = 0;
+	lua->fcn = NULL;
 	LIST_INIT(&lua->com);
 	lua->T = lua_newthread(gL.T);
 	if (!lua->T) {
@@ -1001,10 +1087,15 @@ static enum hlua_exec hlua_ctx_resume(struct hlua *lua, int yield_allowed)
 {
 	int ret;
 	const char *msg;
+	struct timeval start, stop;
+	unsigned long long alloc = 0;
 
 	/* Initialise run time counter. */
-	if (!HLUA_IS_RUNNING(lua))
+	if (!HLUA_IS_RUNNING(lua)) {
 		lua->run_time = 0;
+		if (lua->fcn)
+			lua->fcn->calls++;
+	}
 
 resume_execution:
 
@@ -1022,8 +1113,21 @@ resume_execution:
 	/* Update the start time. */
 	lua->start_time = now_ms;
 
-	/* Call the function. */
+	/* Call the function. The registered function's profiling counters
+	 * are updated with the real time spent and the memory allocated.
+	 */
+	if (lua->fcn) {
+		tv_now(&start);
+		alloc = hlua_global_allocator.total;
+	}
 	ret = lua_resume(lua->T, gL.T, lua->nargs);
+	if (lua->fcn) {
+		tv_now(&stop);
+		lua->fcn->run_time += (stop.tv_sec - start.tv_sec) * 1000000LL + stop.tv_usec - start.tv_usec;
+		lua->fcn->alloc += hlua_global_allocator.total - alloc;
+		if (ret == LUA_YIELD)
+			lua->fcn->yields++;
+	}
 	switch (ret) {
 
 	case LUA_OK:
@@ -1521,6 +1625,128 @@ __LJMP static struct hlua_socket *hlua_checksocket(lua_State *L, int ud)
 	return MAY_LJMP(hlua_checkudata(L, ud, class_socket_ref));
 }
 
+/* Removes the socket applet <appctx> from its TCP pool, if any, and
+ * wakes up the coroutines waiting for a free slot in this pool.
+ */
+static void hlua_tcp_pool_detach(struct appctx *appctx)
+{
+	struct hlua_tcp_pool *pool = appctx->ctx.hlua.pool;
+
+	if (!pool)
+		return;
+
+	if (!LIST_ISEMPTY(&appctx->ctx.hlua.by_pool)) {
+		LIST_DEL(&appctx->ctx.hlua.by_pool);
+		LIST_INIT(&appctx->ctx.hlua.by_pool);
+		pool->idle--;
+	}
+	else
+		pool->used--;
+
+	appctx->ctx.hlua.pool = NULL;
+	hlua_com_wake(&pool->wake_on_release);
+}
+
+/* Removes the socket applet <appctx> from its pool and closes its stream. */
+static void hlua_tcp_pool_kill(struct appctx *appctx)
+{
+	hlua_tcp_pool_detach(appctx);
+	stream_shutdown(si_strm(appctx->owner), SF_ERR_KILLED);
+}
+
+/* Returns non-zero if the connection of the socket applet <appctx> may
+ * be leased again: it must be established, open in both directions and
+ * there must not remain any unread data.
+ */
+static int hlua_tcp_pool_reusable(struct appctx *appctx)
+{
+	struct stream_interface *si = appctx->owner;
+	struct stream *s = si_strm(si);
+
+	return !stopping && appctx->ctx.hlua.connected &&
+	       objt_conn(si_opposite(si)->end) &&
+	       !(s->flags & SF_ERR_MASK) &&
+	       !channel_input_closed(&s->req) && !channel_output_closed(&s->req) &&
+	       !channel_input_closed(&s->res) && channel_is_empty(&s->res);
+}
+
+/* Moves the leased socket applet <appctx> to the idle list of its pool.
+ * Returns 0 if the connection is not reusable, in which case it is left
+ * untouched, otherwise 1.
+ */
+static int hlua_tcp_pool_put(struct appctx *appctx)
+{
+	struct hlua_tcp_pool *pool = appctx->ctx.hlua.pool;
+	struct stream *s = si_strm(appctx->owner);
+
+	if (!hlua_tcp_pool_reusable(appctx))
+		return 0;
+
+	/* Restore the default timeouts, settimeout() may have changed them. */
+	s->req.rto = s->req.wto = TICK_ETERNITY;
+	s->res.rto = s->res.wto = TICK_ETERNITY;
+
+	appctx->ctx.hlua.socket = NULL;
+	pool->used--;
+	pool->idle++;
+	LIST_ADD(&pool->idle_conns, &appctx->ctx.hlua.by_pool);
+
+	appctx->ctx.hlua.idle_exp = tick_add_ifset(now_ms, pool->idle_timeout);
+	if (tick_isset(appctx->ctx.hlua.idle_exp) && !tick_isset(pool->task->expire)) {
+		pool->task->expire = appctx->ctx.hlua.idle_exp;
+		task_queue(pool->task);
+	}
+
+	hlua_com_wake(&pool->wake_on_release);
+	return 1;
+}
+
+/* Takes the most recently used idle connection of <pool>, skipping and
+ * closing the ones which are not reusable anymore. Returns the socket
+ * applet, which is accounted as leased, or NULL if none is available.
+ */
+static struct appctx *hlua_tcp_pool_take(struct hlua_tcp_pool *pool)
+{
+	struct appctx *appctx;
+
+	while (!LIST_ISEMPTY(&pool->idle_conns)) {
+		appctx = LIST_NEXT(&pool->idle_conns, struct appctx *, ctx.hlua.by_pool);
+		if (!hlua_tcp_pool_reusable(appctx)) {
+			hlua_tcp_pool_kill(appctx);
+			continue;
+		}
+
+		LIST_DEL(&appctx->ctx.hlua.by_pool);
+		LIST_INIT(&appctx->ctx.hlua.by_pool);
+		pool->idle--;
+		pool->used++;
+		pool->reused++;
+		return appctx;
+	}
+	return NULL;
+}
+
+/* This task closes the idle connections of a pool which have reached their
+ * idle timeout, and all of them when the process is stopping. The idle list
+ * is ordered by idle date, the oldest connections are at the tail.
+ */
+static struct task *hlua_tcp_pool_expire(struct task *t)
+{
+	struct hlua_tcp_pool *pool = t->context;
+	struct appctx *appctx;
+
+	t->expire = TICK_ETERNITY;
+	while (!LIST_ISEMPTY(&pool->idle_conns)) {
+		appctx = LIST_PREV(&pool->idle_conns, struct appctx *, ctx.hlua.by_pool);
+		if (!stopping && !tick_is_expired(appctx->ctx.hlua.idle_exp, now_ms)) {
+			t->expire = appctx->ctx.hlua.idle_exp;
+			break;
+		}
+		hlua_tcp_pool_kill(appctx);
+	}
+	return t;
+}
+
 /* This function is the handler called for each I/O on the established
  * connection. It is used for notify space avalaible to send or data
  * received.
@@ -1530,6 +1756,15 @@ static void hlua_socket_handler(struct appctx *appctx)
 	struct stream_interface *si = appctx->owner;
 	struct connection *c = objt_conn(si_opposite(si)->end);
 
+	/* An idle pooled connection is not expected to receive anything nor
+	 * to be closed. If it happens, it is removed from the pool.
+	 */
+	if (appctx->ctx.hlua.pool && !appctx->ctx.hlua.socket) {
+		if (!c || !hlua_tcp_pool_reusable(appctx))
+			hlua_tcp_pool_kill(appctx);
+		return;
+	}
+
 	/* If the connection object is not avalaible, close all the
 	 * streams and wakeup everithing waiting for.
 	 */
@@ -1581,6 +1816,9 @@ static void hlua_socket_release(struct appctx *appctx)
 	if (appctx->ctx.hlua.socket)
 		appctx->ctx.hlua.socket->s = NULL;
 
+	/* Release my slot in the pool. */
+	hlua_tcp_pool_detach(appctx);
+
 	/* Wake all the task waiting for me. */
 	hlua_com_wake(&appctx->ctx.hlua.wake_on_read);
 	hlua_com_wake(&appctx->ctx.hlua.wake_on_write);
@@ -1626,9 +1864,15 @@ __LJMP static int hlua_socket_close(lua_State *L)
 	if (!socket->s)
 		return 0;
 
+	/* A pooled connection goes back to its pool if it is reusable. */
+	appctx = objt_appctx(socket->s->si[0].end);
+	if (appctx->ctx.hlua.pool && hlua_tcp_pool_put(appctx)) {
+		socket->s = NULL;
+		return 0;
+	}
+
 	/* Close the stream and remove the associated stop task. */
 	stream_shutdown(socket->s, SF_ERR_KILLED);
-	appctx = objt_appctx(socket->s->si[0].end);
 	appctx->ctx.hlua.socket = NULL;
 	socket->s = NULL;
 
@@ -2160,17 +2404,54 @@ __LJMP static int hlua_socket_connect_yield(struct lua_State *L, int status, lua
 	return 0;
 }
 
+/* This function initiates the connection of <socket> to <addr>, then
+ * yields. The continuation function <k> is called when the connection
+ * is established or failed.
+ */
+__LJMP static int hlua_socket_connect_addr(struct lua_State *L, struct hlua_socket *socket,
+                                           const struct sockaddr_storage *addr,
+                                           lua_KFunction k)
+{
+	struct connection *conn;
+	struct hlua *hlua;
+	struct appctx *appctx;
+
+	conn = si_alloc_conn(&socket->s->si[1]);
+	if (!conn)
+		WILL_LJMP(luaL_error(L, "connect: internal error"));
+
+	/* needed for the connection not to be closed */
+	conn->target = socket->s->target;
+	memcpy(&conn->addr.to, addr, sizeof(struct sockaddr_storage));
+
+	hlua = hlua_gethlua(L);
+	appctx = objt_appctx(socket->s->si[0].end);
+
+	/* inform the stream that we want to be notified whenever the
+	 * connection completes.
+	 */
+	si_applet_cant_get(&socket->s->si[0]);
+	si_applet_cant_put(&socket->s->si[0]);
+	appctx_wakeup(appctx);
+
+	hlua->flags |= HLUA_MUST_GC;
+
+	if (!hlua_com_new(hlua, &appctx->ctx.hlua.wake_on_write))
+		WILL_LJMP(luaL_error(L, "out of memory"));
+	WILL_LJMP(hlua_yieldk(L, 0, 0, k, TICK_ETERNITY, 0));
+
+	return 0;
+}
+
 /* This function fail or initite the connection. */
 __LJMP static int hlua_socket_connect(struct lua_State *L)
 {
 	struct hlua_socket *socket;
 	int port = -1;
 	const char *ip;
-	struct connection *conn;
-	struct hlua *hlua;
-	struct appctx *appctx;
 	int low, high;
 	struct sockaddr_storage *addr;
+	struct sockaddr_storage to;
 
 	if (lua_gettop(L) < 2)
 		WILL_LJMP(luaL_error(L, "connect: need at least 2 arguments"));
@@ -2181,51 +2462,28 @@ __LJMP static int hlua_socket_connect(struct lua_State *L)
 	if (lua_gettop(L) >= 3)
 		port = MAY_LJMP(luaL_checkinteger(L, 3));
 
-	conn = si_alloc_conn(&socket->s->si[1]);
-	if (!conn)
-		WILL_LJMP(luaL_error(L, "connect: internal error"));
-
-	/* needed for the connection not to be closed */
-	conn->target = socket->s->target;
-
 	/* Parse ip address. */
 	addr = str2sa_range(ip, &low, &high, NULL, NULL, NULL, 0);
 	if (!addr)
 		WILL_LJMP(luaL_error(L, "connect: cannot parse destination address '%s'", ip));
 	if (low != high)
 		WILL_LJMP(luaL_error(L, "connect: port ranges not supported : address '%s'", ip));
-	memcpy(&conn->addr.to, addr, sizeof(struct sockaddr_storage));
+	memcpy(&to, addr, sizeof(struct sockaddr_storage));
 
 	/* Set port. */
 	if (low == 0) {
-		if (conn->addr.to.ss_family == AF_INET) {
+		if (to.ss_family == AF_INET) {
 			if (port == -1)
 				WILL_LJMP(luaL_error(L, "connect: port missing"));
-			((struct sockaddr_in *)&conn->addr.to)->sin_port = htons(port);
-		} else if (conn->addr.to.ss_family == AF_INET6) {
+			((struct sockaddr_in *)&to)->sin_port = htons(port);
+		} else if (to.ss_family == AF_INET6) {
 			if (port == -1)
 				WILL_LJMP(luaL_error(L, "connect: port missing"));
-			((struct sockaddr_in6 *)&conn->addr.to)->sin6_port = htons(port);
+			((struct sockaddr_in6 *)&to)->sin6_port = htons(port);
 		}
 	}
 
-	hlua = hlua_gethlua(L);
-	appctx = objt_appctx(socket->s->si[0].end);
-
-	/* inform the stream that we want to be notified whenever the
-	 * connection completes.
-	 */
-	si_applet_cant_get(&socket->s->si[0]);
-	si_applet_cant_put(&socket->s->si[0]);
-	appctx_wakeup(appctx);
-
-	hlua->flags |= HLUA_MUST_GC;
-
-	if (!hlua_com_new(hlua, &appctx->ctx.hlua.wake_on_write))
-		WILL_LJMP(luaL_error(L, "out of memory"));
-	WILL_LJMP(hlua_yieldk(L, 0, 0, hlua_socket_connect_yield, TICK_ETERNITY, 0));
-
-	return 0;
+	return MAY_LJMP(hlua_socket_connect_addr(L, socket, &to, hlua_socket_connect_yield));
 }
 
 #ifdef USE_OPENSSL
@@ -2263,19 +2521,12 @@ __LJMP static int hlua_socket_settimeout(struct lua_State *L)
 	return 0;
 }
 
-__LJMP static int hlua_socket_new(lua_State *L)
+/* This function creates a Socket object which is not yet attached to
+ * any stream, pushes it on the stack and returns it.
+ */
+__LJMP static struct hlua_socket *hlua_socket_push(lua_State *L)
 {
 	struct hlua_socket *socket;
-	struct appctx *appctx;
-	struct session *sess;
-	struct stream *strm;
-	struct task *task;
-
-	/* Check stack size. */
-	if (!lua_checkstack(L, 3)) {
-		hlua_pusherror(L, "socket: full stack");
-		goto out_fail_conf;
-	}
 
 	/* Create the object: obj[0] = userdata. */
 	lua_newtable(L);
@@ -2283,16 +2534,30 @@ __LJMP static int hlua_socket_new(lua_State *L)
 	lua_rawseti(L, -2, 0);
 	memset(socket, 0, sizeof(*socket));
 
+	/* Pop a class stream metatable and affect it to the userdata. */
+	lua_rawgeti(L, LUA_REGISTRYINDEX, class_socket_ref);
+	lua_setmetatable(L, -2);
+
+	return socket;
+}
+
+/* This function creates the applet, the session and the stream used by
+ * <socket> for its I/O. It returns 1 on success, otherwise it pushes an
+ * error message on the stack and returns 0.
+ */
+static int hlua_socket_init_stream(lua_State *L, struct hlua_socket *socket)
+{
+	struct appctx *appctx;
+	struct session *sess;
+	struct stream *strm;
+	struct task *task;
+
 	/* Check if the various memory pools are intialized. */
 	if (!pool2_stream || !pool2_buffer) {
 		hlua_pusherror(L, "socket: uninitialized pools.");
 		goto out_fail_conf;
 	}
 
-	/* Pop a class stream metatable and affect it to the userdata. */
-	lua_rawgeti(L, LUA_REGISTRYINDEX, class_socket_ref);
-	lua_setmetatable(L, -2);
-
 	/* Create the applet context */
 	appctx = appctx_new(&update_applet);
 	if (!appctx) {
@@ -2302,8 +2567,10 @@ __LJMP static int hlua_socket_new(lua_State *L)
 
 	appctx->ctx.hlua.socket = socket;
 	appctx->ctx.hlua.connected = 0;
+	appctx->ctx.hlua.pool = NULL;
 	LIST_INIT(&appctx->ctx.hlua.wake_on_write);
 	LIST_INIT(&appctx->ctx.hlua.wake_on_read);
+	LIST_INIT(&appctx->ctx.hlua.by_pool);
 
 	/* Now create a session, task and stream for this applet */
 	sess = session_new(&socket_proxy, NULL, &appctx->obj_type);
@@ -2334,33 +2601,291 @@ __LJMP static int hlua_socket_new(lua_State *L)
 	strm->hlua.flags = 0;
 	LIST_INIT(&strm->hlua.com);
 
-	/* Configure "right" stream interface. this "si" is used to connect
-	 * and retrieve data from the server. The connection is initialized
-	 * with the "struct server".
-	 */
-	si_set_state(&strm->si[1], SI_ST_ASS);
+	/* Configure "right" stream interface. this "si" is used to connect
+	 * and retrieve data from the server. The connection is initialized
+	 * with the "struct server".
+	 */
+	si_set_state(&strm->si[1], SI_ST_ASS);
+
+	/* Force destination server. */
+	strm->flags |= SF_DIRECT | SF_ASSIGNED | SF_ADDR_SET | SF_BE_ASSIGNED;
+	strm->target = &socket_tcp.obj_type;
+
+	/* Update statistics counters. */
+	socket_proxy.feconn++; /* beconn will be increased later */
+	jobs++;
+	totalconn++;
+
+	return 1;
+
+ out_fail_stream:
+	task_free(task);
+ out_fail_task:
+	session_free(sess);
+ out_fail_sess:
+	appctx_free(appctx);
+ out_fail_conf:
+	return 0;
+}
+
+__LJMP static int hlua_socket_new(lua_State *L)
+{
+	struct hlua_socket *socket;
+
+	/* Check stack size. */
+	if (!lua_checkstack(L, 3)) {
+		hlua_pusherror(L, "socket: full stack");
+		WILL_LJMP(lua_error(L));
+	}
+
+	socket = MAY_LJMP(hlua_socket_push(L));
+	if (!hlua_socket_init_stream(L, socket))
+		WILL_LJMP(lua_error(L));
+
+	/* Return yield waiting for connection. */
+	return 1;
+}
+
+/*
+ *
+ *
+ * Class TcpPool
+ *
+ *
+ */
+
+__LJMP static struct hlua_tcp_pool *hlua_checktcppool(lua_State *L, int ud)
+{
+	return MAY_LJMP(hlua_checkudata(L, ud, class_tcp_pool_ref));
+}
+
+/* Pushes on the stack the TcpPool object associated with <pool>. */
+static void hlua_tcp_pool_push(lua_State *L, struct hlua_tcp_pool *pool)
+{
+	lua_newtable(L);
+	lua_pushlightuserdata(L, pool);
+	lua_rawseti(L, -2, 0);
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, class_tcp_pool_ref);
+	lua_setmetatable(L, -2);
+}
+
+/* This function is the TcpPool constructor: core.tcp_pool(name, addr, max
+ * [, idle_timeout]). The pools are shared by all the Lua coroutines, so if
+ * a pool with the same name already exists, it is returned and the other
+ * arguments are ignored. The idle timeout is in seconds, 0 disables it.
+ */
+__LJMP static int hlua_tcp_pool_new(lua_State *L)
+{
+	struct hlua_tcp_pool *pool;
+	const char *name;
+	const char *ip;
+	int max;
+	int timeout = 30;
+	int low, high;
+	struct sockaddr_storage *addr;
+
+	if (lua_gettop(L) < 3 || lua_gettop(L) > 4)
+		WILL_LJMP(luaL_error(L, "'tcp_pool' needs between 3 and 4 arguments"));
+
+	name = MAY_LJMP(luaL_checkstring(L, 1));
+	ip = MAY_LJMP(luaL_checkstring(L, 2));
+	max = MAY_LJMP(luaL_checkinteger(L, 3));
+	if (lua_gettop(L) >= 4)
+		timeout = MAY_LJMP(luaL_checkinteger(L, 4));
+
+	list_for_each_entry(pool, &hlua_tcp_pools, list) {
+		if (strcmp(pool->name, name) == 0) {
+			hlua_tcp_pool_push(L, pool);
+			return 1;
+		}
+	}
+
+	if (max <= 0)
+		WILL_LJMP(luaL_argerror(L, 3, "must be a positive integer"));
+	if (timeout < 0 || timeout > INT_MAX / 1000)
+		WILL_LJMP(luaL_argerror(L, 4, "invalid timeout"));
+
+	addr = str2sa_range(ip, &low, &high, NULL, NULL, NULL, 0);
+	if (!addr)
+		WILL_LJMP(luaL_error(L, "tcp_pool: cannot parse destination address '%s'", ip));
+	if (low != high)
+		WILL_LJMP(luaL_error(L, "tcp_pool: port ranges not supported : address '%s'", ip));
+	if (low == 0 && (addr->ss_family == AF_INET || addr->ss_family == AF_INET6))
+		WILL_LJMP(luaL_error(L, "tcp_pool: port missing : address '%s'", ip));
+
+	pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		WILL_LJMP(luaL_error(L, "tcp_pool: out of memory"));
+
+	pool->name = strdup(name);
+	pool->task = task_new();
+	if (!pool->name || !pool->task) {
+		free(pool->name);
+		if (pool->task)
+			task_free(pool->task);
+		free(pool);
+		WILL_LJMP(luaL_error(L, "tcp_pool: out of memory"));
+	}
+
+	memcpy(&pool->addr, addr, sizeof(pool->addr));
+	pool->max = max;
+	pool->idle_timeout = timeout ? MS_TO_TICKS(timeout * 1000) : TICK_ETERNITY;
+	LIST_INIT(&pool->idle_conns);
+	LIST_INIT(&pool->wake_on_release);
+
+	pool->task->process = hlua_tcp_pool_expire;
+	pool->task->context = pool;
+	pool->task->expire = TICK_ETERNITY;
+
+	/* The idle connections must be closed when the process is stopping. */
+	signal_register_task(0, pool->task, 0);
+
+	LIST_ADDQ(&hlua_tcp_pools, &pool->list);
+	hlua_tcp_pool_push(L, pool);
+	return 1;
+}
+
+/* This function is the continuation of the connection of a new pooled
+ * socket. The socket is at the index 2 of the stack, it is returned
+ * once connected.
+ */
+__LJMP static int hlua_tcp_pool_connect_yield(struct lua_State *L, int status, lua_KContext ctx)
+{
+	struct hlua_socket *socket = MAY_LJMP(hlua_checksocket(L, 2));
+	struct hlua *hlua = hlua_gethlua(L);
+	struct appctx *appctx;
+
+	/* Check for connection close. */
+	if (!hlua || !socket->s || channel_output_closed(&socket->s->req)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Can't connect");
+		return 2;
+	}
+
+	appctx = objt_appctx(socket->s->si[0].end);
+
+	/* Check for connection established. */
+	if (appctx->ctx.hlua.connected) {
+		lua_pushvalue(L, 2);
+		return 1;
+	}
+
+	if (!hlua_com_new(hlua, &appctx->ctx.hlua.wake_on_write))
+		WILL_LJMP(luaL_error(L, "out of memory error"));
+	WILL_LJMP(hlua_yieldk(L, 0, 0, hlua_tcp_pool_connect_yield, TICK_ETERNITY, 0));
+	return 0;
+}
+
+/* This function leases a connection from the pool. An idle connection is
+ * used if one is available, otherwise a new one is established if the
+ * pool is not full, otherwise the function waits for a connection to be
+ * released. <ctx> contains the date the wait started, or 0.
+ */
+__LJMP static int hlua_tcp_pool_get_yield(struct lua_State *L, int status, lua_KContext ctx)
+{
+	struct hlua_tcp_pool *pool = MAY_LJMP(hlua_checktcppool(L, 1));
+	struct hlua *hlua = hlua_gethlua(L);
+	unsigned int wait_start = ctx;
+	struct hlua_socket *socket;
+	struct appctx *appctx;
+
+	/* Check if this lua stack is schedulable. */
+	if (!hlua || !hlua->task)
+		WILL_LJMP(luaL_error(L, "The 'get' function is only allowed in "
+		                      "'frontend', 'backend' or 'task'"));
+
+	/* The socket object is created before leasing the connection because
+	 * its allocation may fail. A previous one left by a wait is dropped.
+	 */
+	lua_settop(L, 1);
+	if (!lua_checkstack(L, 3))
+		WILL_LJMP(luaL_error(L, "tcp_pool: full stack"));
+	socket = MAY_LJMP(hlua_socket_push(L));
+	hlua->flags |= HLUA_MUST_GC;
+
+	appctx = hlua_tcp_pool_take(pool);
+	if (!appctx && pool->idle + pool->used >= pool->max) {
+		if (!wait_start)
+			wait_start = tick_add(now_ms, 0);
+		if (!hlua_com_new(hlua, &pool->wake_on_release))
+			WILL_LJMP(luaL_error(L, "out of memory"));
+		WILL_LJMP(hlua_yieldk(L, 0, wait_start, hlua_tcp_pool_get_yield, TICK_ETERNITY, 0));
+	}
+
+	if (wait_start) {
+		pool->waits++;
+		pool->wait_time += now_ms - wait_start;
+	}
+
+	if (appctx) {
+		socket->s = si_strm(appctx->owner);
+		appctx->ctx.hlua.socket = socket;
+		return 1;
+	}
+
+	/* No idle connection, establish a new one. */
+	if (!hlua_socket_init_stream(L, socket))
+		WILL_LJMP(lua_error(L));
+
+	appctx = objt_appctx(socket->s->si[0].end);
+	appctx->ctx.hlua.pool = pool;
+	pool->used++;
+	pool->created++;
+
+	return MAY_LJMP(hlua_socket_connect_addr(L, socket, &pool->addr, hlua_tcp_pool_connect_yield));
+}
 
-	/* Force destination server. */
-	strm->flags |= SF_DIRECT | SF_ASSIGNED | SF_ADDR_SET | SF_BE_ASSIGNED;
-	strm->target = &socket_tcp.obj_type;
+__LJMP static int hlua_tcp_pool_get(struct lua_State *L)
+{
+	MAY_LJMP(check_args(L, 1, "get"));
+	return MAY_LJMP(hlua_tcp_pool_get_yield(L, 0, 0));
+}
 
-	/* Update statistics counters. */
-	socket_proxy.feconn++; /* beconn will be increased later */
-	jobs++;
-	totalconn++;
+/* This function returns a table containing the occupancy and the
+ * statistics of the pool.
+ */
+__LJMP static int hlua_tcp_pool_stats(struct lua_State *L)
+{
+	struct hlua_tcp_pool *pool;
+	struct hlua_com *com;
+	int waiting = 0;
 
-	/* Return yield waiting for connection. */
-	return 1;
+	MAY_LJMP(check_args(L, 1, "stats"));
+	pool = MAY_LJMP(hlua_checktcppool(L, 1));
 
- out_fail_stream:
-	task_free(task);
- out_fail_task:
-	session_free(sess);
- out_fail_sess:
-	appctx_free(appctx);
- out_fail_conf:
-	WILL_LJMP(lua_error(L));
-	return 0;
+	list_for_each_entry(com, &pool->wake_on_release, wake_me)
+		waiting++;
+
+	lua_newtable(L);
+	lua_pushstring(L, "name");
+	lua_pushstring(L, pool->name);
+	lua_settable(L, -3);
+	lua_pushstring(L, "max");
+	lua_pushinteger(L, pool->max);
+	lua_settable(L, -3);
+	lua_pushstring(L, "idle");
+	lua_pushinteger(L, pool->idle);
+	lua_settable(L, -3);
+	lua_pushstring(L, "used");
+	lua_pushinteger(L, pool->used);
+	lua_settable(L, -3);
+	lua_pushstring(L, "waiting");
+	lua_pushinteger(L, waiting);
+	lua_settable(L, -3);
+	lua_pushstring(L, "created");
+	lua_pushinteger(L, pool->created);
+	lua_settable(L, -3);
+	lua_pushstring(L, "reused");
+	lua_pushinteger(L, pool->reused);
+	lua_settable(L, -3);
+	lua_pushstring(L, "waits");
+	lua_pushinteger(L, pool->waits);
+	lua_settable(L, -3);
+	lua_pushstring(L, "wait_time");
+	lua_pushinteger(L, pool->wait_time);
+	lua_settable(L, -3);
+	return 1;
 }
 
 /*
@@ -2933,6 +3458,44 @@ static int hlua_fetches_new(lua_State *L, struct hlua_txn *txn, unsigned int fla
 	return 1;
 }
 
+/* Runs the sample fetch <f> into <smp> for stream <s> of proxy <p> in
+ * direction <dir>. Its arguments are read from the Lua stack starting at
+ * index <first>. It returns the value of the fetch's process function, or
+ * throws an error if the arguments are invalid.
+ */
+__LJMP static int hlua_fetch_sample(lua_State *L, struct sample_fetch *f, int first,
+                                    struct proxy *p, struct stream *s, int dir,
+                                    struct sample *smp)
+{
+	struct arg args[ARGM_NBARGS + 1];
+	int i;
+
+	/* Get extra arguments. */
+	for (i = 0; i < lua_gettop(L) - (first - 1); i++) {
+		if (i >= ARGM_NBARGS)
+			break;
+		hlua_lua2arg(L, i + first, &args[i]);
+	}
+	args[i].type = ARGT_STOP;
+	args[i].data.str.str = NULL;
+
+	/* Check arguments. */
+	MAY_LJMP(hlua_lua2arg_check(L, first, args, f->arg_mask, p));
+
+	/* Run the special args checker. */
+	if (f->val_args && !f->val_args(args, NULL)) {
+		lua_pushfstring(L, "error in arguments");
+		WILL_LJMP(lua_error(L));
+	}
+
+	/* Initialise the sample. */
+	memset(smp, 0, sizeof(*smp));
+
+	/* Run the sample fetch process. */
+	smp_set_owner(smp, p, s->sess, s, dir & SMP_OPT_DIR);
+	return f->process(args, smp, f->kw, f->private);
+}
+
 /* This function is an LUA binding. It is called with each sample-fetch.
  * It uses closure argument to store the associated sample-fetch. It
  * returns only one argument or throws an error. An error is thrown
@@ -2943,8 +3506,6 @@ __LJMP static int hlua_run_sample_fetch(lua_State *L)
 {
 	struct hlua_smp *hsmp;
 	struct sample_fetch *f;
-	struct arg args[ARGM_NBARGS + 1];
-	int i;
 	struct sample smp;
 
 	/* Get closure arguments. */
@@ -2961,30 +3522,7 @@ __LJMP static int hlua_run_sample_fetch(lua_State *L)
 		WILL_LJMP(lua_error(L));
 	}
 
-	/* Get extra arguments. */
-	for (i = 0; i < lua_gettop(L) - 1; i++) {
-		if (i >= ARGM_NBARGS)
-			break;
-		hlua_lua2arg(L, i + 2, &args[i]);
-	}
-	args[i].type = ARGT_STOP;
-	args[i].data.str.str = NULL;
-
-	/* Check arguments. */
-	MAY_LJMP(hlua_lua2arg_check(L, 2, args, f->arg_mask, hsmp->p));
-
-	/* Run the special args checker. */
-	if (f->val_args && !f->val_args(args, NULL)) {
-		lua_pushfstring(L, "error in arguments");
-		WILL_LJMP(lua_error(L));
-	}
-
-	/* Initialise the sample. */
-	memset(&smp, 0, sizeof(smp));
-
-	/* Run the sample fetch process. */
-	smp_set_owner(&smp, hsmp->p, hsmp->s->sess, hsmp->s, hsmp->dir & SMP_OPT_DIR);
-	if (!f->process(args, &smp, f->kw, f->private)) {
+	if (!MAY_LJMP(hlua_fetch_sample(L, f, 2, hsmp->p, hsmp->s, hsmp->dir, &smp))) {
 		if (hsmp->flags & HLUA_F_AS_STRING)
 			lua_pushstring(L, "");
 		else
@@ -3989,7 +4527,7 @@ __LJMP static int hlua_applet_http_start_response(lua_State *L)
 	lua_pushvalue(L, 0);
 	if (lua_getfield(L, 1, "response") != LUA_TTABLE) {
 		hlua_pusherror(L, "Lua applet http '%s': AppletHTTP['response'] missing.\n",
-		               appctx->appctx->rule->arg.hlua_rule->fcn.name);
+		               appctx->appctx->rule->arg.hlua_rule->fcn->name);
 		WILL_LJMP(lua_error(L));
 	}
 
@@ -4000,7 +4538,7 @@ __LJMP static int hlua_applet_http_start_response(lua_State *L)
 		/* We expect a string as -2. */
 		if (lua_type(L, -2) != LUA_TSTRING) {
 			hlua_pusherror(L, "Lua applet http '%s': AppletHTTP['response'][] element must be a string. got %s.\n",
-								appctx->appctx->rule->arg.hlua_rule->fcn.name,
+								appctx->appctx->rule->arg.hlua_rule->fcn->name,
 			               lua_typename(L, lua_type(L, -2)));
 			WILL_LJMP(lua_error(L));
 		}
@@ -4009,7 +4547,7 @@ __LJMP static int hlua_applet_http_start_response(lua_State *L)
 		/* We expect an array as -1. */
 		if (lua_type(L, -1) != LUA_TTABLE) {
 			hlua_pusherror(L, "Lua applet http '%s': AppletHTTP['response']['%s'] element must be an table. got %s.\n",
-								appctx->appctx->rule->arg.hlua_rule->fcn.name,
+								appctx->appctx->rule->arg.hlua_rule->fcn->name,
 								name,
 			               lua_typename(L, lua_type(L, -1)));
 			WILL_LJMP(lua_error(L));
@@ -4022,7 +4560,7 @@ __LJMP static int hlua_applet_http_start_response(lua_State *L)
 			/* We expect a number as -2. */
 			if (lua_type(L, -2) != LUA_TNUMBER) {
 				hlua_pusherror(L, "Lua applet http '%s': AppletHTTP['response']['%s'][] element must be a number. got %s.\n",
-									appctx->appctx->rule->arg.hlua_rule->fcn.name,
+									appctx->appctx->rule->arg.hlua_rule->fcn->name,
 									name,
 				               lua_typename(L, lua_type(L, -2)));
 				WILL_LJMP(lua_error(L));
@@ -4032,7 +4570,7 @@ __LJMP static int hlua_applet_http_start_response(lua_State *L)
 			/* We expect a string as -2. */
 			if (lua_type(L, -1) != LUA_TSTRING) {
 				hlua_pusherror(L, "Lua applet http '%s': AppletHTTP['response']['%s'][%d] element must be a string. got %s.\n",
-									appctx->appctx->rule->arg.hlua_rule->fcn.name,
+									appctx->appctx->rule->arg.hlua_rule->fcn->name,
 									name, id,
 				               lua_typename(L, lua_type(L, -1)));
 				WILL_LJMP(lua_error(L));
@@ -4274,6 +4812,134 @@ __LJMP static int hlua_http_res_get_headers(lua_State *L)
 	return hlua_http_get_headers(L, htxn, &htxn->s->txn->rsp);
 }
 
+/* This function returns the value of one occurrence of the header
+ * whose name is the second argument, or nil if it is not found. The
+ * optional third argument is the occurrence: positive values count
+ * from the first one (1 is the first), negative values count from the
+ * last one (-1 is the last, this is the default). Unlike get_headers(),
+ * only the requested value is converted into a Lua string. It is used
+ * as wrapper with the 2 following functions.
+ */
+__LJMP static int hlua_http_get_header(lua_State *L, struct hlua_txn *htxn, struct http_msg *msg)
+{
+	size_t len;
+	const char *name = MAY_LJMP(luaL_checklstring(L, 2, &len));
+	int occ = MAY_LJMP(luaL_optinteger(L, 3, -1));
+	struct http_txn *txn = htxn->s->txn;
+	struct hdr_ctx ctx;
+	int found;
+
+	/* Check if a valid message is parsed */
+	if (!txn || unlikely(msg->msg_state < HTTP_MSG_BODY) || occ == 0) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	if (occ < 0) {
+		/* count the occurrences, then convert to a positive one. */
+		found = 0;
+		ctx.idx = 0;
+		while (http_find_full_header2(name, len, msg->chn->buf->p, &txn->hdr_idx, &ctx))
+			found++;
+		occ += found + 1;
+		if (occ <= 0) {
+			lua_pushnil(L);
+			return 1;
+		}
+	}
+
+	ctx.idx = 0;
+	while (http_find_full_header2(name, len, msg->chn->buf->p, &txn->hdr_idx, &ctx)) {
+		if (--occ)
+			continue;
+		lua_pushlstring(L, ctx.line + ctx.val, ctx.vlen);
+		return 1;
+	}
+
+	lua_pushnil(L);
+	return 1;
+}
+
+__LJMP static int hlua_http_req_get_header(lua_State *L)
+{
+	struct hlua_txn *htxn;
+
+	if (lua_gettop(L) < 2 || lua_gettop(L) > 3)
+		WILL_LJMP(luaL_error(L, "'req_get_header' needs between 2 and 3 arguments"));
+	htxn = MAY_LJMP(hlua_checkhttp(L, 1));
+
+	return MAY_LJMP(hlua_http_get_header(L, htxn, &htxn->s->txn->req));
+}
+
+__LJMP static int hlua_http_res_get_header(lua_State *L)
+{
+	struct hlua_txn *htxn;
+
+	if (lua_gettop(L) < 2 || lua_gettop(L) > 3)
+		WILL_LJMP(luaL_error(L, "'res_get_header' needs between 2 and 3 arguments"));
+	htxn = MAY_LJMP(hlua_checkhttp(L, 1));
+
+	return MAY_LJMP(hlua_http_get_header(L, htxn, &htxn->s->txn->rsp));
+}
+
+/* This function returns true if the header whose name is the second
+ * argument is present. If a third argument is given, at least one
+ * occurrence must also have exactly this value. No Lua string is
+ * created, so it is the cheapest way to inspect headers. It is used
+ * as wrapper with the 2 following functions.
+ */
+__LJMP static int hlua_http_has_header(lua_State *L, struct hlua_txn *htxn, struct http_msg *msg)
+{
+	size_t len, vlen = 0;
+	const char *name = MAY_LJMP(luaL_checklstring(L, 2, &len));
+	const char *value = NULL;
+	struct http_txn *txn = htxn->s->txn;
+	struct hdr_ctx ctx;
+
+	if (lua_gettop(L) >= 3)
+		value = MAY_LJMP(luaL_checklstring(L, 3, &vlen));
+
+	/* Check if a valid message is parsed */
+	if (!txn || unlikely(msg->msg_state < HTTP_MSG_BODY)) {
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+
+	ctx.idx = 0;
+	while (http_find_full_header2(name, len, msg->chn->buf->p, &txn->hdr_idx, &ctx)) {
+		if (!value ||
+		    (ctx.vlen == vlen && memcmp(ctx.line + ctx.val, value, vlen) == 0)) {
+			lua_pushboolean(L, 1);
+			return 1;
+		}
+	}
+
+	lua_pushboolean(L, 0);
+	return 1;
+}
+
+__LJMP static int hlua_http_req_has_header(lua_State *L)
+{
+	struct hlua_txn *htxn;
+
+	if (lua_gettop(L) < 2 || lua_gettop(L) > 3)
+		WILL_LJMP(luaL_error(L, "'req_has_header' needs between 2 and 3 arguments"));
+	htxn = MAY_LJMP(hlua_checkhttp(L, 1));
+
+	return MAY_LJMP(hlua_http_has_header(L, htxn, &htxn->s->txn->req));
+}
+
+__LJMP static int hlua_http_res_has_header(lua_State *L)
+{
+	struct hlua_txn *htxn;
+
+	if (lua_gettop(L) < 2 || lua_gettop(L) > 3)
+		WILL_LJMP(luaL_error(L, "'res_has_header' needs between 2 and 3 arguments"));
+	htxn = MAY_LJMP(hlua_checkhttp(L, 1));
+
+	return MAY_LJMP(hlua_http_has_header(L, htxn, &htxn->s->txn->rsp));
+}
+
 /* This function replace full header, or just a value in
  * the request or in the response. It is a wrapper fir the
  * 4 following functions.
@@ -4636,6 +5302,64 @@ __LJMP static int hlua_get_var(lua_State *L)
 	return hlua_smp2lua(L, &smp);
 }
 
+/* Returns true if the variable exists and its value is equal to the
+ * third argument. The variable content is not converted into a Lua
+ * value.
+ */
+__LJMP static int hlua_match_var(lua_State *L)
+{
+	struct hlua_txn *htxn;
+	const char *name;
+	size_t len;
+	struct sample smp;
+
+	MAY_LJMP(check_args(L, 3, "match_var"));
+
+	htxn = MAY_LJMP(hlua_checktxn(L, 1));
+	name = MAY_LJMP(luaL_checklstring(L, 2, &len));
+
+	smp_set_owner(&smp, htxn->p, htxn->s->sess, htxn->s, htxn->dir & SMP_OPT_DIR);
+	if (!vars_get_by_name(name, len, &smp)) {
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+
+	lua_pushboolean(L, hlua_smp_match(L, 3, &smp));
+	return 1;
+}
+
+/* Returns true if the sample fetch named by the second argument succeeds
+ * and its result is equal to the third argument. The remaining arguments
+ * are passed to the sample fetch. As with match_var(), the result is not
+ * converted into a Lua value.
+ */
+__LJMP static int hlua_match_fetch(lua_State *L)
+{
+	struct hlua_txn *htxn;
+	struct sample_fetch *f;
+	const char *name;
+	size_t len;
+	struct sample smp;
+
+	if (lua_gettop(L) < 3)
+		WILL_LJMP(luaL_error(L, "'match_fetch' needs at least 3 arguments"));
+
+	htxn = MAY_LJMP(hlua_checktxn(L, 1));
+	name = MAY_LJMP(luaL_checklstring(L, 2, &len));
+
+	f = find_sample_fetch(name, len);
+	if (!f)
+		WILL_LJMP(luaL_argerror(L, 2, "unknown sample fetch"));
+
+	if (!MAY_LJMP(hlua_fetch_sample(L, f, 4, htxn->p, htxn->s, htxn->dir, &smp))) {
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+
+	lua_pushboolean(L, hlua_smp_match(L, 3, &smp));
+	return 1;
+}
+
 __LJMP static int hlua_set_priv(lua_State *L)
 {
 	struct hlua *hlua;
@@ -5248,6 +5972,7 @@ static int hlua_sample_conv_wrapper(const struct arg *arg_p, struct sample *smp,
 
 		/* Restore the function in the stack. */
 		lua_rawgeti(stream->hlua.T, LUA_REGISTRYINDEX, fcn->function_ref);
+		stream->hlua.fcn = fcn;
 
 		/* convert input sample and pust-it in the stack. */
 		if (!lua_checkstack(stream->hlua.T, 1)) {
@@ -5356,6 +6081,7 @@ static int hlua_sample_fetch_wrapper(const struct arg *arg_p, struct sample *smp
 
 		/* Restore the function in the stack. */
 		lua_rawgeti(stream->hlua.T, LUA_REGISTRYINDEX, fcn->function_ref);
+		stream->hlua.fcn = fcn;
 
 		/* push arguments in the stack. */
 		if (!hlua_txn_new(stream->hlua.T, stream, smp->px, smp->opt & SMP_OPT_DIR,
@@ -5457,6 +6183,8 @@ __LJMP static int hlua_register_converters(lua_State *L)
 	if (!fcn->name)
 		WILL_LJMP(luaL_error(L, "lua out of memory error."));
 	fcn->function_ref = ref;
+	fcn->type = "converter";
+	LIST_ADDQ(&hlua_functions, &fcn->list);
 
 	/* List head */
 	sck->list.n = sck->list.p = NULL;
@@ -5514,6 +6242,8 @@ __LJMP static int hlua_register_fetches(lua_State *L)
 	if (!fcn->name)
 		WILL_LJMP(luaL_error(L, "lua out of memory error."));
 	fcn->function_ref = ref;
+	fcn->type = "fetch";
+	LIST_ADDQ(&hlua_functions, &fcn->list);
 
 	/* List head */
 	sfk->list.n = sfk->list.p = NULL;
@@ -5570,7 +6300,7 @@ static enum act_return hlua_action(struct act_rule *rule, struct proxy *px,
 	 */
 	if (!s->hlua.T && !hlua_ctx_init(&s->hlua, s->task)) {
 		SEND_ERR(px, "Lua action '%s': can't initialize Lua context.\n",
-		         rule->arg.hlua_rule->fcn.name);
+		         rule->arg.hlua_rule->fcn->name);
 		return ACT_RET_CONT;
 	}
 
@@ -5584,25 +6314,26 @@ static enum act_return hlua_action(struct act_rule *rule, struct proxy *px,
 			else
 				error = "critical error";
 			SEND_ERR(px, "Lua function '%s': %s.\n",
-			         rule->arg.hlua_rule->fcn.name, error);
+			         rule->arg.hlua_rule->fcn->name, error);
 			return ACT_RET_CONT;
 		}
 
 		/* Check stack available size. */
 		if (!lua_checkstack(s->hlua.T, 1)) {
 			SEND_ERR(px, "Lua function '%s': full stack.\n",
-			         rule->arg.hlua_rule->fcn.name);
+			         rule->arg.hlua_rule->fcn->name);
 			RESET_SAFE_LJMP(s->hlua.T);
 			return ACT_RET_CONT;
 		}
 
 		/* Restore the function in the stack. */
-		lua_rawgeti(s->hlua.T, LUA_REGISTRYINDEX, rule->arg.hlua_rule->fcn.function_ref);
+		lua_rawgeti(s->hlua.T, LUA_REGISTRYINDEX, rule->arg.hlua_rule->fcn->function_ref);
+		s->hlua.fcn = rule->arg.hlua_rule->fcn;
 
 		/* Create and and push object stream in the stack. */
 		if (!hlua_txn_new(s->hlua.T, s, px, dir, 0)) {
 			SEND_ERR(px, "Lua function '%s': full stack.\n",
-			         rule->arg.hlua_rule->fcn.name);
+			         rule->arg.hlua_rule->fcn->name);
 			RESET_SAFE_LJMP(s->hlua.T);
 			return ACT_RET_CONT;
 		}
@@ -5612,7 +6343,7 @@ static enum act_return hlua_action(struct act_rule *rule, struct proxy *px,
 		for (arg = rule->arg.hlua_rule->args; arg && *arg; arg++) {
 			if (!lua_checkstack(s->hlua.T, 1)) {
 				SEND_ERR(px, "Lua function '%s': full stack.\n",
-				         rule->arg.hlua_rule->fcn.name);
+				         rule->arg.hlua_rule->fcn->name);
 				RESET_SAFE_LJMP(s->hlua.T);
 				return ACT_RET_CONT;
 			}
@@ -5665,7 +6396,7 @@ static enum act_return hlua_action(struct act_rule *rule, struct proxy *px,
 			return ACT_RET_ERR;
 		/* Display log. */
 		SEND_ERR(px, "Lua function '%s': %s.\n",
-		         rule->arg.hlua_rule->fcn.name, lua_tostring(s->hlua.T, -1));
+		         rule->arg.hlua_rule->fcn->name, lua_tostring(s->hlua.T, -1));
 		lua_pop(s->hlua.T, 1);
 		return ACT_RET_CONT;
 
@@ -5674,7 +6405,7 @@ static enum act_return hlua_action(struct act_rule *rule, struct proxy *px,
 			return ACT_RET_ERR;
 		/* Display log. */
 		SEND_ERR(px, "Lua function '%s' return an unknown error.\n",
-		         rule->arg.hlua_rule->fcn.name);
+		         rule->arg.hlua_rule->fcn->name);
 
 	default:
 		return ACT_RET_CONT;
@@ -5712,7 +6443,7 @@ static int hlua_applet_tcp_init(struct appctx *ctx, struct proxy *px, struct str
 	task = task_new();
 	if (!task) {
 		SEND_ERR(px, "Lua applet tcp '%s': out of memory.\n",
-		         ctx->rule->arg.hlua_rule->fcn.name);
+		         ctx->rule->arg.hlua_rule->fcn->name);
 		return 0;
 	}
 	task->nice = 0;
@@ -5727,7 +6458,7 @@ static int hlua_applet_tcp_init(struct appctx *ctx, struct proxy *px, struct str
 	 */
 	if (!hlua_ctx_init(hlua, task)) {
 		SEND_ERR(px, "Lua applet tcp '%s': can't initialize Lua context.\n",
-		         ctx->rule->arg.hlua_rule->fcn.name);
+		         ctx->rule->arg.hlua_rule->fcn->name);
 		return 0;
 	}
 
@@ -5741,7 +6472,7 @@ static int hlua_applet_tcp_init(struct appctx *ctx, struct proxy *px, struct str
 		else
 			error = "critical error";
 		SEND_ERR(px, "Lua applet tcp '%s': %s.\n",
-		         ctx->rule->arg.hlua_rule->fcn.name, error);
+		         ctx->rule->arg.hlua_rule->fcn->name, error);
 		RESET_SAFE_LJMP(hlua->T);
 		return 0;
 	}
@@ -5749,18 +6480,19 @@ static int hlua_applet_tcp_init(struct appctx *ctx, struct proxy *px, struct str
 	/* Check stack available size. */
 	if (!lua_checkstack(hlua->T, 1)) {
 		SEND_ERR(px, "Lua applet tcp '%s': full stack.\n",
-		         ctx->rule->arg.hlua_rule->fcn.name);
+		         ctx->rule->arg.hlua_rule->fcn->name);
 		RESET_SAFE_LJMP(hlua->T);
 		return 0;
 	}
 
 	/* Restore the function in the stack. */
-	lua_rawgeti(hlua->T, LUA_REGISTRYINDEX, ctx->rule->arg.hlua_rule->fcn.function_ref);
+	lua_rawgeti(hlua->T, LUA_REGISTRYINDEX, ctx->rule->arg.hlua_rule->fcn->function_ref);
+	hlua->fcn = ctx->rule->arg.hlua_rule->fcn;
 
 	/* Create and and push object stream in the stack. */
 	if (!hlua_applet_tcp_new(hlua->T, ctx)) {
 		SEND_ERR(px, "Lua applet tcp '%s': full stack.\n",
-		         ctx->rule->arg.hlua_rule->fcn.name);
+		         ctx->rule->arg.hlua_rule->fcn->name);
 		RESET_SAFE_LJMP(hlua->T);
 		return 0;
 	}
@@ -5770,7 +6502,7 @@ static int hlua_applet_tcp_init(struct appctx *ctx, struct proxy *px, struct str
 	for (arg = ctx->rule->arg.hlua_rule->args; arg && *arg; arg++) {
 		if (!lua_checkstack(hlua->T, 1)) {
 			SEND_ERR(px, "Lua applet tcp '%s': full stack.\n",
-			         ctx->rule->arg.hlua_rule->fcn.name);
+			         ctx->rule->arg.hlua_rule->fcn->name);
 			RESET_SAFE_LJMP(hlua->T);
 			return 0;
 		}
@@ -5829,14 +6561,14 @@ static void hlua_applet_tcp_fct(struct appctx *ctx)
 	case HLUA_E_ERRMSG:
 		/* Display log. */
 		SEND_ERR(px, "Lua applet tcp '%s': %s.\n",
-		         rule->arg.hlua_rule->fcn.name, lua_tostring(hlua->T, -1));
+		         rule->arg.hlua_rule->fcn->name, lua_tostring(hlua->T, -1));
 		lua_pop(hlua->T, 1);
 		goto error;
 
 	case HLUA_E_ERR:
 		/* Display log. */
 		SEND_ERR(px, "Lua applet tcp '%s' return an unknown error.\n",
-		         rule->arg.hlua_rule->fcn.name);
+		         rule->arg.hlua_rule->fcn->name);
 		goto error;
 
 	default:
@@ -5904,7 +6636,7 @@ static int hlua_applet_http_init(struct appctx *ctx, struct proxy *px, struct st
 	task = task_new();
 	if (!task) {
 		SEND_ERR(px, "Lua applet http '%s': out of memory.\n",
-		         ctx->rule->arg.hlua_rule->fcn.name);
+		         ctx->rule->arg.hlua_rule->fcn->name);
 		return 0;
 	}
 	task->nice = 0;
@@ -5919,7 +6651,7 @@ static int hlua_applet_http_init(struct appctx *ctx, struct proxy *px, struct st
 	 */
 	if (!hlua_ctx_init(hlua, task)) {
 		SEND_ERR(px, "Lua applet http '%s': can't initialize Lua context.\n",
-		         ctx->rule->arg.hlua_rule->fcn.name);
+		         ctx->rule->arg.hlua_rule->fcn->name);
 		return 0;
 	}
 
@@ -5933,25 +6665,26 @@ static int hlua_applet_http_init(struct appctx *ctx, struct proxy *px, struct st
 		else
 			error = "critical error";
 		SEND_ERR(px, "Lua applet http '%s': %s.\n",
-		         ctx->rule->arg.hlua_rule->fcn.name, error);
+		         ctx->rule->arg.hlua_rule->fcn->name, error);
 		return 0;
 	}
 
 	/* Check stack available size. */
 	if (!lua_checkstack(hlua->T, 1)) {
 		SEND_ERR(px, "Lua applet http '%s': full stack.\n",
-		         ctx->rule->arg.hlua_rule->fcn.name);
+		         ctx->rule->arg.hlua_rule->fcn->name);
 		RESET_SAFE_LJMP(hlua->T);
 		return 0;
 	}
 
 	/* Restore the function in the stack. */
-	lua_rawgeti(hlua->T, LUA_REGISTRYINDEX, ctx->rule->arg.hlua_rule->fcn.function_ref);
+	lua_rawgeti(hlua->T, LUA_REGISTRYINDEX, ctx->rule->arg.hlua_rule->fcn->function_ref);
+	hlua->fcn = ctx->rule->arg.hlua_rule->fcn;
 
 	/* Create and and push object stream in the stack. */
 	if (!hlua_applet_http_new(hlua->T, ctx)) {
 		SEND_ERR(px, "Lua applet http '%s': full stack.\n",
-		         ctx->rule->arg.hlua_rule->fcn.name);
+		         ctx->rule->arg.hlua_rule->fcn->name);
 		RESET_SAFE_LJMP(hlua->T);
 		return 0;
 	}
@@ -5969,7 +6702,7 @@ static int hlua_applet_http_init(struct appctx *ctx, struct proxy *px, struct st
 	for (arg = ctx->rule->arg.hlua_rule->args; arg && *arg; arg++) {
 		if (!lua_checkstack(hlua->T, 1)) {
 			SEND_ERR(px, "Lua applet http '%s': full stack.\n",
-			         ctx->rule->arg.hlua_rule->fcn.name);
+			         ctx->rule->arg.hlua_rule->fcn->name);
 			RESET_SAFE_LJMP(hlua->T);
 			return 0;
 		}
@@ -6059,14 +6792,14 @@ static void hlua_applet_http_fct(struct appctx *ctx)
 		case HLUA_E_ERRMSG:
 			/* Display log. */
 			SEND_ERR(px, "Lua applet http '%s': %s.\n",
-			         rule->arg.hlua_rule->fcn.name, lua_tostring(hlua->T, -1));
+			         rule->arg.hlua_rule->fcn->name, lua_tostring(hlua->T, -1));
 			lua_pop(hlua->T, 1);
 			goto error;
 
 		case HLUA_E_ERR:
 			/* Display log. */
 			SEND_ERR(px, "Lua applet http '%s' return an unknown error.\n",
-			         rule->arg.hlua_rule->fcn.name);
+			         rule->arg.hlua_rule->fcn->name);
 			goto error;
 
 		default:
@@ -6086,7 +6819,7 @@ static void hlua_applet_http_fct(struct appctx *ctx)
 			/* critical error. */
 			if (ret == -2 || ret == -3) {
 				SEND_ERR(px, "Lua applet http '%s'cannont send last chunk.\n",
-				         rule->arg.hlua_rule->fcn.name);
+				         rule->arg.hlua_rule->fcn->name);
 				goto error;
 			}
 
@@ -6156,7 +6889,7 @@ static enum act_parse_ret action_register_lua(const char **args, int *cur_arg, s
 	}
 
 	/* Reference the Lua function and store the reference. */
-	rule->arg.hlua_rule->fcn = *fcn;
+	rule->arg.hlua_rule->fcn = fcn;
 
 	/* TODO: later accept arguments. */
 	rule->arg.hlua_rule->args = NULL;
@@ -6190,7 +6923,7 @@ static enum act_parse_ret action_register_service_http(const char **args, int *c
 	}
 
 	/* Reference the Lua function and store the reference. */
-	rule->arg.hlua_rule->fcn = *fcn;
+	rule->arg.hlua_rule->fcn = fcn;
 
 	/* TODO: later accept arguments. */
 	rule->arg.hlua_rule->args = NULL;
@@ -6250,6 +6983,8 @@ __LJMP static int hlua_register_action(lua_State *L)
 		if (!fcn->name)
 			WILL_LJMP(luaL_error(L, "lua out of memory error."));
 		fcn->function_ref = ref;
+		fcn->type = "action";
+		LIST_ADDQ(&hlua_functions, &fcn->list);
 
 		/* List head */
 		akl->list.n = akl->list.p = NULL;
@@ -6299,7 +7034,7 @@ static enum act_parse_ret action_register_service_tcp(const char **args, int *cu
 	}
 
 	/* Reference the Lua function and store the reference. */
-	rule->arg.hlua_rule->fcn = *fcn;
+	rule->arg.hlua_rule->fcn = fcn;
 
 	/* TODO: later accept arguments. */
 	rule->arg.hlua_rule->args = NULL;
@@ -6354,6 +7089,8 @@ __LJMP static int hlua_register_service(lua_State *L)
 		WILL_LJMP(luaL_error(L, "lua out of memory error."));
 	snprintf((char *)fcn->name, len, "<lua.%s>", name);
 	fcn->function_ref = ref;
+	fcn->type = "service";
+	LIST_ADDQ(&hlua_functions, &fcn->list);
 
 	/* List head */
 	akl->list.n = akl->list.p = NULL;
@@ -6438,6 +7175,7 @@ static int hlua_cli_parse_fct(char **args, struct appctx *appctx, void *private)
 
 	/* Restore the function in the stack. */
 	lua_rawgeti(hlua->T, LUA_REGISTRYINDEX, fcn->function_ref);
+	hlua->fcn = fcn;
 
 	/* Once the arguments parsed, the CLI is like an AppletTCP,
 	 * so push AppletTCP in the stack.
@@ -6607,6 +7345,8 @@ __LJMP static int hlua_register_cli(lua_State *L)
 	}
 	strncat((char *)fcn->name, ">", len);
 	fcn->function_ref = ref_io;
+	fcn->type = "cli";
+	LIST_ADDQ(&hlua_functions, &fcn->list);
 
 	/* Fill last entries. */
 	cli_kws->kw[0].private = fcn;
@@ -6710,8 +7450,29 @@ static int hlua_load(char **args, int section_type, struct proxy *curpx,
                      char **err)
 {
 	int error;
+	FILE *f;
+	unsigned char hdr[5];
+
+	/* Files starting with the Lua signature are precompiled chunks, as
+	 * produced by "luac". They skip the parsing but are only valid for
+	 * the exact Lua version they were built with, so we check it here
+	 * in order to report something clearer than a load error.
+	 */
+	f = fopen(args[1], "rb");
+	if (f) {
+		if (fread(hdr, 1, sizeof(hdr), f) == sizeof(hdr) &&
+		    memcmp(hdr, LUA_SIGNATURE, sizeof(hdr) - 1) == 0 &&
+		    hdr[4] != (LUA_VERSION_NUM / 100) * 16 + LUA_VERSION_NUM % 100) {
+			memprintf(err, "lua file '%s' is precompiled for Lua %d.%d but this binary is built with Lua %d.%d, please rebuild it with the matching luac",
+			          args[1], hdr[4] >> 4, hdr[4] & 15,
+			          LUA_VERSION_NUM / 100, LUA_VERSION_NUM % 100);
+			fclose(f);
+			return -1;
+		}
+		fclose(f);
+	}
 
-	/* Just load and compile the file. */
+	/* Just load and compile the file, or load the precompiled chunk. */
 	error = luaL_loadfile(gL.T, args[1]);
 	if (error) {
 		memprintf(err, "error in lua file '%s': %s", args[1], lua_tostring(gL.T, -1));
@@ -6759,6 +7520,57 @@ static struct cfg_kw_list cfg_kws = {{ },{
 	{ 0, NULL, NULL },
 }};
 
+/* Parses the "show lua stats" directive. It always returns 0. */
+static int hlua_cli_parse_show_stats(char **args, struct appctx *appctx, void *private)
+{
+	appctx->ctx.hlua_stats.cur = NULL;
+	return 0;
+}
+
+/* Dumps the profiling counters of the registered Lua functions. Returns 0
+ * if the output buffer is full and it needs to be called again, otherwise
+ * non-zero.
+ */
+static int hlua_cli_io_handler_show_stats(struct appctx *appctx)
+{
+	struct stream_interface *si = appctx->owner;
+	struct hlua_function *fcn;
+
+	chunk_reset(&trash);
+
+	if (!appctx->ctx.hlua_stats.cur) {
+		chunk_printf(&trash, "# type name calls yields run_time_us alloc_bytes (mem: used=%lu limit=%lu)\n",
+		             (unsigned long)hlua_global_allocator.allocated,
+		             (unsigned long)hlua_global_allocator.limit);
+		if (bi_putchk(si_ic(si), &trash) == -1) {
+			si_applet_cant_put(si);
+			return 0;
+		}
+		appctx->ctx.hlua_stats.cur = hlua_functions.n;
+	}
+
+	for (; appctx->ctx.hlua_stats.cur != &hlua_functions;
+	     appctx->ctx.hlua_stats.cur = appctx->ctx.hlua_stats.cur->n) {
+		fcn = LIST_ELEM(appctx->ctx.hlua_stats.cur, struct hlua_function *, list);
+
+		chunk_printf(&trash, "%s %s %llu %llu %llu %llu\n",
+		             fcn->type, fcn->name, fcn->calls, fcn->yields,
+		             fcn->run_time, fcn->alloc);
+		if (bi_putchk(si_ic(si), &trash) == -1) {
+			si_applet_cant_put(si);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* register cli keywords */
+static struct cli_kw_list cli_kws = {{ },{
+	{ { "show", "lua", "stats", NULL }, "show lua stats : report per-function Lua profiling counters", hlua_cli_parse_show_stats, hlua_cli_io_handler_show_stats },
+	{{},}
+}};
+
 /* This function can fail with an abort() due to an Lua critical error.
  * We are in the initialisation process of HAProxy, this abort() is
  * tolerated.
@@ -6828,8 +7640,10 @@ static void *hlua_alloc(void *ud, void *ptr, size_t osize, size_t nsize)
 			return NULL;
 
 		ptr = malloc(nsize);
-		if (ptr)
+		if (ptr) {
 			zone->allocated += nsize;
+			zone->total += nsize;
+		}
 		return ptr;
 	}
 
@@ -6838,8 +7652,11 @@ static void *hlua_alloc(void *ud, void *ptr, size_t osize, size_t nsize)
 		return NULL;
 
 	ptr = realloc(ptr, nsize);
-	if (ptr)
+	if (ptr) {
 		zone->allocated += nsize - osize;
+		if (nsize > osize)
+			zone->total += nsize - osize;
+	}
 	return ptr;
 }
 
@@ -6872,6 +7689,7 @@ void hlua_init(void)
 
 	/* Register configuration keywords. */
 	cfg_register_keywords(&cfg_kws);
+	cli_register_kw(&cli_kws);
 
 	/* Init main lua stack. */
 	gL.Mref = LUA_REFNIL;
@@ -6933,6 +7751,7 @@ void hlua_init(void)
 	hlua_class_function(gL.T, "set_map", hlua_set_map);
 	hlua_class_function(gL.T, "del_map", hlua_del_map);
 	hlua_class_function(gL.T, "tcp", hlua_socket_new);
+	hlua_class_function(gL.T, "tcp_pool", hlua_tcp_pool_new);
 	hlua_class_function(gL.T, "log", hlua_log);
 	hlua_class_function(gL.T, "Debug", hlua_log_debug);
 	hlua_class_function(gL.T, "Info", hlua_log_info);
@@ -7123,6 +7942,8 @@ void hlua_init(void)
 
 	/* Register Lua functions. */
 	hlua_class_function(gL.T, "req_get_headers",hlua_http_req_get_headers);
+	hlua_class_function(gL.T, "req_get_header", hlua_http_req_get_header);
+	hlua_class_function(gL.T, "req_has_header", hlua_http_req_has_header);
 	hlua_class_function(gL.T, "req_del_header", hlua_http_req_del_hdr);
 	hlua_class_function(gL.T, "req_rep_header", hlua_http_req_rep_hdr);
 	hlua_class_function(gL.T, "req_rep_value",  hlua_http_req_rep_val);
@@ -7134,6 +7955,8 @@ void hlua_init(void)
 	hlua_class_function(gL.T, "req_set_uri",    hlua_http_req_set_uri);
 
 	hlua_class_function(gL.T, "res_get_headers",hlua_http_res_get_headers);
+	hlua_class_function(gL.T, "res_get_header", hlua_http_res_get_header);
+	hlua_class_function(gL.T, "res_has_header", hlua_http_res_has_header);
 	hlua_class_function(gL.T, "res_del_header", hlua_http_res_del_hdr);
 	hlua_class_function(gL.T, "res_rep_header", hlua_http_res_rep_hdr);
 	hlua_class_function(gL.T, "res_rep_value",  hlua_http_res_rep_val);
@@ -7218,6 +8041,8 @@ void hlua_init(void)
 	hlua_class_function(gL.T, "set_var",     hlua_set_var);
 	hlua_class_function(gL.T, "unset_var",   hlua_unset_var);
 	hlua_class_function(gL.T, "get_var",     hlua_get_var);
+	hlua_class_function(gL.T, "match_var",   hlua_match_var);
+	hlua_class_function(gL.T, "match_fetch", hlua_match_fetch);
 	hlua_class_function(gL.T, "done",        hlua_txn_done);
 	hlua_class_function(gL.T, "set_loglevel",hlua_txn_set_loglevel);
 	hlua_class_function(gL.T, "set_tos",     hlua_txn_set_tos);
@@ -7269,6 +8094,27 @@ void hlua_init(void)
 	/* Register previous table in the registry with reference and named entry. */
 	class_socket_ref = hlua_register_metatable(gL.T, CLASS_SOCKET);
 
+	/*
+	 *
+	 * Register class TcpPool
+	 *
+	 */
+
+	/* Create and fill the metatable. */
+	lua_newtable(gL.T);
+
+	/* Create and fille the __index entry. */
+	lua_pushstring(gL.T, "__index");
+	lua_newtable(gL.T);
+
+	hlua_class_function(gL.T, "get",   hlua_tcp_pool_get);
+	hlua_class_function(gL.T, "stats", hlua_tcp_pool_stats);
+
+	lua_rawset(gL.T, -3); /* Push the last 2 entries in the table at index -3 */
+
+	/* Register previous table in the registry with reference and named entry. */
+	class_tcp_pool_ref = hlua_register_metatable(gL.T, CLASS_TCP_POOL);
+
 	/* Proxy and server configuration initialisation. */
 	memset(&socket_proxy, 0, sizeof(socket_proxy));
 	init_new_proxy(&socket_proxy);
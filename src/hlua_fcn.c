@@ -14,10 +14,13 @@
  * in an environment able to catch a longjmp, otherwise a
  * critical error can be raised.
  */
+#include <sys/mman.h>
+
 #include <lauxlib.h>
 #include <lua.h>
 #include <lualib.h>
 
+#include <common/hash.h>
 #include <common/time.h>
 #include <common/uri_auth.h>
 
@@ -36,6 +39,7 @@ static int class_concat_ref;
 static int class_proxy_ref;
 static int class_server_ref;
 static int class_listener_ref;
+static int class_dict_ref;
 
 #define STATS_LEN (MAX((int)ST_F_TOTAL_FIELDS, (int)INF_TOTAL_FIELDS))
 
@@ -1033,6 +1037,540 @@ int hlua_match_addr(lua_State *L)
 	return 1;
 }
 
+/*
+ *
+ * Class Dict
+ *
+ * A dictionary is a bounded key/value store allocated in a shared memory
+ * area before the processes are forked, so it is shared by all the
+ * coroutines of all the processes. Entries are fixed-size slots chained
+ * in hash buckets. The writers are serialized by a spinlock and bump a
+ * sequence counter around each modification. The readers never take the
+ * lock: they copy the value and retry if the sequence changed meanwhile.
+ * When the dictionary is full, expired entries are reclaimed first, then
+ * a clock sweep evicts an entry which was not read since the last pass.
+ *
+ */
+
+#define HLUA_DICT_T_STR   0
+#define HLUA_DICT_T_SINT  1
+#define HLUA_DICT_T_BOOL  2
+
+struct hlua_dict_entry {
+	unsigned int next;     /* next entry in the bucket or the free list (index + 1, 0 = none) */
+	unsigned int expire;   /* expiration date in seconds, 0 = never */
+	unsigned char used;    /* the slot contains an entry */
+	unsigned char ref;     /* the entry was read since the last clock sweep */
+	unsigned char type;    /* HLUA_DICT_T_* */
+	unsigned short klen;   /* key length */
+	unsigned int vlen;     /* string value length */
+	long long sint;        /* integer or boolean value */
+	char data[0];          /* the key followed by the string value */
+};
+
+struct hlua_dict_shm {
+	unsigned int lock;           /* writers lock */
+	unsigned int seq;            /* odd while a writer modifies the dictionary */
+	unsigned int entries;        /* number of used entries */
+	unsigned int free;           /* head of the free list (index + 1) */
+	unsigned int hand;           /* clock hand for the eviction */
+	unsigned long long evictions;  /* entries evicted to make room */
+	unsigned long long expirations; /* expired entries reclaimed */
+	unsigned int buckets[0];     /* hash buckets (index + 1), then the slots */
+};
+
+struct hlua_dict {
+	struct list list;            /* chaining of all the dictionaries */
+	char *name;
+	unsigned int size;           /* max number of entries */
+	unsigned int mask;           /* number of buckets - 1 */
+	unsigned int data_size;      /* max length of a key and its value */
+	unsigned int slot_size;      /* size of a slot */
+	struct hlua_dict_shm *shm;
+	char *slots;
+};
+
+static struct list hlua_dicts = LIST_HEAD_INIT(hlua_dicts);
+
+static inline struct hlua_dict_entry *hlua_dict_entry(struct hlua_dict *d, unsigned int idx)
+{
+	return (struct hlua_dict_entry *)(d->slots + (idx - 1) * d->slot_size);
+}
+
+static inline void hlua_dict_lock(struct hlua_dict *d)
+{
+	while (__sync_lock_test_and_set(&d->shm->lock, 1))
+		while (d->shm->lock)
+			__asm volatile("" ::: "memory");
+	d->shm->seq++;
+	__sync_synchronize();
+}
+
+static inline void hlua_dict_unlock(struct hlua_dict *d)
+{
+	__sync_synchronize();
+	d->shm->seq++;
+	__sync_lock_release(&d->shm->lock);
+}
+
+static inline int hlua_dict_expired(struct hlua_dict_entry *e)
+{
+	return e->expire && (int)(e->expire - date.tv_sec) <= 0;
+}
+
+/* Looks up <key> in <d>. Must be called with the lock held. Returns the
+ * index of the entry or 0, and sets <prev> to the index of the previous
+ * entry in the bucket, or 0 if it is the first one.
+ */
+static unsigned int hlua_dict_lookup(struct hlua_dict *d, const char *key, size_t klen,
+                                     unsigned int *prev)
+{
+	unsigned int idx;
+	struct hlua_dict_entry *e;
+
+	*prev = 0;
+	idx = d->shm->buckets[hash_djb2(key, klen) & d->mask];
+	while (idx) {
+		e = hlua_dict_entry(d, idx);
+		if (e->klen == klen && memcmp(e->data, key, klen) == 0)
+			return idx;
+		*prev = idx;
+		idx = e->next;
+	}
+	return 0;
+}
+
+/* Unlinks the entry <idx> whose previous entry is <prev> and moves it to
+ * the free list. Must be called with the lock held.
+ */
+static void hlua_dict_remove(struct hlua_dict *d, unsigned int idx, unsigned int prev)
+{
+	struct hlua_dict_entry *e = hlua_dict_entry(d, idx);
+
+	if (prev)
+		hlua_dict_entry(d, prev)->next = e->next;
+	else
+		d->shm->buckets[hash_djb2(e->data, e->klen) & d->mask] = e->next;
+
+	e->used = 0;
+	e->next = d->shm->free;
+	d->shm->free = idx;
+	d->shm->entries--;
+}
+
+/* Evicts one entry to make room, preferably an expired one. Must be called
+ * with the lock held and the dictionary full.
+ */
+static void hlua_dict_evict(struct hlua_dict *d)
+{
+	struct hlua_dict_entry *e;
+	unsigned int idx, prev;
+	unsigned int loops;
+
+	for (loops = 0; loops < 2 * d->size; loops++) {
+		idx = d->shm->hand + 1;
+		d->shm->hand = (d->shm->hand + 1) % d->size;
+		e = hlua_dict_entry(d, idx);
+		if (!e->used)
+			continue;
+		if (hlua_dict_expired(e))
+			d->shm->expirations++;
+		else if (e->ref) {
+			e->ref = 0;
+			continue;
+		}
+		else
+			d->shm->evictions++;
+		hlua_dict_lookup(d, e->data, e->klen, &prev);
+		hlua_dict_remove(d, idx, prev);
+		return;
+	}
+}
+
+/* Returns an entry for <key>, allocating it if it does not exist or is
+ * expired, in which case <created> is set to 1. Must be called with the
+ * lock held. Returns 0 if the key is too large.
+ */
+static unsigned int hlua_dict_get_slot(struct hlua_dict *d, const char *key, size_t klen,
+                                       int *created)
+{
+	struct hlua_dict_entry *e;
+	unsigned int idx, prev, bucket;
+
+	*created = 0;
+	if (klen > d->data_size)
+		return 0;
+
+	idx = hlua_dict_lookup(d, key, klen, &prev);
+	if (idx && !hlua_dict_expired(hlua_dict_entry(d, idx)))
+		return idx;
+	if (idx) {
+		d->shm->expirations++;
+		hlua_dict_remove(d, idx, prev);
+	}
+
+	if (!d->shm->free)
+		hlua_dict_evict(d);
+
+	idx = d->shm->free;
+	if (!idx)
+		return 0;
+
+	e = hlua_dict_entry(d, idx);
+	d->shm->free = e->next;
+	d->shm->entries++;
+
+	bucket = hash_djb2(key, klen) & d->mask;
+	e->next = d->shm->buckets[bucket];
+	e->used = 1;
+	e->ref = 0;
+	e->expire = 0;
+	e->type = HLUA_DICT_T_SINT;
+	e->sint = 0;
+	e->vlen = 0;
+	e->klen = klen;
+	memcpy(e->data, key, klen);
+	d->shm->buckets[bucket] = idx;
+	*created = 1;
+	return idx;
+}
+
+static struct hlua_dict *hlua_check_dict(lua_State *L, int ud)
+{
+	return hlua_checkudata(L, ud, class_dict_ref);
+}
+
+/* Creates and pushes a Dict object for <d>. */
+static void hlua_dict_push(lua_State *L, struct hlua_dict *d)
+{
+	lua_newtable(L);
+	lua_pushlightuserdata(L, d);
+	lua_rawseti(L, -2, 0);
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, class_dict_ref);
+	lua_setmetatable(L, -2);
+}
+
+/* Returns the dictionary <name>: core.dict(name [, size [, data_size]]).
+ * If it does not exist, it is created with room for <size> entries whose
+ * key and value together do not exceed <data_size> bytes. The creation is
+ * only possible during the startup, before the processes are forked.
+ */
+int hlua_dict_new(lua_State *L)
+{
+	struct hlua_dict *d;
+	const char *name;
+	lua_Integer size = 0;
+	lua_Integer data_size = 256;
+	unsigned int nbuckets;
+	size_t shm_size;
+	void *area;
+
+	if (lua_gettop(L) < 1 || lua_gettop(L) > 3)
+		luaL_error(L, "'dict' needs between 1 and 3 arguments");
+
+	name = luaL_checkstring(L, 1);
+	if (lua_gettop(L) >= 2)
+		size = luaL_checkinteger(L, 2);
+	if (lua_gettop(L) >= 3)
+		data_size = luaL_checkinteger(L, 3);
+
+	list_for_each_entry(d, &hlua_dicts, list) {
+		if (strcmp(d->name, name) == 0) {
+			hlua_dict_push(L, d);
+			return 1;
+		}
+	}
+
+	if (!size)
+		luaL_error(L, "'dict': unknown dictionary '%s'", name);
+	if (!(global.mode & MODE_STARTING))
+		luaL_error(L, "'dict': dictionaries must be created during the startup");
+	if (size < 0 || size > 0x1000000)
+		luaL_argerror(L, 2, "must be between 1 and 16777216");
+	if (data_size <= 0 || data_size > global.tune.bufsize)
+		luaL_argerror(L, 3, "must be between 1 and tune.bufsize");
+
+	d = calloc(1, sizeof(*d));
+	if (!d)
+		luaL_error(L, "'dict': out of memory");
+
+	for (nbuckets = 1; nbuckets < size; nbuckets <<= 1);
+
+	d->size = size;
+	d->mask = nbuckets - 1;
+	d->data_size = data_size;
+	d->slot_size = (sizeof(struct hlua_dict_entry) + data_size + 7) & ~7;
+
+	shm_size = sizeof(struct hlua_dict_shm) + nbuckets * sizeof(unsigned int);
+	shm_size = (shm_size + 7) & ~7;
+	area = mmap(NULL, shm_size + (size_t)size * d->slot_size, PROT_READ | PROT_WRITE,
+	            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	d->name = strdup(name);
+	if (area == MAP_FAILED || !d->name) {
+		if (area != MAP_FAILED)
+			munmap(area, shm_size + (size_t)size * d->slot_size);
+		free(d->name);
+		free(d);
+		luaL_error(L, "'dict': out of memory");
+	}
+
+	/* The mapping is zeroed. Chain all the slots in the free list. */
+	d->shm = area;
+	d->slots = (char *)area + shm_size;
+	for (; size > 0; size--) {
+		hlua_dict_entry(d, size)->next = d->shm->free;
+		d->shm->free = size;
+	}
+
+	LIST_ADDQ(&hlua_dicts, &d->list);
+	hlua_dict_push(L, d);
+	return 1;
+}
+
+/* Returns the value associated with the key, or nil. This function does
+ * not take the lock: the value is copied, then the copy is discarded if a
+ * writer was active meanwhile.
+ */
+int hlua_dict_get(lua_State *L)
+{
+	struct hlua_dict *d;
+	struct hlua_dict_entry *e;
+	const char *key;
+	size_t klen;
+	unsigned int seq, idx, steps;
+	int type = HLUA_DICT_T_STR;
+	long long sint = 0;
+	int found;
+
+	d = hlua_check_dict(L, 1);
+	key = luaL_checklstring(L, 2, &klen);
+
+ retry:
+	seq = d->shm->seq;
+	if (seq & 1)
+		goto retry;
+	__sync_synchronize();
+
+	found = 0;
+	idx = d->shm->buckets[hash_djb2(key, klen) & d->mask];
+	for (steps = 0; idx && idx <= d->size && steps < d->size; steps++) {
+		e = hlua_dict_entry(d, idx);
+		if (e->klen == klen && memcmp(e->data, key, klen) == 0) {
+			if (!e->used || hlua_dict_expired(e))
+				break;
+			type = e->type;
+			sint = e->sint;
+			trash.len = e->vlen;
+			if (type == HLUA_DICT_T_STR) {
+				if (trash.len > d->data_size - klen)
+					break;
+				memcpy(trash.str, e->data + klen, trash.len);
+			}
+			found = 1;
+			break;
+		}
+		idx = e->next;
+	}
+
+	__sync_synchronize();
+	if (d->shm->seq != seq)
+		goto retry;
+
+	if (!found) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	/* hint for the eviction, races are harmless */
+	e->ref = 1;
+
+	if (type == HLUA_DICT_T_STR)
+		lua_pushlstring(L, trash.str, trash.len);
+	else if (type == HLUA_DICT_T_BOOL)
+		lua_pushboolean(L, sint);
+	else
+		lua_pushinteger(L, sint);
+	return 1;
+}
+
+/* Sets the value of a key: Dict:set(key, value [, ttl]). The value may be
+ * a string, an integer or a boolean. A nil value deletes the key, and a
+ * number without an integer representation raises an error. The ttl is in
+ * seconds. Returns false if the key and the value are too large.
+ */
+int hlua_dict_set(lua_State *L)
+{
+	struct hlua_dict *d;
+	struct hlua_dict_entry *e;
+	const char *key;
+	const char *str = NULL;
+	size_t klen, vlen = 0;
+	lua_Integer ttl = 0, sint = 0;
+	unsigned int idx, prev;
+	int created;
+
+	if (lua_gettop(L) < 3 || lua_gettop(L) > 4)
+		luaL_error(L, "'set' needs between 3 and 4 arguments");
+
+	d = hlua_check_dict(L, 1);
+	key = luaL_checklstring(L, 2, &klen);
+	if (lua_gettop(L) >= 4)
+		ttl = luaL_checkinteger(L, 4);
+
+	switch (lua_type(L, 3)) {
+	case LUA_TNIL:
+		hlua_dict_lock(d);
+		idx = hlua_dict_lookup(d, key, klen, &prev);
+		if (idx)
+			hlua_dict_remove(d, idx, prev);
+		hlua_dict_unlock(d);
+		lua_pushboolean(L, 1);
+		return 1;
+	case LUA_TSTRING:
+		str = lua_tolstring(L, 3, &vlen);
+		break;
+	case LUA_TNUMBER:
+		/* refuses 2.5 instead of silently storing 2 */
+		sint = luaL_checkinteger(L, 3);
+		break;
+	case LUA_TBOOLEAN:
+		break;
+	default:
+		luaL_argerror(L, 3, "string, integer, boolean or nil expected");
+	}
+
+	if (klen + vlen > d->data_size) {
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+
+	hlua_dict_lock(d);
+	idx = hlua_dict_get_slot(d, key, klen, &created);
+	if (idx) {
+		e = hlua_dict_entry(d, idx);
+		e->expire = ttl > 0 ? date.tv_sec + ttl : 0;
+		if (str) {
+			e->type = HLUA_DICT_T_STR;
+			e->vlen = vlen;
+			memcpy(e->data + klen, str, vlen);
+		}
+		else if (lua_type(L, 3) == LUA_TBOOLEAN) {
+			e->type = HLUA_DICT_T_BOOL;
+			e->sint = lua_toboolean(L, 3);
+		}
+		else {
+			e->type = HLUA_DICT_T_SINT;
+			e->sint = sint;
+		}
+	}
+	hlua_dict_unlock(d);
+
+	lua_pushboolean(L, idx != 0);
+	return 1;
+}
+
+/* Atomically adds <n> to the integer value of a key and returns the new
+ * value: Dict:incr(key, n [, init [, ttl]]). If the key does not exist
+ * or is expired, it is first set to <init> (0 by default) with the
+ * optional <ttl>. Returns nil and an error message if the current value
+ * is not an integer.
+ */
+int hlua_dict_incr(lua_State *L)
+{
+	struct hlua_dict *d;
+	struct hlua_dict_entry *e;
+	const char *key;
+	size_t klen;
+	lua_Integer n, init = 0, ttl = 0;
+	unsigned int idx;
+	long long value = 0;
+	int created;
+	int err = 0;
+
+	if (lua_gettop(L) < 3 || lua_gettop(L) > 5)
+		luaL_error(L, "'incr' needs between 3 and 5 arguments");
+
+	d = hlua_check_dict(L, 1);
+	key = luaL_checklstring(L, 2, &klen);
+	n = luaL_checkinteger(L, 3);
+	if (lua_gettop(L) >= 4)
+		init = luaL_checkinteger(L, 4);
+	if (lua_gettop(L) >= 5)
+		ttl = luaL_checkinteger(L, 5);
+
+	hlua_dict_lock(d);
+	idx = hlua_dict_get_slot(d, key, klen, &created);
+	if (idx) {
+		e = hlua_dict_entry(d, idx);
+		if (created) {
+			e->type = HLUA_DICT_T_SINT;
+			e->sint = init;
+			e->expire = ttl > 0 ? date.tv_sec + ttl : 0;
+		}
+		if (e->type == HLUA_DICT_T_SINT) {
+			e->sint += n;
+			value = e->sint;
+		}
+		else
+			err = 1;
+	}
+	hlua_dict_unlock(d);
+
+	if (!idx || err) {
+		lua_pushnil(L);
+		lua_pushstring(L, idx ? "not an integer" : "key too large");
+		return 2;
+	}
+	lua_pushinteger(L, value);
+	return 1;
+}
+
+/* Deletes a key. */
+int hlua_dict_del(lua_State *L)
+{
+	struct hlua_dict *d;
+	const char *key;
+	size_t klen;
+	unsigned int idx, prev;
+
+	d = hlua_check_dict(L, 1);
+	key = luaL_checklstring(L, 2, &klen);
+
+	hlua_dict_lock(d);
+	idx = hlua_dict_lookup(d, key, klen, &prev);
+	if (idx)
+		hlua_dict_remove(d, idx, prev);
+	hlua_dict_unlock(d);
+	return 0;
+}
+
+/* Returns a table with the dictionary usage. */
+int hlua_dict_stats(lua_State *L)
+{
+	struct hlua_dict *d;
+
+	d = hlua_check_dict(L, 1);
+
+	lua_newtable(L);
+	lua_pushstring(L, "size");
+	lua_pushinteger(L, d->size);
+	lua_settable(L, -3);
+	lua_pushstring(L, "data_size");
+	lua_pushinteger(L, d->data_size);
+	lua_settable(L, -3);
+	lua_pushstring(L, "entries");
+	lua_pushinteger(L, d->shm->entries);
+	lua_settable(L, -3);
+	lua_pushstring(L, "evictions");
+	lua_pushinteger(L, d->shm->evictions);
+	lua_settable(L, -3);
+	lua_pushstring(L, "expirations");
+	lua_pushinteger(L, d->shm->expirations);
+	lua_settable(L, -3);
+	return 1;
+}
+
 int hlua_fcn_reg_core_fcn(lua_State *L)
 {
 	if (!hlua_concat_init(L))
@@ -1048,6 +1586,7 @@ int hlua_fcn_reg_core_fcn(lua_State *L)
 	hlua_class_function(L, "parse_addr", hlua_parse_addr);
 	hlua_class_function(L, "match_addr", hlua_match_addr);
 	hlua_class_function(L, "tokenize", hlua_tokenize);
+	hlua_class_function(L, "dict", hlua_dict_new);
 
 	/* Create listener object. */
 	lua_newtable(L);
@@ -1097,5 +1636,17 @@ int hlua_fcn_reg_core_fcn(lua_State *L)
 	lua_settable(L, -3); /* -> META["__index"] = TABLE */
 	class_proxy_ref = hlua_register_metatable(L, CLASS_PROXY);
 
+	/* Create dict object. */
+	lua_newtable(L);
+	lua_pushstring(L, "__index");
+	lua_newtable(L);
+	hlua_class_function(L, "get", hlua_dict_get);
+	hlua_class_function(L, "set", hlua_dict_set);
+	hlua_class_function(L, "incr", hlua_dict_incr);
+	hlua_class_function(L, "del", hlua_dict_del);
+	hlua_class_function(L, "stats", hlua_dict_stats);
+	lua_settable(L, -3); /* -> META["__index"] = TABLE */
+	class_dict_ref = hlua_register_metatable(L, CLASS_DICT);
+
 	return 5;
 }
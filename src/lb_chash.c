@@ -401,6 +401,39 @@ struct server *chash_get_next_server(struct proxy *p, struct server *srvtoavoid)
 	return srv;
 }
 
+/* Assigns server <srv> to its tree and allocates its nodes with their keys,
+ * without queuing them. This is done for all servers at boot time, and for
+ * servers added at runtime. Returns 0 on success or -1 on memory shortage.
+ */
+static int chash_init_server(struct server *srv)
+{
+	struct proxy *p = srv->proxy;
+	int node;
+
+	srv->lb_tree = (srv->flags & SRV_F_BACKUP) ? &p->lbprm.chash.bck : &p->lbprm.chash.act;
+	srv->lb_nodes_tot = srv->uweight * BE_WEIGHT_SCALE;
+	srv->lb_nodes_now = 0;
+	srv->lb_nodes = calloc(srv->lb_nodes_tot, sizeof(struct tree_occ));
+	if (!srv->lb_nodes && srv->lb_nodes_tot)
+		return -1;
+
+	for (node = 0; node < srv->lb_nodes_tot; node++) {
+		srv->lb_nodes[node].server = srv;
+		srv->lb_nodes[node].node.key = full_hash(srv->puid * SRV_EWGHT_RANGE + node);
+	}
+	return 0;
+}
+
+/* Releases the nodes of server <srv> removed at runtime. It must not be in
+ * the tree anymore, which is guaranteed once it's in maintenance.
+ */
+static void chash_deinit_server(struct server *srv)
+{
+	free(srv->lb_nodes);
+	srv->lb_nodes = NULL;
+	srv->lb_nodes_tot = srv->lb_nodes_now = 0;
+}
+
 /* This function is responsible for building the active and backup trees for
  * constistent hashing. The servers receive an array of initialized nodes
  * with their assigned keys. It also sets p->lbprm.wdiv to the eweight to
@@ -410,13 +443,14 @@ void chash_init_server_tree(struct proxy *p)
 {
 	struct server *srv;
 	struct eb_root init_head = EB_ROOT;
-	int node;
 
 	p->lbprm.set_server_status_up   = chash_set_server_status_up;
 	p->lbprm.set_server_status_down = chash_set_server_status_down;
 	p->lbprm.update_server_eweight  = chash_update_server_weight;
 	p->lbprm.server_take_conn = NULL;
 	p->lbprm.server_drop_conn = NULL;
+	p->lbprm.server_init   = chash_init_server;
+	p->lbprm.server_deinit = chash_deinit_server;
 
 	p->lbprm.wdiv = BE_WEIGHT_SCALE;
 	for (srv = p->srv; srv; srv = srv->next) {
@@ -433,16 +467,7 @@ void chash_init_server_tree(struct proxy *p)
 
 	/* queue active and backup servers in two distinct groups */
 	for (srv = p->srv; srv; srv = srv->next) {
-		srv->lb_tree = (srv->flags & SRV_F_BACKUP) ? &p->lbprm.chash.bck : &p->lbprm.chash.act;
-		srv->lb_nodes_tot = srv->uweight * BE_WEIGHT_SCALE;
-		srv->lb_nodes_now = 0;
-		srv->lb_nodes = calloc(srv->lb_nodes_tot, sizeof(struct tree_occ));
-
-		for (node = 0; node < srv->lb_nodes_tot; node++) {
-			srv->lb_nodes[node].server = srv;
-			srv->lb_nodes[node].node.key = full_hash(srv->puid * SRV_EWGHT_RANGE + node);
-		}
-
+		chash_init_server(srv);
 		if (srv_is_usable(srv))
 			chash_queue_dequeue_srv(srv);
 	}
@@ -127,6 +127,47 @@ void recalc_server_map(struct proxy *px)
 	px->lbprm.map.state &= ~LB_MAP_RECALC;
 }
 
+/* This function grows the map of the proxy of server <srv>, which was just
+ * added at runtime, to the largest size its servers list may need, and asks
+ * for it to be recomputed. Returns 0 on success or -1 on memory shortage.
+ */
+static int map_server_init(struct server *srv)
+{
+	struct proxy *p = srv->proxy;
+	struct server *cur, **map;
+	int act, bck;
+
+	act = bck = 0;
+	for (cur = p->srv; cur; cur = cur->next) {
+		if (cur->flags & SRV_F_BACKUP)
+			bck += cur->eweight;
+		else
+			act += cur->eweight;
+	}
+
+	if (act < bck)
+		act = bck;
+
+	if (!act)
+		act = 1;
+
+	map = realloc(p->lbprm.map.srv, act * sizeof(struct server *));
+	if (!map)
+		return -1;
+
+	p->lbprm.map.srv = map;
+	p->lbprm.map.state |= LB_MAP_RECALC;
+	return 0;
+}
+
+/* The map may still reference server <srv> being removed at runtime, so it
+ * must be recomputed before the next lookup.
+ */
+static void map_server_deinit(struct server *srv)
+{
+	srv->proxy->lbprm.map.state |= LB_MAP_RECALC;
+}
+
 /* This function is responsible of building the server MAP for map-based LB
  * algorithms, allocating the map, and setting p->lbprm.wmult to the GCD of the
  * weights if applicable. It should be called only once per proxy, at config
@@ -141,6 +182,8 @@ void init_server_map(struct proxy *p)
 	p->lbprm.set_server_status_up   = map_set_server_status_up;
 	p->lbprm.set_server_status_down = map_set_server_status_down;
 	p->lbprm.update_server_eweight = NULL;
+	p->lbprm.server_init   = map_server_init;
+	p->lbprm.server_deinit = map_server_deinit;
  
 	if (!p->srv)
 		return;
@@ -18,6 +18,9 @@
 #include <unistd.h>
 #include <fcntl.h>
 
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
 #include <common/accept4.h>
 #include <common/config.h>
 #include <common/errors.h>
@@ -32,6 +35,7 @@
 #include <proto/fd.h>
 #include <proto/freq_ctr.h>
 #include <proto/log.h>
+#include <proto/proxy.h>
 #include <proto/listener.h>
 #include <proto/sample.h>
 #include <proto/stream.h>
@@ -288,6 +292,84 @@ void delete_listener(struct listener *listener)
 	listener->proto->nb_listeners--;
 }
 
+/* Returns the number of connections waiting in the accept queue of listener
+ * <l>, or -1 if it cannot be known. <qfull> is set if the queue is full, which
+ * means that the system is dropping incoming connections.
+ */
+static int listener_queue_len(struct listener *l, int *qfull)
+{
+#if defined(__linux__) && defined(TCP_INFO)
+	struct tcp_info info;
+	socklen_t len = sizeof(info);
+
+	if (l->addr.ss_family != AF_INET && l->addr.ss_family != AF_INET6)
+		return -1;
+
+	/* for listening sockets, Linux reports the accept queue's length and
+	 * size in place of the unacked and sacked counts.
+	 */
+	if (getsockopt(l->fd, IPPROTO_TCP, TCP_INFO, &info, &len) == -1)
+		return -1;
+
+	*qfull = info.tcpi_unacked >= info.tcpi_sacked;
+	return info.tcpi_unacked;
+#else
+	return -1;
+#endif
+}
+
+/* Updates the number of connections listener <l> will accept at its next wake
+ * up after it accepted <done> ones in a row. <more> indicates that it stopped
+ * on its batch limit instead of an empty queue. When the queue was drained,
+ * the batch converges to the number of connections really found so that the
+ * accept() call which fails at the end can be avoided at low loads. When the
+ * batch was exhausted, it only grows if connections are still pending, and
+ * sticks to <done> if the queue turns out to be empty. It is always bounded
+ * by the listener's maxaccept and is never below 1.
+ */
+static void listener_adapt_batch(struct listener *l, int done, int more)
+{
+	unsigned int next;
+	int qlen, qfull = 0;
+
+	if (l->counters)
+		swrate_add(&l->counters->acc_batch, ACCEPT_BATCH_SAMPLES, done);
+	if (l->frontend)
+		swrate_add(&l->frontend->fe_counters.acc_batch, ACCEPT_BATCH_SAMPLES, done);
+
+	if ((int)l->maxaccept <= 1)
+		return; /* unlimited or one at a time */
+
+	next = l->acc_batch ? l->acc_batch : l->maxaccept;
+	if (!more) {
+		/* rounded down so that it settles on <done> */
+		next = (next + done) / 2;
+	}
+	else {
+		qlen = listener_queue_len(l, &qfull);
+		if (!qlen)
+			next = done;
+		else if (qlen < 0)
+			next *= 2; /* queue unknown, it may still be full */
+		else if (qlen > next)
+			next = qlen;
+		else
+			next *= 2;
+		if (qfull) {
+			if (l->counters)
+				l->counters->acc_qfull++;
+			if (l->frontend)
+				l->frontend->fe_counters.acc_qfull++;
+		}
+	}
+
+	if (next > l->maxaccept)
+		next = l->maxaccept;
+	if (!next)
+		next = 1;
+	l->acc_batch = next;
+}
+
 /* This function is called on a read event from a listening socket, corresponding
  * to an accept. It tries to accept as many connections as possible, and for each
  * calls the listener's accept handler (generally the frontend's accept handler).
@@ -297,6 +379,7 @@ void listener_accept(int fd)
 	struct listener *l = fdtab[fd].owner;
 	struct proxy *p = l->frontend;
 	int max_accept = l->maxaccept ? l->maxaccept : 1;
+	int accepted = 0;
 	int expire;
 	int cfd;
 	int ret;
@@ -309,6 +392,22 @@ void listener_accept(int fd)
 		return;
 	}
 
+	if (max_accept > 0 && l->acc_batch && max_accept > l->acc_batch)
+		max_accept = l->acc_batch;
+
+	if (l->acc_lim) {
+		int max = freq_ctr_remain(&l->acc_per_sec, l->acc_lim, 0);
+
+		if (unlikely(!max)) {
+			/* listener accept rate limit was reached */
+			expire = tick_add(now_ms, next_event_delay(&l->acc_per_sec, l->acc_lim, 0));
+			goto wait_expire;
+		}
+
+		if (max_accept > max)
+			max_accept = max;
+	}
+
 	if (!(l->options & LI_O_UNLIMITED) && global.sps_lim) {
 		int max = freq_ctr_remain(&global.sess_per_sec, global.sps_lim, 0);
 
@@ -382,6 +481,12 @@ void listener_accept(int fd)
 			return;
 		}
 
+		/* the streams of this frontend use more than its "maxmem" */
+		if (unlikely(p && proxy_mem_full(p))) {
+			limit_listener(l, &p->listener_queue);
+			return;
+		}
+
 #ifdef USE_ACCEPT4
 		/* only call accept4() if it's known to be safe, otherwise
 		 * fallback to the legacy accept() + fcntl().
@@ -406,6 +511,7 @@ void listener_accept(int fd)
 					fdtab[fd].ev &= ~FD_POLL_HUP;
 					goto transient_error;
 				}
+				listener_adapt_batch(l, accepted, 0);
 				fd_cant_recv(fd);
 				return;   /* nothing more to accept */
 			case EINVAL:
@@ -460,6 +566,8 @@ void listener_accept(int fd)
 		jobs++;
 		totalconn++;
 		l->nbconn++;
+		accepted++;
+		update_freq_ctr(&l->acc_per_sec, 1);
 
 		if (l->counters) {
 			if (l->nbconn > l->counters->conn_max)
@@ -505,6 +613,8 @@ void listener_accept(int fd)
 
 	} /* end of while (max_accept--) */
 
+	listener_adapt_batch(l, accepted, 1);
+
 	/* we've exhausted max_accept, so there is no need to poll again */
  stop:
 	fd_done_recv(fd);
@@ -643,6 +753,52 @@ static int bind_parse_accept_netscaler_cip(char **args, int cur_arg, struct prox
 	return 0;
 }
 
+/* parse the "accept-rate" bind keyword */
+static int bind_parse_accept_rate(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
+{
+	struct listener *l;
+	int val;
+
+	if (!*args[cur_arg + 1]) {
+		memprintf(err, "'%s' : missing value", args[cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	val = atol(args[cur_arg + 1]);
+	if (val <= 0) {
+		memprintf(err, "'%s' : invalid value %d, must be > 0", args[cur_arg], val);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	list_for_each_entry(l, &conf->listeners, by_bind)
+		l->acc_lim = val;
+
+	return 0;
+}
+
+/* parse the "accept-weight" bind keyword */
+static int bind_parse_accept_weight(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
+{
+	struct listener *l;
+	int val;
+
+	if (!*args[cur_arg + 1]) {
+		memprintf(err, "'%s' : missing value", args[cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	val = atol(args[cur_arg + 1]);
+	if (val < 1 || val > 1000) {
+		memprintf(err, "'%s' : invalid value %d, allowed range is 1..1000", args[cur_arg], val);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	list_for_each_entry(l, &conf->listeners, by_bind)
+		l->acc_weight = val;
+
+	return 0;
+}
+
 /* parse the "backlog" bind keyword */
 static int bind_parse_backlog(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
 {
@@ -841,6 +997,8 @@ static struct acl_kw_list acl_kws = {ILH, {
 static struct bind_kw_list bind_kws = { "ALL", { }, {
 	{ "accept-netscaler-cip", bind_parse_accept_netscaler_cip, 1 }, /* enable NetScaler Client IP insertion protocol */
 	{ "accept-proxy", bind_parse_accept_proxy, 0 }, /* enable PROXY protocol */
+	{ "accept-rate",  bind_parse_accept_rate,  1 }, /* set max accept rate of listening socket */
+	{ "accept-weight", bind_parse_accept_weight, 1 }, /* set accept batch weight of listening socket */
 	{ "backlog",      bind_parse_backlog,      1 }, /* set backlog of listening socket */
 	{ "id",           bind_parse_id,           1 }, /* set id of listening socket */
 	{ "maxconn",      bind_parse_maxconn,      1 }, /* set maxconn of listening socket */
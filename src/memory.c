@@ -10,6 +10,8 @@
  *
  */
 
+#include <sys/mman.h>
+
 #include <types/applet.h>
 #include <types/cli.h>
 #include <types/global.h>
@@ -94,6 +96,145 @@ struct pool_head *create_pool(char *name, unsigned int size, unsigned int flags)
 	return pool;
 }
 
+/* Returns the distance between two objects carved from a slab of pool <pool>.
+ * It keeps the 16-byte alignment malloc() would have provided.
+ */
+static inline size_t pool_slab_stride(const struct pool_head *pool)
+{
+	return (pool->size + POOL_EXTRA + 15) & -16;
+}
+
+/* Returns non-zero if <ptr> was carved from one of the slabs of pool <pool>.
+ * Only the slab starting at or before <ptr> needs to be checked.
+ */
+static int pool_in_slab(struct pool_head *pool, const void *ptr)
+{
+	struct ebpt_node *node;
+	struct pool_slab *slab;
+
+	node = ebpt_lookup_le(&pool->slabs, (void *)ptr);
+	if (!node)
+		return 0;
+	slab = ebpt_entry(node, struct pool_slab, node);
+	return (const char *)ptr < (const char *)slab->node.key + slab->size;
+}
+
+/* Maps a POOL_SLAB_SIZE area aligned on its size for pool <pool>, using the
+ * page type set by "tune.pool.hugepages". Explicit huge pages fall back to
+ * transparent ones when none are reserved, and are not tried again for this
+ * pool. The page type which was obtained is stored into <type>. Returns NULL
+ * if no memory could be mapped.
+ */
+static char *pool_slab_map(struct pool_head *pool, unsigned int *type)
+{
+	char *area, *aligned;
+
+#ifdef MAP_HUGETLB
+	if (global.tune.pool_hugepages == POOL_HP_EXPLICIT && !pool->no_hugetlb) {
+		area = mmap(NULL, POOL_SLAB_SIZE, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (area != MAP_FAILED) {
+			*type = POOL_PAGE_HUGETLB;
+			return area;
+		}
+		pool->no_hugetlb = 1;
+	}
+#endif
+	/* map twice the size and trim it so that the kernel may back the
+	 * whole slab with a single huge page.
+	 */
+	area = mmap(NULL, 2 * POOL_SLAB_SIZE, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (area == MAP_FAILED)
+		return NULL;
+
+	aligned = (char *)(((unsigned long)area + POOL_SLAB_SIZE - 1) & -(unsigned long)POOL_SLAB_SIZE);
+	if (aligned > area)
+		munmap(area, aligned - area);
+	if (aligned + POOL_SLAB_SIZE < area + 2 * POOL_SLAB_SIZE)
+		munmap(aligned + POOL_SLAB_SIZE, area + 2 * POOL_SLAB_SIZE - (aligned + POOL_SLAB_SIZE));
+
+	*type = POOL_PAGE_NORMAL;
+#ifdef MADV_HUGEPAGE
+	if (madvise(aligned, POOL_SLAB_SIZE, MADV_HUGEPAGE) == 0)
+		*type = POOL_PAGE_THP;
+#endif
+	return aligned;
+}
+
+/* Carves one object for pool <pool> from its current slab, after mapping a new
+ * slab if the current one is exhausted. Returns NULL if slabs are disabled,
+ * if the pool's objects are too large for slabs, or if no slab could be
+ * mapped, in which case the caller is expected to fall back to malloc().
+ */
+static void *pool_slab_alloc(struct pool_head *pool)
+{
+	size_t stride = pool_slab_stride(pool);
+	struct pool_slab *slab;
+	void *ptr;
+
+	if (global.tune.pool_hugepages == POOL_HP_OFF ||
+	    stride > POOL_SLAB_SIZE / POOL_SLAB_MIN_OBJS)
+		return NULL;
+
+	if (!pool->slab_ptr || (size_t)(pool->slab_end - pool->slab_ptr) < stride) {
+		slab = MALLOC(sizeof(*slab));
+		if (!slab)
+			return NULL;
+		slab->node.key = pool_slab_map(pool, &slab->type);
+		if (!slab->node.key) {
+			FREE(slab);
+			return NULL;
+		}
+		slab->size = POOL_SLAB_SIZE;
+		ebpt_insert(&pool->slabs, &slab->node);
+		pool->slab_ptr = slab->node.key;
+		pool->slab_end = pool->slab_ptr + slab->size;
+		pool->nb_slabs++;
+		pool->slab_cap += slab->size / stride;
+	}
+
+	ptr = pool->slab_ptr;
+	pool->slab_ptr += stride;
+	pool->slab_objs++;
+	return ptr;
+}
+
+/* Makes all pools start a new slab on their next refill, so that the calling
+ * process maps and first touches its own memory, on its own NUMA node when
+ * its CPUs are bound. The remaining part of the current slabs is lost.
+ */
+void pool_slab_detach()
+{
+	struct pool_head *entry;
+
+	list_for_each_entry(entry, &pools, list) {
+		if (entry->slab_ptr)
+			entry->slab_cap -= (entry->slab_end - entry->slab_ptr) / pool_slab_stride(entry);
+		entry->slab_ptr = entry->slab_end = NULL;
+	}
+}
+
+/* Releases the free objects of pool <pool> as long as more than <keep> objects
+ * are available. Objects carved from slabs cannot be released individually and
+ * are left in the free list.
+ */
+static void pool_release_free(struct pool_head *pool, int keep)
+{
+	void **prev = (void **)&pool->free_list;
+	void *temp;
+
+	while ((temp = *prev) && (int)(pool->allocated - pool->used) > keep) {
+		if (!eb_is_empty(&pool->slabs) && pool_in_slab(pool, temp)) {
+			prev = POOL_LINK(pool, temp);
+			continue;
+		}
+		*prev = *POOL_LINK(pool, temp);
+		pool->allocated--;
+		FREE(temp);
+	}
+}
+
 /* Allocates new entries for pool <pool> until there are at least <avail> + 1
  * available, then returns the last one for immediate use, so that at least
  * <avail> are left available in the pool upon return. NULL is returned if the
@@ -114,7 +255,9 @@ void *pool_refill_alloc(struct pool_head *pool, unsigned int avail)
 		if (pool->limit && pool->allocated >= pool->limit)
 			return NULL;
 
-		ptr = MALLOC(pool->size + POOL_EXTRA);
+		ptr = pool_slab_alloc(pool);
+		if (!ptr)
+			ptr = MALLOC(pool->size + POOL_EXTRA);
 		if (!ptr) {
 			pool->failed++;
 			if (failed)
@@ -142,20 +285,14 @@ void *pool_refill_alloc(struct pool_head *pool, unsigned int avail)
  */
 void pool_flush2(struct pool_head *pool)
 {
-	void *temp, *next;
 	if (!pool)
 		return;
 
-	next = pool->free_list;
-	while (next) {
-		temp = next;
-		next = *POOL_LINK(pool, temp);
-		pool->allocated--;
-		FREE(temp);
-	}
-	pool->free_list = next;
+	pool_release_free(pool, -1);
 
-	/* here, we should have pool->allocate == pool->used */
+	/* here, we should have pool->allocate == pool->used, except for the
+	 * objects carved from slabs.
+	 */
 }
 
 /*
@@ -172,17 +309,8 @@ void pool_gc2()
 		goto out;
 
 	list_for_each_entry(entry, &pools, list) {
-		void *temp, *next;
 		//qfprintf(stderr, "Flushing pool %s\n", entry->name);
-		next = entry->free_list;
-		while (next &&
-		       (int)(entry->allocated - entry->used) > (int)entry->minavail) {
-			temp = next;
-			next = *POOL_LINK(entry, temp);
-			entry->allocated--;
-			FREE(temp);
-		}
-		entry->free_list = next;
+		pool_release_free(entry, entry->minavail);
 	}
  out:
 	recurse--;
@@ -203,6 +331,15 @@ void *pool_destroy2(struct pool_head *pool)
 			return pool;
 		pool->users--;
 		if (!pool->users) {
+			struct ebpt_node *node;
+			struct pool_slab *slab;
+
+			while ((node = ebpt_first(&pool->slabs))) {
+				slab = ebpt_entry(node, struct pool_slab, node);
+				ebpt_delete(node);
+				munmap(slab->node.key, slab->size);
+				FREE(slab);
+			}
 			LIST_DEL(&pool->list);
 			FREE(pool);
 		}
@@ -210,27 +347,57 @@ void *pool_destroy2(struct pool_head *pool)
 	return NULL;
 }
 
+/* Returns the name of the page type backing the slabs of pool <pool>. */
+static const char *pool_slab_type(struct pool_head *pool)
+{
+	static const char *names[] = {
+		[POOL_PAGE_NORMAL]  = "normal",
+		[POOL_PAGE_THP]     = "transparent huge",
+		[POOL_PAGE_HUGETLB] = "huge",
+	};
+	struct ebpt_node *node;
+	unsigned int type;
+
+	node = ebpt_first(&pool->slabs);
+	type = ebpt_entry(node, struct pool_slab, node)->type;
+	for (node = ebpt_next(node); node; node = ebpt_next(node))
+		if (ebpt_entry(node, struct pool_slab, node)->type != type)
+			return "mixed";
+	return names[type];
+}
+
 /* This function dumps memory usage information into the trash buffer. */
 void dump_pools_to_trash()
 {
 	struct pool_head *entry;
-	unsigned long allocated, used;
+	unsigned long allocated, used, mapped;
 	int nbpools;
 
-	allocated = used = nbpools = 0;
+	allocated = used = mapped = nbpools = 0;
 	chunk_printf(&trash, "Dumping pools usage. Use SIGQUIT to flush them.\n");
 	list_for_each_entry(entry, &pools, list) {
-		chunk_appendf(&trash, "  - Pool %s (%d bytes) : %d allocated (%u bytes), %d used, %d failures, %d users%s\n",
+		chunk_appendf(&trash, "  - Pool %s (%d bytes) : %d allocated (%u bytes), %d used, %d failures, %d users%s",
 			 entry->name, entry->size, entry->allocated,
 		         entry->size * entry->allocated, entry->used, entry->failed,
 			 entry->users, (entry->flags & MEM_F_SHARED) ? " [SHARED]" : "");
 
+		if (entry->nb_slabs) {
+			chunk_appendf(&trash, ", %u slabs of %s pages (%u%% filled)",
+				      entry->nb_slabs, pool_slab_type(entry),
+				      entry->slab_cap ? (unsigned int)(entry->slab_objs * 100ULL / entry->slab_cap) : 100);
+			mapped += (unsigned long)entry->nb_slabs * POOL_SLAB_SIZE;
+		}
+		chunk_appendf(&trash, "\n");
+
 		allocated += entry->allocated * entry->size;
 		used += entry->used * entry->size;
 		nbpools++;
 	}
-	chunk_appendf(&trash, "Total: %d pools, %lu bytes allocated, %lu used.\n",
+	chunk_appendf(&trash, "Total: %d pools, %lu bytes allocated, %lu used",
 		 nbpools, allocated, used);
+	if (mapped)
+		chunk_appendf(&trash, ", %lu mapped in slabs", mapped);
+	chunk_appendf(&trash, ".\n");
 }
 
 /* Dump statistics on pools usage. */
@@ -23,6 +23,7 @@
 #include <proto/pattern.h>
 #include <proto/sample.h>
 
+#include <eb32tree.h>
 #include <ebsttree.h>
 #include <import/lru.h>
 #include <import/xxhash.h>
@@ -2466,47 +2467,68 @@ int pattern_delete(struct pattern_expr *expr, struct pat_ref_elt *ref)
 void pattern_finalize_config(void)
 {
 	int i = 0;
-	struct pat_ref *ref, *ref2, *ref3;
-	struct list pr = LIST_HEAD_INIT(pr);
+	int len = 0, j;
+	struct pat_ref *ref, **refs;
+	struct eb32_node *nodes, *node;
+	struct eb_root used = EB_ROOT;
+	struct eb_root sorted = EB_ROOT;
 
 	pat_lru_seed = random();
 	if (global.tune.pattern_cache)
 		pat_lru_tree = lru64_new(global.tune.pattern_cache);
 
+	list_for_each_entry(ref, &pattern_reference, list)
+		len++;
+
+	if (!len)
+		return;
+
+	/* The references are indexed by id in a temporary tree so that large
+	 * configurations with many anonymous ACLs do not take quadratic time.
+	 */
+	refs = calloc(len, sizeof(*refs));
+	nodes = calloc(len, sizeof(*nodes));
+	if (!refs || !nodes) {
+		Alert("Out of memory while finalizing the patterns.\n");
+		exit(1);
+	}
+
+	j = 0;
 	list_for_each_entry(ref, &pattern_reference, list) {
-		if (ref->unique_id == -1) {
-			/* Look for the first free id. */
-			while (1) {
-				list_for_each_entry(ref2, &pattern_reference, list) {
-					if (ref2->unique_id == i) {
-						i++;
-						break;
-					}
-				}
-				if (&ref2->list == &pattern_reference)
-					break;
-			}
+		refs[j] = ref;
+		if (ref->unique_id != -1) {
+			nodes[j].key = ref->unique_id;
+			eb32_insert(&used, &nodes[j]);
+		}
+		j++;
+	}
 
-			/* Uses the unique id and increment it for the next entry. */
-			ref->unique_id = i;
+	/* Give the first free ids to the references which have none */
+	for (j = 0; j < len; j++) {
+		if (refs[j]->unique_id != -1)
+			continue;
+
+		while (eb32_lookup(&used, i))
 			i++;
-		}
+
+		/* Uses the unique id and increment it for the next entry. */
+		refs[j]->unique_id = i;
+		i++;
 	}
 
-	/* This sort the reference list by id. */
-	list_for_each_entry_safe(ref, ref2, &pattern_reference, list) {
-		LIST_DEL(&ref->list);
-		list_for_each_entry(ref3, &pr, list) {
-			if (ref->unique_id < ref3->unique_id) {
-				LIST_ADDQ(&ref3->list, &ref->list);
-				break;
-			}
-		}
-		if (&ref3->list == &pr)
-			LIST_ADDQ(&pr, &ref->list);
+	/* This sort the reference list by id. Duplicate keys are kept in
+	 * insertion order, so references sharing an id keep their order.
+	 */
+	memset(nodes, 0, len * sizeof(*nodes));
+	for (j = 0; j < len; j++) {
+		nodes[j].key = refs[j]->unique_id;
+		eb32_insert(&sorted, &nodes[j]);
 	}
 
-	/* swap root */
-	LIST_ADD(&pr, &pattern_reference);
-	LIST_DEL(&pr);
+	LIST_INIT(&pattern_reference);
+	for (node = eb32_first(&sorted); node; node = eb32_next(node))
+		LIST_ADDQ(&pattern_reference, &refs[node - nodes]->list);
+
+	free(nodes);
+	free(refs);
 }
@@ -23,6 +23,11 @@ struct pool_head *pool2_pipe = NULL;
 struct pipe *pipes_live = NULL; /* pipes which are still ready to use */
 int pipes_used = 0;             /* # of pipes in use (2 fds each) */
 int pipes_free = 0;             /* # of pipes unused */
+int pipes_size = 0;             /* size of the last created pipe, 0 if unknown */
+
+#ifdef F_SETPIPE_SZ
+static int pipes_resize_failed = 0; /* F_SETPIPE_SZ refused, don't insist */
+#endif
 
 /* allocate memory for the pipes */
 static void init_pipe()
@@ -60,8 +65,20 @@ struct pipe *get_pipe()
 		return NULL;
 	}
 #ifdef F_SETPIPE_SZ
-	if (global.tune.pipesize)
-		fcntl(pipefd[0], F_SETPIPE_SZ, global.tune.pipesize);
+	/* the size is above /proc/sys/fs/pipe-max-size or the user's quota was
+	 * reached : there's no point trying again on each new pipe.
+	 */
+	if (global.tune.pipesize && !pipes_resize_failed &&
+	    fcntl(pipefd[0], F_SETPIPE_SZ, global.tune.pipesize) < 0)
+		pipes_resize_failed = 1;
+#endif
+#ifdef F_GETPIPE_SZ
+	if (!pipes_size) {
+		int size = fcntl(pipefd[0], F_GETPIPE_SZ);
+
+		if (size > 0)
+			pipes_size = size;
+	}
 #endif
 	ret->data = 0;
 	ret->prod = pipefd[1];
@@ -99,6 +116,33 @@ void put_pipe(struct pipe *p)
 	pipes_used--;
 }
 
+/* create up to <count> pipes at once and place them into the live pool, so
+ * that they are already sized when splicing starts. Returns the number of
+ * pipes created.
+ */
+int prealloc_pipes(int count)
+{
+	struct pipe *p, *list = NULL;
+	int done;
+
+	/* pipes must all be allocated before being released, otherwise
+	 * get_pipe() would always return the same one.
+	 */
+	for (done = 0; done < count; done++) {
+		p = get_pipe();
+		if (!p)
+			break;
+		p->next = list;
+		list = p;
+	}
+
+	while (list) {
+		p = list;
+		list = list->next;
+		put_pipe(p);
+	}
+	return done;
+}
 
 __attribute__((constructor))
 static void __pipe_module_init(void)
@@ -32,6 +32,10 @@
 #include <netinet/tcp.h>
 #include <netinet/in.h>
 
+#if defined(__linux__)
+#include <linux/filter.h>
+#endif
+
 #include <common/compat.h>
 #include <common/config.h>
 #include <common/debug.h>
@@ -712,6 +716,65 @@ int tcp_connect_probe(struct connection *conn)
 }
 
 
+/* Looks for a socket inherited from an old process which is compatible with
+ * <l> : same address and port, interface, namespace and binding options. If
+ * one is found, it is removed from the list and its fd is returned, otherwise
+ * -1 is returned. Sockets are taken in the order the old process sent them,
+ * and <l> learns whether the old process knew their order was the one of
+ * their SO_REUSEPORT group.
+ */
+static int tcp_find_compatible_fd(struct listener *l)
+{
+	struct xfer_sock_list *xfer_sock = xfer_sock_list;
+	struct xfer_sock_list **prev = &xfer_sock_list;
+	const char *ns = NULL;
+	int ret = -1;
+
+#ifdef CONFIG_HAP_NS
+	if (l->netns)
+		ns = l->netns->node.key;
+#endif
+	for (; xfer_sock; prev = &xfer_sock->next, xfer_sock = xfer_sock->next) {
+		if (xfer_sock->addr.ss_family != l->addr.ss_family ||
+		    (xfer_sock->options & LI_O_XFER_MASK) != (l->options & LI_O_XFER_MASK))
+			continue;
+
+		if ((!!xfer_sock->iface != !!l->interface) ||
+		    (l->interface && strcmp(xfer_sock->iface, l->interface) != 0))
+			continue;
+
+		if ((!!xfer_sock->namespace != !!ns) ||
+		    (ns && strcmp(xfer_sock->namespace, ns) != 0))
+			continue;
+
+		if (l->addr.ss_family == AF_INET) {
+			const struct sockaddr_in *a = (const struct sockaddr_in *)&l->addr;
+			const struct sockaddr_in *b = (const struct sockaddr_in *)&xfer_sock->addr;
+
+			if (a->sin_port == b->sin_port && a->sin_addr.s_addr == b->sin_addr.s_addr)
+				break;
+		}
+		else if (l->addr.ss_family == AF_INET6) {
+			const struct sockaddr_in6 *a = (const struct sockaddr_in6 *)&l->addr;
+			const struct sockaddr_in6 *b = (const struct sockaddr_in6 *)&xfer_sock->addr;
+
+			if (a->sin6_port == b->sin6_port &&
+			    memcmp(&a->sin6_addr, &b->sin6_addr, sizeof(a->sin6_addr)) == 0)
+				break;
+		}
+	}
+
+	if (xfer_sock) {
+		l->options |= xfer_sock->options & LI_O_GRP_ORDER;
+		ret = xfer_sock->fd;
+		*prev = xfer_sock->next;
+		free(xfer_sock->iface);
+		free(xfer_sock->namespace);
+		free(xfer_sock);
+	}
+	return ret;
+}
+
 /* This function tries to bind a TCPv4/v6 listener. It may return a warning or
  * an error message in <errmsg> if the message is at most <errlen> bytes long
  * (including '\0'). Note that <errmsg> may be NULL if <errlen> is also zero.
@@ -742,6 +805,10 @@ int tcp_bind_listener(struct listener *listener, char *errmsg, int errlen)
 
 	err = ERR_NONE;
 
+	/* a compatible socket may have been passed by the old process */
+	if (listener->fd == -1)
+		listener->fd = tcp_find_compatible_fd(listener);
+
 	/* if the listener already has an fd assigned, then we were offered the
 	 * fd by an external process (most likely the parent), and we don't want
 	 * to create a new socket. However we still want to set a few flags on
@@ -749,6 +816,8 @@ int tcp_bind_listener(struct listener *listener, char *errmsg, int errlen)
 	 */
 	fd = listener->fd;
 	ext = (fd >= 0);
+	if (ext)
+		listener->options |= LI_O_INHERITED;
 
 	if (!ext) {
 		fd = my_socketat(listener->netns, listener->addr.ss_family, SOCK_STREAM, IPPROTO_TCP);
@@ -929,6 +998,8 @@ int tcp_bind_listener(struct listener *listener, char *errmsg, int errlen)
 
  tcp_close_return:
 	close(fd);
+	/* an inherited fd must not be used again once closed */
+	listener->fd = -1;
 	goto tcp_return;
 }
 
@@ -996,6 +1067,217 @@ int tcp_pause_listener(struct listener *l)
 	return 1;
 }
 
+#if defined(__linux__) && defined(USE_CPU_AFFINITY)
+/* Returns non-zero if TCP addresses <a> and <b> have the same family, address
+ * and port.
+ */
+static int tcp_same_addr(const struct sockaddr_storage *a, const struct sockaddr_storage *b)
+{
+	if (a->ss_family != b->ss_family)
+		return 0;
+
+	if (a->ss_family == AF_INET) {
+		const struct sockaddr_in *a4 = (const struct sockaddr_in *)a;
+		const struct sockaddr_in *b4 = (const struct sockaddr_in *)b;
+
+		return a4->sin_port == b4->sin_port && a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+	}
+	if (a->ss_family == AF_INET6) {
+		const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *)a;
+		const struct sockaddr_in6 *b6 = (const struct sockaddr_in6 *)b;
+
+		return a6->sin6_port == b6->sin6_port &&
+		       memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof(a6->sin6_addr)) == 0;
+	}
+	return 0;
+}
+
+/* Returns non-zero if bound listeners <a> and <b> share the same address, port
+ * and namespace, and thus belong to the same SO_REUSEPORT group.
+ */
+static int tcp_same_reuseport_group(const struct listener *a, const struct listener *b)
+{
+	if (a->fd < 0 || b->fd < 0 || a->state < LI_LISTEN || b->state < LI_LISTEN ||
+	    a->netns != b->netns)
+		return 0;
+
+	return tcp_same_addr(&a->addr, &b->addr);
+}
+
+/* Checks whether the position of each socket in the SO_REUSEPORT group of
+ * listener <l> is known to be the order in which their listeners are declared,
+ * and sets or clears LI_O_GRP_ORDER on all of them accordingly. The kernel
+ * orders a group by join order and moves the last socket into the slot of a
+ * leaving one. So the order is only known when all sockets were created by
+ * this process while no old process could hold sockets in the same group, or
+ * when they were all inherited with "-x" from an old process which knew their
+ * order (the sockets are then taken in the order it sent them), and none of
+ * them is left unused, since closing it would reorder the group. The result
+ * is the same for all members, so the function may be called again for any
+ * of them.
+ */
+static void tcp_check_reuseport_order(struct listener *l)
+{
+	struct xfer_sock_list *xfer_sock;
+	struct listener *l2;
+	struct proxy *px;
+	int created = 0, inherited = 0, ordered = 0;
+	int known;
+
+	for (px = proxy; px; px = px->next) {
+		list_for_each_entry(l2, &px->conf.listeners, by_fe) {
+			if (!tcp_same_reuseport_group(l, l2))
+				continue;
+			if (!(l2->options & LI_O_INHERITED))
+				created++;
+			else if (l2->options & LI_O_GRP_ORDER)
+				ordered++;
+			else
+				inherited++;
+		}
+	}
+
+	if (!inherited && !ordered)
+		known = !nb_oldpids;
+	else if (!created && !inherited) {
+		known = 1;
+		for (xfer_sock = xfer_sock_list; xfer_sock; xfer_sock = xfer_sock->next)
+			if (tcp_same_addr(&xfer_sock->addr, &l->addr))
+				known = 0;
+	}
+	else
+		known = 0;
+
+	for (px = proxy; px; px = px->next) {
+		list_for_each_entry(l2, &px->conf.listeners, by_fe) {
+			if (!tcp_same_reuseport_group(l, l2))
+				continue;
+			if (known)
+				l2->options |= LI_O_GRP_ORDER;
+			else
+				l2->options &= ~LI_O_GRP_ORDER;
+		}
+	}
+}
+
+/* Returns the CPU mask of the only process listener <l> will run on, or 0 if it
+ * may run on several processes or if this process has no "cpu-map".
+ */
+static unsigned long tcp_listener_cpus(const struct listener *l)
+{
+	unsigned long mask = l->bind_conf->bind_proc;
+	int proc;
+
+	if (!mask && l->frontend)
+		mask = l->frontend->bind_proc;
+	if (!mask)
+		mask = nbits(global.nbproc);
+	mask &= nbits(global.nbproc);
+	if (my_popcountl(mask) != 1)
+		return 0;
+
+	for (proc = 0; !(mask & (1UL << proc)); proc++)
+		;
+	return global.cpu_map[proc];
+}
+
+/* Attaches to the SO_REUSEPORT groups of the listeners declared with
+ * "steer-cpu" a classic BPF program which delivers each new connection to the
+ * socket of the process pinned to the CPU which received it. It must be called
+ * once all listeners are bound, before forking and before closing the unused
+ * inherited sockets. The program designates sockets by their position in the
+ * group, so it is only attached when this position is known to follow the
+ * order of the listeners (see tcp_check_reuseport_order()). Otherwise, or if
+ * the kernel doesn't support the program (< 4.5), the socket is only marked
+ * with its CPU with SO_INCOMING_CPU. Connections received on CPUs not mapped
+ * this way are distributed as usual.
+ */
+void tcp_steer_listeners(void)
+{
+	struct sock_filter code[2 + 2 * LONGBITS];
+	struct sock_fprog prog;
+	struct proxy *px, *px2;
+	struct listener *l, *l2;
+	unsigned long cpus, done;
+	int idx, cpu, len;
+
+	/* the order is also reported to the next process when using "-x" */
+	for (px = proxy; px; px = px->next) {
+		list_for_each_entry(l, &px->conf.listeners, by_fe) {
+			if ((l->addr.ss_family == AF_INET || l->addr.ss_family == AF_INET6) &&
+			    l->fd >= 0 && l->state >= LI_LISTEN)
+				tcp_check_reuseport_order(l);
+		}
+	}
+
+	for (px = proxy; px; px = px->next) {
+		list_for_each_entry(l, &px->conf.listeners, by_fe) {
+			if (!(l->options & LI_O_STEER_CPU) || l->fd < 0 || l->state < LI_LISTEN)
+				continue;
+
+			cpus = tcp_listener_cpus(l);
+			if (!cpus) {
+				Warning("Proxy '%s': 'steer-cpu' on bind '%s' at [%s:%d] ignored, the socket must be bound to a single process having a 'cpu-map'.\n",
+					px->id, l->bind_conf->arg, l->bind_conf->file, l->bind_conf->line);
+				continue;
+			}
+
+			if (!(l->options & LI_O_GRP_ORDER)) {
+				Warning("Proxy '%s': 'steer-cpu' on bind '%s' at [%s:%d] only sets the socket's CPU, its position in the reuseport group is unknown (reload without '-x' or changed 'bind' lines).\n",
+					px->id, l->bind_conf->arg, l->bind_conf->file, l->bind_conf->line);
+#ifdef SO_DETACH_REUSEPORT_BPF
+				/* a program left by an old process would use wrong positions */
+				setsockopt(l->fd, SOL_SOCKET, SO_DETACH_REUSEPORT_BPF, &cpus, sizeof(cpus));
+#endif
+				for (cpu = 0; !(cpus & (1UL << cpu)); cpu++)
+					;
+				setsockopt(l->fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu));
+				continue;
+			}
+
+			/* A = current CPU; for each mapped CPU : if (A == cpu) return idx */
+			len = 0;
+			code[len++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU);
+			done = 0;
+			idx = 0;
+			for (px2 = proxy; px2; px2 = px2->next) {
+				list_for_each_entry(l2, &px2->conf.listeners, by_fe) {
+					if (!tcp_same_reuseport_group(l, l2))
+						continue;
+
+					cpus = (l2->options & LI_O_STEER_CPU) ? tcp_listener_cpus(l2) & ~done : 0;
+					done |= cpus;
+					for (cpu = 0; cpu < LONGBITS; cpu++) {
+						if (!(cpus & (1UL << cpu)))
+							continue;
+						code[len++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, cpu, 0, 1);
+						code[len++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, idx);
+					}
+					idx++;
+				}
+			}
+			/* an out of range index makes the kernel fall back to hashing */
+			code[len++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0xffffffff);
+
+			if (idx < 2)
+				continue;
+
+			prog.len = len;
+			prog.filter = code;
+			if (setsockopt(l->fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) == -1) {
+				for (cpu = 0; !(tcp_listener_cpus(l) & (1UL << cpu)); cpu++)
+					;
+				setsockopt(l->fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu));
+			}
+		}
+	}
+}
+#else
+void tcp_steer_listeners(void)
+{
+}
+#endif
+
 /*
  * Execute the "set-src" action. May be called from {tcp,http}request.
  * It only changes the address and tries to preserve the original port. If the
@@ -1535,6 +1817,25 @@ smp_fetch_fc_reordering(const struct arg *args, struct sample *smp, const char *
 #endif // TCP_INFO
 
 #ifdef IPV6_V6ONLY
+#if defined(__linux__)
+/* parse the "steer-cpu" bind keyword */
+static int bind_parse_steer_cpu(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
+{
+	struct listener *l;
+
+#ifndef USE_CPU_AFFINITY
+	memprintf(err, "'%s' relies on 'cpu-map' which is not supported in this build (USE_CPU_AFFINITY is not set)", args[cur_arg]);
+	return ERR_ALERT | ERR_FATAL;
+#endif
+	list_for_each_entry(l, &conf->listeners, by_bind) {
+		if (l->addr.ss_family == AF_INET || l->addr.ss_family == AF_INET6)
+			l->options |= LI_O_STEER_CPU;
+	}
+
+	return 0;
+}
+#endif
+
 /* parse the "v4v6" bind keyword */
 static int bind_parse_v4v6(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
 {
@@ -1785,6 +2086,9 @@ static struct bind_kw_list bind_kws = { "TCP", { }, {
 #ifdef TCP_MAXSEG
 	{ "mss",           bind_parse_mss,          1 }, /* set MSS of listening socket */
 #endif
+#if defined(__linux__)
+	{ "steer-cpu",     bind_parse_steer_cpu,    0 }, /* deliver connections to the process on the receiving CPU */
+#endif
 #ifdef TCP_USER_TIMEOUT
 	{ "tcp-ut",        bind_parse_tcp_ut,       1 }, /* set User Timeout on listening socket */
 #endif
@@ -1805,6 +2109,7 @@ static struct bind_kw_list bind_kws = { "TCP", { }, {
 	{ "defer-accept",  NULL,  0 },
 	{ "interface",     NULL,  1 },
 	{ "mss",           NULL,  1 },
+	{ "steer-cpu",     NULL,  0 },
 	{ "transparent",   NULL,  0 },
 	{ "v4v6",          NULL,  0 },
 	{ "v6only",        NULL,  0 },
@@ -646,27 +646,24 @@ struct proxy *proxy_find_best_match(int cap, const char *name, int id, int *diff
 
 struct server *findserver(const struct proxy *px, const char *name) {
 
-	struct server *cursrv, *target = NULL;
+	struct ebpt_node *node, *next;
 
 	if (!px)
 		return NULL;
 
-	for (cursrv = px->srv; cursrv; cursrv = cursrv->next) {
-		if (strcmp(cursrv->id, name))
-			continue;
-
-		if (!target) {
-			target = cursrv;
-			continue;
-		}
+	node = ebis_lookup((struct eb_root *)&px->conf.used_server_name, name);
+	if (!node)
+		return NULL;
 
+	next = ebpt_next(node);
+	if (next && strcmp(next->key, name) == 0) {
 		Alert("Refusing to use duplicated server '%s' found in proxy: %s!\n",
 			name, px->id);
 
 		return NULL;
 	}
 
-	return target;
+	return container_of(node, struct server, conf.name);
 }
 
 /* This function checks that the designated proxy has no http directives
@@ -744,6 +741,7 @@ void init_new_proxy(struct proxy *p)
 	LIST_INIT(&p->req_add);
 	LIST_INIT(&p->rsp_add);
 	LIST_INIT(&p->listener_queue);
+	LIST_INIT(&p->mem.wait);
 	LIST_INIT(&p->logsrvs);
 	LIST_INIT(&p->logformat);
 	LIST_INIT(&p->logformat_sd);
@@ -913,6 +911,39 @@ struct task *manage_proxy(struct task *t)
 }
 
 
+/* Adds the signed deltas <buf>, <http> and <comp> to the memory accounted to
+ * proxy <px>. The streams waiting for memory are woken up when the usage falls
+ * below the proxy's "maxmem", or when no stream holds buffers anymore since
+ * they would otherwise wait forever. The limited listeners are only enabled
+ * again once the usage is below "maxmem".
+ */
+void proxy_mem_add(struct proxy *px, long buf, long http, long comp)
+{
+	struct stream *s, *back;
+
+	px->mem.buf  += buf;
+	px->mem.http += http;
+	px->mem.comp += comp;
+
+	if (buf + http + comp >= 0 || !px->mem.max)
+		return;
+
+	if (!proxy_mem_full(px) || !(px->mem.buf + px->mem.comp)) {
+		list_for_each_entry_safe(s, back, &px->mem.wait, buffer_wait) {
+			LIST_DEL(&s->buffer_wait);
+			LIST_INIT(&s->buffer_wait);
+			task_wakeup(s->task, TASK_WOKEN_RES);
+		}
+	}
+
+	if (proxy_mem_full(px))
+		return;
+
+	if (!LIST_ISEMPTY(&px->listener_queue) &&
+	    (!px->fe_sps_lim || freq_ctr_remain(&px->fe_sess_per_sec, px->fe_sps_lim, 0) > 0))
+		dequeue_all_listeners(&px->listener_queue);
+}
+
 /*
  * this function disables health-check servers so that the process will quickly be ignored
  * by load balancers. Note that if a proxy was already in the PAUSED state, then its grace
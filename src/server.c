@@ -13,6 +13,9 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include <common/cfgparse.h>
 #include <common/config.h>
@@ -32,6 +35,7 @@
 #include <proto/checks.h>
 #include <proto/port_range.h>
 #include <proto/protocol.h>
+#include <proto/proxy.h>
 #include <proto/queue.h>
 #include <proto/raw_sock.h>
 #include <proto/server.h>
@@ -41,6 +45,10 @@
 #include <proto/task.h>
 #include <proto/dns.h>
 
+#ifdef USE_OPENSSL
+#include <proto/ssl_sock.h>
+#endif
+
 static void srv_update_state(struct server *srv, int version, char **params);
 static int srv_apply_lastaddr(struct server *srv, int *err_code);
 
@@ -998,6 +1006,8 @@ int parse_server(const char *file, int linenum, char **args, struct proxy *curpr
 			newsrv->state = SRV_ST_RUNNING; /* early server setup */
 			newsrv->last_change = now.tv_sec;
 			newsrv->id = strdup(args[1]);
+			newsrv->conf.name.key = newsrv->id;
+			ebis_insert(&curproxy->conf.used_server_name, &newsrv->conf.name);
 
 			/* several ways to check the port component :
 			 *  - IP    => port=+0, relative (IPv4 only)
@@ -2017,13 +2027,12 @@ struct server *server_find_by_name(struct proxy *bk, const char *name)
 			return curserver;
 	}
 	else {
-		curserver = bk->srv;
-
-		while (curserver && (strcmp(curserver->id, name) != 0))
-			curserver = curserver->next;
+		struct ebpt_node *node;
 
-		if (curserver)
-			return curserver;
+		/* servers with the same name are stored in declaration order */
+		node = ebis_lookup(&bk->conf.used_server_name, name);
+		if (node)
+			return container_of(node, struct server, conf.name);
 	}
 
 	return NULL;
@@ -2356,34 +2365,298 @@ static void srv_update_state(struct server *srv, int version, char **params)
 	}
 }
 
-/* This function parses all the proxies and only take care of the backends (since we're looking for server)
- * For each proxy, it does the following:
- *  - opens its server state file (either one or local one)
- *  - read whole file, line by line
- *  - analyse each line to check if it matches our current backend:
- *    - backend name matches
- *    - backend id matches if id is forced and name doesn't match
- *  - if the server pointed by the line is found, then state is applied
- *
- * If the running backend uuid or id differs from the state file, then HAProxy reports
- * a warning.
+/* Applies the state line made of <params> and <srv_params> (see
+ * srv_state_apply_file()) to backend <bk>, provided that its name or its
+ * forced id matches the ones of the line.
  */
-void apply_server_state(void)
+static void srv_state_apply_line(struct proxy *bk, int version, char **params, char **srv_params)
+{
+	struct server *srv;
+	int bk_f_forced_id = 0;
+	int check_id = 0;
+	int check_name = 0;
+	int diff;
+
+	switch (version) {
+		case 1:
+			bk_f_forced_id = (atoi(params[15]) & PR_O_FORCED_ID);
+			check_id = (atoi(params[0]) == bk->uuid);
+			check_name = (strcmp(bk->id, params[1]) == 0);
+			break;
+	}
+
+	/* if backend can't be found, let's continue */
+	if (!check_id && !check_name)
+		return;
+	else if (!check_id && check_name) {
+		Warning("backend ID mismatch: from server state file: '%s', from running config '%d'\n", params[0], bk->uuid);
+		send_log(bk, LOG_NOTICE, "backend ID mismatch: from server state file: '%s', from running config '%d'\n", params[0], bk->uuid);
+	}
+	else if (check_id && !check_name) {
+		Warning("backend name mismatch: from server state file: '%s', from running config '%s'\n", params[1], bk->id);
+		send_log(bk, LOG_NOTICE, "backend name mismatch: from server state file: '%s', from running config '%s'\n", params[1], bk->id);
+		/* if name doesn't match, we still want to update curproxy if the backend id
+		 * was forced in previous the previous configuration */
+		if (!bk_f_forced_id)
+			return;
+	}
+
+	/* look for the server by its id: param[2] */
+	/* else look for the server by its name: param[3] */
+	diff = 0;
+	srv = server_find_best_match(bk, params[3], atoi(params[2]), &diff);
+
+	if (!srv) {
+		/* if no server found, then warning and continue with next line */
+		Warning("can't find server '%s' with id '%s' in backend with id '%s' or name '%s'\n",
+			params[3], params[2], params[0], params[1]);
+		send_log(bk, LOG_NOTICE, "can't find server '%s' with id '%s' in backend with id '%s' or name '%s'\n",
+			 params[3], params[2], params[0], params[1]);
+		return;
+	}
+	else if (diff & PR_FBM_MISMATCH_ID) {
+		Warning("In backend '%s' (id: '%d'): server ID mismatch: from server state file: '%s', from running config %d\n", bk->id, bk->uuid, params[2], srv->puid);
+		send_log(bk, LOG_NOTICE, "In backend '%s' (id: %d): server ID mismatch: from server state file: '%s', from running config %d\n", bk->id, bk->uuid, params[2], srv->puid);
+	}
+	else if (diff & PR_FBM_MISMATCH_NAME) {
+		Warning("In backend '%s' (id: %d): server name mismatch: from server state file: '%s', from running config '%s'\n", bk->id, bk->uuid, params[3], srv->id);
+		send_log(bk, LOG_NOTICE, "In backend '%s' (id: %d): server name mismatch: from server state file: '%s', from running config '%s'\n", bk->id, bk->uuid, params[3], srv->id);
+	}
+
+	/* now we can proceed with server's state update */
+	srv_update_state(srv, version, srv_params);
+}
+
+/* Reads the server states from <f> and applies them. If <px> is not NULL, the
+ * file is the local one of this backend and only its lines are considered.
+ * Otherwise each line is applied to the backends it designates by name or by
+ * id which load their state from a file of type <from>, or from any file if
+ * <from> is PR_SRV_STATE_FILE_UNSPEC. These backends are looked up in the
+ * proxy trees so that the file is read only once whatever the number of
+ * backends. <filepath> is only used in warnings.
+ */
+static void srv_state_apply_file(FILE *f, const char *filepath, struct proxy *px, int from)
 {
 	char *cur, *end;
 	char mybuf[SRV_STATE_LINE_MAXLEN];
 	int mybuflen;
 	char *params[SRV_STATE_FILE_MAX_FIELDS];
 	char *srv_params[SRV_STATE_FILE_MAX_FIELDS];
-	int arg, srv_arg, version, diff;
+	int arg, srv_arg, version;
+	struct proxy *bk, *bk2;
+
+	mybuf[0] = '\0';
+	mybuflen = 0;
+	version = 0;
+
+	/* first character of first line of the file must contain the version of the export */
+	if (fgets(mybuf, SRV_STATE_LINE_MAXLEN, f) == NULL) {
+		Warning("Can't read first line of the server state file '%s'\n", filepath);
+		return;
+	}
+
+	cur = mybuf;
+	version = atoi(cur);
+	if ((version < SRV_STATE_FILE_VERSION_MIN) ||
+	    (version > SRV_STATE_FILE_VERSION_MAX))
+		return;
+
+	while (fgets(mybuf, SRV_STATE_LINE_MAXLEN, f)) {
+		mybuflen = strlen(mybuf);
+		cur = mybuf;
+		end = cur + mybuflen;
+
+		/* we need at least one character */
+		if (mybuflen == 0)
+			continue;
+
+		/* ignore blank characters at the beginning of the line */
+		while (isspace(*cur))
+			++cur;
+
+		if (cur == end)
+			continue;
+
+		/* ignore comment line */
+		if (*cur == '#')
+			continue;
+
+		/* we're now ready to move the line into *srv_params[] */
+		params[0] = cur;
+		arg = 1;
+		srv_arg = 0;
+		while (*cur && arg < SRV_STATE_FILE_MAX_FIELDS) {
+			if (isspace(*cur)) {
+				*cur = '\0';
+				++cur;
+				while (isspace(*cur))
+					++cur;
+				switch (version) {
+					case 1:
+						/*
+						 * srv_addr:             params[4]  => srv_params[0]
+						 * srv_op_state:         params[5]  => srv_params[1]
+						 * srv_admin_state:      params[6]  => srv_params[2]
+						 * srv_uweight:          params[7]  => srv_params[3]
+						 * srv_iweight:          params[8]  => srv_params[4]
+						 * srv_last_time_change: params[9]  => srv_params[5]
+						 * srv_check_status:     params[10] => srv_params[6]
+						 * srv_check_result:     params[11] => srv_params[7]
+						 * srv_check_health:     params[12] => srv_params[8]
+						 * srv_check_state:      params[13] => srv_params[9]
+						 * srv_agent_state:      params[14] => srv_params[10]
+						 * bk_f_forced_id:       params[15] => srv_params[11]
+						 * srv_f_forced_id:      params[16] => srv_params[12]
+						 */
+						if (arg >= 4) {
+							srv_params[srv_arg] = cur;
+							++srv_arg;
+						}
+						break;
+				}
+
+				params[arg] = cur;
+				++arg;
+			}
+			else {
+				++cur;
+			}
+		}
+
+		/* if line is incomplete line, then ignore it */
+		switch (version) {
+			case 1:
+				if (arg < SRV_STATE_FILE_NB_FIELDS_VERSION_1)
+					continue;
+				break;
+		}
+
+		if (px) {
+			srv_state_apply_line(px, version, params, srv_params);
+			continue;
+		}
+
+		/* the line may designate one backend by its name and another
+		 * one by its id, each of them decides whether it applies.
+		 */
+		bk = proxy_find_by_name(params[1], PR_CAP_BE, 0);
+		if (bk && (from == PR_SRV_STATE_FILE_UNSPEC ?
+		           bk->load_server_state_from_file != PR_SRV_STATE_FILE_NONE :
+		           bk->load_server_state_from_file == from))
+			srv_state_apply_line(bk, version, params, srv_params);
+
+		bk2 = proxy_find_by_id(atoi(params[0]), PR_CAP_BE, 0);
+		if (bk2 && bk2 != bk && (from == PR_SRV_STATE_FILE_UNSPEC ?
+		                         bk2->load_server_state_from_file != PR_SRV_STATE_FILE_NONE :
+		                         bk2->load_server_state_from_file == from))
+			srv_state_apply_line(bk2, version, params, srv_params);
+	}
+}
+
+/* Retrieves the server states from the old process through its stats socket
+ * <unixsocket> ("-x" command line option) and applies them to all backends
+ * loading their state from a file, so that the file does not need to be
+ * dumped before the reload. Returns 0 on success, -1 if the states could not
+ * be retrieved, in which case the state files must be used.
+ */
+static int srv_state_apply_socket(const char *unixsocket)
+{
+	struct sockaddr_un addr;
+	char *buf = NULL, *newbuf;
+	size_t size = 0, len = 0;
+	ssize_t ret;
+	FILE *f;
+	int sock;
+
+	if (strlen(unixsocket) >= sizeof(addr.sun_path))
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, unixsocket);
+
+	sock = socket(PF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0)
+		return -1;
+
+	if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    send(sock, "show servers state\n", 19, 0) != 19)
+		goto fail;
+
+	while (1) {
+		if (len == size) {
+			size = size ? size * 2 : 65536;
+			newbuf = realloc(buf, size);
+			if (!newbuf)
+				goto fail;
+			buf = newbuf;
+		}
+		ret = recv(sock, buf + len, size - len, 0);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			goto fail;
+		}
+		if (ret == 0)
+			break;
+		len += ret;
+	}
+	close(sock);
+	sock = -1;
+
+	/* anything but a version number means an error (eg: permission denied) */
+	if (!len || !isdigit((unsigned char)*buf))
+		goto fail;
+
+	f = fmemopen(buf, len, "r");
+	if (!f)
+		goto fail;
+
+	srv_state_apply_file(f, unixsocket, NULL, PR_SRV_STATE_FILE_UNSPEC);
+	fclose(f);
+	free(buf);
+	return 0;
+
+ fail:
+	if (sock >= 0)
+		close(sock);
+	free(buf);
+	Warning("Failed to get the server states from the old process through '%s', using the server state files.\n", unixsocket);
+	return -1;
+}
+
+/* This function applies the server states to all the backends (since we're
+ * looking for servers). If <unixsocket> is not NULL, the states are first
+ * requested from the old process through this stats socket, and the files
+ * are only used if this fails. Otherwise:
+ *  - the global server state file is read once, each line is applied to the
+ *    backend it designates by name, or by id if the id was forced, when this
+ *    backend loads its state from the global file;
+ *  - each backend having its own file reads it and only applies the lines
+ *    matching its name or its forced id.
+ *
+ * If the running backend uuid or id differs from the state file, then HAProxy reports
+ * a warning.
+ */
+void apply_server_state(const char *unixsocket)
+{
 	FILE *f;
 	char *filepath;
 	char globalfilepath[MAXPATHLEN + 1];
 	char localfilepath[MAXPATHLEN + 1];
-	int len, fileopenerr, globalfilepathlen, localfilepathlen;
+	int len, globalfilepathlen, localfilepathlen;
 	extern struct proxy *proxy;
-	struct proxy *curproxy, *bk;
-	struct server *srv;
+	struct proxy *curproxy;
+	int use_global = 0;
+
+	for (curproxy = proxy; curproxy != NULL; curproxy = curproxy->next) {
+		if ((curproxy->cap & PR_CAP_BE) &&
+		    curproxy->load_server_state_from_file == PR_SRV_STATE_FILE_GLOBAL)
+			use_global = 1;
+	}
+
+	if (unixsocket && srv_state_apply_socket(unixsocket) == 0)
+		return;
 
 	globalfilepathlen = 0;
 	/* create the globalfilepath variable */
@@ -2433,24 +2706,27 @@ void apply_server_state(void)
 	if (globalfilepathlen == 0)
 		globalfilepath[0] = '\0';
 
+	/* read servers state from the global file, only once */
+	if (use_global && globalfilepathlen) {
+		errno = 0;
+		f = fopen(globalfilepath, "r");
+		if (errno)
+			Warning("Can't open server state file '%s': %s\n", globalfilepath, strerror(errno));
+		if (f) {
+			srv_state_apply_file(f, globalfilepath, NULL, PR_SRV_STATE_FILE_GLOBAL);
+			fclose(f);
+		}
+	}
+
 	/* read servers state from local file */
 	for (curproxy = proxy; curproxy != NULL; curproxy = curproxy->next) {
 		/* servers are only in backends */
 		if (!(curproxy->cap & PR_CAP_BE))
 			continue;
-		fileopenerr = 0;
 		filepath = NULL;
 
 		/* search server state file path and name */
 		switch (curproxy->load_server_state_from_file) {
-			/* read servers state from global file */
-			case PR_SRV_STATE_FILE_GLOBAL:
-				/* there was an error while generating global server state file path */
-				if (globalfilepathlen == 0)
-					continue;
-				filepath = globalfilepath;
-				fileopenerr = 1;
-				break;
 			/* this backend has its own file */
 			case PR_SRV_STATE_FILE_LOCAL:
 				localfilepathlen = 0;
@@ -2503,161 +2779,18 @@ void apply_server_state(void)
 					localfilepath[0] = '\0';
 
 				break;
+			/* the global file was already processed above */
+			case PR_SRV_STATE_FILE_GLOBAL:
 			case PR_SRV_STATE_FILE_NONE:
 			default:
 				continue;
 		}
 
-		/* preload global state file */
-		errno = 0;
 		f = fopen(filepath, "r");
-		if (errno && fileopenerr)
-			Warning("Can't open server state file '%s': %s\n", filepath, strerror(errno));
 		if (!f)
 			continue;
 
-		mybuf[0] = '\0';
-		mybuflen = 0;
-		version = 0;
-
-		/* first character of first line of the file must contain the version of the export */
-		if (fgets(mybuf, SRV_STATE_LINE_MAXLEN, f) == NULL) {
-			Warning("Can't read first line of the server state file '%s'\n", filepath);
-			goto fileclose;
-		}
-
-		cur = mybuf;
-		version = atoi(cur);
-		if ((version < SRV_STATE_FILE_VERSION_MIN) ||
-		    (version > SRV_STATE_FILE_VERSION_MAX))
-			goto fileclose;
-
-		while (fgets(mybuf, SRV_STATE_LINE_MAXLEN, f)) {
-			int bk_f_forced_id = 0;
-			int check_id = 0;
-			int check_name = 0;
-
-			mybuflen = strlen(mybuf);
-			cur = mybuf;
-			end = cur + mybuflen;
-
-			bk = NULL;
-			srv = NULL;
-
-			/* we need at least one character */
-			if (mybuflen == 0)
-				continue;
-
-			/* ignore blank characters at the beginning of the line */
-			while (isspace(*cur))
-				++cur;
-
-			if (cur == end)
-				continue;
-
-			/* ignore comment line */
-			if (*cur == '#')
-				continue;
-
-			/* we're now ready to move the line into *srv_params[] */
-			params[0] = cur;
-			arg = 1;
-			srv_arg = 0;
-			while (*cur && arg < SRV_STATE_FILE_MAX_FIELDS) {
-				if (isspace(*cur)) {
-					*cur = '\0';
-					++cur;
-					while (isspace(*cur))
-						++cur;
-					switch (version) {
-						case 1:
-							/*
-							 * srv_addr:             params[4]  => srv_params[0]
-							 * srv_op_state:         params[5]  => srv_params[1]
-							 * srv_admin_state:      params[6]  => srv_params[2]
-							 * srv_uweight:          params[7]  => srv_params[3]
-							 * srv_iweight:          params[8]  => srv_params[4]
-							 * srv_last_time_change: params[9]  => srv_params[5]
-							 * srv_check_status:     params[10] => srv_params[6]
-							 * srv_check_result:     params[11] => srv_params[7]
-							 * srv_check_health:     params[12] => srv_params[8]
-							 * srv_check_state:      params[13] => srv_params[9]
-							 * srv_agent_state:      params[14] => srv_params[10]
-							 * bk_f_forced_id:       params[15] => srv_params[11]
-							 * srv_f_forced_id:      params[16] => srv_params[12]
-							 */
-							if (arg >= 4) {
-								srv_params[srv_arg] = cur;
-								++srv_arg;
-							}
-							break;
-					}
-
-					params[arg] = cur;
-					++arg;
-				}
-				else {
-					++cur;
-				}
-			}
-
-			/* if line is incomplete line, then ignore it.
-			 * otherwise, update useful flags */
-			switch (version) {
-				case 1:
-					if (arg < SRV_STATE_FILE_NB_FIELDS_VERSION_1)
-						continue;
-					bk_f_forced_id = (atoi(params[15]) & PR_O_FORCED_ID);
-					check_id = (atoi(params[0]) == curproxy->uuid);
-					check_name = (strcmp(curproxy->id, params[1]) == 0);
-					break;
-			}
-
-			diff = 0;
-			bk = curproxy;
-
-			/* if backend can't be found, let's continue */
-			if (!check_id && !check_name)
-				continue;
-			else if (!check_id && check_name) {
-				Warning("backend ID mismatch: from server state file: '%s', from running config '%d'\n", params[0], bk->uuid);
-				send_log(bk, LOG_NOTICE, "backend ID mismatch: from server state file: '%s', from running config '%d'\n", params[0], bk->uuid);
-			}
-			else if (check_id && !check_name) {
-				Warning("backend name mismatch: from server state file: '%s', from running config '%s'\n", params[1], bk->id);
-				send_log(bk, LOG_NOTICE, "backend name mismatch: from server state file: '%s', from running config '%s'\n", params[1], bk->id);
-				/* if name doesn't match, we still want to update curproxy if the backend id
-				 * was forced in previous the previous configuration */
-				if (!bk_f_forced_id)
-					continue;
-			}
-
-			/* look for the server by its id: param[2] */
-			/* else look for the server by its name: param[3] */
-			diff = 0;
-			srv = server_find_best_match(bk, params[3], atoi(params[2]), &diff);
-
-			if (!srv) {
-				/* if no server found, then warning and continue with next line */
-				Warning("can't find server '%s' with id '%s' in backend with id '%s' or name '%s'\n",
-					params[3], params[2], params[0], params[1]);
-				send_log(bk, LOG_NOTICE, "can't find server '%s' with id '%s' in backend with id '%s' or name '%s'\n",
-					 params[3], params[2], params[0], params[1]);
-				continue;
-			}
-			else if (diff & PR_FBM_MISMATCH_ID) {
-				Warning("In backend '%s' (id: '%d'): server ID mismatch: from server state file: '%s', from running config %d\n", bk->id, bk->uuid, params[2], srv->puid);
-				send_log(bk, LOG_NOTICE, "In backend '%s' (id: %d): server ID mismatch: from server state file: '%s', from running config %d\n", bk->id, bk->uuid, params[2], srv->puid);
-			}
-			else if (diff & PR_FBM_MISMATCH_NAME) {
-				Warning("In backend '%s' (id: %d): server name mismatch: from server state file: '%s', from running config '%s'\n", bk->id, bk->uuid, params[3], srv->id);
-				send_log(bk, LOG_NOTICE, "In backend '%s' (id: %d): server name mismatch: from server state file: '%s', from running config '%s'\n", bk->id, bk->uuid, params[3], srv->id);
-			}
-
-			/* now we can proceed with server's state update */
-			srv_update_state(srv, version, srv_params);
-		}
-fileclose:
+		srv_state_apply_file(f, filepath, curproxy, PR_SRV_STATE_FILE_LOCAL);
 		fclose(f);
 	}
 }
@@ -3685,6 +3818,326 @@ static int cli_parse_enable_server(char **args, struct appctx *appctx, void *pri
 	return 1;
 }
 
+/* A server removed at runtime waits in this list until all the streams which
+ * existed at the time of its removal are gone, because they may still point
+ * to it (target, idle connection, log or stats context). The stream which
+ * issued the removal cannot reference it anymore and is not waited for.
+ */
+struct dead_server {
+	struct list list;
+	struct server *srv;
+	struct timeval date;            /* internal date of the removal */
+	struct stream *strm;            /* stream which removed the server */
+};
+
+static struct list dead_servers = LIST_HEAD_INIT(dead_servers);
+static struct task *dead_servers_task = NULL;
+
+/* Releases all the memory used by server <srv> which is not referenced
+ * anymore, the same way deinit() does at exit.
+ */
+static void srv_release(struct server *srv)
+{
+	free_check(&srv->check);
+	free_check(&srv->agent);
+	free(srv->agent.send_string);
+	free(srv->id);
+	free(srv->cookie);
+	free(srv->rdr_pfx);
+	free(srv->trackit);
+	free(srv->resolvers_id);
+	free(srv->hostname);
+	free(srv->lastaddr);
+	if (srv->resolution) {
+		free(srv->resolution->hostname_dn);
+		free(srv->resolution);
+	}
+	free(srv->conn_src.sport_range);
+#if defined(CONFIG_HAP_TRANSPARENT)
+	free(srv->conn_src.bind_hdr_name);
+#endif
+	free((char *)srv->conf.file);
+#ifdef USE_OPENSSL
+	if (srv->use_ssl || srv->check.use_ssl)
+		ssl_sock_free_srv_ctx(srv);
+#endif
+	free(srv);
+}
+
+/* Periodically releases the servers removed at runtime once no stream which
+ * existed at the time of their removal remains.
+ */
+static struct task *srv_release_dead(struct task *t)
+{
+	struct dead_server *dead, *back;
+	struct stream *s;
+
+	list_for_each_entry_safe(dead, back, &dead_servers, list) {
+		list_for_each_entry(s, &streams, list) {
+			if (s != dead->strm && tv_isge(&dead->date, &strm_sess(s)->tv_accept))
+				break;
+		}
+
+		if (&s->list != &streams)
+			continue;
+
+		LIST_DEL(&dead->list);
+		srv_release(dead->srv);
+		free(dead);
+	}
+
+	if (LIST_ISEMPTY(&dead_servers))
+		t->expire = TICK_ETERNITY;
+	else
+		t->expire = tick_add(now_ms, MS_TO_TICKS(1000));
+	return t;
+}
+
+/* parse a "add server" command. It always returns 1. */
+static int cli_parse_add_server(char **args, struct appctx *appctx, void *private)
+{
+	char *srv_args[MAX_STATS_ARGS + 1];
+	struct server *sv, *prev;
+	struct proxy *px;
+	char *name;
+	int arg, disabled;
+
+	if (!cli_has_level(appctx, ACCESS_LVL_ADMIN))
+		return 1;
+
+	for (name = args[2]; *name && *name != '/'; name++);
+	if (*name)
+		*name++ = '\0';
+
+	if (!*name || !*args[2] || !*args[3]) {
+		appctx->ctx.cli.msg = "Require 'backend/server' and an address.\n";
+		appctx->st0 = CLI_ST_PRINT;
+		return 1;
+	}
+
+	px = proxy_be_by_name(args[2]);
+	if (!px) {
+		appctx->ctx.cli.msg = "No such backend.\n";
+		appctx->st0 = CLI_ST_PRINT;
+		return 1;
+	}
+
+	if (px->state == PR_STSTOPPED) {
+		appctx->ctx.cli.msg = "Proxy is disabled.\n";
+		appctx->st0 = CLI_ST_PRINT;
+		return 1;
+	}
+
+	if (ebis_lookup(&px->conf.used_server_name, name)) {
+		appctx->ctx.cli.msg = "Server name already in use in this backend.\n";
+		appctx->st0 = CLI_ST_PRINT;
+		return 1;
+	}
+
+	/* turn the command into a "server" configuration line */
+	srv_args[0] = "server";
+	srv_args[1] = name;
+	for (arg = 3; arg <= MAX_STATS_ARGS; arg++)
+		srv_args[arg - 1] = args[arg];
+	srv_args[MAX_STATS_ARGS] = "";
+
+	prev = px->srv;
+	if (parse_server("CLI", 0, srv_args, px, NULL) & (ERR_ALERT | ERR_ABORT)) {
+		appctx->ctx.cli.msg = "Invalid server definition.\n";
+		goto fail;
+	}
+	sv = px->srv;
+
+	/* parse_server() counted it as usable, but it starts in maintenance
+	 * and only becomes visible to the LB algorithm once fully set up.
+	 */
+	if (sv->flags & SRV_F_BACKUP)
+		px->srv_bck--;
+	else
+		px->srv_act--;
+
+	if (sv->hostname || sv->resolvers_id) {
+		appctx->ctx.cli.msg = "Only IP addresses are supported at runtime.\n";
+		goto fail;
+	}
+
+	if (sv->trackit) {
+		appctx->ctx.cli.msg = "Tracking is not supported at runtime.\n";
+		goto fail;
+	}
+
+	/* the same fixups as the configuration review */
+	if (sv->minconn > sv->maxconn)
+		sv->maxconn = sv->minconn;
+	else if (sv->maxconn && !sv->minconn)
+		sv->minconn = sv->maxconn;
+
+	sv->check.type = px->options2 & PR_O2_CHK_ANY;
+	if ((sv->check.state & CHK_ST_CONFIGURED) && sv->check.type == PR_O2_EXT_CHK) {
+		appctx->ctx.cli.msg = "External checks are not supported at runtime.\n";
+		goto fail;
+	}
+
+#ifdef USE_OPENSSL
+	if ((sv->use_ssl || sv->check.use_ssl) && ssl_sock_prepare_srv_ctx(sv, px)) {
+		appctx->ctx.cli.msg = "Failed to initialize the SSL context.\n";
+		goto fail;
+	}
+#endif
+
+	if (!sv->puid) {
+		sv->conf.id.key = sv->puid = get_next_id(&px->conf.used_server_id, 1);
+		eb32_insert(&px->conf.used_server_id, &sv->conf.id);
+	}
+
+	disabled = sv->admin & SRV_ADMF_CMAINT;
+	sv->admin |= SRV_ADMF_FMAINT;
+	sv->state = SRV_ST_STOPPED;
+	sv->check.state |= CHK_ST_PAUSED;
+	sv->check.health = 0;
+	sv->eweight = (sv->uweight * px->lbprm.wdiv + px->lbprm.wmult - 1) / px->lbprm.wmult;
+	srv_lb_commit_status(sv);
+
+	/* move it from the head to the tail of the servers list */
+	px->srv = sv->next;
+	sv->next = NULL;
+	if (!px->srv)
+		px->srv = sv;
+	else {
+		for (prev = px->srv; prev->next; prev = prev->next);
+		prev->next = sv;
+	}
+
+	if (px->lbprm.server_init && px->lbprm.server_init(sv) < 0) {
+		appctx->ctx.cli.msg = "Out of memory.\n";
+		goto unlink;
+	}
+
+	if (start_server_checks(sv) < 0) {
+		appctx->ctx.cli.msg = "Failed to start the checks.\n";
+		if (px->lbprm.server_deinit)
+			px->lbprm.server_deinit(sv);
+		goto unlink;
+	}
+
+	if (!disabled)
+		srv_adm_set_ready(sv);
+
+	appctx->ctx.cli.msg = "New server registered.\n";
+	appctx->st0 = CLI_ST_PRINT;
+	return 1;
+
+ unlink:
+	if (px->srv == sv)
+		px->srv = NULL;
+	else {
+		for (prev = px->srv; prev->next != sv; prev = prev->next);
+		prev->next = NULL;
+	}
+	goto release;
+
+ fail:
+	/* parse_server() may have failed before allocating the server */
+	if (px->srv == prev) {
+		appctx->st0 = CLI_ST_PRINT;
+		return 1;
+	}
+	sv = px->srv;
+	px->srv = sv->next;
+ release:
+	ebpt_delete(&sv->conf.name);
+	eb32_delete(&sv->conf.id);
+	srv_release(sv);
+	appctx->st0 = CLI_ST_PRINT;
+	return 1;
+}
+
+/* parse a "del server" command. It always returns 1. */
+static int cli_parse_del_server(char **args, struct appctx *appctx, void *private)
+{
+	struct dead_server *dead;
+	struct server_rule *rule;
+	struct server *sv, **prev;
+	struct proxy *px;
+
+	if (!cli_has_level(appctx, ACCESS_LVL_ADMIN))
+		return 1;
+
+	sv = cli_find_server(appctx, args[2]);
+	if (!sv)
+		return 1;
+
+	px = sv->proxy;
+	appctx->st0 = CLI_ST_PRINT;
+
+	if (!(sv->admin & SRV_ADMF_MAINT)) {
+		appctx->ctx.cli.msg = "Server must be put in maintenance mode first.\n";
+		return 1;
+	}
+
+	if (sv->cur_sess || sv->nbpend) {
+		appctx->ctx.cli.msg = "Server still has connections attached to it, retry once it is drained.\n";
+		return 1;
+	}
+
+	if ((sv->check.state | sv->agent.state) & CHK_ST_INPROGRESS ||
+	    (sv->resolution && sv->resolution->step != RSLV_STEP_NONE)) {
+		appctx->ctx.cli.msg = "A check or a DNS resolution is in progress, retry later.\n";
+		return 1;
+	}
+
+	if (sv->trackers) {
+		appctx->ctx.cli.msg = "Server is tracked by other servers.\n";
+		return 1;
+	}
+
+	list_for_each_entry(rule, &px->server_rules, list) {
+		if (rule->srv.ptr == sv) {
+			appctx->ctx.cli.msg = "Server is referenced by a 'use-server' rule.\n";
+			return 1;
+		}
+	}
+
+	dead = calloc(1, sizeof(*dead));
+	if (!dead_servers_task && (dead_servers_task = task_new()) != NULL) {
+		dead_servers_task->process = srv_release_dead;
+		dead_servers_task->context = NULL;
+		dead_servers_task->expire = TICK_ETERNITY;
+	}
+
+	if (!dead || !dead_servers_task) {
+		free(dead);
+		appctx->ctx.cli.msg = "Out of memory.\n";
+		return 1;
+	}
+
+	if (sv->track) {
+		for (prev = &sv->track->trackers; *prev != sv; prev = &(*prev)->tracknext);
+		*prev = sv->tracknext;
+	}
+
+	for (prev = &px->srv; *prev != sv; prev = &(*prev)->next);
+	*prev = sv->next;
+
+	ebpt_delete(&sv->conf.name);
+	eb32_delete(&sv->conf.id);
+	stop_server_checks(sv);
+	if (px->lbprm.server_deinit)
+		px->lbprm.server_deinit(sv);
+
+	/* a stats dump paused on this server may still follow sv->next, and
+	 * other streams may reference it, so it is released later.
+	 */
+	dead->srv = sv;
+	dead->date = now;
+	dead->strm = si_strm(appctx->owner);
+	LIST_ADDQ(&dead_servers, &dead->list);
+	task_schedule(dead_servers_task, tick_add(now_ms, MS_TO_TICKS(1000)));
+
+	appctx->ctx.cli.msg = "Server deleted.\n";
+	return 1;
+}
+
 /* register cli keywords */
 static struct cli_kw_list cli_kws = {{ },{
 	{ { "disable", "agent",  NULL }, "disable agent  : disable agent checks (use 'set server' instead)", cli_parse_disable_agent, NULL },
@@ -3697,6 +4150,8 @@ static struct cli_kw_list cli_kws = {{ },{
 	{ { "set", "server", NULL }, "set server     : change a server's state, weight or address",  cli_parse_set_server },
 	{ { "get", "weight", NULL }, "get weight     : report a server's current weight",  cli_parse_get_weight },
 	{ { "set", "weight", NULL }, "set weight     : change a server's weight (deprecated)",  cli_parse_set_weight },
+	{ { "add", "server", NULL }, "add server     : add a new server to a backend",  cli_parse_add_server },
+	{ { "del", "server", NULL }, "del server     : remove a server in maintenance from a backend",  cli_parse_del_server },
 
 	{{},}
 }};
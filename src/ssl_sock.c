@@ -38,6 +38,7 @@
 #include <sys/types.h>
 #include <netdb.h>
 #include <netinet/tcp.h>
+#include <pthread.h>
 
 #include <openssl/crypto.h>
 #include <openssl/ssl.h>
@@ -67,6 +68,7 @@
 #include <common/cfgparse.h>
 #include <common/base64.h>
 
+#include <ebistree.h>
 #include <ebsttree.h>
 
 #include <types/applet.h>
@@ -180,6 +182,271 @@ const char *SSL_SOCK_KEYTYPE_NAMES[] = {
 #define SSL_SOCK_NUM_KEYTYPES 1
 #endif
 
+/* Before a crt-list or a directory of certificates is loaded, its PEM files are
+ * decoded and the .ocsp and .sctl files next to them are read by a pool of
+ * threads. The SSL contexts, the SNI trees and the OCSP tree are then built in
+ * the configuration order by the main thread, which uses the preloaded objects
+ * instead of reading the files. Only OpenSSL 1.1.0 and above may be used from
+ * several threads without locking callbacks, so older versions read the files
+ * sequentially as before.
+ */
+#if (OPENSSL_VERSION_NUMBER >= 0x10100000L) && !defined(LIBRESSL_VERSION_NUMBER)
+#define SSL_SOCK_PRELOAD
+#endif
+
+#define SSL_PRELOAD_PEM  0  /* private key and certificate chain */
+#define SSL_PRELOAD_RAW  1  /* raw contents of a file */
+
+struct ssl_preload {
+	struct ebpt_node node;          /* indexed by file path */
+	int type;                       /* SSL_PRELOAD_* */
+	EVP_PKEY *key;                  /* private key, NULL if not loaded */
+	X509 *cert;                     /* certificate, NULL if not loaded */
+	STACK_OF(X509) *chain;          /* extra chain certificates */
+	struct chunk data;              /* file contents, str is NULL if not loaded */
+};
+
+static struct eb_root ssl_preload_tree = EB_ROOT_UNIQUE;
+static struct ssl_preload **ssl_preload_list = NULL;
+static int ssl_preload_count = 0;
+static int ssl_preload_next = 0;
+
+/* Returns the preloaded object of type <type> for file <path>, or NULL if it
+ * was not preloaded or could not be loaded, in which case the caller must read
+ * the file itself.
+ */
+static struct ssl_preload *ssl_sock_preload_get(const char *path, int type)
+{
+	struct ebpt_node *node;
+	struct ssl_preload *pre;
+
+	node = ebis_lookup(&ssl_preload_tree, path);
+	if (!node)
+		return NULL;
+
+	pre = container_of(node, struct ssl_preload, node);
+	if (pre->type != type)
+		return NULL;
+	if (type == SSL_PRELOAD_PEM && (!pre->key || !pre->cert))
+		return NULL;
+	if (type == SSL_PRELOAD_RAW && !pre->data.str)
+		return NULL;
+	return pre;
+}
+
+#ifdef SSL_SOCK_PRELOAD
+/* Queues file <path> to be preloaded as <type> */
+static void ssl_sock_preload_add(const char *path, int type)
+{
+	struct ssl_preload *pre, **list;
+
+	if (ebis_lookup(&ssl_preload_tree, path))
+		return;
+
+	if (!(ssl_preload_count & 63)) {
+		list = realloc(ssl_preload_list, (ssl_preload_count + 64) * sizeof(*list));
+		if (!list)
+			return;
+		ssl_preload_list = list;
+	}
+
+	pre = calloc(1, sizeof(*pre));
+	if (!pre)
+		return;
+
+	pre->node.key = strdup(path);
+	if (!pre->node.key) {
+		free(pre);
+		return;
+	}
+	pre->type = type;
+	ebis_insert(&ssl_preload_tree, &pre->node);
+	ssl_preload_list[ssl_preload_count++] = pre;
+}
+
+/* Queues certificate file <path> and the files which may accompany it */
+static void ssl_sock_preload_add_cert(const char *path)
+{
+	char extra[MAXPATHLEN+1];
+
+	ssl_sock_preload_add(path, SSL_PRELOAD_PEM);
+	snprintf(extra, sizeof(extra), "%s.ocsp", path);
+	ssl_sock_preload_add(extra, SSL_PRELOAD_RAW);
+	snprintf(extra, sizeof(extra), "%s.sctl", path);
+	ssl_sock_preload_add(extra, SSL_PRELOAD_RAW);
+}
+
+/* Password callback which refuses to decrypt keys from the worker threads, so
+ * that the main thread prompts for them as usual.
+ */
+static int ssl_sock_preload_nopass(char *buf, int size, int rwflag, void *userdata)
+{
+	return -1;
+}
+
+/* Decodes the private key and the certificate chain of PEM file <pre> the way
+ * ssl_sock_load_cert_file() does. Nothing is kept on failure.
+ */
+static void ssl_sock_preload_pem(struct ssl_preload *pre)
+{
+	unsigned long err;
+	BIO *in;
+	X509 *ca;
+
+	in = BIO_new_file(pre->node.key, "r");
+	if (!in)
+		goto fail;
+
+	pre->key = PEM_read_bio_PrivateKey(in, NULL, ssl_sock_preload_nopass, NULL);
+	if (!pre->key || BIO_reset(in) != 0)
+		goto fail;
+
+	pre->cert = PEM_read_bio_X509_AUX(in, NULL, ssl_sock_preload_nopass, NULL);
+	pre->chain = sk_X509_new_null();
+	if (!pre->cert || !pre->chain)
+		goto fail;
+
+	while ((ca = PEM_read_bio_X509(in, NULL, ssl_sock_preload_nopass, NULL))) {
+		if (!sk_X509_push(pre->chain, ca)) {
+			X509_free(ca);
+			goto fail;
+		}
+	}
+
+	/* only the end of the file is expected here */
+	err = ERR_get_error();
+	if (err && (ERR_GET_LIB(err) != ERR_LIB_PEM || ERR_GET_REASON(err) != PEM_R_NO_START_LINE))
+		goto fail;
+
+	ERR_clear_error();
+	BIO_free(in);
+	return;
+
+ fail:
+	ERR_clear_error();
+	if (in)
+		BIO_free(in);
+	EVP_PKEY_free(pre->key);
+	X509_free(pre->cert);
+	sk_X509_pop_free(pre->chain, X509_free);
+	pre->key = NULL;
+	pre->cert = NULL;
+	pre->chain = NULL;
+}
+
+/* Reads the contents of file <pre>, up to the size of a buffer */
+static void ssl_sock_preload_raw(struct ssl_preload *pre)
+{
+	int fd, r;
+
+	fd = open(pre->node.key, O_RDONLY);
+	if (fd == -1)
+		return;
+
+	pre->data.str = malloc(global.tune.bufsize);
+	if (!pre->data.str)
+		goto end;
+	pre->data.size = global.tune.bufsize;
+
+	while (pre->data.len < pre->data.size) {
+		r = read(fd, pre->data.str + pre->data.len, pre->data.size - pre->data.len);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			free(pre->data.str);
+			pre->data.str = NULL;
+			break;
+		}
+		else if (r == 0)
+			break;
+		pre->data.len += r;
+	}
+ end:
+	close(fd);
+}
+
+static void *ssl_sock_preload_worker(void *arg)
+{
+	struct ssl_preload *pre;
+	int idx;
+
+	while ((idx = __sync_fetch_and_add(&ssl_preload_next, 1)) < ssl_preload_count) {
+		pre = ssl_preload_list[idx];
+		if (pre->type == SSL_PRELOAD_PEM)
+			ssl_sock_preload_pem(pre);
+		else
+			ssl_sock_preload_raw(pre);
+	}
+	return NULL;
+}
+
+/* Preloads the queued files using up to tune.ssl.load-threads threads,
+ * including the calling one.
+ */
+static void ssl_sock_preload_run(void)
+{
+	pthread_t threads[MAX_SSL_LOAD_THREADS];
+	int nbthreads = global.tune.ssl_load_threads;
+	int i, started = 0;
+
+	if (!nbthreads) {
+		nbthreads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (nbthreads < 1)
+			nbthreads = 1;
+	}
+	if (nbthreads > MAX_SSL_LOAD_THREADS)
+		nbthreads = MAX_SSL_LOAD_THREADS;
+
+	/* below a few files per thread, starting the threads costs more */
+	if (nbthreads > ssl_preload_count / 3)
+		nbthreads = ssl_preload_count / 3;
+	if (nbthreads < 2)
+		return;
+
+	ssl_preload_next = 0;
+	for (i = 1; i < nbthreads; i++) {
+		if (pthread_create(&threads[started], NULL, ssl_sock_preload_worker, NULL) == 0)
+			started++;
+	}
+	ssl_sock_preload_worker(NULL);
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+}
+#endif /* SSL_SOCK_PRELOAD */
+
+/* Releases all preloaded objects */
+static void ssl_sock_preload_release(void)
+{
+	struct ssl_preload *pre;
+	int i;
+
+	for (i = 0; i < ssl_preload_count; i++) {
+		pre = ssl_preload_list[i];
+		ebpt_delete(&pre->node);
+		free(pre->node.key);
+		EVP_PKEY_free(pre->key);
+		X509_free(pre->cert);
+		sk_X509_pop_free(pre->chain, X509_free);
+		free(pre->data.str);
+		free(pre);
+	}
+	free(ssl_preload_list);
+	ssl_preload_list = NULL;
+	ssl_preload_count = 0;
+}
+
+/* When tune.ssl.lazy-cache-size is set, only the default certificate of each
+ * bind line gets an SSL context at startup. The other ones are kept encoded
+ * and only their names are indexed, their context is built the first time a
+ * client asks for one of them and kept in an LRU cache. This relies on SNI and
+ * on the thread-safe OpenSSL versions used for preloading.
+ */
+#if defined(SSL_SOCK_PRELOAD) && defined(SSL_CTRL_SET_TLSEXT_HOSTNAME)
+#define SSL_SOCK_LAZY
+static struct lru64_head *ssl_lazy_lru_tree = NULL;
+static SSL_CTX *ssl_sock_lazy_build(struct bind_conf *bind_conf, struct proxy *px, struct ssl_lazy_cert *lazy);
+#endif
+
 #if (defined SSL_CTRL_SET_TLSEXT_STATUS_REQ_CB && !defined OPENSSL_NO_OCSP)
 /*
  * struct alignment works here such that the key.key is the same as key_data
@@ -461,10 +728,18 @@ int ssl_sock_update_ocsp_response(struct chunk *ocsp_response, char **err)
  */
 static int ssl_sock_load_ocsp_response_from_file(const char *ocsp_path, struct certificate_ocsp *ocsp, OCSP_CERTID *cid, char **err)
 {
+	struct ssl_preload *pre;
 	int fd = -1;
 	int r = 0;
 	int ret = 1;
 
+	pre = ssl_sock_preload_get(ocsp_path, SSL_PRELOAD_RAW);
+	if (pre) {
+		trash.len = MIN(pre->data.len, trash.size);
+		memcpy(trash.str, pre->data.str, trash.len);
+		goto loaded;
+	}
+
 	fd = open(ocsp_path, O_RDONLY);
 	if (fd == -1) {
 		memprintf(err, "Error opening OCSP response file");
@@ -489,7 +764,7 @@ static int ssl_sock_load_ocsp_response_from_file(const char *ocsp_path, struct c
 
 	close(fd);
 	fd = -1;
-
+ loaded:
 	ret = ssl_sock_load_ocsp_response(&trash, ocsp, cid, err);
 end:
 	if (fd != -1)
@@ -921,12 +1196,20 @@ out:
 
 static int ssl_sock_load_sctl_from_file(const char *sctl_path, struct chunk **sctl)
 {
+	struct ssl_preload *pre;
 	int fd = -1;
 	int r = 0;
 	int ret = 1;
 
 	*sctl = NULL;
 
+	pre = ssl_sock_preload_get(sctl_path, SSL_PRELOAD_RAW);
+	if (pre) {
+		trash.len = MIN(pre->data.len, trash.size);
+		memcpy(trash.str, pre->data.str, trash.len);
+		goto loaded;
+	}
+
 	fd = open(sctl_path, O_RDONLY);
 	if (fd == -1)
 		goto end;
@@ -945,7 +1228,7 @@ static int ssl_sock_load_sctl_from_file(const char *sctl_path, struct chunk **sc
 		}
 		trash.len += r;
 	}
-
+ loaded:
 	ret = ssl_sock_parse_sctl(&trash);
 	if (ret)
 		goto end;
@@ -1389,6 +1672,55 @@ ssl_sock_generate_certificate(const char *servername, struct bind_conf *bind_con
 	return ssl_ctx;
 }
 
+#ifdef SSL_SOCK_LAZY
+/* Releases a lazily built context leaving the LRU cache. Failed builds are
+ * cached as NULL and were never counted as loaded.
+ */
+static void ssl_sock_lazy_free(void *ctx)
+{
+	if (!ctx)
+		return;
+	global.ssl_lazy_evictions++;
+	SSL_CTX_free(ctx);
+}
+
+/* Switches <ssl> to the context of lazy certificate <lazy> from bind_conf <s>,
+ * which is built if it is not in the cache. A failed build is cached as well so
+ * that a broken certificate is not rebuilt for each handshake. Returns the new
+ * context or NULL if the current one is kept.
+ */
+static SSL_CTX *ssl_sock_lazy_switchctx(SSL *ssl, struct bind_conf *s, struct ssl_lazy_cert *lazy)
+{
+	struct connection *conn = SSL_get_app_data(ssl);
+	struct lru64 *lru = NULL;
+	SSL_CTX *ctx;
+
+	if (ssl_lazy_lru_tree)
+		lru = lru64_get((unsigned long)lazy, ssl_lazy_lru_tree, s, 0);
+
+	if (lru && lru->domain)
+		ctx = lru->data;
+	else {
+		ctx = ssl_sock_lazy_build(s, objt_listener(conn->target)->frontend, lazy);
+		if (ctx && lru)
+			global.ssl_lazy_loads++;
+		lru64_commit(lru, ctx, s, 0, ssl_sock_lazy_free);
+	}
+
+	if (!ctx)
+		return NULL;
+
+	SSL_set_SSL_CTX(ssl, ctx);
+	if (!lru) {
+		/* not cached nor counted, this CTX will be released as soon
+		 * as the session dies.
+		 */
+		SSL_CTX_free(ctx);
+	}
+	return ctx;
+}
+#endif
+
 /* Sets the SSL ctx of <ssl> to match the advertised server name. Returns a
  * warning when no match is found, which implies the default (first) cert
  * will keep being used.
@@ -1398,6 +1730,7 @@ static int ssl_sock_switchctx_cbk(SSL *ssl, int *al, struct bind_conf *s)
 	const char *servername;
 	const char *wildp = NULL;
 	struct ebmb_node *node, *n;
+	struct sni_ctx *sc;
 	int i;
 	(void)al; /* shut gcc stupid warning */
 
@@ -1461,7 +1794,17 @@ static int ssl_sock_switchctx_cbk(SSL *ssl, int *al, struct bind_conf *s)
 	}
 
 	/* switch ctx */
-	SSL_set_SSL_CTX(ssl, container_of(node, struct sni_ctx, name)->ctx);
+	sc = container_of(node, struct sni_ctx, name);
+#ifdef SSL_SOCK_LAZY
+	if (!sc->ctx) {
+		if (ssl_sock_lazy_switchctx(ssl, s, sc->lazy))
+			return SSL_TLSEXT_ERR_OK;
+		return (s->strict_sni ?
+			SSL_TLSEXT_ERR_ALERT_FATAL :
+			SSL_TLSEXT_ERR_ALERT_WARNING);
+	}
+#endif
+	SSL_set_SSL_CTX(ssl, sc->ctx);
 	return SSL_TLSEXT_ERR_OK;
 }
 #endif /* SSL_CTRL_SET_TLSEXT_HOSTNAME */
@@ -1684,12 +2027,13 @@ int ssl_sock_load_global_dh_param_from_file(const char *filename)
 	return -1;
 }
 
-/* Loads Diffie-Hellman parameter from a file. Returns 1 if loaded, else -1
-   if an error occured, and 0 if parameter not found. */
-int ssl_sock_load_dh_params(SSL_CTX *ctx, const char *file)
+/* Uses Diffie-Hellman parameters <dh> for <ctx>, or the global ones if <dh> is
+ * NULL. Returns 1 if <dh> was used, else -1 if an error occured, and 0 if the
+ * global parameters were used.
+ */
+static int ssl_sock_set_dh_params(SSL_CTX *ctx, DH *dh)
 {
 	int ret = -1;
-	DH *dh = ssl_sock_get_dh_from_file(file);
 
 	if (dh) {
 		ret = 1;
@@ -1727,6 +2071,17 @@ int ssl_sock_load_dh_params(SSL_CTX *ctx, const char *file)
 	}
 
 end:
+	return ret;
+}
+
+/* Loads Diffie-Hellman parameter from a file. Returns 1 if loaded, else -1
+   if an error occured, and 0 if parameter not found. */
+int ssl_sock_load_dh_params(SSL_CTX *ctx, const char *file)
+{
+	int ret;
+	DH *dh = ssl_sock_get_dh_from_file(file);
+
+	ret = ssl_sock_set_dh_params(ctx, dh);
 	if (dh)
 		DH_free(dh);
 
@@ -1734,7 +2089,7 @@ end:
 }
 #endif
 
-static int ssl_sock_add_cert_sni(SSL_CTX *ctx, struct bind_conf *s, char *name, int order)
+static int ssl_sock_add_cert_sni(SSL_CTX *ctx, struct ssl_lazy_cert *lazy, struct bind_conf *s, char *name, int order)
 {
 	struct sni_ctx *sc;
 	int wild = 0, neg = 0;
@@ -1767,7 +2122,7 @@ static int ssl_sock_add_cert_sni(SSL_CTX *ctx, struct bind_conf *s, char *name,
 			node = ebst_lookup(&s->sni_ctx, trash.str);
 		for (; node; node = ebmb_next_dup(node)) {
 			sc = ebmb_entry(node, struct sni_ctx, name);
-			if (sc->ctx == ctx && sc->neg == neg)
+			if (sc->ctx == ctx && sc->lazy == lazy && sc->neg == neg)
 				return order;
 		}
 
@@ -1776,6 +2131,7 @@ static int ssl_sock_add_cert_sni(SSL_CTX *ctx, struct bind_conf *s, char *name,
 			return order;
 		memcpy(sc->name.key, trash.str, len + 1);
 		sc->ctx = ctx;
+		sc->lazy = lazy;
 		sc->order = order++;
 		sc->neg = neg;
 		if (wild)
@@ -1786,6 +2142,55 @@ static int ssl_sock_add_cert_sni(SSL_CTX *ctx, struct bind_conf *s, char *name,
 	return order;
 }
 
+/* Indexes the names found in the SAN and CN of certificate <x> for context
+ * <ctx> or lazy certificate <lazy>, or the <fcount> names of <sni_filter>
+ * instead if any. Returns the number of entries added.
+ */
+static int ssl_sock_add_cert_names(SSL_CTX *ctx, struct ssl_lazy_cert *lazy, struct bind_conf *s, X509 *x, char **sni_filter, int fcount)
+{
+	X509_NAME *xname;
+	char *str;
+	int i, order = 0;
+#ifdef SSL_CTRL_SET_TLSEXT_HOSTNAME
+	STACK_OF(GENERAL_NAME) *names;
+#endif
+
+	if (fcount) {
+		while (fcount--)
+			order = ssl_sock_add_cert_sni(ctx, lazy, s, sni_filter[fcount], order);
+	}
+	else {
+#ifdef SSL_CTRL_SET_TLSEXT_HOSTNAME
+		names = X509_get_ext_d2i(x, NID_subject_alt_name, NULL, NULL);
+		if (names) {
+			for (i = 0; i < sk_GENERAL_NAME_num(names); i++) {
+				GENERAL_NAME *name = sk_GENERAL_NAME_value(names, i);
+				if (name->type == GEN_DNS) {
+					if (ASN1_STRING_to_UTF8((unsigned char **)&str, name->d.dNSName) >= 0) {
+						order = ssl_sock_add_cert_sni(ctx, lazy, s, str, order);
+						OPENSSL_free(str);
+					}
+				}
+			}
+			sk_GENERAL_NAME_pop_free(names, GENERAL_NAME_free);
+		}
+#endif /* SSL_CTRL_SET_TLSEXT_HOSTNAME */
+		xname = X509_get_subject_name(x);
+		i = -1;
+		while ((i = X509_NAME_get_index_by_NID(xname, NID_commonName, i)) != -1) {
+			X509_NAME_ENTRY *entry = X509_NAME_get_entry(xname, i);
+			ASN1_STRING *value;
+
+			value = X509_NAME_ENTRY_get_data(entry);
+			if (ASN1_STRING_to_UTF8((unsigned char **)&str, value) >= 0) {
+				order = ssl_sock_add_cert_sni(ctx, lazy, s, str, order);
+				OPENSSL_free(str);
+			}
+		}
+	}
+	return order;
+}
+
 
 /* The following code is used for loading multiple crt files into
  * SSL_CTX's based on CN/SAN
@@ -2204,7 +2609,7 @@ static int ssl_sock_load_multi_cert(const char *path, struct bind_conf *bind_con
 		}
 
 		/* Update SNI Tree */
-		key_combos[i-1].order = ssl_sock_add_cert_sni(cur_ctx, bind_conf, str, key_combos[i-1].order);
+		key_combos[i-1].order = ssl_sock_add_cert_sni(cur_ctx, NULL, bind_conf, str, key_combos[i-1].order);
 		node = ebmb_next(node);
 	}
 
@@ -2252,18 +2657,23 @@ static int ssl_sock_load_multi_cert(const char *path, struct bind_conf *bind_con
  */
 static int ssl_sock_load_cert_chain_file(SSL_CTX *ctx, const char *file, struct bind_conf *s, char **sni_filter, int fcount)
 {
-	BIO *in;
+	BIO *in = NULL;
 	X509 *x = NULL, *ca;
 	int i, err;
 	int ret = -1;
-	int order = 0;
-	X509_NAME *xname;
-	char *str;
 	pem_password_cb *passwd_cb;
 	void *passwd_cb_userdata;
+#ifdef SSL_SOCK_PRELOAD
+	struct ssl_preload *pre;
+#endif
 
-#ifdef SSL_CTRL_SET_TLSEXT_HOSTNAME
-	STACK_OF(GENERAL_NAME) *names;
+#ifdef SSL_SOCK_PRELOAD
+	pre = ssl_sock_preload_get(file, SSL_PRELOAD_PEM);
+	if (pre) {
+		x = pre->cert;
+		X509_up_ref(x);
+		goto loaded;
+	}
 #endif
 
 	in = BIO_new(BIO_s_file());
@@ -2280,40 +2690,8 @@ static int ssl_sock_load_cert_chain_file(SSL_CTX *ctx, const char *file, struct
 	x = PEM_read_bio_X509_AUX(in, NULL, passwd_cb, passwd_cb_userdata);
 	if (x == NULL)
 		goto end;
-
-	if (fcount) {
-		while (fcount--)
-			order = ssl_sock_add_cert_sni(ctx, s, sni_filter[fcount], order);
-	}
-	else {
-#ifdef SSL_CTRL_SET_TLSEXT_HOSTNAME
-		names = X509_get_ext_d2i(x, NID_subject_alt_name, NULL, NULL);
-		if (names) {
-			for (i = 0; i < sk_GENERAL_NAME_num(names); i++) {
-				GENERAL_NAME *name = sk_GENERAL_NAME_value(names, i);
-				if (name->type == GEN_DNS) {
-					if (ASN1_STRING_to_UTF8((unsigned char **)&str, name->d.dNSName) >= 0) {
-						order = ssl_sock_add_cert_sni(ctx, s, str, order);
-						OPENSSL_free(str);
-					}
-				}
-			}
-			sk_GENERAL_NAME_pop_free(names, GENERAL_NAME_free);
-		}
-#endif /* SSL_CTRL_SET_TLSEXT_HOSTNAME */
-		xname = X509_get_subject_name(x);
-		i = -1;
-		while ((i = X509_NAME_get_index_by_NID(xname, NID_commonName, i)) != -1) {
-			X509_NAME_ENTRY *entry = X509_NAME_get_entry(xname, i);
-			ASN1_STRING *value;
-
-			value = X509_NAME_ENTRY_get_data(entry);
-			if (ASN1_STRING_to_UTF8((unsigned char **)&str, value) >= 0) {
-				order = ssl_sock_add_cert_sni(ctx, s, str, order);
-				OPENSSL_free(str);
-			}
-		}
-	}
+ loaded:
+	ssl_sock_add_cert_names(ctx, NULL, s, x, sni_filter, fcount);
 
 	ret = 0; /* the caller must not free the SSL_CTX argument anymore */
 	if (!SSL_CTX_use_certificate(ctx, x))
@@ -2328,6 +2706,22 @@ static int ssl_sock_load_cert_chain_file(SSL_CTX *ctx, const char *file, struct
 	}
 #endif
 
+#ifdef SSL_SOCK_PRELOAD
+	if (pre) {
+		/* the context takes over the references */
+		for (i = 0; i < sk_X509_num(pre->chain); i++) {
+			ca = sk_X509_value(pre->chain, i);
+			X509_up_ref(ca);
+			if (!SSL_CTX_add_extra_chain_cert(ctx, ca)) {
+				X509_free(ca);
+				goto end;
+			}
+		}
+		ret = 1;
+		goto end;
+	}
+#endif
+
 	while ((ca = PEM_read_bio_X509(in, NULL, passwd_cb, passwd_cb_userdata))) {
 		if (!SSL_CTX_add_extra_chain_cert(ctx, ca)) {
 			X509_free(ca);
@@ -2352,10 +2746,192 @@ end:
 	return ret;
 }
 
+#ifdef SSL_SOCK_LAZY
+/* Builds and prepares the SSL context of lazy certificate <lazy> for bind_conf
+ * <bind_conf> of proxy <px>. Returns NULL if it fails.
+ */
+static SSL_CTX *ssl_sock_lazy_build(struct bind_conf *bind_conf, struct proxy *px, struct ssl_lazy_cert *lazy)
+{
+	const unsigned char *p = lazy->der, *end;
+	EVP_PKEY *key = NULL;
+	X509 *x = NULL, *ca;
+	SSL_CTX *ctx;
+#ifndef OPENSSL_NO_DH
+	DH *dh = NULL;
+#endif
+
+	ctx = SSL_CTX_new(SSLv23_server_method());
+	if (!ctx)
+		return NULL;
+
+	key = d2i_AutoPrivateKey(NULL, &p, lazy->key_len);
+	if (!key || SSL_CTX_use_PrivateKey(ctx, key) <= 0)
+		goto fail;
+
+	x = d2i_X509_AUX(NULL, &p, lazy->cert_len);
+	if (!x || !SSL_CTX_use_certificate(ctx, x))
+		goto fail;
+
+	end = p + lazy->chain_len;
+	while (p < end) {
+		ca = d2i_X509(NULL, &p, end - p);
+		if (!ca)
+			goto fail;
+		if (!SSL_CTX_add_extra_chain_cert(ctx, ca)) {
+			X509_free(ca);
+			goto fail;
+		}
+	}
+
+#ifndef OPENSSL_NO_DH
+	if (lazy->dh_len && !(dh = d2i_DHparams(NULL, &p, lazy->dh_len)))
+		goto fail;
+	if (ssl_sock_set_dh_params(ctx, dh) < 0)
+		goto fail;
+#endif
+
+	if (ssl_sock_prepare_ctx(bind_conf, ctx, px))
+		goto fail;
+
+	ERR_clear_error();
+#ifndef OPENSSL_NO_DH
+	DH_free(dh);
+#endif
+	X509_free(x);
+	EVP_PKEY_free(key);
+	return ctx;
+
+ fail:
+	ERR_clear_error();
+#ifndef OPENSSL_NO_DH
+	DH_free(dh);
+#endif
+	X509_free(x);
+	EVP_PKEY_free(key);
+	SSL_CTX_free(ctx);
+	return NULL;
+}
+
+/* Releases lazy certificate <lazy> */
+static void ssl_sock_lazy_release(struct ssl_lazy_cert *lazy)
+{
+	if (!lazy)
+		return;
+	free(lazy->der);
+	free(lazy);
+}
+
+/* Indexes the names of certificate file <path> for bind_conf <bind_conf> the
+ * same way as ssl_sock_load_cert_file() but only keeps the certificate encoded
+ * so that its SSL context is built on first use. Returns non-zero on success,
+ * or 0 if the certificate must be loaded now, either because it comes with
+ * OCSP or SCTL files or because it cannot be decoded without a passphrase, in
+ * which case the regular loading takes care of reporting errors.
+ */
+static int ssl_sock_load_lazy_cert(const char *path, struct bind_conf *bind_conf, char **sni_filter, int fcount)
+{
+	struct ssl_preload tmp, *pre;
+	struct ssl_lazy_cert *lazy = NULL;
+	char extra[MAXPATHLEN+1];
+	struct stat st;
+	unsigned char *p;
+	int i, len, ret = 0;
+#ifndef OPENSSL_NO_DH
+	DH *dh = NULL;
+#endif
+
+	snprintf(extra, sizeof(extra), "%s.ocsp", path);
+	if (stat(extra, &st) == 0)
+		return 0;
+	snprintf(extra, sizeof(extra), "%s.sctl", path);
+	if (stat(extra, &st) == 0)
+		return 0;
+
+	pre = ssl_sock_preload_get(path, SSL_PRELOAD_PEM);
+	if (!pre) {
+		memset(&tmp, 0, sizeof(tmp));
+		tmp.node.key = (char *)path;
+		ssl_sock_preload_pem(&tmp);
+		if (!tmp.cert)
+			return 0;
+		pre = &tmp;
+	}
+
+	if (!X509_check_private_key(pre->cert, pre->key))
+		goto end;
+
+	lazy = calloc(1, sizeof(*lazy));
+	if (!lazy)
+		goto end;
+
+	lazy->key_len = i2d_PrivateKey(pre->key, NULL);
+	lazy->cert_len = i2d_X509_AUX(pre->cert, NULL);
+	if (lazy->key_len <= 0 || lazy->cert_len <= 0)
+		goto end;
+
+	for (i = 0; i < sk_X509_num(pre->chain); i++) {
+		len = i2d_X509(sk_X509_value(pre->chain, i), NULL);
+		if (len <= 0)
+			goto end;
+		lazy->chain_len += len;
+	}
+
+#ifndef OPENSSL_NO_DH
+	dh = ssl_sock_get_dh_from_file(path);
+	if (dh && (lazy->dh_len = i2d_DHparams(dh, NULL)) <= 0)
+		goto end;
+#endif
+
+	lazy->der = malloc(lazy->key_len + lazy->cert_len + lazy->chain_len + lazy->dh_len);
+	if (!lazy->der)
+		goto end;
+
+	p = lazy->der;
+	i2d_PrivateKey(pre->key, &p);
+	i2d_X509_AUX(pre->cert, &p);
+	for (i = 0; i < sk_X509_num(pre->chain); i++)
+		i2d_X509(sk_X509_value(pre->chain, i), &p);
+#ifndef OPENSSL_NO_DH
+	if (dh)
+		i2d_DHparams(dh, &p);
+#endif
+
+	if (!ssl_lazy_lru_tree && !(ssl_lazy_lru_tree = lru64_new(global.tune.ssl_lazy_cache)))
+		goto end;
+
+	/* a certificate without any name cannot be reached */
+	if (!ssl_sock_add_cert_names(NULL, lazy, bind_conf, pre->cert, sni_filter, fcount))
+		ssl_sock_lazy_release(lazy);
+	lazy = NULL;
+	ret = 1;
+
+ end:
+	ERR_clear_error();
+	ssl_sock_lazy_release(lazy);
+#ifndef OPENSSL_NO_DH
+	DH_free(dh);
+#endif
+	if (pre == &tmp) {
+		EVP_PKEY_free(tmp.key);
+		X509_free(tmp.cert);
+		sk_X509_pop_free(tmp.chain, X509_free);
+	}
+	return ret;
+}
+#endif /* SSL_SOCK_LAZY */
+
 static int ssl_sock_load_cert_file(const char *path, struct bind_conf *bind_conf, struct proxy *curproxy, char **sni_filter, int fcount, char **err)
 {
 	int ret;
 	SSL_CTX *ctx;
+	struct ssl_preload *pre;
+
+#ifdef SSL_SOCK_LAZY
+	/* the default certificate is needed to start the handshakes */
+	if (global.tune.ssl_lazy_cache && bind_conf->default_ctx &&
+	    ssl_sock_load_lazy_cert(path, bind_conf, sni_filter, fcount))
+		return 0;
+#endif
 
 	ctx = SSL_CTX_new(SSLv23_server_method());
 	if (!ctx) {
@@ -2364,7 +2940,9 @@ static int ssl_sock_load_cert_file(const char *path, struct bind_conf *bind_conf
 		return 1;
 	}
 
-	if (SSL_CTX_use_PrivateKey_file(ctx, path, SSL_FILETYPE_PEM) <= 0) {
+	pre = ssl_sock_preload_get(path, SSL_PRELOAD_PEM);
+	if (pre ? SSL_CTX_use_PrivateKey(ctx, pre->key) <= 0 :
+	    SSL_CTX_use_PrivateKey_file(ctx, path, SSL_FILETYPE_PEM) <= 0) {
 		memprintf(err, "%sunable to load SSL private key from PEM file '%s'.\n",
 		          err && *err ? *err : "", path);
 		SSL_CTX_free(ctx);
@@ -2470,6 +3048,25 @@ int ssl_sock_load_cert(char *path, struct bind_conf *bind_conf, struct proxy *cu
 			cfgerr++;
 		}
 		else {
+#ifdef SSL_SOCK_PRELOAD
+			for (i = 0; i < n; i++) {
+				end = strrchr(de_list[i]->d_name, '.');
+				if (end && (!strcmp(end, ".issuer") || !strcmp(end, ".ocsp") || !strcmp(end, ".sctl")))
+					continue;
+
+				/* multi-cert bundles are loaded by ssl_sock_load_multi_cert() */
+				for (j = 0; end && j < SSL_SOCK_NUM_KEYTYPES; j++) {
+					if (!strcmp(end + 1, SSL_SOCK_KEYTYPE_NAMES[j]))
+						break;
+				}
+				if (end && j < SSL_SOCK_NUM_KEYTYPES)
+					continue;
+
+				snprintf(fp, sizeof(fp), "%s/%s", path, de_list[i]->d_name);
+				ssl_sock_preload_add_cert(fp);
+			}
+			ssl_sock_preload_run();
+#endif
 			for (i = 0; i < n; i++) {
 				struct dirent *de = de_list[i];
 
@@ -2530,6 +3127,7 @@ ignore_entry:
 				free(de);
 			}
 			free(de_list);
+			ssl_sock_preload_release();
 		}
 		closedir(dir);
 		return cfgerr;
@@ -2569,6 +3167,26 @@ int ssl_sock_load_cert_list_file(char *file, struct bind_conf *bind_conf, struct
 		return 1;
 	}
 
+#ifdef SSL_SOCK_PRELOAD
+	/* first pass to preload the certificates, only the first word matters */
+	while (fgets(thisline, sizeof(thisline), f) != NULL) {
+		char *line = thisline;
+		char *end;
+
+		while (isspace((unsigned char)*line))
+			line++;
+		for (end = line; *end && !isspace((unsigned char)*end) && *end != '#'; end++)
+			;
+		if (end == line)
+			continue;
+		*end = 0;
+		if (stat(line, &buf) == 0 && S_ISREG(buf.st_mode))
+			ssl_sock_preload_add_cert(line);
+	}
+	ssl_sock_preload_run();
+	rewind(f);
+#endif
+
 	while (fgets(thisline, sizeof(thisline), f) != NULL) {
 		int arg;
 		int newarg;
@@ -2630,6 +3248,7 @@ int ssl_sock_load_cert_list_file(char *file, struct bind_conf *bind_conf, struct
 			break;
 		}
 	}
+	ssl_sock_preload_release();
 	fclose(f);
 	return cfgerr;
 }
@@ -2749,6 +3368,20 @@ int ssl_sock_prepare_ctx(struct bind_conf *bind_conf, SSL_CTX *ctx, struct proxy
 	}
 	SSL_CTX_set_verify(ctx, verify, ssl_sock_bind_verifycbk);
 	if (verify & SSL_VERIFY_PEER) {
+#ifdef SSL_SOCK_LAZY
+		if (!(global.mode & MODE_STARTING)) {
+			/* lazy certificate built at runtime, the CA and CRL files
+			 * may not be reachable anymore so the default context's
+			 * ones are shared.
+			 */
+			X509_STORE *store = SSL_CTX_get_cert_store(bind_conf->default_ctx);
+
+			X509_STORE_up_ref(store);
+			SSL_CTX_set_cert_store(ctx, store);
+			SSL_CTX_set_client_CA_list(ctx, SSL_dup_CA_list(SSL_CTX_get_client_CA_list(bind_conf->default_ctx)));
+		}
+		else
+#endif
 		if (bind_conf->ca_file) {
 			/* load CAfile to verify */
 			if (!SSL_CTX_load_verify_locations(ctx, bind_conf->ca_file, NULL)) {
@@ -3202,9 +3835,9 @@ int ssl_sock_prepare_all_ctx(struct bind_conf *bind_conf, struct proxy *px)
 	node = ebmb_first(&bind_conf->sni_ctx);
 	while (node) {
 		sni = ebmb_entry(node, struct sni_ctx, name);
-		if (!sni->order && sni->ctx != bind_conf->default_ctx)
+		if (!sni->order && sni->ctx && sni->ctx != bind_conf->default_ctx)
 			/* only initialize the CTX on its first occurrence and
-			   if it is not the default_ctx */
+			   if it is not the default_ctx nor a lazy certificate */
 			err += ssl_sock_prepare_ctx(bind_conf, sni->ctx, px);
 		node = ebmb_next(node);
 	}
@@ -3212,9 +3845,9 @@ int ssl_sock_prepare_all_ctx(struct bind_conf *bind_conf, struct proxy *px)
 	node = ebmb_first(&bind_conf->sni_w_ctx);
 	while (node) {
 		sni = ebmb_entry(node, struct sni_ctx, name);
-		if (!sni->order && sni->ctx != bind_conf->default_ctx)
+		if (!sni->order && sni->ctx && sni->ctx != bind_conf->default_ctx)
 			/* only initialize the CTX on its first occurrence and
-			   if it is not the default_ctx */
+			   if it is not the default_ctx nor a lazy certificate */
 			err += ssl_sock_prepare_ctx(bind_conf, sni->ctx, px);
 		node = ebmb_next(node);
 	}
@@ -3245,8 +3878,12 @@ void ssl_sock_free_all_ctx(struct bind_conf *bind_conf)
 		sni = ebmb_entry(node, struct sni_ctx, name);
 		back = ebmb_next(node);
 		ebmb_delete(node);
-		if (!sni->order) /* only free the CTX on its first occurrence */
+		if (!sni->order) { /* only free the CTX on its first occurrence */
 			SSL_CTX_free(sni->ctx);
+#ifdef SSL_SOCK_LAZY
+			ssl_sock_lazy_release(sni->lazy);
+#endif
+		}
 		free(sni);
 		node = back;
 	}
@@ -3256,8 +3893,12 @@ void ssl_sock_free_all_ctx(struct bind_conf *bind_conf)
 		sni = ebmb_entry(node, struct sni_ctx, name);
 		back = ebmb_next(node);
 		ebmb_delete(node);
-		if (!sni->order) /* only free the CTX on its first occurrence */
+		if (!sni->order) { /* only free the CTX on its first occurrence */
 			SSL_CTX_free(sni->ctx);
+#ifdef SSL_SOCK_LAZY
+			ssl_sock_lazy_release(sni->lazy);
+#endif
+		}
 		free(sni);
 		node = back;
 	}
@@ -6455,6 +7096,9 @@ static void __ssl_sock_deinit(void)
 #ifdef SSL_CTRL_SET_TLSEXT_HOSTNAME
 	lru64_destroy(ssl_ctx_lru_tree);
 #endif
+#ifdef SSL_SOCK_LAZY
+	lru64_destroy(ssl_lazy_lru_tree);
+#endif
 
 #ifndef OPENSSL_NO_DH
         if (local_dh_1024) {
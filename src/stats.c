@@ -130,6 +130,16 @@ const char *info_field_names[INF_TOTAL_FIELDS] = {
 	[INF_IDLE_PCT]                       = "Idle_pct",
 	[INF_NODE]                           = "node",
 	[INF_DESCRIPTION]                    = "description",
+	[INF_COMPRESS_SAVED]                 = "CompressSaved",
+	[INF_COMPRESS_CPU_MS]                = "CompressCpuMs",
+	[INF_COMPRESS_SAVED_PER_CPU_MS]      = "CompressSavedPerCpuMs",
+	[INF_COMPRESS_SKIPPED]               = "CompressSkipped",
+	[INF_SPLICED_BYTES]                  = "SplicedBytes",
+	[INF_COPIED_BYTES]                   = "CopiedBytes",
+	[INF_PIPE_SIZE]                      = "PipeSize",
+	[INF_SSL_LAZY_LOADS]                 = "SslLazyLoads",
+	[INF_SSL_LAZY_EVICTIONS]             = "SslLazyEvictions",
+	[INF_SSL_LAZY_CACHED]                = "SslLazyCached",
 };
 
 const char *stat_field_names[ST_F_TOTAL_FIELDS] = {
@@ -216,6 +226,14 @@ const char *stat_field_names[ST_F_TOTAL_FIELDS] = {
 	[ST_F_INTERCEPTED]    = "intercepted",
 	[ST_F_DCON]           = "dcon",
 	[ST_F_DSES]           = "dses",
+	[ST_F_ACC_BATCH]      = "acc_batch",
+	[ST_F_ACC_QFULL]      = "acc_qfull",
+	[ST_F_MEM_USED]       = "mem_used",
+	[ST_F_MEM_MAX]        = "mem_max",
+	[ST_F_MEM_BUF]        = "mem_buf",
+	[ST_F_MEM_HTTP]       = "mem_http",
+	[ST_F_MEM_COMP]       = "mem_comp",
+	[ST_F_MEM_TBL]        = "mem_tbl",
 };
 
 /* one line of info */
@@ -1032,6 +1050,21 @@ int stats_dump_one_line(const struct field *stats, unsigned int flags, struct pr
 		return stats_dump_fields_csv(&trash, stats);
 }
 
+/* Fills the memory usage fields of proxy <px> into <stats>, which the caller
+ * must have sized for ST_F_TOTAL_FIELDS.
+ */
+static void stats_fill_px_mem(struct proxy *px, struct field *stats)
+{
+	stats[ST_F_MEM_USED] = mkf_u64(FN_GAUGE, proxy_mem_used(px));
+	if (px->mem.max)
+		stats[ST_F_MEM_MAX] = mkf_u64(FN_LIMIT, px->mem.max);
+	stats[ST_F_MEM_BUF]  = mkf_u64(FN_GAUGE, px->mem.buf);
+	stats[ST_F_MEM_HTTP] = mkf_u64(FN_GAUGE, px->mem.http);
+	stats[ST_F_MEM_COMP] = mkf_u64(FN_GAUGE, px->mem.comp);
+	if (px->table.size)
+		stats[ST_F_MEM_TBL] = mkf_u64(FN_GAUGE, proxy_mem_table(px));
+}
+
 /* Fill <stats> with the frontend statistics. <stats> is
  * preallocated array of length <len>. The length of the array
  * must be at least ST_F_TOTAL_FIELDS. If this length is less then
@@ -1094,6 +1127,11 @@ int stats_fill_fe_stats(struct proxy *px, struct field *stats, int len)
 	stats[ST_F_CONN_RATE_MAX] = mkf_u32(FN_MAX, px->fe_counters.cps_max);
 	stats[ST_F_CONN_TOT]      = mkf_u64(FN_COUNTER, px->fe_counters.cum_conn);
 
+	/* accept: average batch, queue full */
+	stats[ST_F_ACC_BATCH]     = mkf_u32(FN_AVG, swrate_avg(px->fe_counters.acc_batch, ACCEPT_BATCH_SAMPLES));
+	stats[ST_F_ACC_QFULL]     = mkf_u64(FN_COUNTER, px->fe_counters.acc_qfull);
+
+	stats_fill_px_mem(px, stats);
 	return 1;
 }
 
@@ -1156,6 +1194,10 @@ int stats_fill_li_stats(struct proxy *px, struct listener *l, int flags,
 	stats[ST_F_IID]      = mkf_u32(FO_KEY|FS_SERVICE, px->uuid);
 	stats[ST_F_SID]      = mkf_u32(FO_KEY|FS_SERVICE, l->luid);
 	stats[ST_F_TYPE]     = mkf_u32(FO_CONFIG|FS_SERVICE, STATS_TYPE_SO);
+	stats[ST_F_RATE]     = mkf_u32(FN_RATE, read_freq_ctr(&l->acc_per_sec));
+	stats[ST_F_RATE_LIM] = mkf_u32(FO_CONFIG|FN_LIMIT, l->acc_lim);
+	stats[ST_F_ACC_BATCH] = mkf_u32(FN_AVG, swrate_avg(l->counters->acc_batch, ACCEPT_BATCH_SAMPLES));
+	stats[ST_F_ACC_QFULL] = mkf_u64(FN_COUNTER, l->counters->acc_qfull);
 
 	if (flags & ST_SHLGNDS) {
 		char str[INET6_ADDRSTRLEN];
@@ -1562,6 +1604,7 @@ int stats_fill_be_stats(struct proxy *px, int flags, struct field *stats, int le
 	stats[ST_F_RTIME]        = mkf_u32(FN_AVG, swrate_avg(px->be_counters.d_time, TIME_STATS_SAMPLES));
 	stats[ST_F_TTIME]        = mkf_u32(FN_AVG, swrate_avg(px->be_counters.t_time, TIME_STATS_SAMPLES));
 
+	stats_fill_px_mem(px, stats);
 	return 1;
 }
 
@@ -1720,7 +1763,7 @@ int stats_dump_proxy_to_buffer(struct stream_interface *si, struct proxy *px, st
 
 	if (uri)
 		flags = uri->flags;
-	else if (strm_li(s)->bind_conf->level >= ACCESS_LVL_OPER)
+	else if ((strm_li(s)->bind_conf->level & ACCESS_LVL_MASK) >= ACCESS_LVL_OPER)
 		flags = ST_SHLGNDS | ST_SHNODE | ST_SHDESC;
 	else
 		flags = ST_SHNODE | ST_SHDESC;
@@ -1824,12 +1867,18 @@ int stats_dump_proxy_to_buffer(struct stream_interface *si, struct proxy *px, st
 		}
 
 		appctx->ctx.stats.sv = px->srv; /* may be NULL */
+
+		/* a single server is directly looked up by its ID */
+		if ((appctx->ctx.stats.flags & STAT_BOUND) && appctx->ctx.stats.sid != -1)
+			appctx->ctx.stats.sv = server_find_by_id(px, appctx->ctx.stats.sid);
+
 		appctx->ctx.stats.px_st = STAT_PX_ST_SV;
 		/* fall through */
 
 	case STAT_PX_ST_SV:
 		/* stats.sv has been initialized above */
-		for (; appctx->ctx.stats.sv != NULL; appctx->ctx.stats.sv = sv->next) {
+		for (; appctx->ctx.stats.sv != NULL;
+		     appctx->ctx.stats.sv = ((appctx->ctx.stats.flags & STAT_BOUND) && appctx->ctx.stats.sid != -1) ? NULL : sv->next) {
 			if (buffer_almost_full(rep->buf)) {
 				si_applet_cant_put(si);
 				return 0;
@@ -2263,7 +2312,9 @@ static int stats_dump_stat_to_buffer(struct stream_interface *si, struct uri_aut
 {
 	struct appctx *appctx = __objt_appctx(si->end);
 	struct channel *rep = si_ic(si);
+	struct eb32_node *node;
 	struct proxy *px;
+	int visited = 0;
 
 	chunk_reset(&trash);
 
@@ -2296,6 +2347,13 @@ static int stats_dump_stat_to_buffer(struct stream_interface *si, struct uri_aut
 		}
 
 		appctx->ctx.stats.px = proxy;
+
+		/* a single proxy is directly looked up by its ID */
+		if ((appctx->ctx.stats.flags & STAT_BOUND) && appctx->ctx.stats.iid != -1) {
+			node = eb32_lookup(&used_proxy_id, appctx->ctx.stats.iid);
+			appctx->ctx.stats.px = node ? container_of(node, struct proxy, conf.id) : NULL;
+		}
+
 		appctx->ctx.stats.px_st = STAT_PX_ST_INIT;
 		appctx->st2 = STAT_ST_LIST;
 		/* fall through */
@@ -2308,13 +2366,24 @@ static int stats_dump_stat_to_buffer(struct stream_interface *si, struct uri_aut
 				return 0;
 			}
 
+			/* scopes may skip lots of proxies without filling the
+			 * buffer, so let other tasks run once in a while.
+			 */
+			if (++visited > global.tune.cli_dump_budget) {
+				si_applet_want_put(si);
+				return 0;
+			}
+
 			px = appctx->ctx.stats.px;
 			/* skip the disabled proxies, global frontend and non-networked ones */
 			if (px->state != PR_STSTOPPED && px->uuid > 0 && (px->cap & (PR_CAP_FE | PR_CAP_BE)))
 				if (stats_dump_proxy_to_buffer(si, px, uri) == 0)
 					return 0;
 
-			appctx->ctx.stats.px = px->next;
+			if ((appctx->ctx.stats.flags & STAT_BOUND) && appctx->ctx.stats.iid != -1)
+				appctx->ctx.stats.px = NULL;
+			else
+				appctx->ctx.stats.px = px->next;
 			appctx->ctx.stats.px_st = STAT_PX_ST_INIT;
 		}
 		/* here, we just have reached the last proxy */
@@ -2991,7 +3060,7 @@ int stats_fill_info(struct field *info, int len)
 	info[INF_COMPRESS_BPS_IN]                = mkf_u32(FN_RATE, read_freq_ctr(&global.comp_bps_in));
 	info[INF_COMPRESS_BPS_OUT]               = mkf_u32(FN_RATE, read_freq_ctr(&global.comp_bps_out));
 	info[INF_COMPRESS_BPS_RATE_LIM]          = mkf_u32(FO_CONFIG|FN_LIMIT, global.comp_rate_lim);
-#ifdef USE_ZLIB
+#if defined(USE_ZLIB) || defined(USE_BROTLI) || defined(USE_ZSTD)
 	info[INF_ZLIB_MEM_USAGE]                 = mkf_u32(0, zlib_used_memory);
 	info[INF_MAX_ZLIB_MEM_USAGE]             = mkf_u32(FO_CONFIG|FN_LIMIT, global.maxzlibmem);
 #endif
@@ -3001,6 +3070,18 @@ int stats_fill_info(struct field *info, int len)
 	info[INF_NODE]                           = mkf_str(FO_CONFIG|FN_OUTPUT|FS_SERVICE, global.node);
 	if (global.desc)
 		info[INF_DESCRIPTION]            = mkf_str(FO_CONFIG|FN_OUTPUT|FS_SERVICE, global.desc);
+	info[INF_COMPRESS_SAVED]                 = mkf_s64(FN_COUNTER, global.comp_saved);
+	info[INF_COMPRESS_CPU_MS]                = mkf_u64(FN_COUNTER, global.comp_cpu_us / 1000);
+	info[INF_COMPRESS_SAVED_PER_CPU_MS]      = mkf_s64(FN_AVG, global.comp_cpu_us >= 1000 ? global.comp_saved / (long long)(global.comp_cpu_us / 1000) : 0);
+	info[INF_COMPRESS_SKIPPED]               = mkf_u32(FN_COUNTER, global.comp_skipped);
+	info[INF_SPLICED_BYTES]                  = mkf_u64(FN_COUNTER, global.spliced_bytes);
+	info[INF_COPIED_BYTES]                   = mkf_u64(FN_COUNTER, global.copied_bytes);
+	info[INF_PIPE_SIZE]                      = mkf_u32(FN_MAX, pipes_size);
+#ifdef USE_OPENSSL
+	info[INF_SSL_LAZY_LOADS]                 = mkf_u32(FN_COUNTER, global.ssl_lazy_loads);
+	info[INF_SSL_LAZY_EVICTIONS]             = mkf_u32(FN_COUNTER, global.ssl_lazy_evictions);
+	info[INF_SSL_LAZY_CACHED]                = mkf_u32(0, global.ssl_lazy_loads - global.ssl_lazy_evictions);
+#endif
 
 	return 1;
 }
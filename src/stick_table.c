@@ -2244,17 +2244,31 @@ enum {
  * and needs to be called again, otherwise non-zero.
  */
 static int table_dump_head_to_buffer(struct chunk *msg, struct stream_interface *si,
-                                     struct proxy *proxy, struct proxy *target)
+                                     struct proxy *proxy, struct proxy *target, int compact)
 {
 	struct stream *s = si_strm(si);
+	int dt;
 
 	chunk_appendf(msg, "# table: %s, type: %s, size:%d, used:%d\n",
 		     proxy->id, stktable_types[proxy->table.type].kw, proxy->table.size, proxy->table.current);
 
 	/* any other information should be dumped here */
 
-	if (target && strm_li(s)->bind_conf->level < ACCESS_LVL_OPER)
+	if (target && (strm_li(s)->bind_conf->level & ACCESS_LVL_MASK) < ACCESS_LVL_OPER)
 		chunk_appendf(msg, "# contents not dumped due to insufficient privileges\n");
+	else if (target && compact) {
+		/* the compact format names the columns only once */
+		chunk_appendf(msg, "# key use exp");
+		for (dt = 0; dt < STKTABLE_DATA_TYPES; dt++) {
+			if (proxy->table.data_ofs[dt] == 0)
+				continue;
+			if (stktable_data_types[dt].arg_type == ARG_T_DELAY)
+				chunk_appendf(msg, " %s(%d)", stktable_data_types[dt].name, proxy->table.data_arg[dt].u);
+			else
+				chunk_appendf(msg, " %s", stktable_data_types[dt].name);
+		}
+		chunk_appendf(msg, "\n");
+	}
 
 	if (bi_putchk(si_ic(si), msg) == -1) {
 		si_applet_cant_put(si);
@@ -2266,45 +2280,51 @@ static int table_dump_head_to_buffer(struct chunk *msg, struct stream_interface
 
 /* Dump a table entry to a stream interface's
  * read buffer. It returns 0 if the output buffer is full
- * and needs to be called again, otherwise non-zero.
+ * and needs to be called again, otherwise non-zero. In
+ * compact format, only the values are dumped, in the order
+ * of the columns reported by table_dump_head_to_buffer().
  */
 static int table_dump_entry_to_buffer(struct chunk *msg, struct stream_interface *si,
-                                      struct proxy *proxy, struct stksess *entry)
+                                      struct proxy *proxy, struct stksess *entry, int compact)
 {
 	int dt;
 
-	chunk_appendf(msg, "%p:", entry);
+	if (!compact)
+		chunk_appendf(msg, "%p: key=", entry);
 
 	if (proxy->table.type == SMP_T_IPV4) {
 		char addr[INET_ADDRSTRLEN];
 		inet_ntop(AF_INET, (const void *)&entry->key.key, addr, sizeof(addr));
-		chunk_appendf(msg, " key=%s", addr);
+		chunk_appendf(msg, "%s", addr);
 	}
 	else if (proxy->table.type == SMP_T_IPV6) {
 		char addr[INET6_ADDRSTRLEN];
 		inet_ntop(AF_INET6, (const void *)&entry->key.key, addr, sizeof(addr));
-		chunk_appendf(msg, " key=%s", addr);
+		chunk_appendf(msg, "%s", addr);
 	}
 	else if (proxy->table.type == SMP_T_SINT) {
-		chunk_appendf(msg, " key=%u", *(unsigned int *)entry->key.key);
+		chunk_appendf(msg, "%u", *(unsigned int *)entry->key.key);
 	}
 	else if (proxy->table.type == SMP_T_STR) {
-		chunk_appendf(msg, " key=");
 		dump_text(msg, (const char *)entry->key.key, proxy->table.key_size);
 	}
 	else {
-		chunk_appendf(msg, " key=");
 		dump_binary(msg, (const char *)entry->key.key, proxy->table.key_size);
 	}
 
-	chunk_appendf(msg, " use=%d exp=%d", entry->ref_cnt - 1, tick_remain(now_ms, entry->expire));
+	if (compact)
+		chunk_appendf(msg, " %d %d", entry->ref_cnt - 1, tick_remain(now_ms, entry->expire));
+	else
+		chunk_appendf(msg, " use=%d exp=%d", entry->ref_cnt - 1, tick_remain(now_ms, entry->expire));
 
 	for (dt = 0; dt < STKTABLE_DATA_TYPES; dt++) {
 		void *ptr;
 
 		if (proxy->table.data_ofs[dt] == 0)
 			continue;
-		if (stktable_data_types[dt].arg_type == ARG_T_DELAY)
+		if (compact)
+			chunk_appendf(msg, " ");
+		else if (stktable_data_types[dt].arg_type == ARG_T_DELAY)
 			chunk_appendf(msg, " %s(%d)=", stktable_data_types[dt].name, proxy->table.data_arg[dt].u);
 		else
 			chunk_appendf(msg, " %s=", stktable_data_types[dt].name);
@@ -2422,9 +2442,9 @@ static int table_process_entry_per_key(struct appctx *appctx, char **args)
 		if (!ts)
 			return 1;
 		chunk_reset(&trash);
-		if (!table_dump_head_to_buffer(&trash, si, px, px))
+		if (!table_dump_head_to_buffer(&trash, si, px, px, 0))
 			return 0;
-		if (!table_dump_entry_to_buffer(&trash, si, px, ts))
+		if (!table_dump_entry_to_buffer(&trash, si, px, ts, 0))
 			return 0;
 		break;
 
@@ -2559,16 +2579,140 @@ static int table_prepare_data_request(struct appctx *appctx, char **args)
 	return 0;
 }
 
+/* Prepares the appctx fields with the key prefix <arg> from the command line.
+ * Since the keys are sorted in the tree, the matching entries are contiguous
+ * and only this part of the tree is walked. Addresses may be followed by a
+ * prefix length in bits, binary keys are in hexadecimal. Returns 0 if the dump
+ * can proceed, 1 if has ended processing.
+ */
+static int table_prepare_prefix_request(struct appctx *appctx, char *arg)
+{
+	struct stktable *t = &((struct proxy *)appctx->ctx.table.target)->table;
+	int action = (long)appctx->private;
+	unsigned char addr[16];
+	unsigned char *prefix;
+	char *slash, *end;
+	long bits;
+	int len, i;
+
+	if (action != STK_CLI_ACT_SHOW && action != STK_CLI_ACT_CLR) {
+		appctx->ctx.cli.msg = "prefix-based lookup is only supported with the \"show\" and \"clear\" actions\n";
+		goto fail;
+	}
+
+	if (appctx->ctx.table.prefix) {
+		appctx->ctx.cli.msg = "Only one prefix may be specified\n";
+		goto fail;
+	}
+
+	switch (t->type) {
+	case SMP_T_IPV4:
+	case SMP_T_IPV6:
+		bits = (t->type == SMP_T_IPV4) ? 32 : 128;
+		slash = strchr(arg, '/');
+		if (slash) {
+			*slash++ = '\0';
+			bits = strtol(slash, &end, 10);
+			if (!*slash || *end || bits < 0 || bits > (t->type == SMP_T_IPV4 ? 32 : 128))
+				bits = -1;
+		}
+		if (bits < 0 || inet_pton(t->type == SMP_T_IPV4 ? AF_INET : AF_INET6, arg, addr) <= 0) {
+			appctx->ctx.cli.msg = "Require an address optionally followed by '/' and a prefix length\n";
+			goto fail;
+		}
+		len = bits / 8;
+		prefix = malloc(len + 1);
+		if (!prefix)
+			goto oom;
+		memcpy(prefix, addr, len + (bits & 7 ? 1 : 0));
+		appctx->ctx.table.prefix_mask = (0xff00 >> (bits & 7)) & 0xff;
+		break;
+
+	case SMP_T_STR:
+		len = strlen(arg);
+		if (!len || len >= t->key_size) {
+			appctx->ctx.cli.msg = "Require a non-empty prefix shorter than the table's keys\n";
+			goto fail;
+		}
+		prefix = (unsigned char *)strdup(arg);
+		if (!prefix)
+			goto oom;
+		break;
+
+	case SMP_T_BIN:
+		len = strlen(arg) / 2;
+		if (!len || (strlen(arg) & 1) || len > t->key_size) {
+			appctx->ctx.cli.msg = "Require a non-empty hexadecimal prefix not larger than the table's keys\n";
+			goto fail;
+		}
+		prefix = malloc(len);
+		if (!prefix)
+			goto oom;
+		for (i = 0; i < len; i++) {
+			if (hex2i(arg[2 * i]) < 0 || hex2i(arg[2 * i + 1]) < 0) {
+				free(prefix);
+				appctx->ctx.cli.msg = "Require a non-empty hexadecimal prefix not larger than the table's keys\n";
+				goto fail;
+			}
+			prefix[i] = (hex2i(arg[2 * i]) << 4) + hex2i(arg[2 * i + 1]);
+		}
+		break;
+
+	default:
+		appctx->ctx.cli.msg = "Prefix lookups are not supported on this table type\n";
+		goto fail;
+	}
+
+	appctx->ctx.table.prefix = prefix;
+	appctx->ctx.table.prefix_len = len;
+	return 0;
+
+ oom:
+	appctx->ctx.cli.msg = "Out of memory\n";
+ fail:
+	appctx->st0 = CLI_ST_PRINT;
+	return 1;
+}
+
+/* Returns the first entry of the table being dumped which may match the
+ * request's key prefix, or NULL if there is none.
+ */
+static struct ebmb_node *table_dump_first(struct appctx *appctx)
+{
+	struct stktable *t = &appctx->ctx.table.proxy->table;
+
+	if (!appctx->ctx.table.prefix)
+		return ebmb_first(&t->keys);
+	return ebmb_lookup(&t->keys, appctx->ctx.table.prefix, appctx->ctx.table.prefix_len);
+}
+
+/* Returns the entry following <eb> in the table being dumped, or NULL if there
+ * is none or if it is past the request's key prefix.
+ */
+static struct ebmb_node *table_dump_next(struct appctx *appctx, struct ebmb_node *eb)
+{
+	eb = ebmb_next(eb);
+	if (eb && appctx->ctx.table.prefix &&
+	    memcmp(eb->key, appctx->ctx.table.prefix, appctx->ctx.table.prefix_len) != 0)
+		return NULL;
+	return eb;
+}
+
 /* returns 0 if wants to be called, 1 if has ended processing */
 static int cli_parse_table_req(char **args, struct appctx *appctx, void *private)
 {
 	int action = (long)private;
+	int arg;
 
 	appctx->private = private;
 	appctx->ctx.table.data_type = -1;
 	appctx->ctx.table.target = NULL;
 	appctx->ctx.table.proxy = NULL;
 	appctx->ctx.table.entry = NULL;
+	appctx->ctx.table.prefix = NULL;
+	appctx->ctx.table.prefix_len = 0;
+	appctx->ctx.table.prefix_mask = 0;
+	appctx->ctx.table.compact = 0;
 
 	if (*args[2]) {
 		appctx->ctx.table.target = proxy_tbl_by_name(args[2]);
@@ -2586,20 +2730,43 @@ static int cli_parse_table_req(char **args, struct appctx *appctx, void *private
 
 	if (strcmp(args[3], "key") == 0)
 		return table_process_entry_per_key(appctx, args);
-	else if (strncmp(args[3], "data.", 5) == 0)
-		return table_prepare_data_request(appctx, args);
-	else if (*args[3])
-		goto err_args;
+
+	/* the data filter, the key prefix and the output format may be combined */
+	for (arg = 3; *args[arg]; ) {
+		if (strncmp(args[arg], "data.", 5) == 0 && arg + 2 < MAX_STATS_ARGS) {
+			if (table_prepare_data_request(appctx, args + arg - 3))
+				goto fail;
+			arg += 3;
+		}
+		else if (strcmp(args[arg], "prefix") == 0 && *args[arg + 1]) {
+			if (table_prepare_prefix_request(appctx, args[arg + 1]))
+				goto fail;
+			arg += 2;
+		}
+		else if (strcmp(args[arg], "compact") == 0 && action == STK_CLI_ACT_SHOW) {
+			appctx->ctx.table.compact = 1;
+			arg++;
+		}
+		else
+			goto err_args;
+	}
 
 	return 0;
 
+fail:
+	free(appctx->ctx.table.prefix);
+	appctx->ctx.table.prefix = NULL;
+	return 1;
+
 err_args:
+	free(appctx->ctx.table.prefix);
+	appctx->ctx.table.prefix = NULL;
 	switch (action) {
 	case STK_CLI_ACT_SHOW:
-		appctx->ctx.cli.msg = "Optional argument only supports \"data.<store_data_type>\" <operator> <value> and key <key>\n";
+		appctx->ctx.cli.msg = "Optional arguments only support \"data.<store_data_type>\" <operator> <value>, prefix <prefix> and compact, or key <key>\n";
 		break;
 	case STK_CLI_ACT_CLR:
-		appctx->ctx.cli.msg = "Required arguments: <table> \"data.<store_data_type>\" <operator> <value> or <table> key <key>\n";
+		appctx->ctx.cli.msg = "Required arguments: <table> [\"data.<store_data_type>\" <operator> <value>] [prefix <prefix>] or <table> key <key>\n";
 		break;
 	case STK_CLI_ACT_SET:
 		appctx->ctx.cli.msg = "Required arguments: <table> key <key> [data.<store_data_type> <value>]*\n";
@@ -2625,6 +2792,7 @@ static int cli_io_handler_table(struct appctx *appctx)
 	int dt;
 	int skip_entry;
 	int show = action == STK_CLI_ACT_SHOW;
+	int visited = 0;
 
 	/*
 	 * We have 3 possible states in appctx->st2 :
@@ -2669,13 +2837,14 @@ static int cli_io_handler_table(struct appctx *appctx)
 			}
 
 			if (appctx->ctx.table.proxy->table.size) {
-				if (show && !table_dump_head_to_buffer(&trash, si, appctx->ctx.table.proxy, appctx->ctx.table.target))
+				if (show && !table_dump_head_to_buffer(&trash, si, appctx->ctx.table.proxy, appctx->ctx.table.target,
+								       appctx->ctx.table.compact))
 					return 0;
 
 				if (appctx->ctx.table.target &&
-				    strm_li(s)->bind_conf->level >= ACCESS_LVL_OPER) {
+				    (strm_li(s)->bind_conf->level & ACCESS_LVL_MASK) >= ACCESS_LVL_OPER) {
 					/* dump entries only if table explicitly requested */
-					eb = ebmb_first(&appctx->ctx.table.proxy->table.keys);
+					eb = table_dump_first(appctx);
 					if (eb) {
 						appctx->ctx.table.entry = ebmb_entry(eb, struct stksess, key);
 						appctx->ctx.table.entry->ref_cnt++;
@@ -2688,9 +2857,22 @@ static int cli_io_handler_table(struct appctx *appctx)
 			break;
 
 		case STAT_ST_LIST:
+			/* filters may skip lots of entries without filling the
+			 * buffer, so let other tasks run once in a while.
+			 */
+			if (++visited > global.tune.cli_dump_budget) {
+				si_applet_want_put(si);
+				return 0;
+			}
+
 			skip_entry = 0;
 
-			if (appctx->ctx.table.data_type >= 0) {
+			if (appctx->ctx.table.prefix_mask &&
+			    ((appctx->ctx.table.entry->key.key[appctx->ctx.table.prefix_len] ^
+			      appctx->ctx.table.prefix[appctx->ctx.table.prefix_len]) & appctx->ctx.table.prefix_mask))
+				skip_entry = 1;
+
+			if (!skip_entry && appctx->ctx.table.data_type >= 0) {
 				/* we're filtering on some data contents */
 				void *ptr;
 				long long data;
@@ -2734,12 +2916,13 @@ static int cli_io_handler_table(struct appctx *appctx)
 			}
 
 			if (show && !skip_entry &&
-			    !table_dump_entry_to_buffer(&trash, si, appctx->ctx.table.proxy, appctx->ctx.table.entry))
+			    !table_dump_entry_to_buffer(&trash, si, appctx->ctx.table.proxy, appctx->ctx.table.entry,
+							appctx->ctx.table.compact))
 			    return 0;
 
 			appctx->ctx.table.entry->ref_cnt--;
 
-			eb = ebmb_next(&appctx->ctx.table.entry->key);
+			eb = table_dump_next(appctx, &appctx->ctx.table.entry->key);
 			if (eb) {
 				struct stksess *old = appctx->ctx.table.entry;
 				appctx->ctx.table.entry = ebmb_entry(eb, struct stksess, key);
@@ -2775,6 +2958,8 @@ static void cli_release_show_table(struct appctx *appctx)
 		appctx->ctx.table.entry->ref_cnt--;
 		stksess_kill_if_expired(&appctx->ctx.table.proxy->table, appctx->ctx.table.entry);
 	}
+	free(appctx->ctx.table.prefix);
+	appctx->ctx.table.prefix = NULL;
 }
 
 /* register cli keywords */
@@ -38,6 +38,7 @@
 #include <proto/stats.h>
 #include <proto/fd.h>
 #include <proto/filters.h>
+#include <proto/flt_http_comp.h>
 #include <proto/freq_ctr.h>
 #include <proto/frontend.h>
 #include <proto/hdr_idx.h>
@@ -60,6 +61,7 @@
 #include <proto/vars.h>
 
 struct pool_head *pool2_stream;
+struct pool_head *pool2_stream_store;
 struct list streams;
 
 /* list of streams waiting for at least one buffer */
@@ -191,6 +193,11 @@ struct stream *stream_new(struct session *sess, struct task *t, enum obj_type *o
 
 	/* init store persistence */
 	s->store_count = 0;
+	s->store = NULL;
+
+	/* nothing is accounted to the proxies yet */
+	s->mem.be = NULL;
+	s->mem.buf = s->mem.http = s->mem.comp = 0;
 
 	channel_init(&s->req);
 	s->req.flags |= CF_READ_ATTACHED; /* the producer is already connected */
@@ -293,6 +300,11 @@ static void stream_free(struct stream *s)
 		LIST_INIT(&s->buffer_wait);
 	}
 
+	/* the proxies do not hold this stream's memory anymore */
+	if (s->mem.be)
+		proxy_mem_add(s->mem.be, -(long)s->mem.buf, -(long)s->mem.http, -(long)s->mem.comp);
+	proxy_mem_add(fe, -(long)s->mem.buf, -(long)s->mem.http, -(long)s->mem.comp);
+
 	b_drop(&s->req.buf);
 	b_drop(&s->res.buf);
 	if (!LIST_ISEMPTY(&buffer_wq))
@@ -312,6 +324,7 @@ static void stream_free(struct stream *s)
 		stksess_free(s->store[i].table, s->store[i].ts);
 		s->store[i].ts = NULL;
 	}
+	pool_free2(pool2_stream_store, s->store);
 
 	if (s->txn) {
 		pool_free2(pool2_hdr_idx, s->txn->hdr_idx.v);
@@ -361,6 +374,7 @@ static void stream_free(struct stream *s)
 		pool_flush2(pool2_requri);
 		pool_flush2(pool2_capture);
 		pool_flush2(pool2_stream);
+		pool_flush2(pool2_stream_store);
 		pool_flush2(pool2_session);
 		pool_flush2(pool2_connection);
 		pool_flush2(pool2_pendconn);
@@ -388,7 +402,35 @@ int stream_alloc_recv_buffer(struct channel *chn)
 
 	s = chn_strm(chn);
 
-	b = b_alloc_margin(&chn->buf, margin);
+	/* a stream which holds no buffer may not start a new request while its
+	 * frontend or backend is above its "maxmem" and other streams of this
+	 * proxy hold buffers or compression contexts. It waits for them to be
+	 * released instead. Streams already holding buffers are never blocked
+	 * so that they can complete and release them.
+	 */
+	if (!(chn->flags & CF_ISRESP) && !s->req.buf->size && !s->res.buf->size) {
+		struct proxy *px = NULL;
+
+		if (proxy_mem_full(strm_fe(s)) &&
+		    strm_fe(s)->mem.buf + strm_fe(s)->mem.comp > s->mem.comp)
+			px = strm_fe(s);
+		else if (proxy_mem_full(s->be) &&
+			 s->be->mem.buf + s->be->mem.comp > s->mem.comp)
+			px = s->be;
+
+		if (px) {
+			if (!LIST_ISEMPTY(&s->buffer_wait))
+				LIST_DEL(&s->buffer_wait);
+			LIST_ADDQ(&px->mem.wait, &s->buffer_wait);
+			return 0;
+		}
+	}
+
+	/* requests generally fit in a small buffer */
+	if (!(chn->flags & CF_ISRESP))
+		b = b_alloc_small_margin(&chn->buf, margin);
+	else
+		b = b_alloc_margin(&chn->buf, margin);
 	if (b)
 		return 1;
 
@@ -423,12 +465,18 @@ int stream_alloc_work_buffer(struct stream *s)
  * update() functions. It will try to wake up as many tasks as the number of
  * buffers that it releases. In practice, most often streams are blocked on
  * a single buffer, so it makes sense to try to wake two up when two buffers
- * are released at once.
+ * are released at once. A request waiting in a queue or for a connection
+ * retry is moved to a small buffer if it fits, since it may wait for long.
  */
 void stream_release_buffers(struct stream *s)
 {
 	if (s->req.buf->size && buffer_empty(s->req.buf))
 		b_free(&s->req.buf);
+	else if (pool2_buffer_small && s->req.buf->size && !b_is_small(s->req.buf) &&
+		 (s->si[1].state == SI_ST_QUE || s->si[1].state == SI_ST_TAR) &&
+		 s->req.buf->i + s->req.buf->o + global.tune.maxrewrite <
+		 pool2_buffer_small->size - sizeof(struct buffer))
+		b_shrink(&s->req.buf);
 
 	if (s->res.buf->size && buffer_empty(s->res.buf))
 		b_free(&s->res.buf);
@@ -438,6 +486,77 @@ void stream_release_buffers(struct stream *s)
 	 */
 	if (!LIST_ISEMPTY(&buffer_wq))
 		stream_offer_buffers();
+
+	stream_account_mem(s);
+}
+
+/* Accounts the memory currently used by stream <s> to its frontend, and to its
+ * backend when it differs. Only the difference with what was previously
+ * accounted is applied, so it may be called as often as needed. Shared
+ * objects (servers, tables, applets) are not accounted here.
+ */
+void stream_account_mem(struct stream *s)
+{
+	struct proxy *fe = strm_fe(s);
+	struct proxy *be = (s->be != fe) ? s->be : NULL;
+	struct cap_hdr *h;
+	unsigned int buf = 0, http = 0, comp = 0;
+	long dbuf, dhttp, dcomp;
+
+	if (s->req.buf->size)
+		buf += sizeof(struct buffer) + s->req.buf->size;
+	if (s->res.buf->size)
+		buf += sizeof(struct buffer) + s->res.buf->size;
+
+	if (s->txn) {
+		http += pool2_http_txn->size;
+		if (s->txn->hdr_idx.v)
+			http += pool2_hdr_idx->size;
+		if (s->txn->uri)
+			http += pool2_requri->size;
+		if (s->txn->cli_cookie)
+			http += pool2_capture->size;
+		if (s->txn->srv_cookie)
+			http += pool2_capture->size;
+		if (s->txn->rsp.flags & HTTP_MSGF_COMPRESSING)
+			comp = http_comp_stream_mem(s);
+	}
+
+	if (s->req_cap) {
+		http += fe->req_cap_pool->size;
+		for (h = fe->req_cap; h; h = h->next)
+			if (s->req_cap[h->index])
+				http += h->pool->size;
+	}
+
+	if (s->res_cap) {
+		http += fe->rsp_cap_pool->size;
+		for (h = fe->rsp_cap; h; h = h->next)
+			if (s->res_cap[h->index])
+				http += h->pool->size;
+	}
+
+	/* the backend changed, move what it was charged with */
+	if (be != s->mem.be) {
+		if (s->mem.be)
+			proxy_mem_add(s->mem.be, -(long)s->mem.buf, -(long)s->mem.http, -(long)s->mem.comp);
+		if (be)
+			proxy_mem_add(be, s->mem.buf, s->mem.http, s->mem.comp);
+		s->mem.be = be;
+	}
+
+	dbuf  = (long)buf  - (long)s->mem.buf;
+	dhttp = (long)http - (long)s->mem.http;
+	dcomp = (long)comp - (long)s->mem.comp;
+	if (!dbuf && !dhttp && !dcomp)
+		return;
+
+	proxy_mem_add(fe, dbuf, dhttp, dcomp);
+	if (be)
+		proxy_mem_add(be, dbuf, dhttp, dcomp);
+	s->mem.buf  = buf;
+	s->mem.http = http;
+	s->mem.comp = comp;
 }
 
 /* Runs across the list of pending streams waiting for a buffer and wakes one
@@ -466,7 +585,8 @@ int init_stream()
 {
 	LIST_INIT(&streams);
 	pool2_stream = create_pool("stream", sizeof(struct stream), MEM_F_SHARED);
-	return pool2_stream != NULL;
+	pool2_stream_store = create_pool("strm_store", STREAM_MAX_STORE * sizeof(struct stream_store), MEM_F_SHARED);
+	return pool2_stream != NULL && pool2_stream_store != NULL;
 }
 
 void stream_process_counters(struct stream *s)
@@ -1293,6 +1413,19 @@ static int process_server_rules(struct stream *s, struct channel *req, int an_bi
 	return 1;
 }
 
+/* Makes sure stream <s> has room for one more stickiness value to store,
+ * allocating its store array on first use. Returns non-zero if
+ * s->store[s->store_count] may be used, otherwise zero.
+ */
+static inline int stream_reserve_store(struct stream *s)
+{
+	if (s->store_count >= STREAM_MAX_STORE)
+		return 0;
+	if (!s->store)
+		s->store = pool_alloc2(pool2_stream_store);
+	return s->store != NULL;
+}
+
 /* This stream analyser works on a request. It applies all sticking rules on
  * it then returns 1. The data must already be present in the buffer otherwise
  * they won't match. It always returns 1.
@@ -1372,7 +1505,7 @@ static int process_sticking_rules(struct stream *s, struct channel *req, int an_
 				}
 			}
 			if (rule->flags & STK_IS_STORE) {
-				if (s->store_count < (sizeof(s->store) / sizeof(s->store[0]))) {
+				if (stream_reserve_store(s)) {
 					struct stksess *ts;
 
 					ts = stksess_new(rule->table.t, key);
@@ -1449,7 +1582,7 @@ static int process_store_rules(struct stream *s, struct channel *rep, int an_bit
 			if (!key)
 				continue;
 
-			if (s->store_count < (sizeof(s->store) / sizeof(s->store[0]))) {
+			if (stream_reserve_store(s)) {
 				struct stksess *ts;
 
 				ts = stksess_new(rule->table.t, key);
@@ -1539,6 +1672,25 @@ static int process_store_rules(struct stream *s, struct channel *rep, int an_bit
 		}							\
 	}
 
+/* Returns non-zero if "option splice-auto" should enable kernel splicing on
+ * channel <chn>, whose backend saw transfers of <kb_sum> kB on average (as a
+ * sliding sum). By default splicing starts once the channel is seen streaming
+ * fast. With "tune.splice.auto-min", it is only used for transfers expected to
+ * reach this size : the known length to forward when there is one, otherwise
+ * the backend's average transfer size.
+ */
+static inline int stream_splice_auto(const struct channel *chn, unsigned int kb_sum)
+{
+	if (!global.tune.splice_auto_min)
+		return !!(chn->flags & CF_STREAMER_FAST);
+
+	if (chn->to_forward != CHN_INFINITE_FORWARD)
+		return chn->to_forward >= global.tune.splice_auto_min;
+
+	return (chn->flags & CF_STREAMER_FAST) ||
+	       ((unsigned long long)swrate_avg(kb_sum, TIME_STATS_SAMPLES) << 10) >= global.tune.splice_auto_min;
+}
+
 /* Processes the client, server, request and response jobs of a stream task,
  * then puts it back to the wait queue in a clean state, or cleans up its
  * resources if it must be deleted. Returns in <next> the date the task wants
@@ -1654,6 +1806,23 @@ struct task *process_stream(struct task *t)
 		goto update_exp_and_leave;
 	}
 
+	/* A small request buffer reaching the rewrite reserve is replaced with
+	 * a standard one before the analysers may consider it full. It is
+	 * subject to the same reserve as other request buffers. If none is
+	 * available, we wait for one instead of parsing a truncated request,
+	 * unless a timeout or an error has to be processed anyway.
+	 */
+	if (b_is_small(req->buf) &&
+	    (buffer_full(req->buf, global.tune.maxrewrite) || !channel_may_recv(req)) &&
+	    !b_grow(&req->buf, global.tune.reserved_bufs) &&
+	    !(req->flags & (CF_SHUTR|CF_READ_TIMEOUT|CF_ANA_TIMEOUT)) &&
+	    !(si_f->flags & (SI_FL_ERR|SI_FL_EXP))) {
+		LIST_ADDQ(&buffer_wq, &s->buffer_wait);
+		si_f->flags &= ~SI_FL_DONT_WAKE;
+		si_b->flags &= ~SI_FL_DONT_WAKE;
+		goto update_exp_and_leave;
+	}
+
 	/* 1b: check for low-level errors reported at the stream interface.
 	 * First we check if it's a retryable error (in which case we don't
 	 * want to tell the buffer). Otherwise we report the error one level
@@ -2068,7 +2237,7 @@ struct task *process_stream(struct task *t)
 	    (pipes_used < global.maxpipes) &&
 	    (((sess->fe->options2|s->be->options2) & PR_O2_SPLIC_REQ) ||
 	     (((sess->fe->options2|s->be->options2) & PR_O2_SPLIC_AUT) &&
-	      (req->flags & CF_STREAMER_FAST)))) {
+	      stream_splice_auto(req, s->be->req_kb_sum)))) {
 		req->flags |= CF_KERN_SPLICING;
 	}
 
@@ -2253,7 +2422,7 @@ struct task *process_stream(struct task *t)
 	    (pipes_used < global.maxpipes) &&
 	    (((sess->fe->options2|s->be->options2) & PR_O2_SPLIC_RTR) ||
 	     (((sess->fe->options2|s->be->options2) & PR_O2_SPLIC_AUT) &&
-	      (res->flags & CF_STREAMER_FAST)))) {
+	      stream_splice_auto(res, s->be->res_kb_sum)))) {
 		res->flags |= CF_KERN_SPLICING;
 	}
 
@@ -2512,6 +2681,10 @@ void stream_update_time_stats(struct stream *s)
 	swrate_add(&s->be->be_counters.c_time, TIME_STATS_SAMPLES, t_connect);
 	swrate_add(&s->be->be_counters.d_time, TIME_STATS_SAMPLES, t_data);
 	swrate_add(&s->be->be_counters.t_time, TIME_STATS_SAMPLES, t_close);
+
+	/* transfer sizes, used by option splice-auto */
+	swrate_add(&s->be->req_kb_sum, TIME_STATS_SAMPLES, MIN(s->logs.bytes_in >> 10, 65535));
+	swrate_add(&s->be->res_kb_sum, TIME_STATS_SAMPLES, MIN(s->logs.bytes_out >> 10, 65535));
 }
 
 /*
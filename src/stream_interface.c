@@ -1101,6 +1101,7 @@ static void si_conn_recv_cb(struct connection *conn)
 			if (ic->to_forward != CHN_INFINITE_FORWARD)
 				ic->to_forward -= ret;
 			ic->total += ret;
+			global.spliced_bytes += ret;
 			cur_read += ret;
 			ic->flags |= CF_READ_PARTIAL;
 		}
@@ -1151,6 +1152,7 @@ static void si_conn_recv_cb(struct connection *conn)
 		if (ret <= 0)
 			break;
 
+		global.copied_bytes += ret;
 		cur_read += ret;
 
 		/* if we're allowed to directly forward data, we must update ->o */
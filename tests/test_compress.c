@@ -0,0 +1,257 @@
+/*
+  Measures the compression throughput of the algorithms haproxy may use, for
+  each compression level, as well as the CRC32 hash. It reports the input
+  processed in MB/s and the compression ratio. The data are read from the file
+  passed in argument, or made of generated HTML-like text by default. First,
+  the CRC32 computed by haproxy is checked against zlib's and the program
+  exits with status 1 on any mismatch.
+
+  gcc -Wall -O2 -I../include -o test_compress test_compress.c ../src/hash.c -lz
+  Add "-DUSE_BROTLI ... -lbrotlienc" and/or "-DUSE_ZSTD ... -lzstd" to also
+  test these algorithms.
+
+  ./test_compress [file]
+ */
+#include <sys/time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <zlib.h>
+
+#ifdef USE_BROTLI
+#include <brotli/encode.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <common/hash.h>
+
+#define CHUNK   16384      /* haproxy compresses one buffer at a time */
+#define RUNTIME 0.5        /* seconds spent on each measure */
+
+static char *in, *out;
+static size_t in_len, out_size;
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+static void load(const char *file)
+{
+	static const char *words[] = {
+		"<div class=\"item\">", "</div>\n", "<a href=\"/products/", "\">",
+		"</a>", "haproxy", "load", "balancer", "the", "of", "and", "server",
+		"<span>", "</span>", "compression", "frontend", "backend", "42", "\n",
+	};
+	FILE *f;
+	size_t i;
+
+	if (file) {
+		f = fopen(file, "r");
+		if (!f) {
+			perror(file);
+			exit(1);
+		}
+		fseek(f, 0, SEEK_END);
+		in_len = ftell(f);
+		rewind(f);
+		in = malloc(in_len);
+		if (!in || fread(in, 1, in_len, f) != in_len) {
+			fprintf(stderr, "Cannot read %s\n", file);
+			exit(1);
+		}
+		fclose(f);
+	}
+	else {
+		in_len = 1 << 20;
+		in = malloc(in_len);
+		srandom(0);
+		for (i = 0; i < in_len; ) {
+			const char *w = words[random() % (sizeof(words) / sizeof(*words))];
+			size_t l = strlen(w);
+
+			if (i + l > in_len)
+				l = in_len - i;
+			memcpy(in + i, w, l);
+			i += l;
+		}
+	}
+	out_size = in_len + in_len / 8 + 65536;
+	out = malloc(out_size);
+}
+
+/* compresses the input by chunks, as haproxy does, and returns the output size */
+static size_t zlib_run(int level, int bits)
+{
+	z_stream strm;
+	size_t ofs;
+
+	memset(&strm, 0, sizeof(strm));
+	deflateInit2(&strm, level, Z_DEFLATED, bits, 8, Z_DEFAULT_STRATEGY);
+	strm.next_out = (Bytef *)out;
+	strm.avail_out = out_size;
+	for (ofs = 0; ofs < in_len; ofs += CHUNK) {
+		strm.next_in = (Bytef *)in + ofs;
+		strm.avail_in = (in_len - ofs < CHUNK) ? in_len - ofs : CHUNK;
+		deflate(&strm, Z_NO_FLUSH);
+	}
+	deflate(&strm, Z_FINISH);
+	deflateEnd(&strm);
+	return strm.total_out;
+}
+
+#ifdef USE_BROTLI
+static size_t brotli_run(int level, int bits)
+{
+	BrotliEncoderState *br;
+	const uint8_t *next_in;
+	uint8_t *next_out = (uint8_t *)out;
+	size_t avail_in, avail_out = out_size, ofs, total = 0;
+
+	br = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+	BrotliEncoderSetParameter(br, BROTLI_PARAM_QUALITY, level);
+	BrotliEncoderSetParameter(br, BROTLI_PARAM_LGWIN, bits);
+	for (ofs = 0; ofs < in_len; ofs += CHUNK) {
+		next_in = (const uint8_t *)in + ofs;
+		avail_in = (in_len - ofs < CHUNK) ? in_len - ofs : CHUNK;
+		BrotliEncoderCompressStream(br, BROTLI_OPERATION_PROCESS, &avail_in, &next_in, &avail_out, &next_out, &total);
+	}
+	avail_in = 0;
+	while (!BrotliEncoderIsFinished(br))
+		BrotliEncoderCompressStream(br, BROTLI_OPERATION_FINISH, &avail_in, &next_in, &avail_out, &next_out, &total);
+	BrotliEncoderDestroyInstance(br);
+	return total;
+}
+#endif
+
+#ifdef USE_ZSTD
+static size_t zstd_run(int level, int bits)
+{
+	ZSTD_CStream *zs;
+	ZSTD_inBuffer ib;
+	ZSTD_outBuffer ob = { out, out_size, 0 };
+	size_t ofs;
+
+	zs = ZSTD_createCStream();
+	ZSTD_initCStream(zs, level);
+	for (ofs = 0; ofs < in_len; ofs += CHUNK) {
+		ib.src = in + ofs;
+		ib.size = (in_len - ofs < CHUNK) ? in_len - ofs : CHUNK;
+		ib.pos = 0;
+		while (ib.pos < ib.size)
+			ZSTD_compressStream(zs, &ob, &ib);
+	}
+	while (ZSTD_endStream(zs, &ob))
+		;
+	ZSTD_freeCStream(zs);
+	return ob.pos;
+}
+#endif
+
+/* runs <fct> repeatedly for about RUNTIME seconds and reports the results */
+static void bench(const char *name, size_t (*fct)(int, int), int level, int bits)
+{
+	double start, elapsed;
+	size_t len = 0;
+	int loops = 0;
+
+	start = now();
+	do {
+		len = fct(level, bits);
+		loops++;
+		elapsed = now() - start;
+	} while (elapsed < RUNTIME);
+
+	printf("%-8s level %2d: %9.1f MB/s  ratio %5.2f%%\n", name, level,
+	       (double)in_len * loops / elapsed / 1e6, len * 100.0 / in_len);
+}
+
+/* accumulates the CRCs so that their calculation cannot be optimized away */
+static unsigned int crc_sum;
+
+/* the gzip CRC as computed by haproxy when zlib is used */
+static size_t crc32_run(int level, int bits)
+{
+	crc_sum ^= hash_crc32_update(0, in, in_len);
+	return in_len;
+}
+
+/* the gzip CRC as computed by zlib itself */
+static size_t zlib_crc32_run(int level, int bits)
+{
+	crc_sum ^= crc32(0, (const Bytef *)in, in_len);
+	return in_len;
+}
+
+/* compares hash_crc32_update() with zlib's crc32() over all lengths up to
+ * 512 bytes from all starts within 16 bytes, over the whole input, and when
+ * the input is processed by chunks of various sizes. Returns the number of
+ * mismatches, each of them being reported.
+ */
+static int crc32_check(void)
+{
+	size_t ofs, len, step;
+	unsigned int ours, ref;
+	int errors = 0;
+
+	for (ofs = 0; ofs < 16; ofs++) {
+		for (len = 0; len <= 512 && ofs + len <= in_len; len++) {
+			ours = hash_crc32_update(0, in + ofs, len);
+			ref = crc32(0, (const Bytef *)in + ofs, len);
+			if (ours != ref) {
+				printf("CRC32 mismatch at offset %lu, length %lu: %08x instead of %08x\n",
+				       (unsigned long)ofs, (unsigned long)len, ours, ref);
+				errors++;
+			}
+		}
+	}
+
+	for (step = 1; step <= CHUNK; step = step * 3 + 1) {
+		ours = 0;
+		for (ofs = 0; ofs < in_len; ofs += step)
+			ours = hash_crc32_update(ours, in + ofs, (in_len - ofs < step) ? in_len - ofs : step);
+		ref = crc32(0, (const Bytef *)in, in_len);
+		if (ours != ref) {
+			printf("CRC32 mismatch over %lu bytes by chunks of %lu: %08x instead of %08x\n",
+			       (unsigned long)in_len, (unsigned long)step, ours, ref);
+			errors++;
+		}
+	}
+	return errors;
+}
+
+int main(int argc, char **argv)
+{
+	int level;
+
+	load(argc > 1 ? argv[1] : NULL);
+	printf("Input: %lu bytes\n", (unsigned long)in_len);
+
+	printf("CRC32 accelerated: %s\n", hash_crc32_accelerated() ? "yes" : "no");
+	if (crc32_check()) {
+		printf("CRC32 check FAILED\n");
+		return 1;
+	}
+	printf("CRC32 check passed\n");
+	bench("crc32", crc32_run, 0, 0);
+	bench("zlib-crc", zlib_crc32_run, 0, 0);
+	for (level = 1; level <= 9; level++)
+		bench("gzip", zlib_run, level, MAX_WBITS + 16);
+	for (level = 1; level <= 9; level++)
+		bench("deflate", zlib_run, level, MAX_WBITS);
+#ifdef USE_BROTLI
+	/* brotli's qualities, with the window haproxy uses */
+	for (level = 0; level <= 11; level++)
+		bench("br", brotli_run, level, 18);
+#endif
+#ifdef USE_ZSTD
+	for (level = 1; level <= 19; level++)
+		bench("zstd", zstd_run, level, MAX_WBITS);
+#endif
+	return 0;
+}